@@ -0,0 +1,388 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <string.h>
+
+#include "batch_optimizer_i.h"
+#include "target_device_table_i.h"
+
+/* target device addresses are 7 bits long */
+#define BATCH_ADDRESS_LEN 128
+#define NO_GROUP UINT32_MAX
+
+/**
+ * @brief A command to send, carrying one or more commands of the original batch.
+ */
+struct batch_group {
+	struct usbi3c_command *first; ///< the first command of the original batch carried
+	uint8_t address;	      ///< the address of the target device of the commands
+	uint32_t members;	      ///< number of commands of the original batch carried
+	uint32_t data_length;	      ///< bytes to write once the writes are coalesced
+	uint32_t next_register;	      ///< register address a write has to start at to be coalesced
+};
+
+/* calls the callbacks of every command carried by a merged command, the response
+ * is kept in the tracker if any of them fails, the callbacks are freed along with
+ * the merged command and its request */
+static int batch_fanout_on_response(struct usbi3c_response *response, void *user_data)
+{
+	struct batch_fanout *fanout = (struct batch_fanout *)user_data;
+	int ret = 0;
+
+	for (uint32_t i = 0; i < fanout->count; i++) {
+		if (fanout->members[i].on_response_cb &&
+		    fanout->members[i].on_response_cb(response, fanout->members[i].user_data) != 0) {
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/* gets the register address a write starts at, the address is sent MSB first */
+static uint32_t write_register(const struct usbi3c_command *command, uint8_t register_address_size)
+{
+	uint32_t address = 0;
+
+	for (uint8_t i = 0; i < register_address_size; i++) {
+		address = (address << 8) | command->data[i];
+	}
+
+	return address;
+}
+
+/* returns TRUE if the settings of two commands are the same */
+static int same_settings(const struct usbi3c_command *a, const struct usbi3c_command *b)
+{
+	const struct command_descriptor *da = a->command_descriptor;
+	const struct command_descriptor *db = b->command_descriptor;
+
+	return da->command_type == db->command_type &&
+	       da->command_direction == db->command_direction &&
+	       da->error_handling == db->error_handling &&
+	       da->transfer_mode == db->transfer_mode &&
+	       da->transfer_rate == db->transfer_rate &&
+	       da->tm_specific_info == db->tm_specific_info &&
+	       da->common_command_code == db->common_command_code &&
+	       da->defining_byte == db->defining_byte;
+}
+
+/* returns TRUE if a command can be merged with others, CCCs have side effects on the
+ * target devices and commands split in chunks already share a single response */
+static int mergeable(const struct usbi3c_command *command)
+{
+	return command->chunked == NULL && command->command_descriptor->command_type == REGULAR_COMMAND;
+}
+
+/* returns TRUE if a write can be appended to a group of writes, without a register
+ * address there is no way to tell if two writes are contiguous, so they are never merged */
+static int can_coalesce_write(const struct table_snapshot *snapshot, struct batch_group *group, const struct usbi3c_command *command, uint8_t register_address_size)
+{
+	const struct command_descriptor *descriptor = command->command_descriptor;
+	const struct target_device *device = NULL;
+	uint32_t payload = descriptor->data_length - register_address_size;
+
+	if (register_address_size == 0 ||
+	    group->address == USBI3C_BROADCAST_ADDRESS ||
+	    group->first->command_descriptor->command_direction != USBI3C_WRITE ||
+	    !mergeable(group->first) ||
+	    !same_settings(group->first, command) ||
+	    descriptor->data_length <= register_address_size) {
+		return FALSE;
+	}
+
+	/* the write has to continue at the register where the previous one ended */
+	if (write_register(command, register_address_size) != group->next_register) {
+		return FALSE;
+	}
+
+	/* the coalesced write cannot exceed the max write length of the target device */
+	device = table_snapshot_get_device(snapshot, group->address);
+	if (device && (device->inventory.valid & USBI3C_INVENTORY_MWL) && device->inventory.max_write_length > 0 &&
+	    group->data_length + payload > device->inventory.max_write_length) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* returns TRUE if a read is identical to the reads of a group */
+static int can_deduplicate_read(struct batch_group *group, const struct usbi3c_command *command)
+{
+	return group->first->command_descriptor->command_direction == USBI3C_READ &&
+	       mergeable(group->first) &&
+	       same_settings(group->first, command) &&
+	       group->first->command_descriptor->data_length == command->command_descriptor->data_length;
+}
+
+static void free_command_in_list(void *data)
+{
+	struct usbi3c_command *command = (struct usbi3c_command *)data;
+
+	bulk_transfer_free_command(&command);
+}
+
+/* creates the command that carries the commands of a group */
+static struct usbi3c_command *batch_merge_group(struct batch_optimization *optimization, struct list *commands, struct batch_group *group, uint32_t group_index, uint8_t register_address_size)
+{
+	struct usbi3c_command *merged = NULL;
+	struct batch_fanout *fanout = NULL;
+	struct list *node = NULL;
+	uint32_t offset = 0;
+	uint32_t member = 0;
+	uint32_t i = 0;
+	int callbacks = FALSE;
+
+	merged = bulk_transfer_alloc_command();
+	*merged->command_descriptor = *group->first->command_descriptor;
+	merged->target_handle = group->first->target_handle;
+	if (merged->command_descriptor->command_direction == USBI3C_WRITE) {
+		merged->command_descriptor->data_length = group->data_length;
+		merged->data = (unsigned char *)malloc_or_die(group->data_length);
+	}
+
+	/* the callbacks only exist if the commands are submitted asynchronously */
+	for (node = commands, i = 0; node && !callbacks; node = node->next, i++) {
+		if (optimization->sent_index[i] == group_index && ((struct usbi3c_command *)node->data)->on_response_cb) {
+			callbacks = TRUE;
+		}
+	}
+	if (callbacks) {
+		fanout = (struct batch_fanout *)malloc_or_die(sizeof(struct batch_fanout) + sizeof(struct batch_fanout_member) * group->members);
+		atomic_init(&fanout->refs, 1);
+		fanout->count = group->members;
+		merged->on_response_cb = batch_fanout_on_response;
+		merged->user_data = fanout;
+		merged->fanout = fanout;
+	}
+
+	for (node = commands, i = 0; node && member < group->members; node = node->next, i++) {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+
+		if (optimization->sent_index[i] != group_index) {
+			continue;
+		}
+		if (merged->data) {
+			/* the register address of every write but the first one is implied */
+			uint32_t skip = (member == 0) ? 0 : register_address_size;
+
+			memcpy(merged->data + offset, command->data + skip, command->command_descriptor->data_length - skip);
+			offset += command->command_descriptor->data_length - skip;
+		}
+		if (fanout) {
+			fanout->members[member].on_response_cb = command->on_response_cb;
+			fanout->members[member].user_data = command->user_data;
+		}
+		member++;
+	}
+
+	return merged;
+}
+
+/**
+ * @brief Coalesces the adjacent writes and removes the duplicate reads of a batch of commands.
+ *
+ * The optimizations applied are:
+ * - USBI3C_COALESCE_WRITES: a write that immediately follows a write to the same target
+ *   device, with the same settings, is appended to it. If the writes start with a register
+ *   address, the write has to start at the register where the previous one ended, and
+ *   its register address is dropped. The coalesced write never exceeds the max write
+ *   length of the target device.
+ * - USBI3C_DEDUPLICATE_READS: a read identical to a previous read from the same target
+ *   device is served by the previous read, as long as no other command was addressed to
+ *   the target device, or broadcast, in between.
+ *
+ * Commands split in chunks, CCCs and target reset patterns are never merged.
+ *
+ * @param[in] table the target device table, used to resolve the target handles of the commands and to get their max write length
+ * @param[in] commands the batch of commands
+ * @param[in] optimizations bitmask of enum usbi3c_batch_optimization to apply
+ * @param[in] register_address_size the number of bytes of register address at the start of each write
+ * @param[out] optimization the optimized batch, to be freed with batch_optimization_free()
+ * @return 0 if at least one command was merged, or -1 if the batch is to be sent as it is
+ */
+int batch_optimize(struct target_device_table *table, struct list *commands, uint8_t optimizations, uint8_t register_address_size, struct batch_optimization *optimization)
+{
+	uint32_t last_group[BATCH_ADDRESS_LEN];
+	const struct table_snapshot *snapshot = NULL;
+	struct batch_group *groups = NULL;
+	struct list *node = NULL;
+	uint32_t last_barrier = NO_GROUP;
+	uint32_t i = 0;
+
+	if (commands == NULL || optimization == NULL) {
+		return -1;
+	}
+	memset(optimization, 0, sizeof(struct batch_optimization));
+	for (i = 0; i < BATCH_ADDRESS_LEN; i++) {
+		last_group[i] = NO_GROUP;
+	}
+
+	optimization->count = list_len(commands);
+	optimization->sent_index = (uint32_t *)malloc_or_die(sizeof(uint32_t) * optimization->count);
+	groups = (struct batch_group *)malloc_or_die(sizeof(struct batch_group) * optimization->count);
+	/* the max write lengths are read without holding the table lock */
+	snapshot = table_snapshot_acquire(table);
+
+	for (node = commands, i = 0; node; node = node->next, i++) {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+		const struct command_descriptor *descriptor = command->command_descriptor;
+		uint8_t address = descriptor->target_address;
+		uint32_t previous = (i > 0) ? optimization->sent_index[i - 1] : NO_GROUP;
+		uint32_t target_group = NO_GROUP;
+		struct batch_group *group = NULL;
+
+		/* commands queued for a target handle are sent to its current address */
+		if (command->target_handle) {
+			table_resolve_target_handle(table, command->target_handle, &address);
+		}
+		address &= (BATCH_ADDRESS_LEN - 1);
+		target_group = last_group[address];
+		if (target_group != NO_GROUP && last_barrier != NO_GROUP && target_group < last_barrier) {
+			/* a broadcast command was sent after the last command to the target */
+			target_group = NO_GROUP;
+		}
+
+		if ((optimizations & USBI3C_COALESCE_WRITES) && mergeable(command) && descriptor->command_direction == USBI3C_WRITE &&
+		    previous != NO_GROUP && previous == optimization->sent - 1 && previous == target_group &&
+		    can_coalesce_write(snapshot, &groups[previous], command, register_address_size)) {
+			group = &groups[previous];
+			group->data_length += descriptor->data_length - register_address_size;
+			group->next_register += descriptor->data_length - register_address_size;
+			optimization->writes_coalesced++;
+		} else if ((optimizations & USBI3C_DEDUPLICATE_READS) && mergeable(command) && descriptor->command_direction == USBI3C_READ &&
+			   address != USBI3C_BROADCAST_ADDRESS && target_group != NO_GROUP &&
+			   can_deduplicate_read(&groups[target_group], command)) {
+			group = &groups[target_group];
+			optimization->reads_deduplicated++;
+		} else {
+			target_group = optimization->sent++;
+			group = &groups[target_group];
+			group->first = command;
+			group->address = address;
+			group->members = 0;
+			group->data_length = descriptor->data_length;
+			group->next_register = 0;
+			if (descriptor->command_direction == USBI3C_WRITE && command->data && descriptor->data_length > register_address_size) {
+				group->next_register = write_register(command, register_address_size) + descriptor->data_length - register_address_size;
+			}
+		}
+		group->members++;
+		optimization->sent_index[i] = target_group;
+
+		last_group[address] = target_group;
+		if (address == USBI3C_BROADCAST_ADDRESS || descriptor->command_type == TARGET_RESET_PATTERN) {
+			last_barrier = target_group;
+		}
+	}
+	table_snapshot_release(table, snapshot);
+
+	if (optimization->sent == optimization->count) {
+		/* nothing to merge */
+		FREE(groups);
+		batch_optimization_free(optimization);
+		return -1;
+	}
+
+	/* build the list from the end so each command is prepended */
+	for (i = optimization->sent; i > 0; i--) {
+		struct batch_group *group = &groups[i - 1];
+		struct usbi3c_command *command = group->first;
+
+		if (group->members > 1) {
+			command = batch_merge_group(optimization, commands, group, i - 1, register_address_size);
+			optimization->merged = list_prepend(optimization->merged, command);
+		}
+		optimization->commands = list_prepend(optimization->commands, command);
+	}
+	FREE(groups);
+
+	return 0;
+}
+
+/* creates a copy of a response for a command that was served by the same command than another one */
+static struct usbi3c_response *response_copy(const struct usbi3c_response *response)
+{
+	struct usbi3c_response *copy = NULL;
+
+	copy = (struct usbi3c_response *)malloc_or_die(sizeof(struct usbi3c_response));
+	*copy = *response;
+	if (response->data && response->data_length > 0) {
+		copy->data = (unsigned char *)malloc_or_die(response->data_length);
+		memcpy(copy->data, response->data, response->data_length);
+	} else {
+		copy->data = NULL;
+	}
+
+	return copy;
+}
+
+/**
+ * @brief Gets a response for every command of the original batch from the responses to the optimized batch.
+ *
+ * Every command carried by a merged command gets the response of the merged command,
+ * so if a coalesced write fails, all the writes coalesced into it are reported as failed.
+ *
+ * @param[in] optimization the optimized batch
+ * @param[in] responses the responses to the commands sent
+ * @return the responses in the order the commands of the original batch were queued
+ */
+struct list *batch_optimization_restore_responses(struct batch_optimization *optimization, struct list *responses)
+{
+	struct usbi3c_response **by_index = NULL;
+	uint8_t *used = NULL;
+	struct list *restored = NULL;
+	struct list *node = NULL;
+	uint32_t i = 0;
+
+	if (optimization == NULL || responses == NULL || (uint32_t)list_len(responses) != optimization->sent) {
+		return responses;
+	}
+
+	by_index = (struct usbi3c_response **)malloc_or_die(sizeof(struct usbi3c_response *) * optimization->sent);
+	used = (uint8_t *)malloc_or_die(optimization->sent);
+	for (node = responses, i = 0; node; node = node->next, i++) {
+		by_index[i] = (struct usbi3c_response *)node->data;
+	}
+	for (i = 0; i < optimization->count; i++) {
+		uint32_t sent = optimization->sent_index[i];
+		struct usbi3c_response *response = by_index[sent];
+
+		if (used[sent]) {
+			response = response_copy(response);
+		}
+		used[sent] = TRUE;
+		restored = list_append(restored, response);
+	}
+	list_free_list(&responses);
+	FREE(used);
+	FREE(by_index);
+
+	return restored;
+}
+
+/**
+ * @brief Frees an optimized batch, the commands of the original batch are not freed.
+ *
+ * @param[in] optimization the optimized batch to free
+ */
+void batch_optimization_free(struct batch_optimization *optimization)
+{
+	if (optimization == NULL) {
+		return;
+	}
+	list_free_list(&optimization->commands);
+	list_free_list_and_data(&optimization->merged, free_command_in_list);
+	FREE(optimization->sent_index);
+}
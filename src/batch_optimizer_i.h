@@ -0,0 +1,37 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __BATCH_OPTIMIZER_I_H__
+#define __BATCH_OPTIMIZER_I_H__
+
+#include "usbi3c_i.h"
+
+/**
+ * @brief A batch of commands with its adjacent writes coalesced and its duplicate reads removed.
+ */
+struct batch_optimization {
+	struct list *commands;	     ///< the commands to send, the ones that were not merged are shared with the original batch
+	struct list *merged;	     ///< the commands created by merging commands of the original batch
+	uint32_t *sent_index;	     ///< position in the commands to send of the command that carries each command of the original batch
+	uint32_t count;		     ///< number of commands in the original batch
+	uint32_t sent;		     ///< number of commands to send
+	uint32_t writes_coalesced;   ///< number of writes merged into a previous write
+	uint32_t reads_deduplicated; ///< number of reads served by a previous identical read
+};
+
+int batch_optimize(struct target_device_table *table, struct list *commands, uint8_t optimizations, uint8_t register_address_size, struct batch_optimization *optimization);
+struct list *batch_optimization_restore_responses(struct batch_optimization *optimization, struct list *responses);
+void batch_optimization_free(struct batch_optimization *optimization);
+
+#endif /* end of include guard: __BATCH_OPTIMIZER_I_H__ */
@@ -21,9 +21,15 @@
 
 #include "ibi_i.h"
 #include "ibi_response_i.h"
+#include "request_id_i.h"
+#include "send_window_i.h"
+#include "target_device_table_i.h"
+#include "timer_wheel_i.h"
 
-/* global variable that holds a monotonically increasing ID. */
-uint16_t bulk_request_id = 0;
+/* granularity of the wheel holding the deadlines of the requests */
+#define REQUEST_EXPIRY_TICK_US 10000
+
+#define MICROSECONDS_PER_SECOND 1000000
 
 /**
  * @brief Struct that contains the context required to cancel a stalled request.
@@ -33,13 +39,41 @@ struct cancel_stall_request_context {
 	uint16_t request_id;			///< The request ID of the command that the I3C controller stalled on
 };
 
-/* Generates a monotonically increasing ID */
-static uint16_t get_request_id(void)
+/**
+ * @brief Releases a reference to a chunked transfer.
+ *
+ * The transfer is freed along with its reassembled response when the last
+ * command and tracked request referring to it are released.
+ *
+ * @param[in] chunked the chunked transfer to release
+ */
+static void chunked_transfer_release(struct chunked_transfer *chunked)
 {
-	uint16_t id = bulk_request_id;
-	bulk_request_id = (bulk_request_id + 1) % UINT16_MAX;
+	if (chunked == NULL) {
+		return;
+	}
+	if (atomic_fetch_sub(&chunked->refs, 1) == 1) {
+		FREE(chunked->response.data);
+		FREE(chunked);
+	}
+}
 
-	return id;
+/**
+ * @brief Releases a reference to the callbacks of a merged command.
+ *
+ * The callbacks are freed when the last command and tracked request referring
+ * to them are released.
+ *
+ * @param[in] fanout the callbacks of the merged command to release
+ */
+static void batch_fanout_release(struct batch_fanout *fanout)
+{
+	if (fanout == NULL) {
+		return;
+	}
+	if (atomic_fetch_sub(&fanout->refs, 1) == 1) {
+		FREE(fanout);
+	}
 }
 
 /**
@@ -55,6 +89,12 @@ static void bulk_transfer_free_regular_request(struct regular_request **request)
 	if ((*request)->response) {
 		bulk_transfer_free_response(&(*request)->response);
 	}
+	/* a request that is dropped before being answered is no longer in flight either */
+	send_window_release((*request)->window, (*request)->window_bytes);
+	request_id_free((*request)->request_ids, (*request)->request_id);
+	timer_wheel_remove((*request)->expiry, &(*request)->expiry_timer);
+	chunked_transfer_release((*request)->chunked);
+	batch_fanout_release((*request)->fanout);
 	FREE(*request);
 }
 
@@ -70,6 +110,19 @@ static void free_regular_request_in_list(void *data)
 	bulk_transfer_free_regular_request(&request);
 }
 
+/**
+ * @brief Unlocks the request tracker and notifies the producers if there is room in the send window.
+ *
+ * The writable callback is run after the tracker is unlocked so it can submit commands.
+ *
+ * @param[in] regular_requests the regular request tracker
+ */
+static void bulk_transfer_unlock_requests(struct bulk_requests *regular_requests)
+{
+	pthread_mutex_unlock(regular_requests->mutex);
+	send_window_notify(regular_requests->window);
+}
+
 /**
  * @brief Frees the memory allocated for a usbi3c command.
  *
@@ -89,6 +142,8 @@ void bulk_transfer_free_command(struct usbi3c_command **command)
 	if ((*command)->data) {
 		FREE((*command)->data);
 	}
+	chunked_transfer_release((*command)->chunked);
+	batch_fanout_release((*command)->fanout);
 	FREE(*command);
 }
 
@@ -217,12 +272,19 @@ void request_tracker_destroy(struct request_tracker **request_tracker)
 	if (request_tracker == NULL || *request_tracker == NULL) {
 		return;
 	}
-	/* free regular request tracker */
+	/* free regular request tracker, nobody is waiting for the send window anymore */
+	bulk_transfer_stop_expiry(*request_tracker);
+	send_window_set_writable_callback((*request_tracker)->regular_requests->window, NULL, NULL);
 	pthread_mutex_lock((*request_tracker)->regular_requests->mutex);
 	list_free_list_and_data(&(*request_tracker)->regular_requests->requests, free_regular_request_in_list);
 	pthread_mutex_unlock((*request_tracker)->regular_requests->mutex);
 	pthread_mutex_destroy((*request_tracker)->regular_requests->mutex);
 	FREE((*request_tracker)->regular_requests->mutex);
+	send_window_destroy(&(*request_tracker)->regular_requests->window);
+	request_id_allocator_destroy(&(*request_tracker)->regular_requests->request_ids);
+	timer_wheel_destroy(&(*request_tracker)->regular_requests->expiry);
+	pthread_cond_destroy((*request_tracker)->regular_requests->expiry_changed);
+	FREE((*request_tracker)->regular_requests->expiry_changed);
 	FREE((*request_tracker)->regular_requests);
 
 	FREE((*request_tracker)->vendor_request);
@@ -244,6 +306,7 @@ struct request_tracker *bulk_transfer_request_tracker_init(struct usb_device *us
 {
 	struct request_tracker *request_tracker = NULL;
 	const int DEFAULT_REATTEMPT_MAX_FOR_STALLED_REQUESTS = 2;
+	pthread_condattr_t attr;
 
 	request_tracker = (struct request_tracker *)malloc_or_die(sizeof(struct request_tracker));
 	request_tracker->reattempt_max = DEFAULT_REATTEMPT_MAX_FOR_STALLED_REQUESTS;
@@ -261,6 +324,15 @@ struct request_tracker *bulk_transfer_request_tracker_init(struct usb_device *us
 	request_tracker->regular_requests->requests = NULL;
 	request_tracker->regular_requests->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
 	pthread_mutex_init(request_tracker->regular_requests->mutex, NULL);
+	request_tracker->regular_requests->window = send_window_init();
+	request_tracker->regular_requests->request_ids = request_id_allocator_init();
+	request_tracker->regular_requests->expiry = timer_wheel_init(REQUEST_EXPIRY_TICK_US, monotonic_time_us());
+	request_tracker->regular_requests->expiry_wake_us = UINT64_MAX;
+	request_tracker->regular_requests->expiry_changed = (pthread_cond_t *)malloc_or_die(sizeof(pthread_cond_t));
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(request_tracker->regular_requests->expiry_changed, &attr);
+	pthread_condattr_destroy(&attr);
 
 	return request_tracker;
 }
@@ -292,7 +364,7 @@ int compare_request_id(const void *a, const void *b)
  * @param[out] buffer_available the size in bytes of the buffer available in the I3C function
  * @return 0 if the size of buffer was obtained correctly, or -1 otherwise
  */
-static int bulk_transfer_get_buffer_available(struct usbi3c_device *usbi3c_dev, uint32_t *buffer_available)
+int bulk_transfer_get_buffer_available(struct usbi3c_device *usbi3c_dev, uint32_t *buffer_available)
 {
 	uint8_t *buffer = NULL;
 
@@ -363,18 +435,17 @@ int bulk_transfer_validate_command(struct usbi3c_command *command)
  *
  * @param[in] buffer a pointer to the memory where the command will be laid out to
  * @param[in] command the command to be laid out into the buffer
+ * @param[in] request_id the ID allocated to the command
  * @return the size the command takes in memory
  */
-static uint32_t bulk_transfer_create_command_buffer(unsigned char *buffer, struct usbi3c_command *command)
+static uint32_t bulk_transfer_create_command_buffer(unsigned char *buffer, struct usbi3c_command *command, uint16_t request_id)
 {
 	struct command_descriptor *desc = command->command_descriptor;
 	uint32_t data_block_len = 0;
-	uint16_t request_id;
 	size_t buffer_size = 0;
 	int padding = 0;
 
 	/* command block header */
-	request_id = get_request_id();
 	GET_BULK_REQUEST_COMMAND_BLOCK_HEADER(buffer)->request_id = request_id;
 	if (desc->command_direction != USBI3C_READ && desc->data_length > 0) {
 		/* only CCC commands or the Write command can have a data block,
@@ -493,6 +564,7 @@ int bulk_transfer_get_regular_response(struct bulk_requests *regular_requests, u
 	struct usbi3c_response *response = NULL;
 	struct regular_request *request = NULL;
 	uint16_t request_id;
+	uint16_t first_request_id = 0;
 	int total_commands = 0;
 	int ret = 0;
 
@@ -515,6 +587,11 @@ int bulk_transfer_get_regular_response(struct bulk_requests *regular_requests, u
 	}
 	request = (struct regular_request *)node->data;
 	total_commands = request->total_commands;
+	first_request_id = request_id;
+
+	/* the bulk request is no longer in flight, its room in the send window can be taken */
+	send_window_release(request->window, request->window_bytes);
+	request->window = NULL;
 
 	for (int i = 0; i < total_commands; i++) {
 
@@ -576,6 +653,9 @@ int bulk_transfer_get_regular_response(struct bulk_requests *regular_requests, u
 			goto UNLOCK_AND_EXIT;
 		}
 
+		/* the command was answered, it can no longer expire */
+		timer_wheel_remove(request->expiry, &request->expiry_timer);
+
 		/* if the user added a callback to be run when the response to the command
 		 * was gotten, now is the time to run it. If no callback was provided, just
 		 * add the response to the tracker */
@@ -606,7 +686,11 @@ int bulk_transfer_get_regular_response(struct bulk_requests *regular_requests, u
 	}
 
 UNLOCK_AND_EXIT:
-	pthread_mutex_unlock(regular_requests->mutex);
+	/* even if its responses could not be handled, the I3C function is done with the bulk request */
+	if (total_commands > 0 && regular_requests->on_request_answered) {
+		regular_requests->on_request_answered(first_request_id, regular_requests->request_answered_context);
+	}
+	bulk_transfer_unlock_requests(regular_requests);
 
 	return ret;
 }
@@ -634,7 +718,7 @@ void bulk_transfer_get_response(void *context, unsigned char *buffer, uint32_t b
 
 	/* let's make sure the type of response we are getting is valid */
 	if (GET_BULK_TRANSFER_HEADER(buffer)->tag == INTERRUPT_BULK_RESPONSE) {
-		if (ibi_response_handle(request_tracker->ibi_response_queue, buffer, buffer_size) < 0) {
+		if (ibi_handle_response(request_tracker->ibi, buffer, buffer_size) < 0) {
 			DEBUG_PRINT("Failed to handle interrupt bulk response\n");
 		}
 		ibi_call_pending(request_tracker->ibi);
@@ -651,32 +735,13 @@ void bulk_transfer_get_response(void *context, unsigned char *buffer, uint32_t b
 	}
 }
 
-/**
- * @brief Sends a bulk request consisting of one or many commands and their associated data.
- *
- * The commands sent by this request will be executed in strict order from first
- * to last command. The I3C function shall send a bulk response transfer containing
- * response blocks for all corresponding commands indicating success/failure. However,
- * since all transactions in USB are initiated by the host, this response has to be
- * obtained separately.
- *
- * If dependent_on_previous is set and a command in the previous bulk request stalls
- * on NACK, the execution or cancellation of the commands in this request  will rely
- * on the host sending a CANCEL_OR_RESUME_BULK_REQUEST to decide if it should retry the
- * stalled command and upon its success continue to execute subsequent dependent commands,
- * or cancel the execution of the stalled command and all subsequent dependent commands.
- *
- * @param[in] usbi3c_dev the usbi3c device
- * @param[in] commands a list of the dependent commands to be transferred
- * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request
- * @return a list containing the ID of each one of the submitted requests, or NULL on failure
- */
-struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous)
+/* sends a bulk request, see bulk_transfer_send_commands(), a non-blocking request is not
+ * sent if it would have to wait for the requests in flight */
+static int bulk_transfer_send(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous, uint8_t non_blocking, struct list **sent_request_ids)
 {
 	struct regular_request *request = NULL;
 	struct list *requests = NULL;
 	struct list *node = NULL;
-	struct list *tail = NULL;
 	struct list *request_ids = NULL;
 	unsigned char *buffer = NULL;
 	unsigned char *cmd_buffer = NULL;
@@ -685,21 +750,25 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 	uint32_t data_block_len = 0;
 	uint32_t response_buffer_size = 0;
 	uint32_t response_data_block_len = 0;
+	uint32_t window_bytes = 0;
+	uint16_t *allocated_ids = NULL;
+	uint64_t deadline_us = 0;
 	int command_count = 0;
+	int command_index = 0;
 	int ret = -1;
 
 	/* validate data */
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return NULL;
+		return -1;
 	}
 	if (commands == NULL) {
 		DEBUG_PRINT("The list of commands to transfer is missing, aborting...\n");
-		return NULL;
+		return -1;
 	}
 	if (dependent_on_previous != USBI3C_NOT_DEPENDENT_ON_PREVIOUS && dependent_on_previous != USBI3C_DEPENDENT_ON_PREVIOUS) {
 		DEBUG_PRINT("Invalid value for dependent_on_previous, aborting...\n");
-		return NULL;
+		return -1;
 	}
 
 	/* only one bulk request transfer header is required for all commands */
@@ -716,10 +785,17 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 		struct command_descriptor *command_desc = NULL;
 
 		if (bulk_transfer_validate_command(command) < 0) {
-			return NULL;
+			return -1;
 		}
 		command_desc = command->command_descriptor;
 
+		/* commands queued for a target handle follow the target device to its current address */
+		if (command->target_handle &&
+		    table_resolve_target_handle(usbi3c_dev->target_device_table, command->target_handle, &command_desc->target_address) < 0) {
+			DEBUG_PRINT("The target device of the command could not be resolved, aborting...\n");
+			return -1;
+		}
+
 		if (command_desc->command_direction == USBI3C_READ) {
 			/* 'Read' commands don't have a data block even when their
 			 * data_length is > 0 */
@@ -751,16 +827,42 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 		command_count = command_count + 1;
 	}
 
+	/* the request and its response take room in the send window until the response
+	 * is received, a non-blocking request is refused if the window is full */
+	window_bytes = buffer_size + response_buffer_size;
+	if (send_window_reserve(usbi3c_dev->request_tracker->regular_requests->window, window_bytes, non_blocking) == USBI3C_WOULD_BLOCK) {
+		return USBI3C_WOULD_BLOCK;
+	}
+
 	/* evaluate if there is enough buffer available in the I3C function to process
 	 * all the commands/data */
 	ret = bulk_transfer_get_buffer_available(usbi3c_dev, &buffer_available);
 	if (ret < 0) {
 		DEBUG_PRINT("Could not get the buffer available from the I3C function, aborting...\n");
-		return NULL;
+		send_window_cancel(usbi3c_dev->request_tracker->regular_requests->window, window_bytes);
+		return -1;
 	}
 	if ((buffer_size + response_buffer_size) > buffer_available) {
+		if (non_blocking) {
+			/* the buffer is freed as the requests in flight are answered */
+			return send_window_refuse(usbi3c_dev->request_tracker->regular_requests->window, window_bytes);
+		}
 		DEBUG_PRINT("There is not enough buffer available in the I3C function for the commands, aborting...\n");
-		return NULL;
+		send_window_cancel(usbi3c_dev->request_tracker->regular_requests->window, window_bytes);
+		return -1;
+	}
+
+	/* an ID can't be reused while a request with that ID is still tracked */
+	allocated_ids = (uint16_t *)malloc_or_die(command_count * sizeof(uint16_t));
+	if (request_id_alloc(usbi3c_dev->request_tracker->regular_requests->request_ids, allocated_ids, command_count) < 0) {
+		FREE(allocated_ids);
+		if (non_blocking) {
+			/* IDs are freed as the requests in flight are answered */
+			return send_window_refuse(usbi3c_dev->request_tracker->regular_requests->window, window_bytes);
+		}
+		DEBUG_PRINT("There are no request IDs available for the commands, aborting...\n");
+		send_window_cancel(usbi3c_dev->request_tracker->regular_requests->window, window_bytes);
+		return -1;
 	}
 
 	/* get a buffer of a suitable size for all the I3C commands in the list */
@@ -781,9 +883,8 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 		uint16_t request_id;
 		uint16_t *request_id_ptr = NULL;
 
-		cmd_size = bulk_transfer_create_command_buffer(cmd_buffer, command);
-
-		request_id = GET_BULK_REQUEST_COMMAND_BLOCK_HEADER(cmd_buffer)->request_id;
+		request_id = allocated_ids[command_index++];
+		cmd_size = bulk_transfer_create_command_buffer(cmd_buffer, command, request_id);
 
 		/* when multiple commands are sent together in a single request transfer,
 		 * it means that the I3C function will execute these commands in strict order,
@@ -802,15 +903,31 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 		 * value so we know how to handle the commands if a previous request fails. */
 		request = (struct regular_request *)malloc_or_die(sizeof(struct regular_request));
 		request->request_id = request_id;
+		request->request_ids = usbi3c_dev->request_tracker->regular_requests->request_ids;
 		request->total_commands = command_count;
 		request->reattempt_count = 0;
 		request->response = NULL;
 		request->on_response_cb = command->on_response_cb;
 		request->user_data = command->user_data;
+		request->chunked = command->chunked;
+		request->fanout = command->fanout;
+		request->expiry = usbi3c_dev->request_tracker->regular_requests->expiry;
+		request->expiry_timer.data = request;
+		if (request->chunked) {
+			/* the transfer has to outlive the command while its response is awaited */
+			atomic_fetch_add(&request->chunked->refs, 1);
+		}
+		if (request->fanout) {
+			/* so do the callbacks of the commands merged into it */
+			atomic_fetch_add(&request->fanout->refs, 1);
+		}
 		if (node == commands) {
 			/* this is the first command in the request, it will depend on the commands
 			 * in the previous request if the user selected it to be */
 			request->dependent_on_previous = dependent_on_previous;
+			/* the first command holds the room of the whole request in the send window */
+			request->window = usbi3c_dev->request_tracker->regular_requests->window;
+			request->window_bytes = window_bytes;
 		} else {
 			/* all subsequent commands in the request are dependent on previous by default */
 			request->dependent_on_previous = TRUE;
@@ -827,12 +944,23 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 		 * memory space so its ready for the next command */
 		cmd_buffer = (cmd_buffer + cmd_size);
 	}
+	FREE(allocated_ids);
 
-	/* the commands have been sent, we can add them to the request tracker now but keep
-	 * a reference of the original tail in case we need to revert this */
+	/* the commands are added to the request tracker before being sent, so their
+	 * responses can't arrive before they are tracked */
 	pthread_mutex_lock(usbi3c_dev->request_tracker->regular_requests->mutex);
-	tail = list_tail(usbi3c_dev->request_tracker->regular_requests->requests);
 	usbi3c_dev->request_tracker->regular_requests->requests = list_concat(usbi3c_dev->request_tracker->regular_requests->requests, requests);
+	if (usbi3c_dev->request_tracker->regular_requests->response_timeout_ms) {
+		/* every command of the request expires at the same time if the response is not received */
+		deadline_us = monotonic_time_us() + (uint64_t)usbi3c_dev->request_tracker->regular_requests->response_timeout_ms * 1000;
+		for (node = requests; node; node = node->next) {
+			request = (struct regular_request *)node->data;
+			timer_wheel_add(request->expiry, &request->expiry_timer, deadline_us);
+		}
+		if (deadline_us < usbi3c_dev->request_tracker->regular_requests->expiry_wake_us) {
+			pthread_cond_signal(usbi3c_dev->request_tracker->regular_requests->expiry_changed);
+		}
+	}
 	pthread_mutex_unlock(usbi3c_dev->request_tracker->regular_requests->mutex);
 
 	/* buffer ready, the transfer can begin */
@@ -840,24 +968,70 @@ struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struc
 	if (ret < 0) {
 		DEBUG_PRINT("The commands failed to be sent\n");
 		FREE(buffer);
+		/* the requests are looked up by ID since some of them could have expired
+		 * while the transfer was being attempted */
+		bulk_transfer_untrack_requests(usbi3c_dev->request_tracker->regular_requests, request_ids);
 		list_free_list_and_data(&request_ids, free);
-		/* the requests list was just concatenated to the end of the requests tracker,
-		 * we can just delete that part of the list and return the original list tail */
-		list_free_list_and_data(&requests, free_regular_request_in_list);
-		if (tail == NULL) {
-			/* there was no tail, the tracker was empty */
-			usbi3c_dev->request_tracker->regular_requests->requests = NULL;
-		} else {
-			tail->next = NULL;
-		}
-		return NULL;
+		return -1;
 	}
 
 	FREE(buffer);
+	*sent_request_ids = request_ids;
+
+	return 0;
+}
+
+/**
+ * @brief Sends a bulk request consisting of one or many commands and their associated data.
+ *
+ * The commands sent by this request will be executed in strict order from first
+ * to last command. The I3C function shall send a bulk response transfer containing
+ * response blocks for all corresponding commands indicating success/failure. However,
+ * since all transactions in USB are initiated by the host, this response has to be
+ * obtained separately.
+ *
+ * If dependent_on_previous is set and a command in the previous bulk request stalls
+ * on NACK, the execution or cancellation of the commands in this request  will rely
+ * on the host sending a CANCEL_OR_RESUME_BULK_REQUEST to decide if it should retry the
+ * stalled command and upon its success continue to execute subsequent dependent commands,
+ * or cancel the execution of the stalled command and all subsequent dependent commands.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] commands a list of the dependent commands to be transferred
+ * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request
+ * @return a list containing the ID of each one of the submitted requests, or NULL on failure
+ */
+struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous)
+{
+	struct list *request_ids = NULL;
+
+	bulk_transfer_send(usbi3c_dev, commands, dependent_on_previous, FALSE, &request_ids);
 
 	return request_ids;
 }
 
+/**
+ * @brief Sends a bulk request the same way bulk_transfer_send_commands() does, unless it would have to wait.
+ *
+ * The request is not sent if the send window is full, or if the I3C function does not have
+ * enough buffer for it while other requests are in flight.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] commands a list of the dependent commands to be transferred
+ * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request
+ * @param[out] request_ids a list containing the ID of each one of the submitted requests
+ * @return 0 if the request was sent, USBI3C_WOULD_BLOCK if it has to wait for the requests in flight, or -1 otherwise
+ */
+int bulk_transfer_try_send_commands(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous, struct list **request_ids)
+{
+	if (request_ids == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return bulk_transfer_send(usbi3c_dev, commands, dependent_on_previous, TRUE, request_ids);
+}
+
 /**
  * @brief Searches for a response for a specific request id in the request tracker.
  *
@@ -913,11 +1087,92 @@ struct usbi3c_response *bulk_transfer_search_response_in_tracker(struct bulk_req
 	regular_requests->requests = list_free_node(regular_requests->requests, node, free_regular_request_in_list);
 
 UNLOCK_AND_EXIT:
-	pthread_mutex_unlock(regular_requests->mutex);
+	bulk_transfer_unlock_requests(regular_requests);
 
 	return response;
 }
 
+/* appends the response to a chunk to the response of the whole transfer, the first
+ * chunk that was not attempted or failed determines the status of the transfer */
+static void response_append_chunk(struct usbi3c_response *merged, struct usbi3c_response *response)
+{
+	if (merged->attempted == USBI3C_COMMAND_ATTEMPTED && merged->error_status == USBI3C_SUCCEEDED) {
+		merged->attempted = response->attempted;
+		merged->error_status = response->error_status;
+	}
+	if (response->data_length > 0 && response->data) {
+		merged->data = (unsigned char *)realloc_or_die(merged->data, merged->data_length + response->data_length);
+		memcpy(merged->data + merged->data_length, response->data, response->data_length);
+		merged->has_data = USBI3C_RESPONSE_HAS_DATA;
+	}
+	merged->data_length += response->data_length;
+}
+
+/* wrapper to bulk_transfer_free_response() to be used to free lists of responses */
+static void free_response_in_list(void *data)
+{
+	struct usbi3c_response *response = (struct usbi3c_response *)data;
+
+	bulk_transfer_free_response(&response);
+}
+
+/**
+ * @brief Reassembles the responses to the chunks of the chunked transfers into one response per transfer.
+ *
+ * The responses have to be in the same order as the commands they correspond to. The
+ * responses to consecutive commands that are chunks of the same transfer are merged
+ * into the response to the first chunk.
+ *
+ * @param[in] commands the list of commands (struct usbi3c_command) that were sent
+ * @param[in,out] responses the list of responses (struct usbi3c_response) to the commands
+ */
+void bulk_transfer_merge_chunked_responses(struct list *commands, struct list **responses)
+{
+	struct list *command_node = commands;
+	struct list *response_node = NULL;
+
+	if (responses == NULL) {
+		return;
+	}
+
+	for (response_node = *responses; command_node && response_node; response_node = response_node->next) {
+		struct usbi3c_command *command = (struct usbi3c_command *)command_node->data;
+
+		command_node = command_node->next;
+		while (command->chunked && command_node && response_node->next &&
+		       ((struct usbi3c_command *)command_node->data)->chunked == command->chunked) {
+			response_append_chunk(response_node->data, response_node->next->data);
+			*responses = list_free_node(*responses, response_node->next, free_response_in_list);
+			command_node = command_node->next;
+		}
+	}
+}
+
+/* receives the responses to the chunks of a transfer and runs the callback of the
+ * transfer once the response to the last chunk is received */
+static int chunked_transfer_on_response(struct usbi3c_response *response, void *user_data)
+{
+	struct chunked_transfer *chunked = (struct chunked_transfer *)user_data;
+	int ret = 0;
+
+	response_append_chunk(&chunked->response, response);
+	chunked->received++;
+	if (chunked->received < chunked->chunks) {
+		return 0;
+	}
+
+	ret = chunked->on_response_cb(&chunked->response, chunked->user_data);
+	if (ret != 0) {
+		/* the callback failed, keep the reassembled response in the tracker
+		 * in place of the response to the last chunk */
+		FREE(response->data);
+		*response = chunked->response;
+		chunked->response.data = NULL;
+	}
+
+	return ret;
+}
+
 /**
  * @brief Allocates a usbi3c_command and pre-initializes it for you.
  *
@@ -971,12 +1226,12 @@ static int is_dependent(const void *a, const void *b)
 		return 0;
 	}
 
-	if (command->request_id > request_id && command->dependent_on_previous == TRUE) {
+	if (request_id_is_after(command->request_id, request_id) && command->dependent_on_previous == TRUE) {
 		/* found a dependent */
 		return 0;
 	}
 
-	if (command->request_id > request_id && command->dependent_on_previous == FALSE) {
+	if (request_id_is_after(command->request_id, request_id) && command->dependent_on_previous == FALSE) {
 		/* this is no longer a dependent, we are done searching */
 		return -1;
 	}
@@ -1014,6 +1269,217 @@ int bulk_transfer_remove_command_and_dependent(struct bulk_requests *regular_req
 	regular_requests->requests = list_free_matching_nodes(regular_requests->requests, &request_id, is_dependent, free_regular_request_in_list);
 
 UNLOCK_AND_EXIT:
+	bulk_transfer_unlock_requests(regular_requests);
+
+	return 0;
+}
+
+/**
+ * @brief Stops tracking requests whose responses are no longer awaited.
+ *
+ * Requests that already got their response but were kept in the tracker are
+ * freed along with their response.
+ *
+ * @param[in] regular_requests the regular request tracker
+ * @param[in] request_ids the list of IDs of the requests to stop tracking
+ */
+void bulk_transfer_untrack_requests(struct bulk_requests *regular_requests, struct list *request_ids)
+{
+	struct list *node = NULL;
+
+	if (regular_requests == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(regular_requests->mutex);
+	for (struct list *id = request_ids; id; id = id->next) {
+		node = list_search_node(regular_requests->requests, id->data, compare_request_id);
+		if (node) {
+			regular_requests->requests = list_free_node(regular_requests->requests, node, free_regular_request_in_list);
+		}
+	}
+	bulk_transfer_unlock_requests(regular_requests);
+}
+
+/* completes a command whose response was not received in time, the same way it would be
+ * completed by its response, the tracker has to be locked */
+static void bulk_transfer_expire_request(struct bulk_requests *regular_requests, struct regular_request *request)
+{
+	struct usbi3c_response *response = NULL;
+	struct list *node = NULL;
+	uint16_t request_id = request->request_id;
+	int first_command = FALSE;
+
+	regular_requests->expiry_stats.expired_commands++;
+	if (request->window) {
+		/* the first command of the bulk request, the request is no longer in flight */
+		regular_requests->expiry_stats.expired_requests++;
+		send_window_release(request->window, request->window_bytes);
+		request->window = NULL;
+		first_command = TRUE;
+	}
+
+	response = (struct usbi3c_response *)malloc_or_die(sizeof(struct usbi3c_response));
+	response->attempted = USBI3C_COMMAND_TIMED_OUT;
+
+	node = list_search_node(regular_requests->requests, &request_id, compare_request_id);
+	if (node && request->on_response_cb && request->on_response_cb(response, request->user_data) == 0) {
+		regular_requests->requests = list_free_node(regular_requests->requests, node, free_regular_request_in_list);
+		FREE(response);
+	} else {
+		/* keep the response in the tracker for whoever is waiting for it, a waiter
+		 * that gives up untracks its requests so the response is not left behind */
+		request->response = response;
+	}
+
+	if (first_command && regular_requests->on_request_answered) {
+		regular_requests->on_request_answered(request_id, regular_requests->request_answered_context);
+	}
+}
+
+/**
+ * @brief Expires the commands whose response was not received before their deadline.
+ *
+ * Each command expired is completed with a response whose attempted field is
+ * USBI3C_COMMAND_TIMED_OUT, through its callback if it has one, or by keeping the
+ * response in the tracker otherwise.
+ *
+ * @param[in] request_tracker the request tracker
+ * @param[in] now_us the current time in microseconds
+ * @return the number of commands expired, or -1 on failure
+ */
+int bulk_transfer_expire_requests(struct request_tracker *request_tracker, uint64_t now_us)
+{
+	struct bulk_requests *regular_requests = NULL;
+	struct timer_wheel_entry *timer = NULL;
+	int expired = 0;
+
+	if (request_tracker == NULL) {
+		DEBUG_PRINT("Missing request tracker, aborting...\n");
+		return -1;
+	}
+	regular_requests = request_tracker->regular_requests;
+
+	pthread_mutex_lock(regular_requests->mutex);
+	while ((timer = timer_wheel_pop_expired(regular_requests->expiry, now_us))) {
+		bulk_transfer_expire_request(regular_requests, (struct regular_request *)timer->data);
+		expired++;
+	}
+	bulk_transfer_unlock_requests(regular_requests);
+
+	/* the threads blocked waiting for a response have to look for it in the tracker */
+	if (expired > 0) {
+		usb_wake_event_waiters(request_tracker->usb_dev);
+	}
+
+	return expired;
+}
+
+static void *bulk_transfer_expiry_thread(void *arg)
+{
+	struct request_tracker *request_tracker = (struct request_tracker *)arg;
+	struct bulk_requests *regular_requests = request_tracker->regular_requests;
+	struct timespec deadline;
+
+	pthread_mutex_lock(regular_requests->mutex);
+	while (regular_requests->expiry_running) {
+		regular_requests->expiry_wake_us = timer_wheel_next_expiry(regular_requests->expiry);
+		if (regular_requests->expiry_wake_us == UINT64_MAX) {
+			pthread_cond_wait(regular_requests->expiry_changed, regular_requests->mutex);
+		} else if (regular_requests->expiry_wake_us > monotonic_time_us()) {
+			deadline.tv_sec = regular_requests->expiry_wake_us / MICROSECONDS_PER_SECOND;
+			deadline.tv_nsec = (long)(regular_requests->expiry_wake_us % MICROSECONDS_PER_SECOND) * 1000;
+			pthread_cond_timedwait(regular_requests->expiry_changed, regular_requests->mutex, &deadline);
+		} else {
+			pthread_mutex_unlock(regular_requests->mutex);
+			bulk_transfer_expire_requests(request_tracker, monotonic_time_us());
+			pthread_mutex_lock(regular_requests->mutex);
+		}
+	}
+	regular_requests->expiry_wake_us = UINT64_MAX;
+	pthread_mutex_unlock(regular_requests->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Sets the time the response to a request is awaited before the request expires.
+ *
+ * The timeout applies to the requests sent after it is set. The thread expiring the
+ * requests is started the first time a timeout is set.
+ *
+ * @param[in] request_tracker the request tracker
+ * @param[in] timeout_ms the time to wait for a response in milliseconds, 0 for requests to never expire
+ * @return 0 if the timeout was set, or -1 otherwise
+ */
+int bulk_transfer_set_response_timeout(struct request_tracker *request_tracker, uint32_t timeout_ms)
+{
+	struct bulk_requests *regular_requests = NULL;
+	int err = 0;
+
+	if (request_tracker == NULL) {
+		DEBUG_PRINT("Missing request tracker, aborting...\n");
+		return -1;
+	}
+	regular_requests = request_tracker->regular_requests;
+
+	pthread_mutex_lock(regular_requests->mutex);
+	regular_requests->response_timeout_ms = timeout_ms;
+	if (timeout_ms && !regular_requests->expiry_running) {
+		regular_requests->expiry_running = TRUE;
+		if ((err = pthread_create(&regular_requests->expiry_thread, NULL, &bulk_transfer_expiry_thread, request_tracker))) {
+			DEBUG_PRINT("pthread_create(): %s\n", strerror(err));
+			regular_requests->expiry_running = FALSE;
+			regular_requests->response_timeout_ms = 0;
+		}
+	}
+	pthread_mutex_unlock(regular_requests->mutex);
+
+	return err ? -1 : 0;
+}
+
+/**
+ * @brief Stops the thread expiring the requests, the deadlines already armed are kept.
+ *
+ * @param[in] request_tracker the request tracker
+ */
+void bulk_transfer_stop_expiry(struct request_tracker *request_tracker)
+{
+	struct bulk_requests *regular_requests = NULL;
+
+	if (request_tracker == NULL) {
+		return;
+	}
+	regular_requests = request_tracker->regular_requests;
+
+	pthread_mutex_lock(regular_requests->mutex);
+	if (regular_requests->expiry_running) {
+		regular_requests->expiry_running = FALSE;
+		pthread_cond_broadcast(regular_requests->expiry_changed);
+		pthread_mutex_unlock(regular_requests->mutex);
+		pthread_join(regular_requests->expiry_thread, NULL);
+	} else {
+		pthread_mutex_unlock(regular_requests->mutex);
+	}
+}
+
+/**
+ * @brief Gets the counters of the requests expired.
+ *
+ * @param[in] regular_requests the regular request tracker
+ * @param[out] stats the counters of the requests expired
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int bulk_transfer_get_request_expiry_stats(struct bulk_requests *regular_requests, struct usbi3c_request_expiry_stats *stats)
+{
+	if (regular_requests == NULL || stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(regular_requests->mutex);
+	*stats = regular_requests->expiry_stats;
+	stats->timeout_ms = regular_requests->response_timeout_ms;
 	pthread_mutex_unlock(regular_requests->mutex);
 
 	return 0;
@@ -1203,3 +1669,80 @@ int bulk_transfer_enqueue_command(struct list **command_queue,
 
 	return 0;
 }
+
+/**
+ * @brief Adds a Read/Write command to the command queue split in chunks that fit the max length of its target device.
+ *
+ * The command is split in consecutive commands of at most max_chunk_size bytes each.
+ * Reads are split in chunks that are a multiple of 4 bytes. Commands queued together
+ * are executed in strict order, so the chunks are transferred in the same order as
+ * the data. If a callback function is provided, it is executed only once, when the
+ * responses to all the chunks are received, with a single response that contains
+ * the data of all of them.
+ *
+ * @param[in] command_queue the queue holding the commands to be sent
+ * @param[in] target_address the target device address
+ * @param[in] command_direction indicates the read/write direction of the command
+ * @param[in] error_handling indicates the condition for the I3C controller to abort subsequent commands
+ * @param[in] i3c_mode the transfer mode and rate that will be used for the transactions
+ * @param[in] data the data to be transferred (required with write)
+ * @param[in] data_size indicates the number of bytes of data to be transferred
+ * @param[in] max_chunk_size the max number of bytes to transfer in a single command, 0 if there is no limit
+ * @param[in] on_response_cb a callback function to execute when the response to the whole transfer is received (optional)
+ * @param[in] user_data the data to share with the on_response_cb callback function (optional)
+ * @return 0 if the commands were added to the queue correctly, or -1 otherwise
+ */
+int bulk_transfer_enqueue_chunked_command(struct list **command_queue,
+					  uint8_t target_address,
+					  uint8_t command_direction,
+					  uint8_t error_handling,
+					  struct i3c_mode *i3c_mode,
+					  unsigned char *data,
+					  uint32_t data_size,
+					  uint32_t max_chunk_size,
+					  on_response_fn on_response_cb,
+					  void *user_data)
+{
+	struct chunked_transfer *chunked = NULL;
+	struct usbi3c_command *command = NULL;
+	const int NOT_APPLICABLE = 0;
+	uint32_t offset = 0;
+
+	if (command_direction == USBI3C_READ && max_chunk_size > 0) {
+		/* the data to read has to be 32-bit aligned */
+		max_chunk_size -= max_chunk_size % 4;
+		if (max_chunk_size == 0) {
+			DEBUG_PRINT("The max read length of the target device is smaller than 4 bytes, aborting...\n");
+			return -1;
+		}
+	}
+
+	if (max_chunk_size == 0 || data_size <= max_chunk_size || i3c_mode == NULL || (command_direction != USBI3C_READ && data == NULL) ||
+	    (command_direction == USBI3C_READ && (data != NULL || data_size % 4 != 0)) || (user_data != NULL && on_response_cb == NULL)) {
+		/* the command does not need to be split, or it is invalid in which case
+		 * it will be rejected with the reason */
+		return bulk_transfer_enqueue_command(command_queue, REGULAR_COMMAND, target_address, command_direction, error_handling, i3c_mode,
+						     NOT_APPLICABLE, NOT_APPLICABLE, data, data_size, on_response_cb, user_data);
+	}
+
+	chunked = (struct chunked_transfer *)malloc_or_die(sizeof(struct chunked_transfer));
+	chunked->on_response_cb = on_response_cb;
+	chunked->user_data = user_data;
+	chunked->chunks = (data_size + max_chunk_size - 1) / max_chunk_size;
+	chunked->response.attempted = USBI3C_COMMAND_ATTEMPTED;
+	chunked->response.error_status = USBI3C_SUCCEEDED;
+	atomic_init(&chunked->refs, chunked->chunks);
+
+	/* the commands are valid at this point, so queueing them cannot fail */
+	for (offset = 0; offset < data_size; offset += max_chunk_size) {
+		uint32_t chunk_size = (data_size - offset) < max_chunk_size ? (data_size - offset) : max_chunk_size;
+
+		bulk_transfer_enqueue_command(command_queue, REGULAR_COMMAND, target_address, command_direction, error_handling, i3c_mode,
+					      NOT_APPLICABLE, NOT_APPLICABLE, data ? data + offset : NULL, chunk_size,
+					      on_response_cb ? chunked_transfer_on_response : NULL, on_response_cb ? chunked : NULL);
+		command = (struct usbi3c_command *)list_tail(*command_queue)->data;
+		command->chunked = chunked;
+	}
+
+	return 0;
+}
@@ -0,0 +1,326 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <stdatomic.h>
+#include <time.h>
+
+#include "bus_inventory_i.h"
+#include "target_device_table_i.h"
+
+/* the buffer of the I3C function is shared by two batches, so the next batch
+ * can be queued while the previous one is being executed */
+#define BUS_INVENTORY_BATCHES_IN_FLIGHT 2
+
+/**
+ * @brief A discovery CCC sent to every target device during the scan.
+ */
+struct discovery_ccc {
+	uint8_t ccc;	    ///< the direct GET CCC
+	uint8_t field;	    ///< the inventory field read by the CCC
+	uint32_t read_size; ///< the max number of bytes returned by the CCC, 32-bit aligned
+};
+
+static const struct discovery_ccc discovery_cccs[] = {
+	{ CCC_DIRECT_GETPID, USBI3C_INVENTORY_PID, 8 },
+	{ CCC_DIRECT_GETBCR, USBI3C_INVENTORY_BCR, 4 },
+	{ CCC_DIRECT_GETDCR, USBI3C_INVENTORY_DCR, 4 },
+	{ CCC_DIRECT_GETMXDS, USBI3C_INVENTORY_MXDS, 8 },
+	{ CCC_DIRECT_GETMRL, USBI3C_INVENTORY_MRL, 4 },
+	{ CCC_DIRECT_GETMWL, USBI3C_INVENTORY_MWL, 4 },
+};
+
+#define DISCOVERY_CCC_COUNT (sizeof(discovery_cccs) / sizeof(discovery_cccs[0]))
+
+struct bus_inventory;
+
+/**
+ * @brief A discovery CCC sent to one target device, used as user data of its response.
+ */
+struct bus_inventory_command {
+	struct bus_inventory *inventory;	   ///< the scan the command belongs to
+	struct target_device_discovery *discovery; ///< where the value read from the target device is stored
+	const struct discovery_ccc *ccc;	   ///< the CCC sent
+};
+
+/**
+ * @brief The state of a bus inventory scan.
+ */
+struct bus_inventory {
+	struct target_device_discovery *discoveries; ///< the values read from each target device
+	struct bus_inventory_command *commands;	     ///< the CCCs sent to each target device, in the order they are sent
+	size_t device_count;			     ///< number of target devices scanned
+	int sent;				     ///< number of commands sent to the I3C function
+	atomic_int responses;			     ///< number of responses received
+	struct list *request_ids;		     ///< the IDs of the commands sent
+};
+
+/* parses the value returned by a discovery CCC, returns -1 if it is too short */
+static int discovery_parse(struct target_device_discovery *discovery, uint8_t ccc, const unsigned char *data, uint32_t length)
+{
+	switch (ccc) {
+	case CCC_DIRECT_GETPID:
+		if (length < 6) {
+			return -1;
+		}
+		/* the PID is returned MSB first */
+		discovery->pid = 0;
+		for (int i = 0; i < 6; i++) {
+			discovery->pid = (discovery->pid << 8) | data[i];
+		}
+		break;
+	case CCC_DIRECT_GETBCR:
+		if (length < 1) {
+			return -1;
+		}
+		discovery->bus_characteristic_register = data[0];
+		break;
+	case CCC_DIRECT_GETDCR:
+		if (length < 1) {
+			return -1;
+		}
+		discovery->device_characteristic_register = data[0];
+		break;
+	case CCC_DIRECT_GETMXDS:
+		if (length < 2) {
+			return -1;
+		}
+		discovery->inventory.max_write_speed = data[0];
+		discovery->inventory.max_read_speed = data[1];
+		/* the max read turnaround is optional and is returned LSB first */
+		if (length >= 5) {
+			discovery->inventory.max_read_turnaround_us = data[2] | (data[3] << 8) | (data[4] << 16);
+		}
+		break;
+	case CCC_DIRECT_GETMRL:
+		if (length < 2) {
+			return -1;
+		}
+		discovery->inventory.max_read_length = (data[0] << 8) | data[1];
+		break;
+	case CCC_DIRECT_GETMWL:
+		if (length < 2) {
+			return -1;
+		}
+		discovery->inventory.max_write_length = (data[0] << 8) | data[1];
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bus_inventory_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct bus_inventory_command *command = (struct bus_inventory_command *)user_data;
+
+	/* a target device that does not support the CCC NACKs it, the rest
+	 * of its CCCs are still executed */
+	if (response->attempted == USBI3C_COMMAND_ATTEMPTED &&
+	    response->error_status == USBI3C_SUCCEEDED &&
+	    discovery_parse(command->discovery, command->ccc->ccc, response->data, response->data_length) == 0) {
+		command->discovery->inventory.valid |= command->ccc->field;
+	}
+	atomic_fetch_add(&command->inventory->responses, 1);
+
+	return 0;
+}
+
+/* gets the number of target devices whose CCCs fit in one batch */
+static size_t bus_inventory_devices_per_batch(struct usbi3c_device *usbi3c_dev)
+{
+	uint32_t buffer_available = 0;
+	uint32_t device_size = 0;
+	uint32_t batch_size = 0;
+
+	/* each batch has a header in the request and another one in the response */
+	const uint32_t batch_overhead = 2 * BULK_TRANSFER_HEADER_SIZE;
+
+	for (size_t i = 0; i < DISCOVERY_CCC_COUNT; i++) {
+		device_size += (BULK_REQUEST_COMMAND_BLOCK_HEADER_SIZE +
+				BULK_REQUEST_COMMAND_DESCRIPTOR_SIZE +
+				BULK_RESPONSE_BLOCK_HEADER_SIZE +
+				BULK_RESPONSE_DESCRIPTOR_SIZE +
+				discovery_cccs[i].read_size);
+	}
+
+	if (bulk_transfer_get_buffer_available(usbi3c_dev, &buffer_available) < 0) {
+		DEBUG_PRINT("Could not get the buffer available from the I3C function, aborting...\n");
+		return 0;
+	}
+
+	batch_size = buffer_available / BUS_INVENTORY_BATCHES_IN_FLIGHT;
+	if (batch_size < batch_overhead + device_size) {
+		/* the batches cannot be pipelined, send one target device at a time */
+		return 1;
+	}
+
+	return (batch_size - batch_overhead) / device_size;
+}
+
+/* sends the CCCs of count target devices starting from the first one */
+static int bus_inventory_send_batch(struct usbi3c_device *usbi3c_dev, struct bus_inventory *inventory, size_t first, size_t count)
+{
+	struct list *batch = NULL;
+	struct list *request_ids = NULL;
+	const int NOT_APPLICABLE = 0;
+
+	for (size_t i = first * DISCOVERY_CCC_COUNT; i < (first + count) * DISCOVERY_CCC_COUNT; i++) {
+		struct bus_inventory_command *command = &inventory->commands[i];
+
+		if (bulk_transfer_enqueue_command(&batch,
+						  CCC_WITHOUT_DEFINING_BYTE,
+						  command->discovery->address,
+						  USBI3C_READ,
+						  USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK,
+						  usbi3c_dev->i3c_mode,
+						  command->ccc->ccc,
+						  NOT_APPLICABLE,
+						  NULL,
+						  command->ccc->read_size,
+						  bus_inventory_response_cb,
+						  command) < 0) {
+			bulk_transfer_free_commands(&batch);
+			return -1;
+		}
+	}
+
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, batch, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	bulk_transfer_free_commands(&batch);
+	if (request_ids == NULL) {
+		return -1;
+	}
+
+	inventory->sent += count * DISCOVERY_CCC_COUNT;
+	inventory->request_ids = list_concat(inventory->request_ids, request_ids);
+
+	return 0;
+}
+
+/* waits until the responses to all the commands sent are received */
+static int bus_inventory_wait(struct usbi3c_device *usbi3c_dev, struct bus_inventory *inventory, time_t initial_time, int timeout)
+{
+	while (atomic_load(&inventory->responses) < inventory->sent) {
+		if (timeout > 0 && (time(NULL) > initial_time + timeout)) {
+			DEBUG_PRINT("Timeout waiting for the responses of the discovery CCCs\n");
+			return -1;
+		}
+		usb_wait_for_next_event(usbi3c_dev->usb_dev);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Reads the limits of every I3C target device in the table with the discovery CCCs.
+ *
+ * The CCCs of as many target devices as fit in half of the buffer available in the
+ * I3C function are sent in a single request, and the next request is sent without
+ * waiting for the previous one to complete. If the I3C function runs out of buffer,
+ * the requests in flight are completed before sending the next one.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] timeout the maximum time in seconds to wait for the responses
+ * @return the number of target devices updated in the table, or -1 on failure
+ */
+int bus_inventory_scan(struct usbi3c_device *usbi3c_dev, int timeout)
+{
+	const struct table_snapshot *snapshot = NULL;
+	struct bus_inventory inventory = { 0 };
+	size_t devices_per_batch = 0;
+	size_t batch = 0;
+	time_t initial_time;
+	int ret = 0;
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	if (snapshot == NULL) {
+		DEBUG_PRINT("The target device table is unknown, aborting...\n");
+		return -1;
+	}
+	if (snapshot->count == 0) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		return 0;
+	}
+	inventory.discoveries = (struct target_device_discovery *)malloc_or_die(sizeof(struct target_device_discovery) * snapshot->count);
+	for (int i = 0; i < snapshot->count; i++) {
+		const struct target_device *device = &snapshot->devices[i];
+
+		/* I2C devices do not support CCCs */
+		if (device->target_address == 0 || device->device_data.target_type != USBI3C_I3C_DEVICE) {
+			continue;
+		}
+		inventory.discoveries[inventory.device_count++].address = device->target_address;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	if (inventory.device_count == 0) {
+		FREE(inventory.discoveries);
+		return 0;
+	}
+
+	inventory.commands = (struct bus_inventory_command *)malloc_or_die(sizeof(struct bus_inventory_command) * inventory.device_count * DISCOVERY_CCC_COUNT);
+	for (size_t i = 0; i < inventory.device_count * DISCOVERY_CCC_COUNT; i++) {
+		inventory.commands[i].inventory = &inventory;
+		inventory.commands[i].discovery = &inventory.discoveries[i / DISCOVERY_CCC_COUNT];
+		inventory.commands[i].ccc = &discovery_cccs[i % DISCOVERY_CCC_COUNT];
+	}
+
+	devices_per_batch = bus_inventory_devices_per_batch(usbi3c_dev);
+	if (devices_per_batch == 0) {
+		ret = -1;
+		goto FREE_AND_EXIT;
+	}
+
+	initial_time = time(NULL);
+	for (size_t first = 0; first < inventory.device_count; first += batch) {
+		batch = inventory.device_count - first;
+		if (batch > devices_per_batch) {
+			batch = devices_per_batch;
+		}
+
+		if (bus_inventory_send_batch(usbi3c_dev, &inventory, first, batch) == 0) {
+			continue;
+		}
+
+		/* the I3C function may not have room for the batch until the ones in flight complete */
+		if (inventory.sent == 0 ||
+		    bus_inventory_wait(usbi3c_dev, &inventory, initial_time, timeout) < 0 ||
+		    bus_inventory_send_batch(usbi3c_dev, &inventory, first, batch) < 0) {
+			DEBUG_PRINT("The discovery CCCs could not be sent to all the target devices\n");
+			ret = -1;
+			break;
+		}
+	}
+
+	if (bus_inventory_wait(usbi3c_dev, &inventory, initial_time, timeout) < 0) {
+		/* the commands refer to the inventory, so no callback can run after we return */
+		bulk_transfer_untrack_requests(usbi3c_dev->request_tracker->regular_requests, inventory.request_ids);
+		ret = -1;
+	}
+
+	/* store whatever was read even if the scan did not complete */
+	if (inventory.sent > 0) {
+		int updated = table_set_device_inventory(usbi3c_dev->target_device_table, inventory.discoveries, inventory.device_count);
+		if (ret == 0) {
+			ret = updated;
+		}
+	}
+
+FREE_AND_EXIT:
+	list_free_list_and_data(&inventory.request_ids, free);
+	FREE(inventory.commands);
+	FREE(inventory.discoveries);
+
+	return ret;
+}
@@ -0,0 +1,22 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __BUS_INVENTORY_I_H__
+#define __BUS_INVENTORY_I_H__
+
+#include "usbi3c_i.h"
+
+int bus_inventory_scan(struct usbi3c_device *usbi3c_dev, int timeout);
+
+#endif /* end of include guard: __BUS_INVENTORY_I_H__ */
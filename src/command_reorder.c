@@ -0,0 +1,190 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <string.h>
+
+#include "command_reorder_i.h"
+#include "target_device_table_i.h"
+
+/* target device addresses are 7 bits long */
+#define REORDER_ADDRESS_LEN 128
+
+/**
+ * @brief A command of the batch being reordered.
+ */
+struct reorder_entry {
+	struct usbi3c_command *command; ///< the command
+	uint8_t address;		///< the address of the target device of the command
+	uint8_t barrier;		///< TRUE if the command affects every target device so it cannot be moved
+	uint8_t sent;			///< TRUE if the command was already placed in the reordered batch
+};
+
+/* returns TRUE if two commands use a different transfer mode or rate */
+static int mode_switch(const struct usbi3c_command *a, const struct usbi3c_command *b)
+{
+	return a->command_descriptor->transfer_mode != b->command_descriptor->transfer_mode ||
+	       a->command_descriptor->transfer_rate != b->command_descriptor->transfer_rate;
+}
+
+/* picks the next command to send: the first one that can be sent with the mode
+ * and rate of the last command sent, or the oldest one if there is none */
+static int reorder_pick_next(struct reorder_entry *entries, uint32_t count, const struct usbi3c_command *last)
+{
+	uint8_t blocked[REORDER_ADDRESS_LEN] = { 0 };
+	int first = -1;
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct reorder_entry *entry = &entries[i];
+
+		if (entry->sent) {
+			continue;
+		}
+		if (first < 0) {
+			/* the oldest command pending can always be sent */
+			first = i;
+		} else if (entry->barrier) {
+			/* nothing can be moved ahead of a command that affects every target */
+			break;
+		} else if (blocked[entry->address]) {
+			/* commands to the same target device keep their order */
+			continue;
+		}
+		blocked[entry->address] = TRUE;
+
+		if (last == NULL || !mode_switch(last, entry->command)) {
+			return i;
+		}
+		if (entry->barrier) {
+			break;
+		}
+	}
+
+	return first;
+}
+
+/**
+ * @brief Reorders a batch of independent commands so commands with the same transfer mode and rate are sent together.
+ *
+ * Every mode switch between consecutive commands costs bus time, such as entering and
+ * exiting HDR mode. The commands are grouped by their transfer mode and rate, keeping
+ * the relative order of the commands to the same target device. Broadcast commands and
+ * target reset patterns affect every target device, so commands are not moved across them.
+ *
+ * @param[in] table the target device table, used to resolve the target handles of the commands
+ * @param[in] commands the batch of commands
+ * @param[out] reorder the reordered batch, to be freed with command_reorder_free()
+ * @return 0 if the batch was reordered, or -1 otherwise
+ */
+int command_reorder_batch(struct target_device_table *table, struct list *commands, struct command_reorder *reorder)
+{
+	struct reorder_entry *entries = NULL;
+	struct usbi3c_command *last = NULL;
+	struct list *node = NULL;
+	uint32_t *order = NULL;
+	uint32_t i = 0;
+
+	if (commands == NULL || reorder == NULL) {
+		return -1;
+	}
+	memset(reorder, 0, sizeof(struct command_reorder));
+
+	reorder->count = list_len(commands);
+	entries = (struct reorder_entry *)malloc_or_die(sizeof(struct reorder_entry) * reorder->count);
+	for (node = commands, i = 0; node; node = node->next, i++) {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+
+		if (command == NULL || command->command_descriptor == NULL) {
+			FREE(entries);
+			return -1;
+		}
+		entries[i].command = command;
+		entries[i].address = command->command_descriptor->target_address;
+		/* commands queued for a target handle are sent to its current address */
+		if (command->target_handle) {
+			table_resolve_target_handle(table, command->target_handle, &entries[i].address);
+		}
+		entries[i].address &= (REORDER_ADDRESS_LEN - 1);
+		entries[i].barrier = (entries[i].address == USBI3C_BROADCAST_ADDRESS ||
+				      command->command_descriptor->command_type == TARGET_RESET_PATTERN);
+		if (i > 0 && mode_switch(entries[i - 1].command, command)) {
+			reorder->mode_switches_before++;
+		}
+	}
+
+	order = (uint32_t *)malloc_or_die(sizeof(uint32_t) * reorder->count);
+	for (i = 0; i < reorder->count; i++) {
+		int next = reorder_pick_next(entries, reorder->count, last);
+
+		entries[next].sent = TRUE;
+		order[i] = next;
+		if (last && mode_switch(last, entries[next].command)) {
+			reorder->mode_switches_after++;
+		}
+		last = entries[next].command;
+	}
+
+	/* build the list from the end so each command is prepended */
+	for (i = reorder->count; i > 0; i--) {
+		reorder->commands = list_prepend(reorder->commands, entries[order[i - 1]].command);
+	}
+	reorder->original_index = order;
+	FREE(entries);
+
+	return 0;
+}
+
+/**
+ * @brief Puts the responses to a reordered batch back in the order the commands were queued.
+ *
+ * @param[in] reorder the reordered batch
+ * @param[in] responses the responses in the order the commands were sent
+ * @return the responses in the order the commands were queued
+ */
+struct list *command_reorder_restore_responses(struct command_reorder *reorder, struct list *responses)
+{
+	struct usbi3c_response **by_index = NULL;
+	struct list *restored = NULL;
+	struct list *node = NULL;
+	uint32_t i = 0;
+
+	if (reorder == NULL || responses == NULL || (uint32_t)list_len(responses) != reorder->count) {
+		return responses;
+	}
+
+	by_index = (struct usbi3c_response **)malloc_or_die(sizeof(struct usbi3c_response *) * reorder->count);
+	for (node = responses, i = 0; node; node = node->next, i++) {
+		by_index[reorder->original_index[i]] = (struct usbi3c_response *)node->data;
+	}
+	for (i = reorder->count; i > 0; i--) {
+		restored = list_prepend(restored, by_index[i - 1]);
+	}
+	list_free_list(&responses);
+	FREE(by_index);
+
+	return restored;
+}
+
+/**
+ * @brief Frees a reordered batch, the commands themselves are not freed.
+ *
+ * @param[in] reorder the reordered batch to free
+ */
+void command_reorder_free(struct command_reorder *reorder)
+{
+	if (reorder == NULL) {
+		return;
+	}
+	list_free_list(&reorder->commands);
+	FREE(reorder->original_index);
+}
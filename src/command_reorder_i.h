@@ -0,0 +1,35 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __COMMAND_REORDER_I_H__
+#define __COMMAND_REORDER_I_H__
+
+#include "usbi3c_i.h"
+
+/**
+ * @brief A batch of commands reordered to reduce the transfer mode and rate switches.
+ */
+struct command_reorder {
+	struct list *commands;	       ///< the commands in the order they have to be sent, the commands are shared with the original batch
+	uint32_t *original_index;      ///< position in the original batch of each command to send
+	uint32_t count;		       ///< number of commands in the batch
+	uint32_t mode_switches_before; ///< mode or rate switches between consecutive commands of the original batch
+	uint32_t mode_switches_after;  ///< mode or rate switches between consecutive commands of the reordered batch
+};
+
+int command_reorder_batch(struct target_device_table *table, struct list *commands, struct command_reorder *reorder);
+struct list *command_reorder_restore_responses(struct command_reorder *reorder, struct list *responses);
+void command_reorder_free(struct command_reorder *reorder);
+
+#endif /* end of include guard: __COMMAND_REORDER_I_H__ */
@@ -17,8 +17,10 @@
 #define __COMMON_I_H__
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define TRUE 1
 #define FALSE 0
@@ -92,4 +94,19 @@ static inline void *realloc_or_die(void *ptr, size_t size)
 	return new_ptr;
 }
 
+/**
+ * @brief Gets the current time of the monotonic clock in microseconds.
+ *
+ * The monotonic clock is not affected by changes to the system time, so it
+ * is the one used to timestamp events and measure intervals.
+ */
+static inline uint64_t monotonic_time_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000) + (uint64_t)(now.tv_nsec / 1000);
+}
+
 #endif /* end of include guard: __COMMON_I_H__ */
@@ -0,0 +1,193 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "device_cache_i.h"
+#include "usbi3c_i.h"
+
+#define DEVICE_CACHE_MAGIC 0x43334955 /* "UI3C" */
+#define DEVICE_CACHE_VERSION 1
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/**
+ * @brief The layout of a warm-start cache file.
+ */
+struct device_cache_file {
+	uint32_t magic;			 ///< identifies the file as a warm-start cache file
+	uint32_t version;		 ///< version of the layout of the file
+	struct device_cache_key key;	 ///< the I3C function the entry belongs to
+	struct device_cache_entry entry; ///< the cached state of the bus
+};
+
+/**
+ * @brief Calculates the fingerprint of a data structure received from the I3C function.
+ *
+ * The fingerprint is a 64-bit FNV-1a hash, it is only used to detect changes between
+ * runs, not to protect the data.
+ *
+ * @param[in] buffer the data structure
+ * @param[in] size the size of the data structure in bytes
+ * @return the fingerprint of the data structure
+ */
+uint64_t device_cache_fingerprint(const uint8_t *buffer, size_t size)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	if (buffer == NULL) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= buffer[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/* builds the path of the cache file of an I3C function */
+static int device_cache_path(const char *directory, const struct device_cache_key *key, char *path, size_t size)
+{
+	int len = 0;
+
+	len = snprintf(path, size, "%s/usbi3c-%04x-%04x-%016llx.cache",
+		       directory,
+		       key->vendor_id,
+		       key->product_id,
+		       (unsigned long long)key->capability_fingerprint);
+	if (len < 0 || (size_t)len >= size) {
+		DEBUG_PRINT("The warm-start cache path is too long\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Loads the warm-start cache entry of an I3C function.
+ *
+ * @param[in] directory the directory where the cache files are kept
+ * @param[in] key the identity of the I3C function
+ * @param[out] entry the cached state of the bus
+ * @return 0 if a valid entry was found for the I3C function, or -1 otherwise
+ */
+int device_cache_load(const char *directory, const struct device_cache_key *key, struct device_cache_entry *entry)
+{
+	struct device_cache_file file = { 0 };
+	char path[PATH_MAX];
+	FILE *stream = NULL;
+	size_t read = 0;
+
+	if (directory == NULL || key == NULL || entry == NULL) {
+		return -1;
+	}
+
+	if (device_cache_path(directory, key, path, sizeof(path))) {
+		return -1;
+	}
+
+	stream = fopen(path, "rb");
+	if (stream == NULL) {
+		/* this is expected the first time an I3C function is seen */
+		return -1;
+	}
+	read = fread(&file, sizeof(file), 1, stream);
+	fclose(stream);
+
+	if (read != 1 ||
+	    file.magic != DEVICE_CACHE_MAGIC ||
+	    file.version != DEVICE_CACHE_VERSION ||
+	    file.key.vendor_id != key->vendor_id ||
+	    file.key.product_id != key->product_id ||
+	    file.key.capability_fingerprint != key->capability_fingerprint) {
+		DEBUG_PRINT("Ignoring invalid warm-start cache file %s\n", path);
+		return -1;
+	}
+
+	*entry = file.entry;
+
+	return 0;
+}
+
+/**
+ * @brief Stores the warm-start cache entry of an I3C function.
+ *
+ * The entry is written to a uniquely named temporary file that is then renamed, so
+ * concurrent readers never see a partially written entry and concurrent writers
+ * never share a temporary file.
+ *
+ * @param[in] directory the directory where the cache files are kept
+ * @param[in] key the identity of the I3C function
+ * @param[in] entry the state of the bus to cache
+ * @return 0 if the entry was stored, or -1 otherwise
+ */
+int device_cache_store(const char *directory, const struct device_cache_key *key, const struct device_cache_entry *entry)
+{
+	struct device_cache_file file = { 0 };
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	FILE *stream = NULL;
+	int len = 0;
+	int fd = -1;
+
+	if (directory == NULL || key == NULL || entry == NULL) {
+		return -1;
+	}
+
+	if (device_cache_path(directory, key, path, sizeof(path))) {
+		return -1;
+	}
+	len = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	if (len < 0 || (size_t)len >= sizeof(tmp_path)) {
+		DEBUG_PRINT("The warm-start cache path is too long\n");
+		return -1;
+	}
+
+	file.magic = DEVICE_CACHE_MAGIC;
+	file.version = DEVICE_CACHE_VERSION;
+	file.key = *key;
+	file.entry = *entry;
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		DEBUG_PRINT("The warm-start cache file %s could not be created\n", tmp_path);
+		return -1;
+	}
+	stream = fdopen(fd, "wb");
+	if (stream == NULL) {
+		DEBUG_PRINT("The warm-start cache file %s could not be opened\n", tmp_path);
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+	if (fwrite(&file, sizeof(file), 1, stream) != 1) {
+		DEBUG_PRINT("The warm-start cache file %s could not be written\n", tmp_path);
+		fclose(stream);
+		unlink(tmp_path);
+		return -1;
+	}
+	if (fclose(stream) != 0 || rename(tmp_path, path) != 0) {
+		DEBUG_PRINT("The warm-start cache file %s could not be written\n", path);
+		unlink(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __DEVICE_CACHE_I_H__
+#define __DEVICE_CACHE_I_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Identifies the I3C function a warm-start cache entry belongs to.
+ */
+struct device_cache_key {
+	uint16_t vendor_id;		 ///< USB vendor ID of the I3C function
+	uint16_t product_id;		 ///< USB product ID of the I3C function
+	uint64_t capability_fingerprint; ///< fingerprint of the I3C capability data structure reported by the I3C function
+};
+
+/**
+ * @brief The state of the bus that was reached the last time the I3C function was initialized.
+ */
+struct device_cache_entry {
+	uint64_t table_fingerprint; ///< fingerprint of the target device table once every target device was configured
+};
+
+uint64_t device_cache_fingerprint(const uint8_t *buffer, size_t size);
+int device_cache_load(const char *directory, const struct device_cache_key *key, struct device_cache_entry *entry);
+int device_cache_store(const char *directory, const struct device_cache_key *key, const struct device_cache_entry *entry);
+
+#endif /* end of include guard: __DEVICE_CACHE_I_H__ */
@@ -12,6 +12,10 @@
  *   version 2.1 as published by the Free Software Foundation.             *
  *                                                                         *
  ***************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
 #include "ibi_i.h"
 #include "usbi3c_i.h"
 
@@ -19,9 +23,48 @@
  * @brief A structure that represent an IBI notification entry
  */
 struct ibi_entry {
-	uint8_t report;	     ///< cause of IBI notification
-	on_ibi_fn on_ibi_cb; ///< function to be called when the IBI is completed
-	void *user_data;     ///< user data to share with the function callback
+	uint8_t report;		       ///< cause of IBI notification
+	on_ibi_fn on_ibi_cb;	       ///< function to be called when the IBI is completed
+	void *user_data;	       ///< user data to share with the function callback
+	uint64_t notification_time_us; ///< host monotonic time the IBI notification was received
+};
+
+/* maps the IBI prioritization of a target device to its priority level */
+#define IBI_PRIORITY_LEVEL(prioritization) ((prioritization) / (256 / USBI3C_IBI_PRIORITY_LEVELS))
+
+/**
+ * @brief A completed IBI waiting to be delivered to the user
+ */
+struct ibi_pending {
+	uint8_t report;		       ///< cause of IBI notification
+	struct ibi_response *response; ///< the completed IBI response
+	on_ibi_fn on_ibi_cb;	       ///< function to be called with the IBI
+	void *user_data;	       ///< user data to share with the function callback
+	uint8_t level;		       ///< priority level of the target device that issued the IBI
+	uint64_t queued_us;	       ///< host monotonic time the IBI was completed
+};
+
+/**
+ * @brief A completed IBI waiting in the poll queue
+ */
+struct ibi_poll_entry {
+	struct usbi3c_ibi_record record; ///< the completed IBI
+	uint8_t level;			 ///< priority level of the target device that issued the IBI
+	uint64_t queued_us;		 ///< host monotonic time the IBI was completed
+};
+
+/**
+ * @brief A bounded ring buffer of completed IBIs waiting to be polled by the user
+ */
+struct ibi_poll_queue {
+	struct ibi_poll_entry *entries; ///< storage for the completed IBIs, NULL if polling is disabled
+	size_t capacity;		///< max number of entries the queue can hold
+	size_t first;			///< index of the first entry to be polled
+	size_t count;			///< number of entries currently in the queue
+	uint32_t overruns;		///< number of completed IBIs dropped because the queue was full
+	uint8_t levels[128];		///< priority level of the last IBI queued from each target device address
+	pthread_mutex_t *mutex;		///< mutex to protect the queue and the priority statistics from concurrent access
+	pthread_cond_t *available;	///< condition signaled every time an entry is added to the queue
 };
 
 /**
@@ -32,6 +75,20 @@ struct ibi {
 	struct ibi_response_queue *response_queue; ///< IBI response queue to handle IBI responses
 	on_ibi_fn on_ibi_cb;			   ///< callback to be assigned to the ibi_entry and called once the IBI is completed
 	void *user_data;			   ///< user_data to be assigned to the ibi_entry and used once the IBI is completed
+	struct ibi_poll_queue poll;		   ///< queue of completed IBIs for users that poll for them
+	struct ibi_storm *storm;		   ///< rate limits and coalesces IBIs from misbehaving target devices
+	on_ibi_storm_fn on_ibi_storm_cb;	   ///< callback to be called when a target device exceeds the IBI storm threshold
+	void *storm_user_data;			   ///< user_data to share with the IBI storm callback
+	ibi_storm_target_fn storm_target_cb;	   ///< function to get the identity of a target device in the IBI storm protection, NULL to use its address
+	void *storm_target_user_data;		   ///< user data to share with the identity function
+	on_ibi_chunk_fn on_ibi_chunk_cb;	   ///< callback to stream the payload of IBIs with pending reads, NULL to buffer it
+	void *chunk_user_data;			   ///< user_data to share with the chunk callback
+	pthread_mutex_t *chunk_mutex;		   ///< mutex to protect the chunk callback from concurrent access
+	struct ibi_clock *clock;		   ///< maps the timestamps of the I3C function to the host clock
+	enum usbi3c_ibi_delivery_order order;	   ///< order in which completed IBIs are delivered
+	ibi_priority_fn priority_cb;		   ///< function to get the IBI prioritization of a target device
+	void *priority_user_data;		   ///< user data to share with the priority function
+	struct usbi3c_ibi_priority_stats stats[USBI3C_IBI_PRIORITY_LEVELS]; ///< delivery statistics of each priority level
 };
 
 /**
@@ -44,7 +101,12 @@ void ibi_handle_notification(struct notification *notification, void *user_data)
 {
 	struct ibi *ibi = (struct ibi *)user_data;
 	struct ibi_entry *entry;
+	if (ibi->head == NULL && ibi_response_queue_take_dropped(ibi->response_queue)) {
+		/* the IBI was dropped by the rate limit of its target device */
+		return;
+	}
 	entry = malloc_or_die(sizeof(struct ibi_entry));
+	entry->notification_time_us = monotonic_time_us();
 	entry->report = notification->code;
 	entry->on_ibi_cb = ibi->on_ibi_cb;
 	entry->user_data = ibi->user_data;
@@ -52,6 +114,59 @@ void ibi_handle_notification(struct notification *notification, void *user_data)
 	ibi_call_pending(ibi);
 }
 
+/* gets the identity of a target device in the IBI storm protection */
+static uint32_t ibi_storm_target(struct ibi *ibi, uint8_t address)
+{
+	if (ibi->storm_target_cb) {
+		return ibi->storm_target_cb(address, ibi->storm_target_user_data);
+	}
+
+	return address;
+}
+
+/* drops an IBI before its response is queued if its target device exceeded its rate limit */
+static int ibi_admit(const struct usbi3c_ibi *descriptor, void *user_data)
+{
+	struct ibi *ibi = (struct ibi *)user_data;
+	enum ibi_storm_verdict verdict;
+	uint32_t target_id = ibi_storm_target(ibi, descriptor->address);
+
+	verdict = ibi_storm_admit(ibi->storm, target_id, monotonic_time_us());
+	if (verdict == IBI_STORM_DISABLE_TARGET && ibi->on_ibi_storm_cb) {
+		ibi->on_ibi_storm_cb(target_id, ibi->storm_user_data);
+	}
+
+	return verdict == IBI_STORM_DELIVER;
+}
+
+/**
+ * @brief Function to handle IBI responses
+ *
+ * IBIs from target devices that exceeded their rate limit are dropped as soon as
+ * their response starts to be received, the rest are queued until completed.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] data data content of the IBI response
+ * @param[in] size the size of the IBI response
+ * @return 0 if the IBI response was handled, or -1 otherwise
+ */
+int ibi_handle_response(struct ibi *ibi, uint8_t *data, size_t size)
+{
+	struct ibi_response_handlers handlers = { 0 };
+
+	if (ibi == NULL) {
+		return -1;
+	}
+	handlers.admit_cb = ibi_admit;
+	handlers.user_data = ibi;
+	pthread_mutex_lock(ibi->chunk_mutex);
+	handlers.on_ibi_chunk_cb = ibi->on_ibi_chunk_cb;
+	handlers.chunk_user_data = ibi->chunk_user_data;
+	pthread_mutex_unlock(ibi->chunk_mutex);
+
+	return ibi_response_handle(ibi->response_queue, data, size, &handlers);
+}
+
 /**
  * @brief destroy an IBI structure
  *
@@ -63,6 +178,15 @@ void ibi_destroy(struct ibi **ibi)
 		return;
 	}
 	list_free_list_and_data(&(*ibi)->head, free);
+	ibi_disable_polling(*ibi);
+	ibi_storm_destroy(&(*ibi)->storm);
+	ibi_clock_destroy(&(*ibi)->clock);
+	pthread_cond_destroy((*ibi)->poll.available);
+	FREE((*ibi)->poll.available);
+	pthread_mutex_destroy((*ibi)->poll.mutex);
+	FREE((*ibi)->poll.mutex);
+	pthread_mutex_destroy((*ibi)->chunk_mutex);
+	FREE((*ibi)->chunk_mutex);
 	FREE(*ibi);
 }
 
@@ -81,8 +205,22 @@ struct ibi *ibi_init(struct ibi_response_queue *response_queue)
 	}
 
 	struct ibi *ibi;
+	pthread_condattr_t attr;
 	ibi = malloc_or_die(sizeof(struct ibi));
 	ibi->response_queue = response_queue;
+	ibi->poll.mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(ibi->poll.mutex, NULL);
+	ibi->chunk_mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(ibi->chunk_mutex, NULL);
+	/* timeouts for the poll queue are measured against the monotonic clock
+	 * so they are not affected by changes to the system time */
+	ibi->poll.available = (pthread_cond_t *)malloc_or_die(sizeof(pthread_cond_t));
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(ibi->poll.available, &attr);
+	pthread_condattr_destroy(&attr);
+	ibi->storm = ibi_storm_init();
+	ibi->clock = ibi_clock_init();
 	return ibi;
 }
 /**
@@ -101,39 +239,569 @@ void ibi_set_callback(struct ibi *ibi, on_ibi_fn on_ibi_cb, void *user_data)
 	ibi->user_data = user_data;
 }
 
+/**
+ * @brief Function to set callback to stream the payload of IBIs with pending reads
+ *
+ * The callback only applies to the IBI responses received for this device, it can
+ * be changed while IBI responses are being received, in which case it is used from the
+ * next IBI on, an IBI that is partially received keeps the mode it was started with.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] on_ibi_chunk_cb callback to be called with every payload fragment, NULL to buffer the payload instead
+ * @param[in] user_data data to share with the function callback
+ */
+void ibi_set_chunk_callback(struct ibi *ibi, on_ibi_chunk_fn on_ibi_chunk_cb, void *user_data)
+{
+	if (ibi == NULL) {
+		return;
+	}
+	pthread_mutex_lock(ibi->chunk_mutex);
+	ibi->on_ibi_chunk_cb = on_ibi_chunk_cb;
+	ibi->chunk_user_data = user_data;
+	pthread_mutex_unlock(ibi->chunk_mutex);
+}
+
+/* records the time a completed IBI waited to be delivered, must be called with the poll mutex locked */
+static void ibi_record_delay(struct ibi *ibi, uint8_t level, uint64_t queued_us, uint64_t now_us)
+{
+	struct usbi3c_ibi_priority_stats *stats = &ibi->stats[level];
+	uint64_t delay_us = now_us > queued_us ? now_us - queued_us : 0;
+
+	stats->delivered++;
+	stats->total_delay_us += delay_us;
+	if (delay_us > stats->max_delay_us) {
+		stats->max_delay_us = delay_us;
+	}
+}
+
+/* delivers a completed IBI to the user callback and to the poll queue */
+static void ibi_deliver(struct ibi *ibi, struct ibi_pending *pending)
+{
+	struct ibi_response *response = pending->response;
+
+	if (pending->on_ibi_cb) {
+		pending->on_ibi_cb(pending->report,
+				   &response->descriptor,
+				   response->data,
+				   response->size,
+				   pending->user_data);
+	}
+	if (ibi_poll_queue_push(ibi, pending) == 0) {
+		/* the poll queue took ownership of the payload, the delay
+		 * is recorded once the user polls the IBI */
+		response->data = NULL;
+	} else {
+		pthread_mutex_lock(ibi->poll.mutex);
+		ibi_record_delay(ibi, pending->level, pending->queued_us, monotonic_time_us());
+		pthread_mutex_unlock(ibi->poll.mutex);
+	}
+	FREE(response->data);
+	FREE(pending->response);
+}
+
+/* adds a completed IBI to the list of IBIs to be delivered, when delivering by priority
+ * it goes after every IBI with the same or higher priority so the order of the IBIs
+ * from each target device is kept */
+static void ibi_stage(struct ibi *ibi, struct ibi_pending **staged, size_t *count, struct ibi_pending *pending)
+{
+	size_t position = *count;
+
+	pending->level = 0;
+	if (ibi->priority_cb) {
+		pending->level = IBI_PRIORITY_LEVEL(ibi->priority_cb(pending->response->descriptor.address, ibi->priority_user_data));
+	}
+	*staged = (struct ibi_pending *)realloc_or_die(*staged, (*count + 1) * sizeof(struct ibi_pending));
+	if (ibi->order == USBI3C_IBI_DELIVERY_PRIORITY) {
+		while (position > 0 && (*staged)[position - 1].level > pending->level) {
+			(*staged)[position] = (*staged)[position - 1];
+			position--;
+		}
+	}
+	(*staged)[position] = *pending;
+	(*count)++;
+}
+
+/* adds the summary of IBIs coalesced during a window to the list of IBIs to be delivered,
+ * summaries carry no payload */
+static void ibi_stage_summary(struct ibi *ibi, struct ibi_pending **staged, size_t *count, on_ibi_fn on_ibi_cb, void *user_data, struct ibi_storm_summary *summary)
+{
+	struct ibi_pending pending = { 0 };
+
+	pending.report = summary->report;
+	pending.response = (struct ibi_response *)malloc_or_die(sizeof(struct ibi_response));
+	pending.response->descriptor = summary->descriptor;
+	pending.response->completed = TRUE;
+	pending.on_ibi_cb = on_ibi_cb;
+	pending.user_data = user_data;
+	pending.queued_us = monotonic_time_us();
+	ibi_stage(ibi, staged, count, &pending);
+}
+
 /**
  * @brief Function to get ibi info that has been completed and execute its callback
  *
+ * Completed IBIs go through the IBI storm protection first, so they can be coalesced
+ * with previous identical IBIs. Summaries of coalescing windows that have expired are
+ * delivered as well. The notifications of the IBIs dropped by the rate limit of their
+ * target device are discarded.
+ *
+ * When IBIs are delivered by priority, every completed IBI available is collected and
+ * they are delivered starting with the ones from the target devices with higher priority.
+ *
  * @param[in] ibi structure to handle IBI notification
  */
 void ibi_call_pending(struct ibi *ibi)
 {
+	struct ibi_storm_summary summary;
+	enum ibi_storm_verdict verdict;
+	struct ibi_pending *staged = NULL;
+	size_t count = 0;
+
 	if (ibi == NULL) {
 		return;
 	}
 
-	if (!ibi_response_queue_size(ibi->response_queue) || !ibi->head) {
+	while (ibi_storm_pop_expired(ibi->storm, monotonic_time_us(), &summary)) {
+		ibi_stage_summary(ibi, &staged, &count, ibi->on_ibi_cb, ibi->user_data, &summary);
+	}
+
+	do {
+		while (ibi->head && ibi_response_queue_take_dropped(ibi->response_queue)) {
+			struct list *head = ibi->head;
+
+			ibi->head = head->next;
+			FREE(head->data);
+			FREE(head);
+		}
+		if (!ibi_response_queue_size(ibi->response_queue) || !ibi->head) {
+			break;
+		}
+
+		if (!ibi_response_queue_front(ibi->response_queue)->completed) {
+			break;
+		}
+
+		struct list *head = ibi->head;
+		struct ibi_entry *entry = head->data;
+		struct ibi_response *response = ibi_response_queue_dequeue(ibi->response_queue);
+		struct ibi_pending pending = { 0 };
+
+		response->descriptor.notification_time_us = entry->notification_time_us;
+		if (response->descriptor.ibi_timestamp) {
+			ibi_clock_add_sample(ibi->clock, response->descriptor.device_timestamp, response->descriptor.response_time_us);
+		}
+		pending.queued_us = monotonic_time_us();
+		verdict = ibi_storm_filter(ibi->storm, ibi_storm_target(ibi, response->descriptor.address), entry->report, &response->descriptor, pending.queued_us, &summary);
+		if (summary.descriptor.repeat_count) {
+			ibi_stage_summary(ibi, &staged, &count, entry->on_ibi_cb, entry->user_data, &summary);
+		}
+		if (verdict == IBI_STORM_DELIVER) {
+			pending.report = entry->report;
+			pending.response = response;
+			pending.on_ibi_cb = entry->on_ibi_cb;
+			pending.user_data = entry->user_data;
+			ibi_stage(ibi, &staged, &count, &pending);
+		} else {
+			FREE(response->data);
+			FREE(response);
+		}
+		ibi->head = head->next;
+		FREE(entry);
+		FREE(head);
+	} while (ibi->order == USBI3C_IBI_DELIVERY_PRIORITY);
+
+	for (size_t i = 0; i < count; i++) {
+		ibi_deliver(ibi, &staged[i]);
+	}
+	FREE(staged);
+}
+
+/* adds a completed IBI to the poll queue, must be called with the poll mutex locked */
+static int ibi_poll_queue_insert(struct ibi *ibi, struct ibi_pending *pending)
+{
+	struct ibi_poll_entry *entry = NULL;
+	size_t position = 0;
+
+	if (ibi->poll.entries == NULL) {
+		return -1;
+	}
+	if (ibi->poll.count == ibi->poll.capacity) {
+		DEBUG_PRINT("The IBI poll queue is full, dropping IBI from address %d\n", pending->response->descriptor.address);
+		ibi->poll.overruns++;
+		return -1;
+	}
+	position = ibi->poll.count;
+	if (ibi->order == USBI3C_IBI_DELIVERY_PRIORITY) {
+		while (position > 0 && ibi->poll.entries[(ibi->poll.first + position - 1) % ibi->poll.capacity].level > pending->level) {
+			ibi->poll.entries[(ibi->poll.first + position) % ibi->poll.capacity] = ibi->poll.entries[(ibi->poll.first + position - 1) % ibi->poll.capacity];
+			position--;
+		}
+	}
+	entry = &ibi->poll.entries[(ibi->poll.first + position) % ibi->poll.capacity];
+	entry->record.report = pending->report;
+	entry->record.descriptor = pending->response->descriptor;
+	entry->record.data = pending->response->data;
+	entry->record.size = pending->response->size;
+	entry->level = pending->level;
+	entry->queued_us = pending->queued_us;
+	ibi->poll.levels[pending->response->descriptor.address & 0x7F] = pending->level;
+	ibi->poll.count++;
+	pthread_cond_broadcast(ibi->poll.available);
+
+	return 0;
+}
+
+/**
+ * @brief Adds a completed IBI to the poll queue and wakes up any waiting consumer.
+ *
+ * When IBIs are delivered by priority, the IBI is placed after every IBI in the queue
+ * with the same or higher priority.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] pending the completed IBI, its payload is owned by the queue on success
+ * @return 0 if the IBI was added to the queue, or -1 if polling is disabled or the queue is full
+ */
+int ibi_poll_queue_push(struct ibi *ibi, struct ibi_pending *pending)
+{
+	int ret = -1;
+
+	if (ibi == NULL || pending == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	ret = ibi_poll_queue_insert(ibi, pending);
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return ret;
+}
+
+/* queues the summaries of the coalescing windows that expired, so they don't have to wait
+ * for another IBI to be received, must be called with the poll mutex locked. The summaries
+ * are popped and queued under the same lock so they can't be queued after a later IBI from
+ * the same target device, and they are not passed to the IBI callback since that is only
+ * called from the thread that handles the IBI responses */
+static void ibi_poll_queue_flush_expired(struct ibi *ibi)
+{
+	struct ibi_storm_summary summary;
+	struct ibi_response response = { 0 };
+	struct ibi_pending pending = { 0 };
+
+	while (ibi_storm_pop_expired(ibi->storm, monotonic_time_us(), &summary)) {
+		response.descriptor = summary.descriptor;
+		response.completed = TRUE;
+		pending.report = summary.report;
+		pending.response = &response;
+		pending.level = ibi->poll.levels[summary.descriptor.address & 0x7F];
+		pending.queued_us = monotonic_time_us();
+		ibi_poll_queue_insert(ibi, &pending);
+	}
+}
+
+/**
+ * @brief Enables the queue used to poll for completed IBIs.
+ *
+ * If polling was already enabled the queue is resized, records that do not fit
+ * in the new queue are dropped and counted as overruns.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] max_records max number of completed IBIs the queue can hold
+ * @return 0 if polling was enabled, or -1 otherwise
+ */
+int ibi_enable_polling(struct ibi *ibi, size_t max_records)
+{
+	struct ibi_poll_entry *entries = NULL;
+	size_t count = 0;
+
+	if (ibi == NULL || max_records == 0) {
+		return -1;
+	}
+
+	entries = (struct ibi_poll_entry *)malloc_or_die(max_records * sizeof(struct ibi_poll_entry));
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	while (ibi->poll.count > 0) {
+		struct ibi_poll_entry *oldest = &ibi->poll.entries[ibi->poll.first];
+		if (count < max_records) {
+			entries[count++] = *oldest;
+		} else {
+			FREE(oldest->record.data);
+			ibi->poll.overruns++;
+		}
+		ibi->poll.first = (ibi->poll.first + 1) % ibi->poll.capacity;
+		ibi->poll.count--;
+	}
+	FREE(ibi->poll.entries);
+	ibi->poll.entries = entries;
+	ibi->poll.capacity = max_records;
+	ibi->poll.first = 0;
+	ibi->poll.count = count;
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return 0;
+}
+
+/**
+ * @brief Disables the queue used to poll for completed IBIs.
+ *
+ * Any IBI still in the queue is discarded, and consumers waiting for IBIs are woken up.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ */
+void ibi_disable_polling(struct ibi *ibi)
+{
+	if (ibi == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	while (ibi->poll.count > 0) {
+		FREE(ibi->poll.entries[ibi->poll.first].record.data);
+		ibi->poll.first = (ibi->poll.first + 1) % ibi->poll.capacity;
+		ibi->poll.count--;
+	}
+	FREE(ibi->poll.entries);
+	ibi->poll.capacity = 0;
+	ibi->poll.first = 0;
+	pthread_cond_broadcast(ibi->poll.available);
+	pthread_mutex_unlock(ibi->poll.mutex);
+}
+
+/**
+ * @brief Moves completed IBIs from the poll queue to a user provided array without blocking.
+ *
+ * The summaries of the coalescing windows that expired are queued first.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[out] records array where the completed IBIs are copied to
+ * @param[in] max the max number of records that fit in the array
+ * @return the number of records copied, or -1 if polling is disabled
+ */
+int ibi_poll(struct ibi *ibi, struct usbi3c_ibi_record *records, size_t max)
+{
+	uint64_t now_us = 0;
+	int copied = 0;
+
+	if (ibi == NULL || records == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	if (ibi->poll.entries == NULL) {
+		copied = -1;
+		goto UNLOCK_AND_EXIT;
+	}
+	ibi_poll_queue_flush_expired(ibi);
+	now_us = monotonic_time_us();
+	while (ibi->poll.count > 0 && (size_t)copied < max) {
+		struct ibi_poll_entry *entry = &ibi->poll.entries[ibi->poll.first];
+		ibi_record_delay(ibi, entry->level, entry->queued_us, now_us);
+		records[copied++] = entry->record;
+		ibi->poll.first = (ibi->poll.first + 1) % ibi->poll.capacity;
+		ibi->poll.count--;
+	}
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return copied;
+}
+
+/**
+ * @brief Blocks until there is at least one completed IBI in the poll queue.
+ *
+ * The summaries of the coalescing windows that expire while waiting are queued as
+ * they expire, so a wait is not only woken up by the IBIs received.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] timeout_us max time to wait in microseconds, a negative value waits indefinitely
+ * @return the number of completed IBIs in the queue, 0 if the timeout expired, or -1 if polling is disabled
+ */
+int ibi_wait(struct ibi *ibi, int timeout_us)
+{
+	struct timespec wake;
+	uint64_t deadline_us = 0;
+	uint64_t wake_us = 0;
+	int ret = 0;
+
+	if (ibi == NULL) {
+		return -1;
+	}
+
+	if (timeout_us > 0) {
+		deadline_us = monotonic_time_us() + (uint64_t)timeout_us;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	for (;;) {
+		if (ibi->poll.entries == NULL) {
+			ret = -1;
+			break;
+		}
+		ibi_poll_queue_flush_expired(ibi);
+		if (ibi->poll.count > 0 || timeout_us == 0 || (timeout_us > 0 && monotonic_time_us() >= deadline_us)) {
+			ret = (int)ibi->poll.count;
+			break;
+		}
+
+		/* wake up when the timeout or the next coalescing window expires, whichever is first */
+		wake_us = deadline_us;
+		if (ibi_storm_next_expiry(ibi->storm, &wake_us) && timeout_us > 0 && wake_us > deadline_us) {
+			wake_us = deadline_us;
+		}
+		if (wake_us == 0) {
+			ret = pthread_cond_wait(ibi->poll.available, ibi->poll.mutex);
+		} else {
+			wake.tv_sec = (time_t)(wake_us / 1000000);
+			wake.tv_nsec = (long)(wake_us % 1000000) * 1000;
+			ret = pthread_cond_timedwait(ibi->poll.available, ibi->poll.mutex, &wake);
+		}
+		if (ret != 0 && ret != ETIMEDOUT) {
+			ret = -1;
+			break;
+		}
+		ret = 0;
+	}
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Gets the number of completed IBIs dropped because the poll queue was full.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @return the number of IBIs dropped
+ */
+uint32_t ibi_get_poll_overruns(struct ibi *ibi)
+{
+	uint32_t overruns = 0;
+
+	if (ibi == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	overruns = ibi->poll.overruns;
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return overruns;
+}
+
+/**
+ * @brief Gets the IBI storm protection used by the IBI handler.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @return the IBI storm protection structure, or NULL if the IBI structure is missing
+ */
+struct ibi_storm *ibi_get_storm(struct ibi *ibi)
+{
+	if (ibi == NULL) {
+		return NULL;
+	}
+
+	return ibi->storm;
+}
+
+/**
+ * @brief Function to set callback to call when a target device exceeds the IBI storm threshold
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] on_ibi_storm_cb callback to be called with the identity of the target device that has to be disabled
+ * @param[in] user_data data to share with the function callback
+ */
+void ibi_set_storm_callback(struct ibi *ibi, on_ibi_storm_fn on_ibi_storm_cb, void *user_data)
+{
+	if (ibi == NULL) {
 		return;
 	}
+	ibi->on_ibi_storm_cb = on_ibi_storm_cb;
+	ibi->storm_user_data = user_data;
+}
+
+/**
+ * @brief Function to set the function used to identify target devices in the IBI storm protection
+ *
+ * Without this function the target devices are identified by their address.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] storm_target_cb function that returns the identity of the target device at an address
+ * @param[in] user_data data to share with the function
+ */
+void ibi_set_storm_target_callback(struct ibi *ibi, ibi_storm_target_fn storm_target_cb, void *user_data)
+{
+	if (ibi == NULL) {
+		return;
+	}
+	ibi->storm_target_cb = storm_target_cb;
+	ibi->storm_target_user_data = user_data;
+}
+
+/**
+ * @brief Gets the structure that maps the timestamps of the I3C function to the host clock.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @return the IBI clock correlation structure, or NULL if the IBI structure is missing
+ */
+struct ibi_clock *ibi_get_clock(struct ibi *ibi)
+{
+	if (ibi == NULL) {
+		return NULL;
+	}
 
-	if (!ibi_response_queue_front(ibi->response_queue)->completed) {
+	return ibi->clock;
+}
+
+/**
+ * @brief Sets the order in which completed IBIs are delivered.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] order the order in which completed IBIs are delivered
+ */
+void ibi_set_delivery_order(struct ibi *ibi, enum usbi3c_ibi_delivery_order order)
+{
+	if (ibi == NULL) {
 		return;
 	}
 
-	struct list *head = ibi->head;
-	struct ibi_entry *entry = head->data;
-	struct ibi_response *response = ibi_response_queue_dequeue(ibi->response_queue);
+	pthread_mutex_lock(ibi->poll.mutex);
+	ibi->order = order;
+	pthread_mutex_unlock(ibi->poll.mutex);
+}
 
-	if (entry->on_ibi_cb) {
-		entry->on_ibi_cb(entry->report,
-				 &response->descriptor,
-				 response->data,
-				 response->size,
-				 entry->user_data);
+/**
+ * @brief Function to set the function used to get the IBI prioritization of a target device
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] priority_cb function that returns the IBI prioritization of a target device (lower values = higher priority)
+ * @param[in] user_data data to share with the function
+ */
+void ibi_set_priority_callback(struct ibi *ibi, ibi_priority_fn priority_cb, void *user_data)
+{
+	if (ibi == NULL) {
+		return;
 	}
-	ibi->head = head->next;
-	FREE(entry);
-	FREE(head);
-	FREE(response->data);
-	FREE(response);
+	ibi->priority_cb = priority_cb;
+	ibi->priority_user_data = user_data;
+}
+
+/**
+ * @brief Gets the delivery statistics of the IBIs of one priority level.
+ *
+ * @param[in] ibi structure to handle IBI notification
+ * @param[in] level the priority level, 0 being the highest priority
+ * @param[out] stats the delivery statistics of the priority level
+ * @return 0 if the statistics were retrieved, or -1 otherwise
+ */
+int ibi_get_priority_stats(struct ibi *ibi, uint8_t level, struct usbi3c_ibi_priority_stats *stats)
+{
+	if (ibi == NULL || stats == NULL || level >= USBI3C_IBI_PRIORITY_LEVELS) {
+		return -1;
+	}
+
+	pthread_mutex_lock(ibi->poll.mutex);
+	*stats = ibi->stats[level];
+	pthread_mutex_unlock(ibi->poll.mutex);
+
+	return 0;
 }
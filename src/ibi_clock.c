@@ -0,0 +1,223 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+
+#include "ibi_clock_i.h"
+#include "usbi3c_i.h"
+
+/* number of recent (device, host) timestamp pairs used to correlate the clocks */
+#define IBI_CLOCK_SAMPLES 32
+
+/**
+ * @brief A pair of timestamps taken by the I3C function and by the host for the same IBI
+ */
+struct ibi_clock_sample {
+	int64_t device_ticks; ///< device timestamp extended to 64 bits so it does not wrap around
+	uint64_t host_us;     ///< host monotonic time the IBI response was received
+};
+
+/**
+ * @brief A structure used to map timestamps of the I3C function to the host monotonic clock
+ *
+ * The mapping is a line fitted to the most recent samples: its slope is the rate of the
+ * device clock as seen from the host, which corrects the drift between the two clocks,
+ * and its offset follows the lower envelope of the samples, which is the one least
+ * affected by the time it takes the IBI to reach the host.
+ */
+struct ibi_clock {
+	struct ibi_clock_sample samples[IBI_CLOCK_SAMPLES]; ///< ring buffer of the most recent samples
+	size_t count;					    ///< number of valid samples in the ring buffer
+	size_t next;					    ///< index where the next sample is stored
+	uint32_t last_timestamp;			    ///< last device timestamp received, used to detect wraparounds
+	int64_t last_ticks;				    ///< last device timestamp extended to 64 bits
+	uint8_t valid;					    ///< TRUE once there are enough samples to map timestamps
+	double us_per_tick;				    ///< slope of the mapping
+	int64_t reference_ticks;			    ///< device timestamp of the mapping origin
+	double reference_us;				    ///< host time of the mapping origin
+	pthread_mutex_t *mutex;				    ///< mutex to protect the mapping from concurrent access
+};
+
+/**
+ * @brief Creates a new IBI clock correlation structure.
+ *
+ * @return a new IBI clock correlation structure
+ */
+struct ibi_clock *ibi_clock_init(void)
+{
+	struct ibi_clock *clock = NULL;
+
+	clock = (struct ibi_clock *)malloc_or_die(sizeof(struct ibi_clock));
+	clock->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(clock->mutex, NULL);
+
+	return clock;
+}
+
+/**
+ * @brief Destroys an IBI clock correlation structure.
+ *
+ * @param[in] clock the IBI clock correlation structure to destroy
+ */
+void ibi_clock_destroy(struct ibi_clock **clock)
+{
+	if (clock == NULL || *clock == NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy((*clock)->mutex);
+	FREE((*clock)->mutex);
+	FREE(*clock);
+}
+
+/* fits the mapping to the samples available, must be called with the mutex locked */
+static void ibi_clock_fit(struct ibi_clock *clock)
+{
+	struct ibi_clock_sample *origin = &clock->samples[(clock->next + IBI_CLOCK_SAMPLES - 1) % IBI_CLOCK_SAMPLES];
+	double mean_ticks = 0;
+	double mean_us = 0;
+	double covariance = 0;
+	double variance = 0;
+	double min_offset = 0;
+
+	if (clock->count < 2) {
+		return;
+	}
+
+	/* values are taken relative to the newest sample to keep precision */
+	for (size_t i = 0; i < clock->count; i++) {
+		mean_ticks += (double)(clock->samples[i].device_ticks - origin->device_ticks);
+		mean_us += (double)clock->samples[i].host_us - (double)origin->host_us;
+	}
+	mean_ticks /= clock->count;
+	mean_us /= clock->count;
+
+	for (size_t i = 0; i < clock->count; i++) {
+		double ticks = (double)(clock->samples[i].device_ticks - origin->device_ticks) - mean_ticks;
+		double us = (double)clock->samples[i].host_us - (double)origin->host_us - mean_us;
+		covariance += ticks * us;
+		variance += ticks * ticks;
+	}
+	if (variance == 0 || covariance <= 0) {
+		return;
+	}
+	clock->us_per_tick = covariance / variance;
+
+	/* the sample that took the least time to reach the host sets the offset */
+	for (size_t i = 0; i < clock->count; i++) {
+		double offset = ((double)clock->samples[i].host_us - (double)origin->host_us) -
+				(clock->us_per_tick * (double)(clock->samples[i].device_ticks - origin->device_ticks));
+		if (i == 0 || offset < min_offset) {
+			min_offset = offset;
+		}
+	}
+	clock->reference_ticks = origin->device_ticks;
+	clock->reference_us = (double)origin->host_us + min_offset;
+	clock->valid = TRUE;
+}
+
+/**
+ * @brief Adds a new pair of timestamps of the same IBI and updates the mapping.
+ *
+ * @param[in] clock the IBI clock correlation structure
+ * @param[in] device_timestamp the timestamp of the IBI given by the I3C function
+ * @param[in] host_time_us the host monotonic time the IBI response was received
+ */
+void ibi_clock_add_sample(struct ibi_clock *clock, uint32_t device_timestamp, uint64_t host_time_us)
+{
+	struct ibi_clock_sample *sample = NULL;
+
+	if (clock == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(clock->mutex);
+	if (clock->count > 0) {
+		clock->last_ticks += (uint32_t)(device_timestamp - clock->last_timestamp);
+	} else {
+		clock->last_ticks = device_timestamp;
+	}
+	clock->last_timestamp = device_timestamp;
+
+	sample = &clock->samples[clock->next];
+	sample->device_ticks = clock->last_ticks;
+	sample->host_us = host_time_us;
+	clock->next = (clock->next + 1) % IBI_CLOCK_SAMPLES;
+	if (clock->count < IBI_CLOCK_SAMPLES) {
+		clock->count++;
+	}
+	ibi_clock_fit(clock);
+	pthread_mutex_unlock(clock->mutex);
+}
+
+/**
+ * @brief Maps a timestamp of the I3C function to the host monotonic clock.
+ *
+ * The timestamp has to be within half the range of the device counter from the last
+ * timestamp received.
+ *
+ * @param[in] clock the IBI clock correlation structure
+ * @param[in] device_timestamp the timestamp given by the I3C function
+ * @param[out] host_time_us the host monotonic time in microseconds
+ * @return 0 if the timestamp was mapped, or -1 if there are not enough samples yet
+ */
+int ibi_clock_device_to_host(struct ibi_clock *clock, uint32_t device_timestamp, uint64_t *host_time_us)
+{
+	int64_t ticks = 0;
+	double host_us = 0;
+	int ret = -1;
+
+	if (clock == NULL || host_time_us == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(clock->mutex);
+	if (!clock->valid) {
+		goto UNLOCK_AND_EXIT;
+	}
+	ticks = clock->last_ticks + (int32_t)(device_timestamp - clock->last_timestamp);
+	host_us = clock->reference_us + (clock->us_per_tick * (double)(ticks - clock->reference_ticks));
+	*host_time_us = host_us > 0 ? (uint64_t)host_us : 0;
+	ret = 0;
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(clock->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Gets the rate of the clock of the I3C function measured by the host.
+ *
+ * @param[in] clock the IBI clock correlation structure
+ * @param[out] ticks_per_second the number of device clock ticks per second of the host clock
+ * @return 0 if the rate was retrieved, or -1 if there are not enough samples yet
+ */
+int ibi_clock_get_rate(struct ibi_clock *clock, double *ticks_per_second)
+{
+	int ret = -1;
+
+	if (clock == NULL || ticks_per_second == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(clock->mutex);
+	if (clock->valid) {
+		*ticks_per_second = 1000000 / clock->us_per_tick;
+		ret = 0;
+	}
+	pthread_mutex_unlock(clock->mutex);
+
+	return ret;
+}
@@ -0,0 +1,28 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __IBI_CLOCK_I_H__
+#define __IBI_CLOCK_I_H__
+
+#include <stdint.h>
+
+struct ibi_clock;
+
+struct ibi_clock *ibi_clock_init(void);
+void ibi_clock_destroy(struct ibi_clock **clock);
+void ibi_clock_add_sample(struct ibi_clock *clock, uint32_t device_timestamp, uint64_t host_time_us);
+int ibi_clock_device_to_host(struct ibi_clock *clock, uint32_t device_timestamp, uint64_t *host_time_us);
+int ibi_clock_get_rate(struct ibi_clock *clock, double *ticks_per_second);
+
+#endif /* end of include guard: __IBI_CLOCK_I_H__ */
@@ -15,16 +15,39 @@
 #ifndef __IBI_I_H__
 #define __IBI_I_H__
 
+#include "ibi_clock_i.h"
 #include "ibi_response_i.h"
+#include "ibi_storm_i.h"
 #include "usbi3c.h"
 
 struct ibi;
+struct ibi_pending;
+
+/**
+ * @brief Function to get the IBI prioritization of a target device (lower values = higher priority).
+ */
+typedef uint8_t (*ibi_priority_fn)(uint8_t address, void *user_data);
 
 struct notification;
 struct ibi *ibi_init(struct ibi_response_queue *response_queue);
 void ibi_destroy(struct ibi **ibi);
 void ibi_handle_notification(struct notification *notification, void *user_data);
+int ibi_handle_response(struct ibi *ibi, uint8_t *data, size_t size);
 void ibi_set_callback(struct ibi *ibi, on_ibi_fn ibi_cb, void *user_data);
+void ibi_set_chunk_callback(struct ibi *ibi, on_ibi_chunk_fn on_ibi_chunk_cb, void *user_data);
 void ibi_call_pending(struct ibi *ibi);
+int ibi_poll_queue_push(struct ibi *ibi, struct ibi_pending *pending);
+int ibi_enable_polling(struct ibi *ibi, size_t max_records);
+void ibi_disable_polling(struct ibi *ibi);
+int ibi_poll(struct ibi *ibi, struct usbi3c_ibi_record *records, size_t max);
+int ibi_wait(struct ibi *ibi, int timeout_us);
+uint32_t ibi_get_poll_overruns(struct ibi *ibi);
+struct ibi_storm *ibi_get_storm(struct ibi *ibi);
+void ibi_set_storm_callback(struct ibi *ibi, on_ibi_storm_fn on_ibi_storm_cb, void *user_data);
+void ibi_set_storm_target_callback(struct ibi *ibi, ibi_storm_target_fn storm_target_cb, void *user_data);
+struct ibi_clock *ibi_get_clock(struct ibi *ibi);
+void ibi_set_delivery_order(struct ibi *ibi, enum usbi3c_ibi_delivery_order order);
+void ibi_set_priority_callback(struct ibi *ibi, ibi_priority_fn priority_cb, void *user_data);
+int ibi_get_priority_stats(struct ibi *ibi, uint8_t level, struct usbi3c_ibi_priority_stats *stats);
 
 #endif /* end of include guard: __IBI_I_H__ */
@@ -46,14 +46,18 @@ struct ibi_payload_buffer payload_buffer = {
  * @brief A queue of IBI responses.
  */
 struct ibi_response_queue {
-	struct list *head;	///< The list of IBI responses.
-	size_t data_queue_size; //< The length of the data in the queue.
+	struct list *head;		///< The list of IBI responses.
+	size_t data_queue_size;		//< The length of the data in the queue.
+	uint32_t dropped;		///< IBIs dropped after the last response in the queue whose notification was not received yet
+	uint8_t dropping;		///< TRUE while the rest of the fragments of a dropped IBI are being received
 };
 
 // ibi response queue
 static struct ibi_response_queue response_queue = {
 	.head = NULL,
 	.data_queue_size = 0,
+	.dropped = 0,
+	.dropping = FALSE,
 };
 
 static void ibi_payload_buffer_enqueue(struct ibi_payload_buffer *buffer,
@@ -97,7 +101,7 @@ static int ibi_payload_buffer_join(struct ibi_payload_buffer *buffer, uint8_t **
 	size_t offset = 0;
 	while (current) {
 		entry = current->data;
-		payload_buffer[offset] = *entry->buffer;
+		memcpy(payload_buffer + offset, entry->buffer, entry->size);
 		offset += entry->size;
 		current = current->next;
 	}
@@ -130,6 +134,9 @@ int ibi_response_queue_enqueue(struct ibi_response_queue *queue, struct ibi_resp
 	if (queue == NULL || response == NULL) {
 		return -1;
 	}
+	/* the IBIs dropped since the last response go before this one */
+	response->dropped_before = queue->dropped;
+	queue->dropped = 0;
 	queue->head = list_append(queue->head, response);
 	queue->data_queue_size++;
 	return 0;
@@ -218,29 +225,71 @@ size_t ibi_response_queue_size(struct ibi_response_queue *queue)
 	return queue->data_queue_size;
 }
 
-static void ibi_response_fill_descriptor(struct ibi_response *response, uint8_t *data, size_t size)
+static void ibi_response_fill_descriptor(struct usbi3c_ibi *descriptor, uint8_t *data, size_t size)
 {
 	struct bulk_ibi_response_footer *footer = (struct bulk_ibi_response_footer *)(data + size - sizeof(struct bulk_ibi_response_footer));
-	response->descriptor.address = footer->target_address;
-	response->descriptor.R_W = footer->R_W;
-	response->descriptor.ibi_status = footer->ibi_status;
-	response->descriptor.error = footer->error;
-	response->descriptor.ibi_timestamp = footer->ibi_timestamp;
-	response->descriptor.ibi_type = footer->ibi_type;
-	response->descriptor.MDB = (uint8_t) * (data + sizeof(struct bulk_ibi_response_header));
+	descriptor->address = footer->target_address;
+	descriptor->R_W = footer->R_W;
+	descriptor->ibi_status = footer->ibi_status;
+	descriptor->error = footer->error;
+	descriptor->ibi_timestamp = footer->ibi_timestamp;
+	descriptor->ibi_type = footer->ibi_type;
+	descriptor->MDB = (uint8_t) * (data + sizeof(struct bulk_ibi_response_header));
+	/* timestamped IBIs carry the timestamp of the I3C function in the DWORD after the MDB */
+	if (footer->ibi_timestamp && size >= sizeof(struct bulk_ibi_response_header) + (2 * DWORD_SIZE) + sizeof(struct bulk_ibi_response_footer)) {
+		memcpy(&descriptor->device_timestamp, data + sizeof(struct bulk_ibi_response_header) + DWORD_SIZE, sizeof(uint32_t));
+	}
+}
+
+/**
+ * @brief Consumes an IBI that was dropped when its response was received.
+ *
+ * IBIs and their notifications are received in the same order, the notification of
+ * an IBI that was dropped has to be discarded instead of matched with the next response.
+ *
+ * @param[in] queue The IBI response queue.
+ * @return TRUE if the next IBI to match with a notification was dropped, FALSE otherwise
+ */
+int ibi_response_queue_take_dropped(struct ibi_response_queue *queue)
+{
+	struct ibi_response *front = ibi_response_queue_front(queue);
+
+	if (front) {
+		if (front->dropped_before == 0) {
+			return FALSE;
+		}
+		front->dropped_before--;
+		return TRUE;
+	}
+	if (queue == NULL || queue->dropped == 0) {
+		return FALSE;
+	}
+	queue->dropped--;
+
+	return TRUE;
 }
 
 /**
  * @brief Function to handle IBI response
  *
- *  Function to handle an IBI response collecting its payload data and queuing it
+ *  Function to handle an IBI response collecting its payload data and queuing it.
+ *  IBIs rejected by the admit handler are dropped along with the rest of their
+ *  fragments before anything is allocated for them.
+ *
+ *  When the handlers have a chunk callback, every fragment of a pending read payload
+ *  is passed to it as soon as it is received instead of being buffered until the IBI
+ *  is completed, so the memory used does not depend on the size of the pending read.
+ *  Completed IBIs are then queued without payload. The chunk callback in the handlers
+ *  is only taken into account when an IBI starts to be received, every fragment of the
+ *  IBI is handled the same way even if the callback changes before it completes.
  *
  * @param[in] queue queue to store IBI response data until its completed and its notification is triggered
  * @param[in] data data content of IBI response
  * @param[in] size the size of the IBI response
- * @return Return parameter description
+ * @param[in] handlers the handlers of the device the IBI response is received for, NULL to queue and buffer every IBI
+ * @return 0 if the IBI response was handled, or -1 otherwise
  */
-int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t size)
+int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t size, const struct ibi_response_handlers *handlers)
 {
 	if (queue == NULL || data == NULL || size == 0) {
 		return -1;
@@ -260,10 +309,36 @@ int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t
 			ibi_payload_buffer_cleanup(&payload_buffer);
 		}
 
+		struct usbi3c_ibi descriptor = { 0 };
+		ibi_response_fill_descriptor(&descriptor, data, size);
+		queue->dropping = FALSE;
+		if (handlers && handlers->admit_cb && !handlers->admit_cb(&descriptor, handlers->user_data)) {
+			queue->dropped++;
+			queue->dropping = !footer->last_byte;
+			return 0;
+		}
+
 		struct ibi_response *response = malloc_or_die(sizeof(struct ibi_response));
-		ibi_response_fill_descriptor(response, data, size);
+		response->descriptor = descriptor;
+		response->descriptor.response_time_us = monotonic_time_us();
+		if (handlers) {
+			response->on_ibi_chunk_cb = handlers->on_ibi_chunk_cb;
+			response->chunk_user_data = handlers->chunk_user_data;
+		}
 		ibi_response_queue_enqueue(queue, response);
+	} else if (queue->dropping) {
+		/* the rest of the payload of a dropped IBI is discarded as it is received */
+		queue->dropping = !footer->last_byte;
+		return 0;
+	}
+
+	/* the IBI keeps the mode it was started with */
+	struct ibi_response *current = ibi_response_queue_back(queue);
+	if (current && current->completed) {
+		current = NULL;
 	}
+	on_ibi_chunk_fn on_ibi_chunk_cb = current ? current->on_ibi_chunk_cb : NULL;
+	void *chunk_user_data = current ? current->chunk_user_data : NULL;
 
 	if (footer->pending_read) {
 
@@ -274,9 +349,21 @@ int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t
 			payload_size += footer->bytes_valid;
 		}
 
-		uint8_t *buffer = malloc_or_die(payload_size);
-		memcpy(buffer, data + sizeof(struct bulk_ibi_response_header), payload_size);
-		ibi_payload_buffer_enqueue(&payload_buffer, buffer, payload_size);
+		if (on_ibi_chunk_cb) {
+			/* streaming mode: the fragment is handed over straight from the
+			 * bulk response buffer so nothing has to be stored */
+			on_ibi_chunk_cb(&current->descriptor,
+					header->sequence_id,
+					footer->last_byte,
+					data + sizeof(struct bulk_ibi_response_header),
+					payload_size,
+					chunk_user_data);
+			current->fragments++;
+		} else {
+			uint8_t *buffer = malloc_or_die(payload_size);
+			memcpy(buffer, data + sizeof(struct bulk_ibi_response_header), payload_size);
+			ibi_payload_buffer_enqueue(&payload_buffer, buffer, payload_size);
+		}
 	}
 
 	if (footer->last_byte) {
@@ -287,6 +374,16 @@ int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t
 			return -1;
 		}
 
+		if (on_ibi_chunk_cb && response->fragments > 0 && !footer->pending_read) {
+			/* the stream was started, let the user know it is over */
+			on_ibi_chunk_cb(&response->descriptor,
+					header->sequence_id,
+					TRUE,
+					NULL,
+					0,
+					chunk_user_data);
+		}
+
 		response->size = ibi_payload_buffer_join(&payload_buffer, &response->data);
 
 		response->completed = TRUE;
@@ -320,4 +417,6 @@ void ibi_response_queue_clear(struct ibi_response_queue *queue)
 
 	list_free_list_and_data(&queue->head, ibi_response_free);
 	queue->data_queue_size = 0;
+	queue->dropped = 0;
+	queue->dropping = FALSE;
 }
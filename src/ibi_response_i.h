@@ -29,8 +29,29 @@ struct ibi_response_queue;
 struct ibi_response {
 	struct usbi3c_ibi descriptor; ///< IBI descriptor with IBI response info
 	uint8_t *data;		      ///< If the IBI has payload this is where it is stored if not it is NULL
-	uint8_t size;		      ///< size of the IBI data
+	size_t size;		      ///< size of the IBI data
 	uint8_t completed;	      ///< Attribute to identify if the ibi_response has been completed or have pending data to received
+	uint32_t fragments;	      ///< number of payload fragments delivered to the chunk callback while streaming
+	on_ibi_chunk_fn on_ibi_chunk_cb; ///< chunk callback set when the IBI started to be received, NULL if its payload is buffered
+	void *chunk_user_data;	      ///< user data to share with the chunk callback
+	uint32_t dropped_before;      ///< number of IBIs dropped right before this one whose notification was not received yet
+};
+
+/**
+ * @brief Function to decide if an IBI is queued or dropped as soon as its response starts to be received.
+ *
+ * @return TRUE if the IBI has to be queued, FALSE if it has to be dropped
+ */
+typedef int (*ibi_admit_fn)(const struct usbi3c_ibi *descriptor, void *user_data);
+
+/**
+ * @brief The handlers of the device the IBI responses are received for.
+ */
+struct ibi_response_handlers {
+	ibi_admit_fn admit_cb;		 ///< function to decide if an IBI is queued, NULL to queue every IBI
+	void *user_data;		 ///< user data to share with the admit function
+	on_ibi_chunk_fn on_ibi_chunk_cb; ///< if set, pending read payloads are streamed to this callback instead of buffered
+	void *chunk_user_data;		 ///< user data to share with the chunk callback
 };
 
 struct ibi_response_queue *ibi_response_queue_get_queue(void);
@@ -40,7 +61,8 @@ struct ibi_response *ibi_response_queue_front(struct ibi_response_queue *queue);
 struct ibi_response *ibi_response_queue_back(struct ibi_response_queue *queue);
 size_t ibi_response_queue_size(struct ibi_response_queue *queue);
 void ibi_response_queue_clear(struct ibi_response_queue *queue);
+int ibi_response_queue_take_dropped(struct ibi_response_queue *queue);
 
-int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t size);
+int ibi_response_handle(struct ibi_response_queue *queue, uint8_t *data, size_t size, const struct ibi_response_handlers *handlers);
 
 #endif /* end of include guard: __IBI_RESPONSE_I_H__ */
@@ -0,0 +1,474 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+#include <string.h>
+
+#include "ibi_storm_i.h"
+#include "usbi3c_i.h"
+
+/* target devices are identified by their target handle, or by their address when the
+ * protection is used without a target device table, either way the identity of each
+ * target device in the bus maps to a different entry since handles keep their slot in
+ * their lower bits and a bus cannot have more target devices than 7-bit addresses */
+#define IBI_STORM_TARGETS 128
+
+#define MICROSECONDS_PER_SECOND 1000000
+
+/**
+ * @brief IBI storm protection state of a single target device
+ */
+struct ibi_storm_target {
+	uint32_t target_id;			   ///< identity of the target device the state belongs to, 0 if the entry is unused
+	uint32_t max_ibis_per_second;		   ///< rate at which tokens are added to the bucket, 0 if the target is not rate limited
+	uint32_t burst;				   ///< max number of tokens the bucket can hold
+	double tokens;				   ///< tokens currently available in the bucket, every IBI delivered takes one
+	uint64_t last_refill_us;		   ///< last time tokens were added to the bucket
+	uint32_t drops_since_full;		   ///< IBIs dropped by the rate limit since the bucket was last full
+	uint8_t disabling;			   ///< TRUE once the target exceeded the storm threshold, until its rate limit is configured again
+	uint8_t window_open;			   ///< TRUE if there is an open coalescing window for the target
+	uint64_t window_start_us;		   ///< time the coalescing window was opened
+	struct ibi_storm_summary window;	   ///< first IBI of the coalescing window and number of IBIs coalesced into it
+	struct usbi3c_ibi_storm_counters counters; ///< counters exposed to the user
+};
+
+/**
+ * @brief A structure used to protect the IBI delivery path from misbehaving target devices
+ */
+struct ibi_storm {
+	struct ibi_storm_target targets[IBI_STORM_TARGETS]; ///< state of each target device, see ibi_storm_lookup()
+	uint32_t window_us;					///< length of the coalescing window, 0 if coalescing is disabled
+	uint32_t disable_threshold;				///< IBIs dropped by the rate limit before disabling the target, 0 to never disable it
+	uint32_t open_windows;					///< number of targets with an open coalescing window
+	pthread_mutex_t *mutex;					///< mutex to protect the state from concurrent access
+};
+
+/**
+ * @brief Creates a new IBI storm protection structure.
+ *
+ * All protections are disabled by default.
+ *
+ * @return a new IBI storm protection structure
+ */
+struct ibi_storm *ibi_storm_init(void)
+{
+	struct ibi_storm *storm = NULL;
+
+	storm = (struct ibi_storm *)malloc_or_die(sizeof(struct ibi_storm));
+	storm->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(storm->mutex, NULL);
+
+	return storm;
+}
+
+/**
+ * @brief Destroys an IBI storm protection structure.
+ *
+ * @param[in] storm the IBI storm protection structure to destroy
+ */
+void ibi_storm_destroy(struct ibi_storm **storm)
+{
+	if (storm == NULL || *storm == NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy((*storm)->mutex);
+	FREE((*storm)->mutex);
+	FREE(*storm);
+}
+
+/* gets the state of a target device, a new state is created if requested and the
+ * target device has none, an entry left by a target that went away is reused */
+static struct ibi_storm_target *ibi_storm_lookup(struct ibi_storm *storm, uint32_t target_id, int create)
+{
+	struct ibi_storm_target *entry = &storm->targets[target_id % IBI_STORM_TARGETS];
+
+	if (entry->target_id == target_id) {
+		return entry;
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	if (entry->window_open) {
+		storm->open_windows--;
+	}
+	memset(entry, 0, sizeof(struct ibi_storm_target));
+	entry->target_id = target_id;
+
+	return entry;
+}
+
+/**
+ * @brief Starts keeping the IBI storm protection state of a target device.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device
+ * @return TRUE if the target device was not tracked yet, FALSE otherwise
+ */
+int ibi_storm_track_target(struct ibi_storm *storm, uint32_t target_id)
+{
+	int tracked = FALSE;
+
+	if (storm == NULL || target_id == 0) {
+		return FALSE;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	if (ibi_storm_lookup(storm, target_id, FALSE) == NULL) {
+		ibi_storm_lookup(storm, target_id, TRUE);
+		tracked = TRUE;
+	}
+	pthread_mutex_unlock(storm->mutex);
+
+	return tracked;
+}
+
+/**
+ * @brief Checks if the IBI storm protection state of a target device is being kept.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device
+ * @return TRUE if the target device is tracked, FALSE otherwise
+ */
+int ibi_storm_has_target(struct ibi_storm *storm, uint32_t target_id)
+{
+	int found = FALSE;
+
+	if (storm == NULL || target_id == 0) {
+		return FALSE;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	found = ibi_storm_lookup(storm, target_id, FALSE) != NULL;
+	pthread_mutex_unlock(storm->mutex);
+
+	return found;
+}
+
+/**
+ * @brief Configures the token bucket used to rate limit the IBIs of a target device.
+ *
+ * Configuring the rate limit of a target device also clears its disabled state.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device
+ * @param[in] max_ibis_per_second the sustained number of IBIs per second allowed, 0 to remove the limit
+ * @param[in] burst the max number of IBIs allowed in a burst (a value of 0 is treated as 1)
+ * @return 0 if the rate limit was configured, or -1 otherwise
+ */
+int ibi_storm_set_rate_limit(struct ibi_storm *storm, uint32_t target_id, uint32_t max_ibis_per_second, uint32_t burst)
+{
+	struct ibi_storm_target *target = NULL;
+
+	if (storm == NULL || target_id == 0) {
+		return -1;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	target = ibi_storm_lookup(storm, target_id, TRUE);
+	target->max_ibis_per_second = max_ibis_per_second;
+	target->burst = burst ? burst : 1;
+	target->tokens = target->burst;
+	target->last_refill_us = monotonic_time_us();
+	target->drops_since_full = 0;
+	target->disabling = FALSE;
+	target->counters.ibi_disabled = FALSE;
+	pthread_mutex_unlock(storm->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief Configures the window in which identical IBIs from a target device are coalesced.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] window_us the length of the window in microseconds, 0 to disable coalescing
+ */
+void ibi_storm_set_coalescing_window(struct ibi_storm *storm, uint32_t window_us)
+{
+	if (storm == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	storm->window_us = window_us;
+	pthread_mutex_unlock(storm->mutex);
+}
+
+/**
+ * @brief Configures the number of rate limited IBIs after which a target device gets disabled.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] threshold the number of IBIs dropped since the token bucket of the target was last full, 0 to never disable targets
+ */
+void ibi_storm_set_disable_threshold(struct ibi_storm *storm, uint32_t threshold)
+{
+	if (storm == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	storm->disable_threshold = threshold;
+	pthread_mutex_unlock(storm->mutex);
+}
+
+/**
+ * @brief Marks a target device as disabled once the request to disable its IBIs completed.
+ *
+ * The target device is only marked if it is still the one that exceeded the storm
+ * threshold, a rate limit configured in the meantime clears its disabled state.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device
+ */
+void ibi_storm_set_disabled(struct ibi_storm *storm, uint32_t target_id)
+{
+	struct ibi_storm_target *target = NULL;
+
+	if (storm == NULL || target_id == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	target = ibi_storm_lookup(storm, target_id, FALSE);
+	if (target && target->disabling) {
+		target->counters.ibi_disabled = TRUE;
+	}
+	pthread_mutex_unlock(storm->mutex);
+}
+
+/**
+ * @brief Gets the IBI storm protection counters of a target device.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device
+ * @param[out] counters the counters of the target device, all 0 if the target device is not tracked
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int ibi_storm_get_counters(struct ibi_storm *storm, uint32_t target_id, struct usbi3c_ibi_storm_counters *counters)
+{
+	struct ibi_storm_target *target = NULL;
+
+	if (storm == NULL || counters == NULL || target_id == 0) {
+		return -1;
+	}
+
+	memset(counters, 0, sizeof(struct usbi3c_ibi_storm_counters));
+	pthread_mutex_lock(storm->mutex);
+	target = ibi_storm_lookup(storm, target_id, FALSE);
+	if (target) {
+		*counters = target->counters;
+	}
+	pthread_mutex_unlock(storm->mutex);
+
+	return 0;
+}
+
+/* closes the coalescing window of a target, returns TRUE if IBIs were coalesced
+ * into it, in which case their summary is copied */
+static int ibi_storm_close_window(struct ibi_storm *storm, struct ibi_storm_target *target, struct ibi_storm_summary *summary)
+{
+	if (!target->window_open) {
+		return FALSE;
+	}
+
+	target->window_open = FALSE;
+	storm->open_windows--;
+
+	if (target->window.descriptor.repeat_count == 0) {
+		return FALSE;
+	}
+
+	*summary = target->window;
+	target->counters.delivered++;
+
+	return TRUE;
+}
+
+/* refills the token bucket of a target according to the time elapsed */
+static void ibi_storm_refill(struct ibi_storm_target *target, uint64_t now_us)
+{
+	if (now_us > target->last_refill_us) {
+		target->tokens += (double)(now_us - target->last_refill_us) * target->max_ibis_per_second / MICROSECONDS_PER_SECOND;
+		target->last_refill_us = now_us;
+	}
+	if (target->tokens >= target->burst) {
+		target->tokens = target->burst;
+		target->drops_since_full = 0;
+	}
+}
+
+/**
+ * @brief Decides if an IBI has to be dropped by the rate limit of its target device.
+ *
+ * The rate limit is checked as soon as the IBI response starts to be received, so the
+ * IBIs dropped don't get their payload buffered nor take room in the IBI queues.
+ *
+ * Once the target device exceeds the storm threshold its IBIs keep being dropped, but
+ * it is not reported as disabled until ibi_storm_set_disabled() is called.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device that issued the IBI, 0 if it is not protected
+ * @param[in] now_us the time the IBI is being received in microseconds
+ * @return IBI_STORM_DELIVER if the IBI has to be queued, or the reason it has to be dropped
+ */
+enum ibi_storm_verdict ibi_storm_admit(struct ibi_storm *storm, uint32_t target_id, uint64_t now_us)
+{
+	struct ibi_storm_target *target = NULL;
+	enum ibi_storm_verdict verdict = IBI_STORM_DELIVER;
+
+	if (storm == NULL || target_id == 0) {
+		return IBI_STORM_DELIVER;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	target = ibi_storm_lookup(storm, target_id, TRUE);
+
+	if (target->max_ibis_per_second) {
+		ibi_storm_refill(target, now_us);
+		if (target->disabling || target->tokens < 1) {
+			target->counters.rate_limited++;
+			target->drops_since_full++;
+			verdict = IBI_STORM_RATE_LIMITED;
+			if (storm->disable_threshold && !target->disabling && target->drops_since_full > storm->disable_threshold) {
+				DEBUG_PRINT("Target device %x exceeded the IBI storm threshold\n", target_id);
+				target->disabling = TRUE;
+				verdict = IBI_STORM_DISABLE_TARGET;
+			}
+			goto UNLOCK_AND_EXIT;
+		}
+		target->tokens -= 1;
+	}
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(storm->mutex);
+
+	return verdict;
+}
+
+/**
+ * @brief Decides if a completed IBI has to be delivered to the user.
+ *
+ * The IBI, that already went through ibi_storm_admit(), is checked against the IBI
+ * that opened the current coalescing window of its target device. If the IBI closes
+ * a window in which other IBIs were coalesced, the summary of that window is returned
+ * so it can be delivered before the IBI.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] target_id the identity of the target device that issued the IBI, 0 if it is not protected
+ * @param[in] report the reason why the IBI was triggered
+ * @param[in] descriptor the descriptor of the completed IBI
+ * @param[in] now_us the time the IBI is being processed in microseconds
+ * @param[out] summary summary of a coalescing window that was closed, its repeat_count is 0 if there is none
+ * @return IBI_STORM_DELIVER if the IBI has to be delivered, or IBI_STORM_COALESCED if it has to be dropped
+ */
+enum ibi_storm_verdict ibi_storm_filter(struct ibi_storm *storm, uint32_t target_id, uint8_t report, struct usbi3c_ibi *descriptor, uint64_t now_us, struct ibi_storm_summary *summary)
+{
+	struct ibi_storm_target *target = NULL;
+	enum ibi_storm_verdict verdict = IBI_STORM_DELIVER;
+
+	if (summary) {
+		summary->descriptor.repeat_count = 0;
+	}
+
+	if (storm == NULL || descriptor == NULL || summary == NULL || target_id == 0) {
+		return IBI_STORM_DELIVER;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	target = ibi_storm_lookup(storm, target_id, TRUE);
+
+	if (target->window_open) {
+		if (storm->window_us && (now_us - target->window_start_us) < storm->window_us && descriptor->MDB == target->window.descriptor.MDB) {
+			target->window.descriptor.repeat_count++;
+			target->counters.coalesced++;
+			verdict = IBI_STORM_COALESCED;
+			goto UNLOCK_AND_EXIT;
+		}
+		ibi_storm_close_window(storm, target, summary);
+	}
+
+	if (storm->window_us) {
+		target->window_open = TRUE;
+		target->window_start_us = now_us;
+		target->window.report = report;
+		target->window.descriptor = *descriptor;
+		target->window.descriptor.repeat_count = 0;
+		storm->open_windows++;
+	}
+	target->counters.delivered++;
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(storm->mutex);
+
+	return verdict;
+}
+
+/**
+ * @brief Closes one expired coalescing window that had IBIs coalesced into it.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[in] now_us the current time in microseconds
+ * @param[out] summary summary of the window that was closed
+ * @return TRUE if a window was closed and its summary has to be delivered, FALSE otherwise
+ */
+int ibi_storm_pop_expired(struct ibi_storm *storm, uint64_t now_us, struct ibi_storm_summary *summary)
+{
+	int found = FALSE;
+
+	if (storm == NULL || summary == NULL) {
+		return FALSE;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	for (int i = 0; i < IBI_STORM_TARGETS && storm->open_windows > 0 && !found; i++) {
+		struct ibi_storm_target *target = &storm->targets[i];
+		if (target->window_open && (now_us - target->window_start_us) >= storm->window_us) {
+			found = ibi_storm_close_window(storm, target, summary);
+		}
+	}
+	pthread_mutex_unlock(storm->mutex);
+
+	return found;
+}
+
+/**
+ * @brief Gets the time the first coalescing window with IBIs coalesced into it expires.
+ *
+ * @param[in] storm the IBI storm protection structure
+ * @param[out] expiry_us the time the window expires in microseconds
+ * @return TRUE if there is a window whose summary will have to be delivered, FALSE otherwise
+ */
+int ibi_storm_next_expiry(struct ibi_storm *storm, uint64_t *expiry_us)
+{
+	int found = FALSE;
+
+	if (storm == NULL || expiry_us == NULL) {
+		return FALSE;
+	}
+
+	pthread_mutex_lock(storm->mutex);
+	for (int i = 0; i < IBI_STORM_TARGETS && storm->open_windows > 0; i++) {
+		struct ibi_storm_target *target = &storm->targets[i];
+		uint64_t expiry = target->window_start_us + storm->window_us;
+		if (target->window_open && target->window.descriptor.repeat_count > 0 && (!found || expiry < *expiry_us)) {
+			*expiry_us = expiry;
+			found = TRUE;
+		}
+	}
+	pthread_mutex_unlock(storm->mutex);
+
+	return found;
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __IBI_STORM_I_H__
+#define __IBI_STORM_I_H__
+
+#include <stdint.h>
+
+#include "usbi3c.h"
+
+struct ibi_storm;
+
+/**
+ * @brief Function to be called when a target device exceeds the IBI storm threshold.
+ */
+typedef void (*on_ibi_storm_fn)(uint32_t target_id, void *user_data);
+
+/**
+ * @brief Function to get the identity used to keep the IBI storm protection state of a target device.
+ *
+ * @return the identity of the target device, or 0 if its IBIs are not to be protected
+ */
+typedef uint32_t (*ibi_storm_target_fn)(uint8_t address, void *user_data);
+
+/**
+ * @brief The decision taken by the IBI storm protection for a completed IBI.
+ */
+enum ibi_storm_verdict {
+	IBI_STORM_DELIVER = 0,		///< the IBI has to be delivered to the user
+	IBI_STORM_RATE_LIMITED = 1,	///< the IBI exceeded the rate limit of its target device and has to be dropped
+	IBI_STORM_COALESCED = 2,	///< the IBI is identical to a recent one, it was counted and has to be dropped
+	IBI_STORM_DISABLE_TARGET = 3,	///< the IBI has to be dropped and its target device disabled, see ibi_storm_set_disabled()
+};
+
+/**
+ * @brief A summary of the identical IBIs coalesced during a window.
+ */
+struct ibi_storm_summary {
+	uint8_t report;		      ///< the reason the first IBI of the window was triggered
+	struct usbi3c_ibi descriptor; ///< descriptor of the first IBI of the window with the number of IBIs coalesced
+};
+
+struct ibi_storm *ibi_storm_init(void);
+void ibi_storm_destroy(struct ibi_storm **storm);
+int ibi_storm_track_target(struct ibi_storm *storm, uint32_t target_id);
+int ibi_storm_has_target(struct ibi_storm *storm, uint32_t target_id);
+int ibi_storm_set_rate_limit(struct ibi_storm *storm, uint32_t target_id, uint32_t max_ibis_per_second, uint32_t burst);
+void ibi_storm_set_coalescing_window(struct ibi_storm *storm, uint32_t window_us);
+void ibi_storm_set_disable_threshold(struct ibi_storm *storm, uint32_t threshold);
+void ibi_storm_set_disabled(struct ibi_storm *storm, uint32_t target_id);
+int ibi_storm_get_counters(struct ibi_storm *storm, uint32_t target_id, struct usbi3c_ibi_storm_counters *counters);
+enum ibi_storm_verdict ibi_storm_admit(struct ibi_storm *storm, uint32_t target_id, uint64_t now_us);
+enum ibi_storm_verdict ibi_storm_filter(struct ibi_storm *storm, uint32_t target_id, uint8_t report, struct usbi3c_ibi *descriptor, uint64_t now_us, struct ibi_storm_summary *summary);
+int ibi_storm_pop_expired(struct ibi_storm *storm, uint64_t now_us, struct ibi_storm_summary *summary);
+int ibi_storm_next_expiry(struct ibi_storm *storm, uint64_t *expiry_us);
+
+#endif /* end of include guard: __IBI_STORM_I_H__ */
@@ -0,0 +1,458 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+#include <string.h>
+
+#include "poll_scheduler_i.h"
+
+/* the load of the ticks is only looked at over this many ticks when choosing the phase of a poll */
+#define POLL_MAX_HORIZON_TICKS 4096
+
+#define MICROSECONDS_PER_SECOND 1000000
+
+/**
+ * @brief A read registered to be sent periodically.
+ */
+struct poll_entry {
+	struct poll_request request;	///< the read to send
+	uint32_t period_ticks;		///< the period of the poll in ticks
+	uint32_t phase;			///< the poll falls due in the ticks whose number modulo the period is the phase
+	uint64_t next_due_tick;		///< the next tick the poll falls due in
+	uint64_t jitter_sum_us;		///< the sum of the delays of every read sent, used for the mean
+	struct usbi3c_poll_stats stats; ///< counters exposed to the user
+};
+
+/**
+ * @brief A scheduler that sends the periodic reads that fall due in the same tick as a single request.
+ */
+struct poll_scheduler {
+	uint32_t tick_us;	  ///< the length of a tick
+	uint64_t start_us;	  ///< the time the first tick started
+	struct list *polls;	  ///< the polls registered
+	int next_id;		  ///< the ID to give to the next poll registered
+	poll_send_fn send;	  ///< the function used to send the reads due in a tick
+	void *context;		  ///< the context of the send function
+	uint8_t running;	  ///< TRUE while the scheduler thread has to keep running
+	pthread_t thread;	  ///< the scheduler thread
+	pthread_mutex_t *mutex;	  ///< mutex to protect the polls from concurrent access
+	pthread_cond_t *changed;  ///< condition signaled when a poll is added or the scheduler is stopped
+};
+
+/**
+ * @brief Creates a poll scheduler, its thread is not started until poll_scheduler_start() is called.
+ *
+ * @param[in] tick_us the length of a tick in microseconds
+ * @param[in] start_us the time the first tick starts in microseconds
+ * @param[in] send the function used to send the reads due in a tick
+ * @param[in] context the context of the send function
+ * @return the poll scheduler, or NULL if the tick length is invalid
+ */
+struct poll_scheduler *poll_scheduler_init(uint32_t tick_us, uint64_t start_us, poll_send_fn send, void *context)
+{
+	struct poll_scheduler *scheduler = NULL;
+	pthread_condattr_t attr;
+
+	if (tick_us == 0 || send == NULL) {
+		return NULL;
+	}
+
+	scheduler = (struct poll_scheduler *)malloc_or_die(sizeof(struct poll_scheduler));
+	scheduler->tick_us = tick_us;
+	scheduler->start_us = start_us;
+	scheduler->send = send;
+	scheduler->context = context;
+	scheduler->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(scheduler->mutex, NULL);
+	scheduler->changed = (pthread_cond_t *)malloc_or_die(sizeof(pthread_cond_t));
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(scheduler->changed, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return scheduler;
+}
+
+/**
+ * @brief Stops the thread of a poll scheduler and destroys it along with its polls.
+ *
+ * @param[in] scheduler the poll scheduler to destroy
+ */
+void poll_scheduler_destroy(struct poll_scheduler **scheduler)
+{
+	if (scheduler == NULL || *scheduler == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock((*scheduler)->mutex);
+	if ((*scheduler)->running) {
+		(*scheduler)->running = FALSE;
+		pthread_cond_broadcast((*scheduler)->changed);
+		pthread_mutex_unlock((*scheduler)->mutex);
+		pthread_join((*scheduler)->thread, NULL);
+	} else {
+		pthread_mutex_unlock((*scheduler)->mutex);
+	}
+
+	list_free_list_and_data(&(*scheduler)->polls, free);
+	pthread_cond_destroy((*scheduler)->changed);
+	FREE((*scheduler)->changed);
+	pthread_mutex_destroy((*scheduler)->mutex);
+	FREE((*scheduler)->mutex);
+	FREE(*scheduler);
+}
+
+/* gets the time a tick starts at */
+static uint64_t poll_tick_time(struct poll_scheduler *scheduler, uint64_t tick)
+{
+	return scheduler->start_us + tick * scheduler->tick_us;
+}
+
+/* gets the tick a time falls in */
+static uint64_t poll_current_tick(struct poll_scheduler *scheduler, uint64_t now_us)
+{
+	if (now_us < scheduler->start_us) {
+		return 0;
+	}
+
+	return (now_us - scheduler->start_us) / scheduler->tick_us;
+}
+
+/* sleeps until the next poll falls due, the scheduler has to be locked */
+static void poll_wait_next_due(struct poll_scheduler *scheduler)
+{
+	struct timespec deadline;
+	uint64_t wake_tick = UINT64_MAX;
+	uint64_t wake_us = 0;
+
+	for (struct list *node = scheduler->polls; node; node = node->next) {
+		struct poll_entry *poll = (struct poll_entry *)node->data;
+		if (poll->next_due_tick < wake_tick) {
+			wake_tick = poll->next_due_tick;
+		}
+	}
+	if (wake_tick == UINT64_MAX) {
+		pthread_cond_wait(scheduler->changed, scheduler->mutex);
+		return;
+	}
+
+	wake_us = poll_tick_time(scheduler, wake_tick);
+	if (wake_us <= monotonic_time_us()) {
+		return;
+	}
+	deadline.tv_sec = wake_us / MICROSECONDS_PER_SECOND;
+	deadline.tv_nsec = (long)(wake_us % MICROSECONDS_PER_SECOND) * 1000;
+	pthread_cond_timedwait(scheduler->changed, scheduler->mutex, &deadline);
+}
+
+static void *poll_scheduler_thread(void *arg)
+{
+	struct poll_scheduler *scheduler = (struct poll_scheduler *)arg;
+
+	pthread_mutex_lock(scheduler->mutex);
+	while (scheduler->running) {
+		poll_wait_next_due(scheduler);
+		if (!scheduler->running) {
+			break;
+		}
+		pthread_mutex_unlock(scheduler->mutex);
+		poll_scheduler_tick(scheduler, monotonic_time_us());
+		pthread_mutex_lock(scheduler->mutex);
+	}
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Starts the thread that sends the polls as they fall due.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @return 0 if the thread was started, or -1 otherwise
+ */
+int poll_scheduler_start(struct poll_scheduler *scheduler)
+{
+	int err = 0;
+
+	if (scheduler == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(scheduler->mutex);
+	if (scheduler->running) {
+		pthread_mutex_unlock(scheduler->mutex);
+		return -1;
+	}
+	scheduler->running = TRUE;
+	if ((err = pthread_create(&scheduler->thread, NULL, &poll_scheduler_thread, scheduler))) {
+		DEBUG_PRINT("pthread_create(): %s\n", strerror(err));
+		scheduler->running = FALSE;
+	}
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return err ? -1 : 0;
+}
+
+/* chooses the phase of a new poll that keeps the busiest of its ticks as idle as
+ * possible, the scheduler has to be locked */
+static uint32_t poll_choose_phase(struct poll_scheduler *scheduler, uint32_t period_ticks)
+{
+	uint32_t horizon = period_ticks;
+	uint32_t best_phase = 0;
+	uint32_t best_peak = UINT32_MAX;
+	uint64_t best_total = UINT64_MAX;
+	uint32_t *load = NULL;
+
+	for (struct list *node = scheduler->polls; node; node = node->next) {
+		struct poll_entry *poll = (struct poll_entry *)node->data;
+		if (poll->period_ticks > horizon) {
+			horizon = poll->period_ticks;
+		}
+	}
+	if (horizon > POLL_MAX_HORIZON_TICKS) {
+		horizon = POLL_MAX_HORIZON_TICKS;
+	}
+
+	/* number of polls that fall due in each tick of the horizon */
+	load = (uint32_t *)malloc_or_die(sizeof(uint32_t) * horizon);
+	for (struct list *node = scheduler->polls; node; node = node->next) {
+		struct poll_entry *poll = (struct poll_entry *)node->data;
+		for (uint32_t tick = poll->phase; tick < horizon; tick += poll->period_ticks) {
+			load[tick]++;
+		}
+	}
+
+	for (uint32_t phase = 0; phase < period_ticks && phase < horizon; phase++) {
+		uint32_t peak = 0;
+		uint64_t total = 0;
+
+		for (uint32_t tick = phase; tick < horizon; tick += period_ticks) {
+			if (load[tick] > peak) {
+				peak = load[tick];
+			}
+			total += load[tick];
+		}
+		if (peak < best_peak || (peak == best_peak && total < best_total)) {
+			best_phase = phase;
+			best_peak = peak;
+			best_total = total;
+		}
+	}
+	FREE(load);
+
+	return best_phase;
+}
+
+/**
+ * @brief Registers a read to be sent periodically.
+ *
+ * The period is rounded to a whole number of ticks, and the poll is given the phase
+ * that spreads the polls most evenly across the ticks.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @param[in] address the address of the target device to read from
+ * @param[in] length the number of bytes to read
+ * @param[in] period_us the period of the read in microseconds
+ * @param[in] on_response_cb the callback to call with the response of each read
+ * @param[in] user_data the user data of the callback
+ * @param[in] now_us the current time in microseconds
+ * @return the ID of the poll, or -1 on failure
+ */
+int poll_scheduler_add(struct poll_scheduler *scheduler, uint8_t address, uint32_t length, uint32_t period_us, on_response_fn on_response_cb, void *user_data, uint64_t now_us)
+{
+	struct poll_entry *poll = NULL;
+	uint64_t current_tick = 0;
+	int id = 0;
+
+	if (scheduler == NULL || on_response_cb == NULL || period_us == 0) {
+		return -1;
+	}
+
+	poll = (struct poll_entry *)malloc_or_die(sizeof(struct poll_entry));
+	poll->request.address = address;
+	poll->request.length = length;
+	poll->request.on_response_cb = on_response_cb;
+	poll->request.user_data = user_data;
+	poll->period_ticks = (period_us + scheduler->tick_us / 2) / scheduler->tick_us;
+	if (poll->period_ticks == 0) {
+		poll->period_ticks = 1;
+	}
+
+	pthread_mutex_lock(scheduler->mutex);
+	id = scheduler->next_id++;
+	poll->request.id = id;
+	poll->phase = poll_choose_phase(scheduler, poll->period_ticks);
+	/* the first read is sent in the next tick of its phase */
+	current_tick = poll_current_tick(scheduler, now_us);
+	poll->next_due_tick = current_tick + 1;
+	poll->next_due_tick += (poll->phase + poll->period_ticks - poll->next_due_tick % poll->period_ticks) % poll->period_ticks;
+	poll->stats.period_us = poll->period_ticks * scheduler->tick_us;
+	poll->stats.phase_offset_us = poll->phase * scheduler->tick_us;
+	scheduler->polls = list_append(scheduler->polls, poll);
+	pthread_cond_broadcast(scheduler->changed);
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return id;
+}
+
+static int compare_poll_id(const void *a, const void *b)
+{
+	return ((const struct poll_entry *)a)->request.id - *(const int *)b;
+}
+
+/**
+ * @brief Unregisters a poll, reads of the poll already sent still get their callback called.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @param[in] id the ID of the poll
+ * @return 0 if the poll was unregistered, or -1 if it does not exist
+ */
+int poll_scheduler_remove(struct poll_scheduler *scheduler, int id)
+{
+	struct list *node = NULL;
+
+	if (scheduler == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(scheduler->mutex);
+	node = list_search_node(scheduler->polls, &id, compare_poll_id);
+	if (node) {
+		scheduler->polls = list_free_node(scheduler->polls, node, free);
+	}
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return node ? 0 : -1;
+}
+
+/**
+ * @brief Gets the counters of a poll.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @param[in] id the ID of the poll
+ * @param[out] stats the counters of the poll
+ * @return 0 if the counters were retrieved, or -1 if the poll does not exist
+ */
+int poll_scheduler_get_stats(struct poll_scheduler *scheduler, int id, struct usbi3c_poll_stats *stats)
+{
+	struct poll_entry *poll = NULL;
+
+	if (scheduler == NULL || stats == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(scheduler->mutex);
+	poll = (struct poll_entry *)list_search(scheduler->polls, &id, compare_poll_id);
+	if (poll) {
+		*stats = poll->stats;
+		stats->mean_jitter_us = poll->stats.polls ? (uint32_t)(poll->jitter_sum_us / poll->stats.polls) : 0;
+	}
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return poll ? 0 : -1;
+}
+
+/**
+ * @brief Gets the reads that fell due up to the current tick.
+ *
+ * A poll that fell due more than once since its last read is only read once, and
+ * each period skipped is counted as a deadline miss. The delay between the time
+ * the read fell due and the current time is counted as jitter.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @param[in] now_us the current time in microseconds
+ * @param[out] requests the list of reads due (struct poll_request), to be freed with list_free_list_and_data()
+ * @return the number of reads due, or -1 on failure
+ */
+int poll_scheduler_collect(struct poll_scheduler *scheduler, uint64_t now_us, struct list **requests)
+{
+	uint64_t current_tick = 0;
+	int count = 0;
+
+	if (scheduler == NULL || requests == NULL) {
+		return -1;
+	}
+	*requests = NULL;
+
+	pthread_mutex_lock(scheduler->mutex);
+	current_tick = poll_current_tick(scheduler, now_us);
+	for (struct list *node = scheduler->polls; node; node = node->next) {
+		struct poll_entry *poll = (struct poll_entry *)node->data;
+		struct poll_request *request = NULL;
+		uint64_t missed = 0;
+		uint64_t due_us = 0;
+		uint64_t jitter_us = 0;
+
+		if (poll->next_due_tick > current_tick) {
+			continue;
+		}
+
+		/* only the latest period that fell due is read */
+		missed = (current_tick - poll->next_due_tick) / poll->period_ticks;
+		due_us = poll_tick_time(scheduler, poll->next_due_tick + missed * poll->period_ticks);
+		jitter_us = now_us > due_us ? now_us - due_us : 0;
+		poll->next_due_tick += (missed + 1) * poll->period_ticks;
+
+		poll->stats.polls++;
+		poll->stats.deadline_misses += missed;
+		poll->jitter_sum_us += jitter_us;
+		if (jitter_us > poll->stats.max_jitter_us) {
+			poll->stats.max_jitter_us = jitter_us > UINT32_MAX ? UINT32_MAX : (uint32_t)jitter_us;
+		}
+
+		request = (struct poll_request *)malloc_or_die(sizeof(struct poll_request));
+		*request = poll->request;
+		*requests = list_append(*requests, request);
+		count++;
+	}
+	pthread_mutex_unlock(scheduler->mutex);
+
+	return count;
+}
+
+/**
+ * @brief Sends the reads that fell due up to the current tick as a single request.
+ *
+ * If the request cannot be sent, each one of the reads in it is counted as a deadline miss.
+ *
+ * @param[in] scheduler the poll scheduler
+ * @param[in] now_us the current time in microseconds
+ * @return the number of reads sent, or -1 if they could not be sent
+ */
+int poll_scheduler_tick(struct poll_scheduler *scheduler, uint64_t now_us)
+{
+	struct list *requests = NULL;
+	int count = 0;
+
+	count = poll_scheduler_collect(scheduler, now_us, &requests);
+	if (count <= 0) {
+		return count;
+	}
+
+	if (scheduler->send(requests, scheduler->context) < 0) {
+		pthread_mutex_lock(scheduler->mutex);
+		for (struct list *node = requests; node; node = node->next) {
+			struct poll_request *request = (struct poll_request *)node->data;
+			struct poll_entry *poll = (struct poll_entry *)list_search(scheduler->polls, &request->id, compare_poll_id);
+			if (poll) {
+				poll->stats.deadline_misses++;
+			}
+		}
+		pthread_mutex_unlock(scheduler->mutex);
+		count = -1;
+	}
+	list_free_list_and_data(&requests, free);
+
+	return count;
+}
@@ -0,0 +1,47 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __POLL_SCHEDULER_I_H__
+#define __POLL_SCHEDULER_I_H__
+
+#include "usbi3c_i.h"
+
+struct poll_scheduler;
+
+/**
+ * @brief A read that fell due in a tick of the poll scheduler.
+ */
+struct poll_request {
+	int id;			       ///< the ID of the poll the read belongs to
+	uint8_t address;	       ///< the address of the target device to read from
+	uint32_t length;	       ///< the number of bytes to read
+	on_response_fn on_response_cb; ///< the callback of the poll
+	void *user_data;	       ///< the user data of the callback
+};
+
+/**
+ * @brief Function used by the poll scheduler to send the reads due in a tick as a single request.
+ */
+typedef int (*poll_send_fn)(struct list *requests, void *context);
+
+struct poll_scheduler *poll_scheduler_init(uint32_t tick_us, uint64_t start_us, poll_send_fn send, void *context);
+void poll_scheduler_destroy(struct poll_scheduler **scheduler);
+int poll_scheduler_start(struct poll_scheduler *scheduler);
+int poll_scheduler_add(struct poll_scheduler *scheduler, uint8_t address, uint32_t length, uint32_t period_us, on_response_fn on_response_cb, void *user_data, uint64_t now_us);
+int poll_scheduler_remove(struct poll_scheduler *scheduler, int id);
+int poll_scheduler_get_stats(struct poll_scheduler *scheduler, int id, struct usbi3c_poll_stats *stats);
+int poll_scheduler_collect(struct poll_scheduler *scheduler, uint64_t now_us, struct list **requests);
+int poll_scheduler_tick(struct poll_scheduler *scheduler, uint64_t now_us);
+
+#endif /* end of include guard: __POLL_SCHEDULER_I_H__ */
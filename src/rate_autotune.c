@@ -0,0 +1,306 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "rate_autotune_i.h"
+#include "target_device_table_i.h"
+
+/* I3C target devices can be probed at SDR and at the three HDR modes */
+#define AUTOTUNE_I3C_MODES 4
+/* the rates are bits 0 to 6 of the rate masks of the capabilities */
+#define AUTOTUNE_RATES 7
+#define AUTOTUNE_MAX_CANDIDATES (AUTOTUNE_I3C_MODES * AUTOTUNE_RATES)
+
+/**
+ * @brief The state of a round of the probe sent to a target device.
+ */
+struct autotune_round {
+	const struct usbi3c_autotune_probe *probe; ///< the probe being sent
+	struct usbi3c_autotune_result *result;	   ///< where the outcome of the commands is accumulated
+	uint64_t bytes;				   ///< number of bytes written and read successfully
+	atomic_int responses;			   ///< number of responses received
+};
+
+/**
+ * @brief A command of a probe round, used as user data of its response.
+ */
+struct autotune_command {
+	struct autotune_round *round; ///< the round the command belongs to
+	uint8_t direction;	      ///< USBI3C_WRITE or USBI3C_READ
+};
+
+static int autotune_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct autotune_command *command = (struct autotune_command *)user_data;
+	struct autotune_round *round = command->round;
+	const struct usbi3c_autotune_probe *probe = round->probe;
+
+	if (response->attempted != USBI3C_COMMAND_ATTEMPTED) {
+		round->result->other_errors++;
+	} else if (response->error_status == USBI3C_FAILED_CRC_ERROR) {
+		round->result->crc_errors++;
+	} else if (response->error_status == USBI3C_FAILED_PARITY_ERROR) {
+		round->result->parity_errors++;
+	} else if (response->error_status == USBI3C_FAILED_FRAME_ERROR) {
+		round->result->frame_errors++;
+	} else if (response->error_status != USBI3C_SUCCEEDED) {
+		round->result->other_errors++;
+	} else if (command->direction == USBI3C_WRITE) {
+		round->bytes += probe->write_size;
+	} else if (response->data_length < probe->read_size ||
+		   (probe->expected_data && memcmp(response->data, probe->expected_data, probe->read_size) != 0)) {
+		/* the data got corrupted without the I3C function noticing */
+		round->result->other_errors++;
+	} else {
+		round->bytes += probe->read_size;
+	}
+	atomic_fetch_add(&round->responses, 1);
+
+	return 0;
+}
+
+/* sends one round of the probe and waits for its responses */
+static int autotune_send_round(struct usbi3c_device *usbi3c_dev, uint8_t address, struct i3c_mode *i3c_mode, struct autotune_round *round, int timeout)
+{
+	const struct usbi3c_autotune_probe *probe = round->probe;
+	struct autotune_command commands[2] = { { round, USBI3C_WRITE }, { round, USBI3C_READ } };
+	struct list *batch = NULL;
+	struct list *request_ids = NULL;
+	const int NOT_APPLICABLE = 0;
+	int sent = 0;
+	time_t initial_time;
+
+	atomic_store(&round->responses, 0);
+	for (int i = 0; i < 2; i++) {
+		uint32_t size = commands[i].direction == USBI3C_WRITE ? probe->write_size : probe->read_size;
+
+		if (size == 0) {
+			continue;
+		}
+		/* keep going after an error so every command of the round gets an outcome */
+		if (bulk_transfer_enqueue_command(&batch,
+						  REGULAR_COMMAND,
+						  address,
+						  commands[i].direction,
+						  USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK,
+						  i3c_mode,
+						  NOT_APPLICABLE,
+						  NOT_APPLICABLE,
+						  commands[i].direction == USBI3C_WRITE ? probe->write_data : NULL,
+						  size,
+						  autotune_response_cb,
+						  &commands[i]) < 0) {
+			bulk_transfer_free_commands(&batch);
+			return -1;
+		}
+		sent++;
+	}
+
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, batch, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	bulk_transfer_free_commands(&batch);
+	if (request_ids == NULL) {
+		return -1;
+	}
+	round->result->commands += sent;
+
+	initial_time = time(NULL);
+	while (atomic_load(&round->responses) < sent) {
+		if (timeout > 0 && (time(NULL) > initial_time + timeout)) {
+			DEBUG_PRINT("Timeout waiting for the responses of the probe\n");
+			/* the commands refer to the round, so no callback can run after we return */
+			bulk_transfer_untrack_requests(usbi3c_dev->request_tracker->regular_requests, request_ids);
+			list_free_list_and_data(&request_ids, free);
+			return -1;
+		}
+		usb_wait_for_next_event(usbi3c_dev->usb_dev);
+	}
+	list_free_list_and_data(&request_ids, free);
+
+	return 0;
+}
+
+/* gets the nominal bit rate of a mode and rate in Kbps, used to rank the candidates */
+static double autotune_nominal_rate(const struct usbi3c_bus_capabilities *capabilities, uint8_t transfer_mode, uint8_t transfer_rate)
+{
+	static const double i3c_rates_khz[] = { 2000, 4000, 6000, 8000, 12500 };
+	static const double i2c_rates_khz[] = { 100, 400, 1000 };
+	double rate = 0;
+
+	if (transfer_mode == USBI3C_I2C_MODE) {
+		if (transfer_rate <= USBI3C_I2C_RATE_1_MHZ) {
+			return i2c_rates_khz[transfer_rate];
+		}
+		/* the user defined I2C rates are in Hz */
+		switch (transfer_rate) {
+		case USBI3C_I2C_RATE_USER_DEFINED_1:
+			return capabilities->clock_frequency_i2c_udr1 / 1000.0;
+		case USBI3C_I2C_RATE_USER_DEFINED_2:
+			return capabilities->clock_frequency_i2c_udr2 / 1000.0;
+		default:
+			return capabilities->clock_frequency_i2c_udr3 / 1000.0;
+		}
+	}
+
+	if (transfer_rate <= USBI3C_I3C_RATE_12_5_MHZ) {
+		rate = i3c_rates_khz[transfer_rate];
+	} else if (transfer_rate == USBI3C_I3C_RATE_USER_DEFINED_1) {
+		rate = capabilities->clock_frequency_i3c_udr1;
+	} else {
+		rate = capabilities->clock_frequency_i3c_udr2;
+	}
+
+	/* HDR-DDR and HDR-BT transfer data on both edges, HDR-TS uses ternary symbols */
+	switch (transfer_mode) {
+	case USBI3C_I3C_HDR_DDR_MODE:
+	case USBI3C_I3C_DDR_BT_MODE:
+		return rate * 2;
+	case USBI3C_I3C_HDR_TS_MODE:
+		return rate * 1.5;
+	default:
+		return rate;
+	}
+}
+
+/* lists the modes and rates supported by the I3C controller for a type of target device */
+static int autotune_candidates(const struct usbi3c_bus_capabilities *capabilities, uint8_t target_type, struct i3c_mode *candidates)
+{
+	uint8_t rates = capabilities->i3c_data_transfer_rates;
+	int count = 0;
+
+	if (target_type == USBI3C_I2C_DEVICE) {
+		rates = capabilities->i2c_data_transfer_rates;
+	}
+	/* a controller that does not report its rates supports at least the slowest one */
+	if (rates == 0) {
+		rates = 1;
+	}
+
+	for (uint8_t mode = 0; mode < AUTOTUNE_I3C_MODES; mode++) {
+		uint8_t transfer_mode = mode;
+
+		if (target_type == USBI3C_I2C_DEVICE) {
+			if (mode > 0) {
+				break;
+			}
+			transfer_mode = USBI3C_I2C_MODE;
+		} else if (mode > 0 && (capabilities->i3c_data_transfer_modes & (1 << mode)) == 0) {
+			/* SDR is always supported, the HDR modes only if reported */
+			continue;
+		}
+
+		for (uint8_t rate = 0; rate < AUTOTUNE_RATES; rate++) {
+			if (rates & (1 << rate)) {
+				candidates[count].transfer_mode = transfer_mode;
+				candidates[count].transfer_rate = rate;
+				candidates[count].tm_specific_info = 0;
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * @brief Probes a target device at every mode and rate supported and keeps the fastest reliable one.
+ *
+ * The probe is sent the number of rounds requested at every mode and rate supported
+ * by the I3C controller for the type of target device. The candidates that completed
+ * every command without errors are ranked by their nominal bit rate rather than by
+ * the throughput measured, which a short probe cannot measure reliably since it is
+ * dominated by the USB transfers. The best candidate is stored as the profile of the
+ * target device so it is used by the commands sent to it from then on.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] probe the loopback transfer to send at each mode and rate
+ * @param[out] results the outcome of each mode and rate probed, can be NULL
+ * @param[in] max_results the max number of results to store
+ * @param[in] timeout the maximum time in seconds to wait for the responses of each round
+ * @return the number of modes and rates probed, or -1 if none of them was reliable or on failure
+ */
+int rate_autotune_target(struct usbi3c_device *usbi3c_dev, uint8_t address, const struct usbi3c_autotune_probe *probe, struct usbi3c_autotune_result *results, size_t max_results, int timeout)
+{
+	const struct usbi3c_bus_capabilities *capabilities = &usbi3c_dev->device_info->capabilities;
+	struct usbi3c_autotune_result outcomes[AUTOTUNE_MAX_CANDIDATES] = { 0 };
+	struct i3c_mode candidates[AUTOTUNE_MAX_CANDIDATES];
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	struct autotune_round round = { 0 };
+	double best_rate = 0;
+	int best = -1;
+	int count = 0;
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+	count = autotune_candidates(capabilities, device->device_data.target_type, candidates);
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	round.probe = probe;
+	for (int i = 0; i < count; i++) {
+		struct usbi3c_autotune_result *result = &outcomes[i];
+		uint64_t start_us = 0;
+
+		result->transfer_mode = candidates[i].transfer_mode;
+		result->transfer_rate = candidates[i].transfer_rate;
+		round.result = result;
+		round.bytes = 0;
+
+		start_us = monotonic_time_us();
+		for (uint32_t r = 0; r < probe->rounds; r++) {
+			if (autotune_send_round(usbi3c_dev, address, &candidates[i], &round, timeout) < 0) {
+				DEBUG_PRINT("The probe could not be completed, aborting...\n");
+				return -1;
+			}
+		}
+		result->elapsed_us = monotonic_time_us() - start_us;
+		if (result->elapsed_us > 0) {
+			result->throughput = (double)round.bytes * 1000000 / result->elapsed_us;
+		}
+
+		if (result->crc_errors + result->parity_errors + result->frame_errors + result->other_errors == 0) {
+			double rate = autotune_nominal_rate(capabilities, result->transfer_mode, result->transfer_rate);
+			if (best < 0 || rate > best_rate) {
+				best = i;
+				best_rate = rate;
+			}
+		}
+	}
+
+	if (results) {
+		for (int i = 0; i < count && (size_t)i < max_results; i++) {
+			results[i] = outcomes[i];
+		}
+	}
+
+	if (best < 0) {
+		DEBUG_PRINT("The target device did not work reliably at any mode and rate\n");
+		return -1;
+	}
+
+	if (table_set_device_profile(usbi3c_dev->target_device_table, address, &candidates[best], PROFILE_TUNED) < 0) {
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+
+	return count;
+}
@@ -0,0 +1,487 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <string.h>
+
+#include "regmap_i.h"
+#include "target_device_table_i.h"
+
+/* registers cached per target device, the cache is allocated up front */
+#define REGMAP_MAX_REGISTERS 0x10000
+/* reads have to be 32-bit aligned */
+#define REGMAP_READ_SIZE sizeof(uint32_t)
+
+#define REGISTER_VALID 0x1
+#define REGISTER_DIRTY 0x2
+
+/**
+ * @brief The register map of a target device and the cache of its registers.
+ */
+struct regmap {
+	uint32_t handle;			       ///< the target handle of the target device, so the cache follows it when its address changes
+	struct usbi3c_regmap_config config;	       ///< the layout of the registers, volatile_ranges points to the copy owned by the map
+	struct usbi3c_register_range *volatile_ranges; ///< the ranges of registers that are never cached
+	uint32_t *values;			       ///< the cached value of each register
+	uint8_t *state;				       ///< REGISTER_VALID and REGISTER_DIRTY flags of each register
+	uint8_t defer_writes;			       ///< TRUE if the writes to cacheable registers are kept in the cache until the next sync
+	struct usbi3c_regmap_stats stats;	       ///< counters exposed to the user
+};
+
+/**
+ * @brief Creates the register map of a target device.
+ *
+ * The register map is bound to the target handle of the target device, so its cache
+ * stays with the target device when its dynamic address changes.
+ *
+ * @param[in] handle the target handle of the target device
+ * @param[in] config the layout of the registers of the target device
+ * @return the register map, or NULL if the configuration is invalid
+ */
+struct regmap *regmap_create(uint32_t handle, const struct usbi3c_regmap_config *config)
+{
+	struct regmap *regmap = NULL;
+
+	if (config->register_address_size == 0 || config->register_address_size > sizeof(uint32_t)) {
+		DEBUG_PRINT("Invalid register address size, aborting...\n");
+		return NULL;
+	}
+	if (config->value_size != 1 && config->value_size != 2 && config->value_size != 4) {
+		DEBUG_PRINT("Invalid register value size, aborting...\n");
+		return NULL;
+	}
+	if (config->max_register >= REGMAP_MAX_REGISTERS ||
+	    (config->register_address_size == 1 && config->max_register > UINT8_MAX)) {
+		DEBUG_PRINT("The register map is too large, aborting...\n");
+		return NULL;
+	}
+	if (config->volatile_ranges_count > 0 && config->volatile_ranges == NULL) {
+		DEBUG_PRINT("The volatile ranges are missing, aborting...\n");
+		return NULL;
+	}
+	for (uint32_t i = 0; i < config->volatile_ranges_count; i++) {
+		if (config->volatile_ranges[i].first > config->volatile_ranges[i].last ||
+		    config->volatile_ranges[i].last > config->max_register) {
+			DEBUG_PRINT("Invalid volatile range, aborting...\n");
+			return NULL;
+		}
+	}
+
+	regmap = (struct regmap *)malloc_or_die(sizeof(struct regmap));
+	regmap->handle = handle;
+	regmap->config = *config;
+	if (config->volatile_ranges_count > 0) {
+		regmap->volatile_ranges = (struct usbi3c_register_range *)malloc_or_die(sizeof(struct usbi3c_register_range) * config->volatile_ranges_count);
+		memcpy(regmap->volatile_ranges, config->volatile_ranges, sizeof(struct usbi3c_register_range) * config->volatile_ranges_count);
+	}
+	regmap->config.volatile_ranges = regmap->volatile_ranges;
+	regmap->values = (uint32_t *)malloc_or_die(sizeof(uint32_t) * (config->max_register + 1));
+	regmap->state = (uint8_t *)malloc_or_die(config->max_register + 1);
+
+	return regmap;
+}
+
+/**
+ * @brief Destroys a register map, the registers that were not synced are lost.
+ *
+ * @param[in] regmap the register map to destroy
+ */
+void regmap_destroy(struct regmap **regmap)
+{
+	if (regmap == NULL || *regmap == NULL) {
+		return;
+	}
+
+	FREE((*regmap)->volatile_ranges);
+	FREE((*regmap)->values);
+	FREE((*regmap)->state);
+	FREE(*regmap);
+}
+
+static void free_regmap_in_list(void *data)
+{
+	struct regmap *regmap = (struct regmap *)data;
+
+	regmap_destroy(&regmap);
+}
+
+/**
+ * @brief Destroys a list of register maps.
+ *
+ * @param[in] regmaps the list of register maps
+ */
+void regmap_free_list(struct list **regmaps)
+{
+	list_free_list_and_data(regmaps, free_regmap_in_list);
+}
+
+static int compare_regmap_handle(const void *a, const void *b)
+{
+	return ((const struct regmap *)a)->handle != *(const uint32_t *)b;
+}
+
+/**
+ * @brief Finds the register map of a target device.
+ *
+ * @param[in] regmaps the list of register maps
+ * @param[in] handle the target handle of the target device
+ * @return the register map of the target device, or NULL if it has none
+ */
+struct regmap *regmap_find(struct list *regmaps, uint32_t handle)
+{
+	return (struct regmap *)list_search(regmaps, &handle, compare_regmap_handle);
+}
+
+/**
+ * @brief Gets the target handle a register map is bound to.
+ *
+ * @param[in] regmap the register map of the target device
+ * @return the target handle of the target device
+ */
+uint32_t regmap_get_handle(struct regmap *regmap)
+{
+	return regmap->handle;
+}
+
+/**
+ * @brief Removes and destroys the register map of a target device.
+ *
+ * @param[in] regmaps the list of register maps
+ * @param[in] handle the target handle of the target device
+ * @return the new head of the list
+ */
+struct list *regmap_remove(struct list *regmaps, uint32_t handle)
+{
+	struct list *node = list_search_node(regmaps, &handle, compare_regmap_handle);
+
+	if (node == NULL) {
+		return regmaps;
+	}
+
+	return list_free_node(regmaps, node, free_regmap_in_list);
+}
+
+/* gets the current address of the target device of a register map */
+static int regmap_resolve_address(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint8_t *address)
+{
+	if (table_resolve_target_handle(usbi3c_dev->target_device_table, regmap->handle, address) < 0) {
+		DEBUG_PRINT("The target device of the register map is not in the bus, aborting...\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* returns TRUE if a register can be cached */
+static int regmap_cacheable(struct regmap *regmap, uint32_t reg)
+{
+	for (uint32_t i = 0; i < regmap->config.volatile_ranges_count; i++) {
+		if (reg >= regmap->volatile_ranges[i].first && reg <= regmap->volatile_ranges[i].last) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* the register address is always sent MSB first */
+static void regmap_encode_register(struct regmap *regmap, uint32_t reg, unsigned char *buffer)
+{
+	for (uint8_t i = 0; i < regmap->config.register_address_size; i++) {
+		buffer[i] = (reg >> (8 * (regmap->config.register_address_size - 1 - i))) & 0xFF;
+	}
+}
+
+static void regmap_encode_value(struct regmap *regmap, uint32_t value, unsigned char *buffer)
+{
+	uint8_t size = regmap->config.value_size;
+
+	for (uint8_t i = 0; i < size; i++) {
+		uint8_t shift = regmap->config.big_endian ? 8 * (size - 1 - i) : 8 * i;
+		buffer[i] = (value >> shift) & 0xFF;
+	}
+}
+
+static uint32_t regmap_decode_value(struct regmap *regmap, const unsigned char *buffer)
+{
+	uint8_t size = regmap->config.value_size;
+	uint32_t value = 0;
+
+	for (uint8_t i = 0; i < size; i++) {
+		uint8_t shift = regmap->config.big_endian ? 8 * (size - 1 - i) : 8 * i;
+		value |= (uint32_t)buffer[i] << shift;
+	}
+
+	return value;
+}
+
+/* queues the write of a register */
+static int regmap_enqueue_write(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint8_t address, uint32_t reg, uint32_t value)
+{
+	unsigned char buffer[2 * sizeof(uint32_t)];
+
+	regmap_encode_register(regmap, reg, buffer);
+	regmap_encode_value(regmap, value, buffer + regmap->config.register_address_size);
+
+	return usbi3c_enqueue_command(usbi3c_dev, address, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR,
+				      regmap->config.register_address_size + regmap->config.value_size, buffer, NULL, NULL);
+}
+
+/* returns TRUE if a command was executed successfully */
+static int regmap_succeeded(const struct usbi3c_response *response)
+{
+	return response->attempted == USBI3C_COMMAND_ATTEMPTED && response->error_status == USBI3C_SUCCEEDED;
+}
+
+/**
+ * @brief Reads a register of a target device.
+ *
+ * Cacheable registers are read from the target device only the first time, the
+ * value read is cached and the following reads are served from the cache.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] regmap the register map of the target device
+ * @param[in] reg the register to read
+ * @param[out] value the value of the register
+ * @param[in] timeout the maximum time in seconds to wait for the response
+ * @return 0 if the register was read, or -1 otherwise
+ */
+int regmap_read(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint32_t reg, uint32_t *value, int timeout)
+{
+	unsigned char buffer[sizeof(uint32_t)];
+	struct usbi3c_response *response = NULL;
+	struct list *responses = NULL;
+	uint8_t address = 0;
+	int cacheable = FALSE;
+	int ret = -1;
+
+	if (reg > regmap->config.max_register) {
+		DEBUG_PRINT("The register is out of the register map, aborting...\n");
+		return -1;
+	}
+	cacheable = regmap_cacheable(regmap, reg);
+	if (cacheable && (regmap->state[reg] & REGISTER_VALID)) {
+		*value = regmap->values[reg];
+		regmap->stats.cache_hits++;
+		return 0;
+	}
+	if (usbi3c_dev->command_queue) {
+		DEBUG_PRINT("The command queue is not empty, aborting...\n");
+		return -1;
+	}
+	if (regmap_resolve_address(usbi3c_dev, regmap, &address) < 0) {
+		return -1;
+	}
+
+	/* select the register and read its value */
+	regmap_encode_register(regmap, reg, buffer);
+	if (usbi3c_enqueue_command(usbi3c_dev, address, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR,
+				   regmap->config.register_address_size, buffer, NULL, NULL) < 0 ||
+	    usbi3c_enqueue_command(usbi3c_dev, address, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR,
+				   REGMAP_READ_SIZE, NULL, NULL, NULL) < 0) {
+		bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+		return -1;
+	}
+	responses = usbi3c_send_commands(usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, timeout);
+	if (responses == NULL) {
+		return -1;
+	}
+	regmap->stats.bus_reads++;
+
+	response = (struct usbi3c_response *)list_tail(responses)->data;
+	if (list_len(responses) != 2 || !regmap_succeeded((struct usbi3c_response *)responses->data) ||
+	    !regmap_succeeded(response) || response->data_length < regmap->config.value_size) {
+		DEBUG_PRINT("Failed to read register %u of target device %d\n", reg, address);
+		goto FREE_AND_EXIT;
+	}
+	*value = regmap_decode_value(regmap, response->data);
+	if (cacheable) {
+		regmap->values[reg] = *value;
+		regmap->state[reg] = REGISTER_VALID;
+	}
+	ret = 0;
+
+FREE_AND_EXIT:
+	usbi3c_free_responses(&responses);
+
+	return ret;
+}
+
+/**
+ * @brief Writes a register of a target device.
+ *
+ * The write goes through the cache: it is sent to the target device and, if it
+ * succeeds, the cache is updated with the value written. If writes are deferred,
+ * the writes to cacheable registers only update the cache and mark the register
+ * as dirty until the next sync.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] regmap the register map of the target device
+ * @param[in] reg the register to write
+ * @param[in] value the value to write
+ * @param[in] timeout the maximum time in seconds to wait for the response
+ * @return 0 if the register was written, or -1 otherwise
+ */
+int regmap_write(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint32_t reg, uint32_t value, int timeout)
+{
+	struct list *responses = NULL;
+	uint8_t address = 0;
+	int cacheable = FALSE;
+	int ret = -1;
+
+	if (reg > regmap->config.max_register) {
+		DEBUG_PRINT("The register is out of the register map, aborting...\n");
+		return -1;
+	}
+	cacheable = regmap_cacheable(regmap, reg);
+	if (cacheable && regmap->defer_writes) {
+		regmap->values[reg] = value;
+		regmap->state[reg] = REGISTER_VALID | REGISTER_DIRTY;
+		regmap->stats.deferred_writes++;
+		return 0;
+	}
+	if (usbi3c_dev->command_queue) {
+		DEBUG_PRINT("The command queue is not empty, aborting...\n");
+		return -1;
+	}
+	if (regmap_resolve_address(usbi3c_dev, regmap, &address) < 0) {
+		return -1;
+	}
+
+	if (regmap_enqueue_write(usbi3c_dev, regmap, address, reg, value) < 0) {
+		bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+		return -1;
+	}
+	responses = usbi3c_send_commands(usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, timeout);
+	if (responses) {
+		regmap->stats.bus_writes++;
+		if (regmap_succeeded((struct usbi3c_response *)responses->data)) {
+			ret = 0;
+		}
+	}
+	usbi3c_free_responses(&responses);
+
+	if (cacheable) {
+		/* the value of the register is unknown if the write failed */
+		regmap->values[reg] = value;
+		regmap->state[reg] = (ret == 0) ? REGISTER_VALID : 0;
+	}
+	if (ret < 0) {
+		DEBUG_PRINT("Failed to write register %u of target device %d\n", reg, address);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Enables or disables the deferred writes of a register map.
+ *
+ * @param[in] regmap the register map of the target device
+ * @param[in] defer TRUE to keep the writes to cacheable registers in the cache until the next sync
+ */
+void regmap_defer_writes(struct regmap *regmap, uint8_t defer)
+{
+	regmap->defer_writes = defer ? TRUE : FALSE;
+}
+
+/**
+ * @brief Writes the dirty registers of a register map to the target device.
+ *
+ * All the dirty registers are written in a single bulk request, in ascending
+ * register order. The registers whose write fails remain dirty.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] regmap the register map of the target device
+ * @param[in] timeout the maximum time in seconds to wait for the responses
+ * @return the number of registers written, or -1 if any of them could not be written
+ */
+int regmap_sync(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, int timeout)
+{
+	struct list *responses = NULL;
+	struct list *node = NULL;
+	uint32_t reg = 0;
+	uint8_t address = 0;
+	int dirty = 0;
+	int synced = 0;
+
+	if (usbi3c_dev->command_queue) {
+		DEBUG_PRINT("The command queue is not empty, aborting...\n");
+		return -1;
+	}
+	if (regmap_resolve_address(usbi3c_dev, regmap, &address) < 0) {
+		return -1;
+	}
+
+	for (reg = 0; reg <= regmap->config.max_register; reg++) {
+		if ((regmap->state[reg] & REGISTER_DIRTY) == 0) {
+			continue;
+		}
+		if (regmap_enqueue_write(usbi3c_dev, regmap, address, reg, regmap->values[reg]) < 0) {
+			bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+			return -1;
+		}
+		dirty++;
+	}
+	if (dirty == 0) {
+		return 0;
+	}
+
+	responses = usbi3c_send_commands(usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, timeout);
+	if (responses == NULL || list_len(responses) != dirty) {
+		usbi3c_free_responses(&responses);
+		return -1;
+	}
+	regmap->stats.bus_writes += dirty;
+
+	/* the responses are in the order the registers were queued */
+	for (reg = 0, node = responses; reg <= regmap->config.max_register && node; reg++) {
+		if ((regmap->state[reg] & REGISTER_DIRTY) == 0) {
+			continue;
+		}
+		if (regmap_succeeded((struct usbi3c_response *)node->data)) {
+			regmap->state[reg] &= ~REGISTER_DIRTY;
+			synced++;
+		}
+		node = node->next;
+	}
+	usbi3c_free_responses(&responses);
+	regmap->stats.registers_synced += synced;
+
+	if (synced < dirty) {
+		DEBUG_PRINT("Failed to sync %d registers of target device %d\n", dirty - synced, address);
+		return -1;
+	}
+
+	return synced;
+}
+
+/**
+ * @brief Drops the values cached by a register map, including the ones that were not synced.
+ *
+ * @param[in] regmap the register map of the target device
+ */
+void regmap_invalidate(struct regmap *regmap)
+{
+	memset(regmap->state, 0, regmap->config.max_register + 1);
+}
+
+/**
+ * @brief Gets the counters of a register map.
+ *
+ * @param[in] regmap the register map of the target device
+ * @param[out] stats the counters of the register map
+ */
+void regmap_get_stats(struct regmap *regmap, struct usbi3c_regmap_stats *stats)
+{
+	*stats = regmap->stats;
+}
@@ -0,0 +1,35 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __REGMAP_I_H__
+#define __REGMAP_I_H__
+
+#include "usbi3c_i.h"
+
+struct regmap;
+
+struct regmap *regmap_create(uint32_t handle, const struct usbi3c_regmap_config *config);
+void regmap_destroy(struct regmap **regmap);
+void regmap_free_list(struct list **regmaps);
+struct regmap *regmap_find(struct list *regmaps, uint32_t handle);
+uint32_t regmap_get_handle(struct regmap *regmap);
+struct list *regmap_remove(struct list *regmaps, uint32_t handle);
+int regmap_read(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint32_t reg, uint32_t *value, int timeout);
+int regmap_write(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, uint32_t reg, uint32_t value, int timeout);
+void regmap_defer_writes(struct regmap *regmap, uint8_t defer);
+int regmap_sync(struct usbi3c_device *usbi3c_dev, struct regmap *regmap, int timeout);
+void regmap_invalidate(struct regmap *regmap);
+void regmap_get_stats(struct regmap *regmap, struct usbi3c_regmap_stats *stats);
+
+#endif /* end of include guard: __REGMAP_I_H__ */
@@ -0,0 +1,202 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include "request_id_i.h"
+#include "usbi3c_i.h"
+
+/**
+ * @brief Creates a request ID allocator.
+ *
+ * @return a new request ID allocator
+ */
+struct request_id_allocator *request_id_allocator_init(void)
+{
+	struct request_id_allocator *allocator = NULL;
+
+	allocator = (struct request_id_allocator *)malloc_or_die(sizeof(struct request_id_allocator));
+	allocator->max_in_flight = REQUEST_ID_HALF_RANGE;
+	allocator->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(allocator->mutex, NULL);
+
+	return allocator;
+}
+
+/**
+ * @brief Destroys a request ID allocator.
+ *
+ * @param[in] allocator the request ID allocator to destroy
+ */
+void request_id_allocator_destroy(struct request_id_allocator **allocator)
+{
+	if (allocator == NULL || *allocator == NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy((*allocator)->mutex);
+	FREE((*allocator)->mutex);
+	FREE(*allocator);
+}
+
+/**
+ * @brief Configures the max number of request IDs that can be in use at once.
+ *
+ * @param[in] allocator the request ID allocator
+ * @param[in] max_in_flight the max number of IDs in use, from 1 to REQUEST_ID_HALF_RANGE
+ * @return 0 if the max was configured, or -1 otherwise
+ */
+int request_id_set_max_in_flight(struct request_id_allocator *allocator, uint32_t max_in_flight)
+{
+	if (allocator == NULL || max_in_flight == 0 || max_in_flight > REQUEST_ID_HALF_RANGE) {
+		return -1;
+	}
+
+	pthread_mutex_lock(allocator->mutex);
+	allocator->max_in_flight = max_in_flight;
+	pthread_mutex_unlock(allocator->mutex);
+
+	return 0;
+}
+
+static int is_in_use(struct request_id_allocator *allocator, uint16_t request_id)
+{
+	return (allocator->in_use[request_id / 8] >> (request_id % 8)) & 1;
+}
+
+/* frees an ID, the allocator has to be locked */
+static void release_id(struct request_id_allocator *allocator, uint16_t request_id)
+{
+	if (!is_in_use(allocator, request_id)) {
+		return;
+	}
+
+	allocator->in_use[request_id / 8] &= ~(1 << (request_id % 8));
+	allocator->count--;
+
+	/* the IDs in use are within half the range from the oldest one, so
+	 * the next one in use is found before going around */
+	if (allocator->count > 0 && request_id == allocator->oldest) {
+		do {
+			allocator->oldest++;
+		} while (!is_in_use(allocator, allocator->oldest));
+	}
+}
+
+/**
+ * @brief Allocates the IDs of the commands of a bulk request.
+ *
+ * IDs are issued in increasing order, skipping the ones that are still in use. Either all
+ * the IDs are allocated or none of them is, which happens when there would be more IDs in
+ * use than allowed, or when the IDs in use would be too far apart to be compared.
+ *
+ * @param[in] allocator the request ID allocator
+ * @param[out] request_ids the IDs allocated
+ * @param[in] count the number of IDs to allocate
+ * @return 0 if the IDs were allocated, or -1 otherwise
+ */
+int request_id_alloc(struct request_id_allocator *allocator, uint16_t *request_ids, int count)
+{
+	uint16_t candidate = 0;
+	int allocated = 0;
+
+	if (allocator == NULL || request_ids == NULL || count <= 0) {
+		return -1;
+	}
+
+	pthread_mutex_lock(allocator->mutex);
+	candidate = allocator->next;
+	for (allocated = 0; allocated < count; allocated++) {
+		if (allocator->count >= allocator->max_in_flight) {
+			break;
+		}
+		while (is_in_use(allocator, candidate)) {
+			candidate++;
+		}
+		if (allocator->count == 0) {
+			allocator->oldest = candidate;
+		} else if ((uint16_t)(candidate - allocator->oldest) >= REQUEST_ID_HALF_RANGE) {
+			break;
+		}
+		allocator->in_use[candidate / 8] |= 1 << (candidate % 8);
+		allocator->count++;
+		request_ids[allocated] = candidate++;
+	}
+
+	if (allocated < count) {
+		DEBUG_PRINT("There are too many requests in flight\n");
+		while (allocated > 0) {
+			release_id(allocator, request_ids[--allocated]);
+		}
+		pthread_mutex_unlock(allocator->mutex);
+		return -1;
+	}
+	allocator->next = candidate;
+	pthread_mutex_unlock(allocator->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief Frees a request ID once its request is no longer tracked.
+ *
+ * @param[in] allocator the request ID allocator
+ * @param[in] request_id the ID to free
+ */
+void request_id_free(struct request_id_allocator *allocator, uint16_t request_id)
+{
+	if (allocator == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(allocator->mutex);
+	release_id(allocator, request_id);
+	pthread_mutex_unlock(allocator->mutex);
+}
+
+/**
+ * @brief Gets the number of request IDs in use.
+ *
+ * @param[in] allocator the request ID allocator
+ * @return the number of IDs in use
+ */
+uint32_t request_id_in_use(struct request_id_allocator *allocator)
+{
+	uint32_t count = 0;
+
+	if (allocator == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(allocator->mutex);
+	count = allocator->count;
+	pthread_mutex_unlock(allocator->mutex);
+
+	return count;
+}
+
+/**
+ * @brief Checks if a request ID was issued after another one.
+ *
+ * The IDs wrap around, so they are compared using serial number arithmetic, which is
+ * correct as long as the IDs are less than half the range apart.
+ *
+ * @param[in] a the request ID to check
+ * @param[in] b the request ID to compare against
+ * @return TRUE if a was issued after b, or FALSE otherwise
+ */
+int request_id_is_after(uint16_t a, uint16_t b)
+{
+	uint16_t distance = a - b;
+
+	return distance != 0 && distance < REQUEST_ID_HALF_RANGE;
+}
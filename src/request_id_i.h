@@ -0,0 +1,47 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __REQUEST_ID_I_H__
+#define __REQUEST_ID_I_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define REQUEST_ID_RANGE (UINT16_MAX + 1)
+
+/* request IDs are compared using serial number arithmetic, so the IDs in use
+ * can't be further apart than half the range of IDs */
+#define REQUEST_ID_HALF_RANGE 0x8000
+
+/**
+ * @brief The IDs of the requests being tracked.
+ */
+struct request_id_allocator {
+	uint8_t in_use[REQUEST_ID_RANGE / 8]; ///< bitmap of the IDs in use
+	uint32_t count;			      ///< number of IDs in use
+	uint32_t max_in_flight;		      ///< max number of IDs that can be in use at once
+	uint16_t oldest;		      ///< the oldest ID in use, only valid if count is not 0
+	uint16_t next;			      ///< the next ID to try, IDs increase monotonically and wrap around
+	pthread_mutex_t *mutex;		      ///< mutex to protect the allocator from concurrent access
+};
+
+struct request_id_allocator *request_id_allocator_init(void);
+void request_id_allocator_destroy(struct request_id_allocator **allocator);
+int request_id_set_max_in_flight(struct request_id_allocator *allocator, uint32_t max_in_flight);
+int request_id_alloc(struct request_id_allocator *allocator, uint16_t *request_ids, int count);
+void request_id_free(struct request_id_allocator *allocator, uint16_t request_id);
+uint32_t request_id_in_use(struct request_id_allocator *allocator);
+int request_id_is_after(uint16_t a, uint16_t b);
+
+#endif /* end of include guard: __REQUEST_ID_I_H__ */
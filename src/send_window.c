@@ -0,0 +1,321 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "send_window_i.h"
+#include "usbi3c_i.h"
+
+/**
+ * @brief The bulk requests that can be in flight at once, and the producers to notify once there is room for more.
+ */
+struct send_window {
+	uint32_t max_requests;			 ///< max number of bulk requests in flight, 0 if not limited
+	uint32_t max_bytes;			 ///< max number of bytes in flight, 0 if not limited
+	uint32_t requests;			 ///< bulk requests sent whose response has not been received
+	uint32_t bytes;				 ///< bytes of the I3C function buffer taken by the requests in flight and their responses
+	uint8_t blocked;			 ///< TRUE if a submission was refused since the last time the producers were notified
+	uint8_t writable;			 ///< TRUE if the window became writable and the on_writable_cb function was not called yet
+	on_submit_writable_fn on_writable_cb;	 ///< function called when the window becomes writable after a submission was refused
+	void *user_data;			 ///< user data to share with the on_writable_cb function
+	int event_fd;				 ///< eventfd signaled when the window becomes writable, -1 if it was not requested
+	struct usbi3c_submit_window_stats stats; ///< counters exposed to the user
+	pthread_mutex_t *mutex;			 ///< mutex to protect the window from concurrent access
+};
+
+/**
+ * @brief Creates a send window, the window is not limited by default.
+ *
+ * @return a new send window
+ */
+struct send_window *send_window_init(void)
+{
+	struct send_window *window = NULL;
+
+	window = (struct send_window *)malloc_or_die(sizeof(struct send_window));
+	window->event_fd = -1;
+	window->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(window->mutex, NULL);
+
+	return window;
+}
+
+/**
+ * @brief Destroys a send window.
+ *
+ * @param[in] window the send window to destroy
+ */
+void send_window_destroy(struct send_window **window)
+{
+	if (window == NULL || *window == NULL) {
+		return;
+	}
+
+	if ((*window)->event_fd >= 0) {
+		close((*window)->event_fd);
+	}
+	pthread_mutex_destroy((*window)->mutex);
+	FREE((*window)->mutex);
+	FREE(*window);
+}
+
+/**
+ * @brief Configures the max amount of work that can be in flight at once.
+ *
+ * The limits only apply to non-blocking submissions, and a bulk request is always
+ * accepted when there are no other requests in flight.
+ *
+ * @param[in] window the send window
+ * @param[in] max_requests the max number of bulk requests in flight, 0 to not limit them
+ * @param[in] max_bytes the max number of bytes in flight, 0 to not limit them
+ */
+void send_window_set_limits(struct send_window *window, uint32_t max_requests, uint32_t max_bytes)
+{
+	if (window == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	window->max_requests = max_requests;
+	window->max_bytes = max_bytes;
+	pthread_mutex_unlock(window->mutex);
+}
+
+/**
+ * @brief Assigns the function to call when the window becomes writable after a submission was refused.
+ *
+ * @param[in] window the send window
+ * @param[in] on_writable_cb the function to call, or NULL to remove it
+ * @param[in] user_data the data to share with the function
+ */
+void send_window_set_writable_callback(struct send_window *window, on_submit_writable_fn on_writable_cb, void *user_data)
+{
+	if (window == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	window->on_writable_cb = on_writable_cb;
+	window->user_data = user_data;
+	pthread_mutex_unlock(window->mutex);
+}
+
+/**
+ * @brief Gets an eventfd that is signaled when the window becomes writable after a submission was refused.
+ *
+ * The eventfd is created the first time it is requested and is owned by the window.
+ *
+ * @param[in] window the send window
+ * @return the file descriptor of the eventfd, or -1 if it could not be created
+ */
+int send_window_get_event_fd(struct send_window *window)
+{
+	int fd = -1;
+
+	if (window == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	if (window->event_fd < 0) {
+		window->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (window->event_fd < 0) {
+			DEBUG_PRINT("The eventfd could not be created\n");
+		}
+	}
+	fd = window->event_fd;
+	pthread_mutex_unlock(window->mutex);
+
+	return fd;
+}
+
+/* checks if a bulk request of the given size has to wait for the requests in flight */
+static int send_window_is_full(struct send_window *window, uint32_t bytes)
+{
+	if (window->requests == 0) {
+		return FALSE;
+	}
+	if (window->max_requests && window->requests >= window->max_requests) {
+		return TRUE;
+	}
+	if (window->max_bytes && (uint64_t)window->bytes + bytes > window->max_bytes) {
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * @brief Takes room in the window for a bulk request about to be sent.
+ *
+ * @param[in] window the send window
+ * @param[in] bytes the bytes of the I3C function buffer the request and its response take
+ * @param[in] non_blocking TRUE if the request has to be refused when the window is full
+ * @return 0 if the room was taken, or USBI3C_WOULD_BLOCK if the window is full
+ */
+int send_window_reserve(struct send_window *window, uint32_t bytes, uint8_t non_blocking)
+{
+	int ret = 0;
+
+	if (window == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	if (non_blocking && send_window_is_full(window, bytes)) {
+		window->blocked = TRUE;
+		window->stats.would_block++;
+		ret = USBI3C_WOULD_BLOCK;
+	} else {
+		window->requests++;
+		window->bytes += bytes;
+	}
+	pthread_mutex_unlock(window->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Gives back the room taken by a bulk request that could not be sent.
+ *
+ * @param[in] window the send window
+ * @param[in] bytes the bytes that were taken by the request
+ */
+void send_window_cancel(struct send_window *window, uint32_t bytes)
+{
+	if (window == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	window->requests--;
+	window->bytes -= bytes;
+	pthread_mutex_unlock(window->mutex);
+}
+
+/**
+ * @brief Gives back the room taken by a non-blocking bulk request the I3C function has no buffer for.
+ *
+ * The request can be retried once the requests in flight free some of the I3C function buffer,
+ * if there are none the buffer is just too small for the request.
+ *
+ * @param[in] window the send window
+ * @param[in] bytes the bytes that were taken by the request
+ * @return USBI3C_WOULD_BLOCK if there are other requests in flight, or -1 otherwise
+ */
+int send_window_refuse(struct send_window *window, uint32_t bytes)
+{
+	int ret = -1;
+
+	if (window == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	window->requests--;
+	window->bytes -= bytes;
+	if (window->requests > 0) {
+		window->blocked = TRUE;
+		window->stats.would_block++;
+		ret = USBI3C_WOULD_BLOCK;
+	}
+	pthread_mutex_unlock(window->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Releases the room taken by a bulk request once it is no longer in flight.
+ *
+ * If a submission was refused since the last notification, the eventfd is signaled and
+ * the writable callback is left pending until send_window_notify() is called, since the
+ * room is usually released with the request tracker locked.
+ *
+ * @param[in] window the send window
+ * @param[in] bytes the bytes that were taken by the request
+ */
+void send_window_release(struct send_window *window, uint32_t bytes)
+{
+	if (window == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	window->requests--;
+	window->bytes -= bytes;
+	if (window->blocked) {
+		window->blocked = FALSE;
+		window->stats.notifications++;
+		if (window->event_fd >= 0 && eventfd_write(window->event_fd, 1) < 0) {
+			DEBUG_PRINT("The eventfd could not be signaled\n");
+		}
+		window->writable = TRUE;
+	}
+	pthread_mutex_unlock(window->mutex);
+}
+
+/**
+ * @brief Calls the writable callback if the window became writable since it was last called.
+ *
+ * It has to be called without holding the request tracker lock, so the callback can
+ * submit commands.
+ *
+ * @param[in] window the send window
+ */
+void send_window_notify(struct send_window *window)
+{
+	on_submit_writable_fn on_writable_cb = NULL;
+	void *user_data = NULL;
+
+	if (window == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	if (window->writable) {
+		window->writable = FALSE;
+		on_writable_cb = window->on_writable_cb;
+		user_data = window->user_data;
+	}
+	pthread_mutex_unlock(window->mutex);
+
+	/* the callback is run without holding the window lock */
+	if (on_writable_cb) {
+		on_writable_cb(user_data);
+	}
+}
+
+/**
+ * @brief Gets the counters of the send window.
+ *
+ * @param[in] window the send window
+ * @param[out] stats the counters of the window
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int send_window_get_stats(struct send_window *window, struct usbi3c_submit_window_stats *stats)
+{
+	if (window == NULL || stats == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(window->mutex);
+	*stats = window->stats;
+	stats->requests_in_flight = window->requests;
+	stats->bytes_in_flight = window->bytes;
+	pthread_mutex_unlock(window->mutex);
+
+	return 0;
+}
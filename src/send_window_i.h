@@ -0,0 +1,36 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __SEND_WINDOW_I_H__
+#define __SEND_WINDOW_I_H__
+
+#include <stdint.h>
+
+#include "usbi3c.h"
+
+struct send_window;
+
+struct send_window *send_window_init(void);
+void send_window_destroy(struct send_window **window);
+void send_window_set_limits(struct send_window *window, uint32_t max_requests, uint32_t max_bytes);
+void send_window_set_writable_callback(struct send_window *window, on_submit_writable_fn on_writable_cb, void *user_data);
+int send_window_get_event_fd(struct send_window *window);
+int send_window_reserve(struct send_window *window, uint32_t bytes, uint8_t non_blocking);
+void send_window_cancel(struct send_window *window, uint32_t bytes);
+int send_window_refuse(struct send_window *window, uint32_t bytes);
+void send_window_release(struct send_window *window, uint32_t bytes);
+void send_window_notify(struct send_window *window);
+int send_window_get_stats(struct send_window *window, struct usbi3c_submit_window_stats *stats);
+
+#endif /* end of include guard: __SEND_WINDOW_I_H__ */
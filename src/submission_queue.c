@@ -0,0 +1,416 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+#include <string.h>
+
+#include "submission_queue_i.h"
+
+/* bulk requests sent by the submission queue that can be awaiting their response at once,
+ * a batch of a more urgent class waits for at most this many requests to be answered */
+#define SUBMISSION_MAX_IN_FLIGHT 1
+
+/**
+ * @brief A batch of commands waiting in a submission queue.
+ */
+struct submission {
+	void *batch;		///< the batch of commands, owned by the queue until it is sent
+	uint64_t sequence;	///< the order the batch was submitted in, used to break ties between deadlines
+	uint64_t deadline_us;	///< the time the last command of the batch has to be sent by, UINT64_MAX if it has no deadline
+	uint64_t ready_us;	///< the time the next bulk request of the batch started waiting to be sent
+};
+
+/**
+ * @brief A queue per submission class feeding the bulk requests to the I3C function one at a time.
+ */
+struct submission_queue {
+	struct list *pending[USBI3C_SUBMISSION_CLASSES];	       ///< the batches waiting to be sent in each class
+	struct list *in_flight;					       ///< the ID of the first command of each bulk request awaiting its response
+	uint32_t in_flight_count;				       ///< the bulk requests awaiting their response, including the one being sent
+	struct list *early_responses;				       ///< the IDs of the responses received while a bulk request was being sent
+	uint8_t sending;					       ///< TRUE while a bulk request is being sent
+	uint32_t chunk_size;					       ///< the max size of the chunks the bulk batches are sent in, 0 to send them whole
+	uint64_t next_sequence;					       ///< the sequence number of the next batch submitted
+	submission_send_fn send;				       ///< the function used to send the bulk requests
+	submission_free_fn free_batch;				       ///< the function used to free the batches
+	void *context;						       ///< the context of the send function
+	struct usbi3c_submission_stats stats[USBI3C_SUBMISSION_CLASSES]; ///< counters of each class exposed to the user
+	uint64_t latency_sum_us[USBI3C_SUBMISSION_CLASSES];	       ///< the sum of the time every bulk request of each class waited, used for the mean
+	uint8_t running;					       ///< TRUE while the dispatcher thread has to keep running
+	pthread_t thread;					       ///< the dispatcher thread
+	pthread_mutex_t *mutex;					       ///< mutex to protect the queues from concurrent access
+	pthread_cond_t *changed;				       ///< condition signaled when a batch is submitted, a response is received or the queue is stopped
+};
+
+/**
+ * @brief Creates a submission queue, its thread is not started until submission_queue_start() is called.
+ *
+ * @param[in] send the function used to send the bulk requests
+ * @param[in] free_batch the function used to free the batches once sent, or if they are never sent
+ * @param[in] context the context of the send function
+ * @return the submission queue, or NULL if a function is missing
+ */
+struct submission_queue *submission_queue_init(submission_send_fn send, submission_free_fn free_batch, void *context)
+{
+	struct submission_queue *queue = NULL;
+	pthread_condattr_t attr;
+
+	if (send == NULL || free_batch == NULL) {
+		return NULL;
+	}
+
+	queue = (struct submission_queue *)malloc_or_die(sizeof(struct submission_queue));
+	queue->send = send;
+	queue->free_batch = free_batch;
+	queue->context = context;
+	queue->mutex = (pthread_mutex_t *)malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(queue->mutex, NULL);
+	queue->changed = (pthread_cond_t *)malloc_or_die(sizeof(pthread_cond_t));
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(queue->changed, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return queue;
+}
+
+/**
+ * @brief Stops the thread of a submission queue and destroys it along with the batches not sent.
+ *
+ * @param[in] queue the submission queue to destroy
+ */
+void submission_queue_destroy(struct submission_queue **queue)
+{
+	if (queue == NULL || *queue == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock((*queue)->mutex);
+	if ((*queue)->running) {
+		(*queue)->running = FALSE;
+		pthread_cond_broadcast((*queue)->changed);
+		pthread_mutex_unlock((*queue)->mutex);
+		pthread_join((*queue)->thread, NULL);
+	} else {
+		pthread_mutex_unlock((*queue)->mutex);
+	}
+
+	for (int i = 0; i < USBI3C_SUBMISSION_CLASSES; i++) {
+		for (struct list *node = (*queue)->pending[i]; node; node = node->next) {
+			(*queue)->free_batch(((struct submission *)node->data)->batch);
+		}
+		list_free_list_and_data(&(*queue)->pending[i], free);
+	}
+	list_free_list_and_data(&(*queue)->in_flight, free);
+	list_free_list_and_data(&(*queue)->early_responses, free);
+	pthread_cond_destroy((*queue)->changed);
+	FREE((*queue)->changed);
+	pthread_mutex_destroy((*queue)->mutex);
+	FREE((*queue)->mutex);
+	FREE(*queue);
+}
+
+/* TRUE if there is a batch waiting and room to send it, the queue has to be locked */
+static int submission_queue_ready(struct submission_queue *queue)
+{
+	if (queue->in_flight_count >= SUBMISSION_MAX_IN_FLIGHT) {
+		return FALSE;
+	}
+	for (int i = 0; i < USBI3C_SUBMISSION_CLASSES; i++) {
+		if (queue->pending[i]) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void *submission_queue_thread(void *arg)
+{
+	struct submission_queue *queue = (struct submission_queue *)arg;
+
+	pthread_mutex_lock(queue->mutex);
+	while (queue->running) {
+		if (!submission_queue_ready(queue)) {
+			pthread_cond_wait(queue->changed, queue->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(queue->mutex);
+		submission_queue_dispatch(queue, monotonic_time_us());
+		pthread_mutex_lock(queue->mutex);
+	}
+	pthread_mutex_unlock(queue->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Starts the thread that sends the batches submitted as the I3C function answers the previous ones.
+ *
+ * @param[in] queue the submission queue
+ * @return 0 if the thread was started, or -1 otherwise
+ */
+int submission_queue_start(struct submission_queue *queue)
+{
+	int err = 0;
+
+	if (queue == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(queue->mutex);
+	if (queue->running) {
+		pthread_mutex_unlock(queue->mutex);
+		return -1;
+	}
+	queue->running = TRUE;
+	if ((err = pthread_create(&queue->thread, NULL, &submission_queue_thread, queue))) {
+		DEBUG_PRINT("pthread_create(): %s\n", strerror(err));
+		queue->running = FALSE;
+	}
+	pthread_mutex_unlock(queue->mutex);
+
+	return err ? -1 : 0;
+}
+
+/**
+ * @brief Sets the max size of the chunks the batches of the bulk class are sent in.
+ *
+ * @param[in] queue the submission queue
+ * @param[in] chunk_size the max number of bytes of data per chunk, 0 to send the batches whole
+ */
+void submission_queue_set_chunk_size(struct submission_queue *queue, uint32_t chunk_size)
+{
+	if (queue == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(queue->mutex);
+	queue->chunk_size = chunk_size;
+	pthread_mutex_unlock(queue->mutex);
+}
+
+/**
+ * @brief Queues a batch of commands to be sent in a submission class.
+ *
+ * @param[in] queue the submission queue
+ * @param[in] submission_class the class to queue the batch in
+ * @param[in] batch the batch of commands, the queue takes ownership of it
+ * @param[in] deadline_us the time from now the last command of the batch has to be sent by in microseconds, 0 if it has no deadline
+ * @param[in] now_us the current time in microseconds
+ * @return 0 if the batch was queued, or -1 otherwise
+ */
+int submission_queue_push(struct submission_queue *queue, enum usbi3c_submission_class submission_class, void *batch, uint32_t deadline_us, uint64_t now_us)
+{
+	struct submission *submission = NULL;
+
+	if (queue == NULL || batch == NULL || submission_class >= USBI3C_SUBMISSION_CLASSES) {
+		return -1;
+	}
+
+	submission = (struct submission *)malloc_or_die(sizeof(struct submission));
+	submission->batch = batch;
+	submission->deadline_us = deadline_us ? now_us + deadline_us : UINT64_MAX;
+	submission->ready_us = now_us;
+
+	pthread_mutex_lock(queue->mutex);
+	submission->sequence = queue->next_sequence++;
+	queue->pending[submission_class] = list_append(queue->pending[submission_class], submission);
+	queue->stats[submission_class].submitted++;
+	queue->stats[submission_class].pending++;
+	pthread_cond_broadcast(queue->changed);
+	pthread_mutex_unlock(queue->mutex);
+
+	return 0;
+}
+
+/* takes the batch to send next out of its queue, the most urgent class goes first and
+ * within a class the earliest deadline, the queue has to be locked */
+static struct submission *submission_queue_pop(struct submission_queue *queue, enum usbi3c_submission_class *submission_class)
+{
+	struct list *next = NULL;
+
+	for (int i = 0; i < USBI3C_SUBMISSION_CLASSES; i++) {
+		for (struct list *node = queue->pending[i]; node; node = node->next) {
+			struct submission *submission = (struct submission *)node->data;
+			struct submission *best = next ? (struct submission *)next->data : NULL;
+			if (best == NULL || submission->deadline_us < best->deadline_us ||
+			    (submission->deadline_us == best->deadline_us && submission->sequence < best->sequence)) {
+				next = node;
+			}
+		}
+		if (next) {
+			struct submission *submission = (struct submission *)next->data;
+			*submission_class = i;
+			queue->pending[i] = list_free_node(queue->pending[i], next, NULL);
+			return submission;
+		}
+	}
+
+	return NULL;
+}
+
+static int compare_request_id_value(const void *a, const void *b)
+{
+	return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+/* accounts for a bulk request that was just sent, the queue has to be locked */
+static void submission_queue_track(struct submission_queue *queue, uint16_t request_id)
+{
+	struct list *node = NULL;
+	uint16_t *id = NULL;
+
+	/* the response may have been received before the request could be tracked */
+	node = list_search_node(queue->early_responses, &request_id, compare_request_id_value);
+	if (node) {
+		queue->in_flight_count--;
+		return;
+	}
+
+	id = (uint16_t *)malloc_or_die(sizeof(uint16_t));
+	*id = request_id;
+	queue->in_flight = list_append(queue->in_flight, id);
+}
+
+/**
+ * @brief Sends the next bulk requests while there is room for them.
+ *
+ * The batch sent next is the one of the most urgent class with the earliest deadline,
+ * the batches without deadline go last in their class in the order they were submitted.
+ * A batch of the bulk class that does not fit in a chunk is sent one chunk at a time,
+ * and goes back to its queue after each chunk so a more urgent batch can go before the
+ * next one. A bulk request whose response is lost is waited for until the request tracker
+ * expires it and reports it as answered, see usbi3c_set_response_timeout().
+ *
+ * @param[in] queue the submission queue
+ * @param[in] now_us the current time in microseconds
+ * @return the number of bulk requests sent, or -1 on failure
+ */
+int submission_queue_dispatch(struct submission_queue *queue, uint64_t now_us)
+{
+	enum usbi3c_submission_class submission_class = USBI3C_REALTIME_SUBMISSION;
+	enum submission_send_result result;
+	struct submission *submission = NULL;
+	struct usbi3c_submission_stats *stats = NULL;
+	uint32_t chunk_size = 0;
+	uint64_t latency_us = 0;
+	uint16_t request_id = 0;
+	int count = 0;
+
+	if (queue == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(queue->mutex);
+	while (queue->in_flight_count < SUBMISSION_MAX_IN_FLIGHT && (submission = submission_queue_pop(queue, &submission_class))) {
+		chunk_size = submission_class == USBI3C_BULK_SUBMISSION ? queue->chunk_size : 0;
+		queue->in_flight_count++;
+		queue->sending = TRUE;
+		pthread_mutex_unlock(queue->mutex);
+
+		result = queue->send(submission->batch, chunk_size, &request_id, queue->context);
+
+		pthread_mutex_lock(queue->mutex);
+		queue->sending = FALSE;
+		stats = &queue->stats[submission_class];
+		if (result == SUBMISSION_SEND_FAILED) {
+			queue->in_flight_count--;
+			stats->failed++;
+		} else {
+			submission_queue_track(queue, request_id);
+			latency_us = now_us > submission->ready_us ? now_us - submission->ready_us : 0;
+			stats->requests++;
+			queue->latency_sum_us[submission_class] += latency_us;
+			if (latency_us > stats->max_latency_us) {
+				stats->max_latency_us = latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us;
+			}
+			count++;
+		}
+		list_free_list_and_data(&queue->early_responses, free);
+
+		if (result == SUBMISSION_SEND_PARTIAL) {
+			submission->ready_us = now_us;
+			queue->pending[submission_class] = list_append(queue->pending[submission_class], submission);
+			continue;
+		}
+		if (result == SUBMISSION_SEND_DONE && now_us > submission->deadline_us) {
+			stats->deadline_misses++;
+		}
+		stats->pending--;
+		/* freeing a batch that was not sent completes its commands through their
+		 * callbacks, which may submit more batches */
+		pthread_mutex_unlock(queue->mutex);
+		queue->free_batch(submission->batch);
+		FREE(submission);
+		pthread_mutex_lock(queue->mutex);
+	}
+	pthread_mutex_unlock(queue->mutex);
+
+	return count;
+}
+
+/**
+ * @brief Accounts for the response to a bulk request, making room for the next one.
+ *
+ * @param[in] queue the submission queue
+ * @param[in] request_id the ID of the first command of the bulk request answered
+ */
+void submission_queue_complete(struct submission_queue *queue, uint16_t request_id)
+{
+	struct list *node = NULL;
+	uint16_t *id = NULL;
+
+	if (queue == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(queue->mutex);
+	node = list_search_node(queue->in_flight, &request_id, compare_request_id_value);
+	if (node) {
+		queue->in_flight = list_free_node(queue->in_flight, node, free);
+		queue->in_flight_count--;
+		pthread_cond_broadcast(queue->changed);
+	} else if (queue->sending) {
+		id = (uint16_t *)malloc_or_die(sizeof(uint16_t));
+		*id = request_id;
+		queue->early_responses = list_append(queue->early_responses, id);
+		pthread_cond_broadcast(queue->changed);
+	}
+	pthread_mutex_unlock(queue->mutex);
+}
+
+/**
+ * @brief Gets the counters of a submission class.
+ *
+ * @param[in] queue the submission queue
+ * @param[in] submission_class the submission class
+ * @param[out] stats the counters of the class
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int submission_queue_get_stats(struct submission_queue *queue, enum usbi3c_submission_class submission_class, struct usbi3c_submission_stats *stats)
+{
+	if (queue == NULL || stats == NULL || submission_class >= USBI3C_SUBMISSION_CLASSES) {
+		return -1;
+	}
+
+	pthread_mutex_lock(queue->mutex);
+	*stats = queue->stats[submission_class];
+	if (stats->requests) {
+		stats->mean_latency_us = (uint32_t)(queue->latency_sum_us[submission_class] / stats->requests);
+	}
+	pthread_mutex_unlock(queue->mutex);
+
+	return 0;
+}
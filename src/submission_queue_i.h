@@ -0,0 +1,52 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __SUBMISSION_QUEUE_I_H__
+#define __SUBMISSION_QUEUE_I_H__
+
+#include "usbi3c_i.h"
+
+struct submission_queue;
+
+/**
+ * @brief The result of sending the next part of a batch queued in a submission queue.
+ */
+enum submission_send_result {
+	SUBMISSION_SEND_FAILED = -1, ///< the batch could not be sent, it has to be dropped
+	SUBMISSION_SEND_DONE = 0,    ///< the last part of the batch was sent
+	SUBMISSION_SEND_PARTIAL = 1  ///< a chunk of the batch was sent, the rest of it has to wait for its turn
+};
+
+/**
+ * @brief Function used by the submission queue to send the next bulk request of a batch.
+ *
+ * If max_chunk_size is not 0 only as many commands as fit in it (at least one) are sent.
+ */
+typedef enum submission_send_result (*submission_send_fn)(void *batch, uint32_t max_chunk_size, uint16_t *request_id, void *context);
+
+/**
+ * @brief Function used by the submission queue to free a batch it is done with.
+ */
+typedef void (*submission_free_fn)(void *batch);
+
+struct submission_queue *submission_queue_init(submission_send_fn send, submission_free_fn free_batch, void *context);
+void submission_queue_destroy(struct submission_queue **queue);
+int submission_queue_start(struct submission_queue *queue);
+void submission_queue_set_chunk_size(struct submission_queue *queue, uint32_t chunk_size);
+int submission_queue_push(struct submission_queue *queue, enum usbi3c_submission_class submission_class, void *batch, uint32_t deadline_us, uint64_t now_us);
+int submission_queue_dispatch(struct submission_queue *queue, uint64_t now_us);
+void submission_queue_complete(struct submission_queue *queue, uint16_t request_id);
+int submission_queue_get_stats(struct submission_queue *queue, enum usbi3c_submission_class submission_class, struct usbi3c_submission_stats *stats);
+
+#endif /* end of include guard: __SUBMISSION_QUEUE_I_H__ */
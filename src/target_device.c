@@ -124,56 +124,43 @@ void device_update_from_device_table_entry(struct target_device *device, struct
  */
 int device_create_set_configuration_buffer(uint8_t address, uint8_t config, uint32_t max_ibi_payload_size, uint8_t **buffer)
 {
-	uint16_t buffer_size = TARGET_DEVICE_CONFIG_HEADER_SIZE + TARGET_DEVICE_CONFIG_ENTRY_SIZE;
-	*buffer = (uint8_t *)malloc_or_die(buffer_size);
-
-	GET_TARGET_DEVICE_CONFIG_HEADER(*buffer)->config_change_command_type = CHANGE_CONFIG_COMMAND_TYPE;
-	GET_TARGET_DEVICE_CONFIG_HEADER(*buffer)->numentries = 1;
-
-	GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, 0)->address = address;
-	GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, 0)->target_interrupt_request = config & 0x1;
-	GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, 0)->controller_role_request = (config >> 1) & 0x1;
-	GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, 0)->ibi_timestamp = (config >> 2) & 0x1;
-	GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, 0)->max_ibi_payload_size = max_ibi_payload_size;
+	struct usbi3c_target_device_config device_config = {
+		.address = address,
+		.config = config,
+		.max_ibi_payload_size = max_ibi_payload_size
+	};
 
-	return buffer_size;
-}
-
-/* Gets the size of an address change buffer with N entries */
-static size_t get_address_change_buffer_size(int numentries)
-{
-	return (TARGET_DEVICE_ADDRESS_CHANGE_HEADER_SIZE +
-		(TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_SIZE * numentries));
+	return device_create_set_configurations_buffer(&device_config, 1, buffer);
 }
 
 /**
- * @brief Creates a device address change buffer.
+ * @brief Creates a configuration buffer for several target devices.
  *
- * This buffer contains the required data structure that needs to be sent
- * to the I3C Function in the CHANGE_DYNAMIC_ADDRESS request to change the
- * address of one target device.
+ * This buffer can be sent in a single request to the I3C function to update the
+ * configuration of every target device listed.
  *
- * @param[in] device the I3C device that is to have its address changed
- * @param[in] address 7 bits of the current dynamic address (bits 6:0) of the Target device and 1 bit (bit 7) set to 0
- * @param[in] new_address 7 bits of the new dynamic address (bits 6:0) of the Target device and 1 bit (bit 7) set to 0
- * @param[out] buffer the generated buffer with the address change data structure
+ * @param[in] configs the configuration of each target device
+ * @param[in] count the number of target devices to configure
+ * @param[out] buffer the generated buffer
  * @return the size of the generated buffer
  */
-uint16_t device_create_address_change_buffer(struct target_device *device, uint8_t address, uint8_t new_address, uint8_t **buffer)
+int device_create_set_configurations_buffer(const struct usbi3c_target_device_config *configs, uint8_t count, uint8_t **buffer)
 {
-	const int NUMENTRIES = 1; // we are changing the address of just one device
-	size_t buffer_size = get_address_change_buffer_size(NUMENTRIES);
+	uint16_t buffer_size = TARGET_DEVICE_CONFIG_HEADER_SIZE + (TARGET_DEVICE_CONFIG_ENTRY_SIZE * count);
 	*buffer = (uint8_t *)malloc_or_die(buffer_size);
 
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(*buffer)->address_change_command_type = ADDRESS_CHANGE_COMMAND_TYPE;
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(*buffer)->numentries = NUMENTRIES;
-
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, 0)->current_address = address;
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, 0)->new_address = new_address;
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, 0)->pid_lo = device->pid_lo;
-	GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, 0)->pid_hi = device->pid_hi;
+	GET_TARGET_DEVICE_CONFIG_HEADER(*buffer)->config_change_command_type = CHANGE_CONFIG_COMMAND_TYPE;
+	GET_TARGET_DEVICE_CONFIG_HEADER(*buffer)->numentries = count;
+
+	for (int i = 0; i < count; i++) {
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, i)->address = configs[i].address;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, i)->target_interrupt_request = configs[i].config & 0x1;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, i)->controller_role_request = (configs[i].config >> 1) & 0x1;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, i)->ibi_timestamp = (configs[i].config >> 2) & 0x1;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(*buffer, i)->max_ibi_payload_size = configs[i].max_ibi_payload_size;
+	}
 
-	return (uint16_t)buffer_size;
+	return buffer_size;
 }
 
 /**
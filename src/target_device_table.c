@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "device_cache_i.h"
 #include "target_device_table_i.h"
 #include "usbi3c_i.h"
 
@@ -36,7 +37,9 @@ void table_destroy(struct target_device_table **table)
 	}
 	pthread_mutex_lock((*table)->mutex);
 	list_free_list_and_data(&(*table)->target_devices, free);
-	table_free_address_change_request_tracker(&(*table)->address_change_tracker);
+	table_free_address_change_request_tracker(*table);
+	list_free_list_and_data(&(*table)->retired_snapshots, free);
+	FREE((*table)->snapshot);
 	pthread_mutex_unlock((*table)->mutex);
 	pthread_mutex_destroy((*table)->mutex);
 	FREE((*table)->mutex);
@@ -78,11 +81,75 @@ static void free_address_change_request_in_list(void *data)
 /**
  * @brief Empties the address change request tracker.
  *
- * @param[in] tracker the address change request tracker
+ * @param[in] table the target device table
+ */
+void table_free_address_change_request_tracker(struct target_device_table *table)
+{
+	for (int i = 0; i < ADDRESS_LEN; i++) {
+		list_free_list_and_data(&table->address_change_tracker[i], free_address_change_request_in_list);
+	}
+}
+
+/**
+ * @brief Adds an address change request to the tracker until its result is received.
+ *
+ * @param[in] table the target device table
+ * @param[in] current_address the current address of the target device
+ * @param[in] new_address the new address requested for the target device
+ * @param[in] on_address_change_cb the callback function to run when the address change is processed
+ * @param[in] user_data the data to share with the callback function
+ */
+void table_track_address_change(struct target_device_table *table, uint8_t current_address, uint8_t new_address, on_address_change_fn on_address_change_cb, void *user_data)
+{
+	struct address_change_request *request = NULL;
+
+	request = (struct address_change_request *)malloc_or_die(sizeof(struct address_change_request));
+	request->request_id = (current_address << 8) + new_address;
+	request->on_address_change_cb = on_address_change_cb;
+	request->user_data = user_data;
+
+	pthread_mutex_lock(table->mutex);
+	table->address_change_tracker[current_address] = list_append(table->address_change_tracker[current_address], request);
+	pthread_mutex_unlock(table->mutex);
+}
+
+/**
+ * @brief Removes an address change request from the tracker.
+ *
+ * @param[in] table the target device table
+ * @param[in] current_address the current address of the target device
+ * @param[in] new_address the new address requested for the target device
+ * @return the request removed from the tracker, or NULL if it was not being tracked
+ */
+static struct address_change_request *table_pop_address_change(struct target_device_table *table, uint8_t current_address, uint8_t new_address)
+{
+	struct address_change_request *request = NULL;
+	struct list *node = NULL;
+	uint16_t request_id = (current_address << 8) + new_address;
+
+	pthread_mutex_lock(table->mutex);
+	node = list_search_node(table->address_change_tracker[current_address], &request_id, compare_address_change_request_id);
+	if (node != NULL) {
+		request = (struct address_change_request *)node->data;
+		table->address_change_tracker[current_address] = list_free_node(table->address_change_tracker[current_address], node, NULL);
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	return request;
+}
+
+/**
+ * @brief Stops tracking an address change request that could not be submitted.
+ *
+ * @param[in] table the target device table
+ * @param[in] current_address the current address of the target device
+ * @param[in] new_address the new address requested for the target device
  */
-void table_free_address_change_request_tracker(struct list **tracker)
+void table_untrack_address_change(struct target_device_table *table, uint8_t current_address, uint8_t new_address)
 {
-	list_free_list_and_data(tracker, free_address_change_request_in_list);
+	struct address_change_request *request = table_pop_address_change(table, current_address, new_address);
+
+	FREE(request);
 }
 
 /**
@@ -96,9 +163,17 @@ static void get_address_change_result_async(void *user_context, unsigned char *b
 {
 	struct target_device_table *table = (struct target_device_table *)user_context;
 	struct address_change_request *request = NULL;
-	struct list *node = NULL;
+	int numentries = 0;
 
-	for (int i = 0; i < GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_HEADER(buffer)->numentries; i++) {
+	/* never read entries beyond the data received */
+	numentries = GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_HEADER(buffer)->numentries;
+	if (buffer_size < TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_OFFSET) {
+		numentries = 0;
+	} else if (numentries > (buffer_size - TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_OFFSET) / TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_SIZE) {
+		numentries = (buffer_size - TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_OFFSET) / TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_SIZE;
+	}
+
+	for (int i = 0; i < numentries; i++) {
 		uint8_t old_addr = GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(buffer, i)->current_address;
 		uint8_t new_addr = GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(buffer, i)->new_address;
 		uint8_t request_status = GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(buffer, i)->status;
@@ -112,27 +187,25 @@ static void get_address_change_result_async(void *user_context, unsigned char *b
 			DEBUG_PRINT("The I3C function reported that the address change failed from %d to %d\n", old_addr, new_addr);
 		}
 
-		/* execute the user's callback so they know the address change request was processed */
-		uint16_t request_id = (old_addr << 8) + new_addr;
-		node = list_search_node(table->address_change_tracker, &request_id, compare_address_change_request_id);
-		if (node == NULL) {
+		/* execute the user's callback so they know the address change request was processed,
+		 * the request is no longer tracked after this */
+		request = table_pop_address_change(table, old_addr, new_addr);
+		if (request == NULL) {
 			DEBUG_PRINT("No address change request was found that matches old address: %d, new address: %d in the tracker\n", old_addr, new_addr);
 			continue;
 		}
-		request = (struct address_change_request *)node->data;
 		if (request->on_address_change_cb) {
 			request->on_address_change_cb(old_addr, new_addr, request_status, request->user_data);
-			/* the callback was executed, we no longer need to track this request */
-			pthread_mutex_lock(table->mutex);
-			table->address_change_tracker = list_free_node(table->address_change_tracker, node, free_address_change_request_in_list);
-			pthread_mutex_unlock(table->mutex);
 		}
+		FREE(request);
 	}
 }
-
 /**
  * @brief Updates the local target device table from a GET_TARGET_DEVICE_TABLE request buffer.
  *
+ * If the table was reported to change again while the request was in flight, a single
+ * follow-up request is submitted to pick up those changes.
+ *
  * @note This function is asynchronous and expected to be used as a callback for an async
  * GET_TARGET_DEVICE_TABLE request.
  *
@@ -143,7 +216,79 @@ static void get_address_change_result_async(void *user_context, unsigned char *b
 static void update_target_device_info_async(void *user_context, unsigned char *buffer, uint16_t buffer_size)
 {
 	struct target_device_table *table = (struct target_device_table *)user_context;
-	table_fill_from_device_table_buffer(table, buffer, GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size);
+	uint16_t table_size = 0;
+	int follow_up = FALSE;
+
+	if (buffer_size >= TARGET_DEVICE_HEADER_SIZE) {
+		table_size = GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size;
+		if (table_size > buffer_size) {
+			table_size = buffer_size;
+		}
+		if (table_apply_device_table_buffer(table, buffer, table_size) < 0) {
+			DEBUG_PRINT("There was an error updating the target device table\n");
+		}
+	}
+
+	pthread_mutex_lock(table->mutex);
+	table->refresh_in_flight = FALSE;
+	follow_up = table->refresh_pending;
+	pthread_mutex_unlock(table->mutex);
+
+	if (follow_up) {
+		table_request_refresh(table);
+	}
+}
+
+/**
+ * @brief Requests the I3C function for its target device table to refresh the local one.
+ *
+ * At most one GET_TARGET_DEVICE_TABLE request is kept in flight. Refreshes requested
+ * while there is one in flight are coalesced into a single follow-up request that is
+ * submitted once the one in flight completes, so a burst of Hot-Joins results in at
+ * most two requests. A request that has been in flight longer than the USB timeout is
+ * assumed to be lost, since failed transfers do not complete.
+ *
+ * @param[in] table the target device table
+ * @return 0 if the refresh was submitted or coalesced, or -1 otherwise
+ */
+int table_request_refresh(struct target_device_table *table)
+{
+	uint64_t now_us = monotonic_time_us();
+	int timeout_ms = 0;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	timeout_ms = usb_get_timeout(table->usb_dev);
+
+	pthread_mutex_lock(table->mutex);
+	if (table->refresh_in_flight && (timeout_ms <= 0 || now_us - table->refresh_started_us < (uint64_t)timeout_ms * 1000)) {
+		table->refresh_pending = TRUE;
+		table->refresh_coalesced++;
+		pthread_mutex_unlock(table->mutex);
+		return 0;
+	}
+	table->refresh_in_flight = TRUE;
+	table->refresh_pending = FALSE;
+	table->refresh_started_us = now_us;
+	table->refresh_requests++;
+	pthread_mutex_unlock(table->mutex);
+
+	if (usb_input_control_transfer_async(table->usb_dev,
+					     GET_TARGET_DEVICE_TABLE,
+					     0,
+					     USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX,
+					     update_target_device_info_async,
+					     table) < 0) {
+		DEBUG_PRINT("There was an error submitting the GET_TARGET_DEVICE_TABLE request\n");
+		pthread_mutex_lock(table->mutex);
+		table->refresh_in_flight = FALSE;
+		pthread_mutex_unlock(table->mutex);
+		return -1;
+	}
+
+	return 0;
 }
 
 /**
@@ -185,14 +330,7 @@ void target_device_table_notification_handle(struct notification *notification,
 		}
 	}
 	if (notification->code == HOTJOIN_ADDRESS_ASSIGNMENT_SUCCEEDED) {
-		if (usb_input_control_transfer_async(table->usb_dev,
-						     GET_TARGET_DEVICE_TABLE,
-						     0,
-						     USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX,
-						     update_target_device_info_async,
-						     table) < 0) {
-			DEBUG_PRINT("There was an error submitting the GET_TARGET_DEVICE_TABLE request\n");
-		}
+		table_request_refresh(table);
 	}
 }
 
@@ -210,7 +348,6 @@ struct target_device_table *table_init(struct usb_device *usb_dev)
 	struct target_device_table *table = (struct target_device_table *)malloc_or_die(sizeof(struct target_device_table));
 	table->usb_dev = usb_dev;
 	table->target_devices = NULL;
-	table->address_change_tracker = NULL;
 	table->mutex = malloc_or_die(sizeof(pthread_mutex_t));
 	pthread_mutex_init(table->mutex, NULL);
 	return table;
@@ -302,6 +439,269 @@ static int compare_device_pid(const void *a, const void *b)
 	return 0;
 }
 
+/* gets the 48-bit provisioned ID of a target device */
+static uint64_t device_get_pid(struct target_device *device)
+{
+	return ((uint64_t)device->pid_hi << 16) + device->pid_lo;
+}
+
+/* gets the slot of the PID index where the search for a PID starts,
+ * fibonacci hashing takes the top 8 bits for the 256 slots */
+static int pid_index_home_slot(uint64_t pid)
+{
+	return (int)((pid * 0x9E3779B97F4A7C15ULL) >> 56) & (TABLE_PID_INDEX_LEN - 1);
+}
+
+/**
+ * @brief Adds a target device to the address and PID indexes of the table.
+ *
+ * Devices without an address, or without a PID, are only reachable through the list
+ * of target devices.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] device the target device to index
+ */
+static void table_index_device(struct target_device_table *table, struct target_device *device)
+{
+	uint64_t pid = device_get_pid(device);
+	int slot = 0;
+
+	if (device->target_address != 0 && device->target_address < TABLE_ADDRESS_INDEX_LEN) {
+		table->devices_by_address[device->target_address] = device;
+	}
+
+	if (pid == 0) {
+		return;
+	}
+
+	/* keep the index at most half full so probe sequences stay short */
+	if (table->indexed_pids >= TABLE_PID_INDEX_LEN / 2) {
+		table->unindexed_pids++;
+		return;
+	}
+
+	slot = pid_index_home_slot(pid);
+	while (table->devices_by_pid[slot] != NULL) {
+		slot = (slot + 1) & (TABLE_PID_INDEX_LEN - 1);
+	}
+	table->devices_by_pid[slot] = device;
+	table->indexed_pids++;
+}
+
+/**
+ * @brief Removes a target device from the address and PID indexes of the table.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] device the target device to remove from the indexes
+ */
+static void table_unindex_device(struct target_device_table *table, struct target_device *device)
+{
+	uint64_t pid = device_get_pid(device);
+	int slot = 0;
+	int next = 0;
+	int home = 0;
+
+	if (device->target_address < TABLE_ADDRESS_INDEX_LEN && table->devices_by_address[device->target_address] == device) {
+		table->devices_by_address[device->target_address] = NULL;
+	}
+
+	if (pid == 0) {
+		return;
+	}
+
+	slot = pid_index_home_slot(pid);
+	while (table->devices_by_pid[slot] != device) {
+		if (table->devices_by_pid[slot] == NULL) {
+			/* the device did not fit in the index when it was inserted */
+			table->unindexed_pids--;
+			return;
+		}
+		slot = (slot + 1) & (TABLE_PID_INDEX_LEN - 1);
+	}
+	table->devices_by_pid[slot] = NULL;
+	table->indexed_pids--;
+
+	/* shift back the entries that followed the removed one in the probe
+	 * sequence, otherwise the empty slot would hide them from lookups */
+	next = slot;
+	for (;;) {
+		next = (next + 1) & (TABLE_PID_INDEX_LEN - 1);
+		if (table->devices_by_pid[next] == NULL) {
+			break;
+		}
+		home = pid_index_home_slot(device_get_pid(table->devices_by_pid[next]));
+		if (((next - home) & (TABLE_PID_INDEX_LEN - 1)) >= ((next - slot) & (TABLE_PID_INDEX_LEN - 1))) {
+			table->devices_by_pid[slot] = table->devices_by_pid[next];
+			table->devices_by_pid[next] = NULL;
+			slot = next;
+		}
+	}
+}
+
+/**
+ * @brief Looks up a target device by address.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] address the address of the device
+ * @return the target device, or NULL if no device with that address was found
+ */
+static struct target_device *table_lookup_address(struct target_device_table *table, uint8_t address)
+{
+	if (address != 0 && address < TABLE_ADDRESS_INDEX_LEN) {
+		return table->devices_by_address[address];
+	}
+
+	/* addresses outside the index are only found in the list */
+	return (struct target_device *)list_search(table->target_devices, &address, compare_device_address);
+}
+
+/**
+ * @brief Looks up a target device by provisioned ID.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] pid the provisioned ID of the device
+ * @return the target device, or NULL if no device with that provisioned ID was found
+ */
+static struct target_device *table_lookup_pid(struct target_device_table *table, uint64_t pid)
+{
+	if (pid != 0) {
+		int slot = pid_index_home_slot(pid);
+		while (table->devices_by_pid[slot] != NULL) {
+			if (device_get_pid(table->devices_by_pid[slot]) == pid) {
+				return table->devices_by_pid[slot];
+			}
+			slot = (slot + 1) & (TABLE_PID_INDEX_LEN - 1);
+		}
+		if (table->unindexed_pids == 0) {
+			return NULL;
+		}
+	}
+
+	return (struct target_device *)list_search(table->target_devices, &pid, compare_device_pid);
+}
+
+/**
+ * @brief Looks up the target device a target handle refers to.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] entry the identity of the target device kept by the handle
+ * @return the target device, or NULL if it is not in the bus
+ */
+static struct target_device *table_lookup_handle(struct target_device_table *table, const struct target_handle *entry)
+{
+	struct target_device *device = NULL;
+
+	if (entry->pid) {
+		device = table_lookup_pid(table, entry->pid);
+	} else {
+		device = table_lookup_address(table, entry->static_address);
+		if (device && (device_get_pid(device) != 0 || device->device_capability.static_address != entry->static_address)) {
+			/* a different device took the address */
+			device = NULL;
+		}
+	}
+	if (device && device->target_address == 0) {
+		device = NULL;
+	}
+
+	return device;
+}
+
+/* compares a retired snapshot against a reference count, used to find the ones no reader holds */
+static int compare_snapshot_refs(const void *a, const void *b)
+{
+	struct table_snapshot *snapshot = (struct table_snapshot *)a;
+	const int *refs = (const int *)b;
+
+	return atomic_load(&snapshot->refs) == *refs ? 0 : 1;
+}
+
+/**
+ * @brief Builds a snapshot of the target device table and publishes it.
+ *
+ * The snapshot being replaced cannot be freed right away since readers may still
+ * be holding it, it is retired instead. Every retired snapshot is freed by the first
+ * writer that finds it is no longer held, so a reader holding a snapshot for a long
+ * time only keeps that snapshot alive.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ */
+static void table_publish_snapshot_locked(struct target_device_table *table)
+{
+	struct table_snapshot *snapshot = NULL;
+	struct table_snapshot *old = NULL;
+	struct target_device *device = NULL;
+	struct list *node = NULL;
+	int count = list_len(table->target_devices);
+	int unused = 0;
+
+	snapshot = (struct table_snapshot *)malloc_or_die(sizeof(struct table_snapshot) + count * sizeof(struct target_device));
+	snapshot->version = ++table->snapshot_version;
+	atomic_init(&snapshot->refs, 0);
+	for (node = table->target_devices; node; node = node->next) {
+		device = &snapshot->devices[snapshot->count++];
+		*device = *(struct target_device *)node->data;
+		if (device->target_address != 0 && device->target_address < TABLE_ADDRESS_INDEX_LEN) {
+			snapshot->by_address[device->target_address] = device;
+		}
+	}
+	for (int i = 0; i < TABLE_HANDLE_SLOTS; i++) {
+		if (table->handles[i].refs == 0) {
+			continue;
+		}
+		device = table_lookup_handle(table, &table->handles[i]);
+		if (device && device->target_address < TABLE_ADDRESS_INDEX_LEN) {
+			snapshot->handles_by_address[device->target_address] = TABLE_HANDLE(table->handles[i].generation, i);
+		}
+	}
+
+	old = atomic_exchange(&table->snapshot, snapshot);
+	if (old) {
+		table->retired_snapshots = list_append(table->retired_snapshots, old);
+	}
+
+	/* a reader still taking its reference may be about to hold any of the retired
+	 * snapshots, one that shows up after this check can only get the new snapshot */
+	if (atomic_load(&table->snapshot_acquiring) != 0) {
+		return;
+	}
+	table->retired_snapshots = list_free_matching_nodes(table->retired_snapshots, &unused, compare_snapshot_refs, free);
+}
+
+/**
+ * @brief Adds a target device to the target device table without publishing it.
+ *
+ * @note The table mutex must be held by the caller.
+ *
+ * @param[in] table the target device table
+ * @param[in] device the target device to add
+ * @return 0 if the device was added, or -1 if its address is already taken
+ */
+static int table_add_device_locked(struct target_device_table *table, struct target_device *device)
+{
+	/* if the device has an address let's make sure the address in not already taken */
+	if (device->target_address != 0 && table_lookup_address(table, device->target_address) != NULL) {
+		return -1;
+	}
+
+	table->target_devices = list_append(table->target_devices, device);
+	table_index_device(table, device);
+
+	return 0;
+}
+
 /**
  * @brief Inserts a target device in the target device table.
  *
@@ -319,16 +719,12 @@ int table_insert_device(struct target_device_table *table, struct target_device
 
 	pthread_mutex_lock(table->mutex);
 
-	/* if the device has an address let's make sure the address in not already taken */
-	if (device->target_address != 0) {
-		if (list_search(table->target_devices, &device->target_address, compare_device_address) != NULL) {
-			/* the address is already taken */
-			ret = -1;
-			goto EXIT;
-		}
+	if (table_add_device_locked(table, device) < 0) {
+		/* the address is already taken */
+		ret = -1;
+		goto EXIT;
 	}
-
-	table->target_devices = list_append(table->target_devices, device);
+	table_publish_snapshot_locked(table);
 
 	if (table->enable_events && table->on_insert_cb) {
 		table->on_insert_cb(device->target_address, table->user_data);
@@ -350,6 +746,7 @@ EXIT:
 int table_change_device_address(struct target_device_table *table, uint8_t old_address, uint8_t new_address)
 {
 	struct target_device *device = NULL;
+	int ret = -1;
 
 	if (table == NULL) {
 		return -1;
@@ -359,23 +756,29 @@ int table_change_device_address(struct target_device_table *table, uint8_t old_a
 		return -1;
 	}
 
-	device = table_get_device(table, new_address);
-	if (device != NULL) {
+	pthread_mutex_lock(table->mutex);
+
+	if (table_lookup_address(table, new_address) != NULL) {
 		/* the new address is already taken */
-		return -1;
+		goto EXIT;
 	}
 
-	device = table_get_device(table, old_address);
+	device = table_lookup_address(table, old_address);
 	if (device == NULL) {
 		/* not found */
-		return -1;
+		goto EXIT;
 	}
 
-	pthread_mutex_lock(table->mutex);
+	table_unindex_device(table, device);
 	device->target_address = new_address;
+	table_index_device(table, device);
+	table_publish_snapshot_locked(table);
+	ret = 0;
+
+EXIT:
 	pthread_mutex_unlock(table->mutex);
 
-	return 0;
+	return ret;
 }
 
 /**
@@ -402,6 +805,8 @@ struct target_device *table_remove_device(struct target_device_table *table, uin
 	}
 	device = (struct target_device *)node->data;
 	table->target_devices = list_free_node(table->target_devices, node, NULL);
+	table_unindex_device(table, device);
+	table_publish_snapshot_locked(table);
 
 EXIT:
 	pthread_mutex_unlock(table->mutex);
@@ -426,7 +831,7 @@ struct target_device *table_get_device(struct target_device_table *table, uint8_
 	}
 
 	pthread_mutex_lock(table->mutex);
-	device = (struct target_device *)list_search(table->target_devices, &address, compare_device_address);
+	device = table_lookup_address(table, address);
 	pthread_mutex_unlock(table->mutex);
 
 	return device;
@@ -449,50 +854,250 @@ struct target_device *table_get_device_by_pid(struct target_device_table *table,
 	}
 
 	pthread_mutex_lock(table->mutex);
-	device = (struct target_device *)list_search(table->target_devices, &pid, compare_device_pid);
+	device = table_lookup_pid(table, pid);
 	pthread_mutex_unlock(table->mutex);
 
 	return device;
 }
 
+/* gets the slot of a target handle, or -1 if the handle is stale or was never opened */
+static int table_handle_slot(struct target_device_table *table, uint32_t handle)
+{
+	int slot = TABLE_HANDLE_SLOT(handle);
+
+	if (slot < 0 || slot >= TABLE_HANDLE_SLOTS) {
+		return -1;
+	}
+	if (table->handles[slot].refs == 0 || table->handles[slot].generation != (uint16_t)(handle >> 16)) {
+		return -1;
+	}
+
+	return slot;
+}
+
 /**
- * @brief Fill the target device table from the capability buffer.
+ * @brief Opens a handle bound to the identity of the target device at an address.
+ *
+ * I3C target devices are identified by their provisioned ID, and I2C target devices
+ * by their static address, so the handle keeps referring to the same target device
+ * after its dynamic address changes or it is rediscovered. Opening a handle for a
+ * target device that already has one returns the same handle.
  *
  * @param[in] table the target device table
- * @param[in] buffer the capability buffer
- * @param[in] buffer_size the buffer size
- * @return 0 if the table was filled up successfully, or -1 on failure
+ * @param[in] address the current address of the target device
+ * @param[out] handle the handle of the target device
+ * @return 0 if the handle was opened, or -1 otherwise
  */
-int table_fill_from_capability_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size)
+int table_open_target_handle(struct target_device_table *table, uint8_t address, uint32_t *handle)
 {
-	if (table == NULL || buffer == NULL) {
+	struct target_handle *entry = NULL;
+	struct target_device *device = NULL;
+	uint64_t pid = 0;
+	uint8_t static_address = 0;
+	int free_slot = -1;
+	int ret = -1;
+
+	if (table == NULL || handle == NULL) {
 		return -1;
 	}
 
-	if (buffer_size == 0) {
-		return -1;
+	pthread_mutex_lock(table->mutex);
+
+	device = table_lookup_address(table, address);
+	if (device == NULL) {
+		DEBUG_PRINT("Device with address %d not found in table\n", address);
+		goto UNLOCK_AND_EXIT;
+	}
+	pid = device_get_pid(device);
+	if (pid == 0) {
+		static_address = device->device_capability.static_address;
+		if (static_address == 0) {
+			DEBUG_PRINT("The target device has neither a provisioned ID nor a static address\n");
+			goto UNLOCK_AND_EXIT;
+		}
 	}
 
-	if (GET_CAPABILITY_HEADER(buffer)->error_code != DEVICE_CONTAINS_CAPABILITY_DATA) {
-		return 0;
+	for (int i = 0; i < TABLE_HANDLE_SLOTS; i++) {
+		entry = &table->handles[i];
+		if (entry->refs == 0) {
+			if (free_slot < 0) {
+				free_slot = i;
+			}
+			continue;
+		}
+		if (entry->pid == pid && entry->static_address == static_address) {
+			entry->refs++;
+			*handle = TABLE_HANDLE(entry->generation, i);
+			ret = 0;
+			goto UNLOCK_AND_EXIT;
+		}
 	}
 
-	/* create or update the table with the info from target devices */
+	if (free_slot < 0) {
+		DEBUG_PRINT("There are no target handles available\n");
+		goto UNLOCK_AND_EXIT;
+	}
+
+	entry = &table->handles[free_slot];
+	entry->pid = pid;
+	entry->static_address = static_address;
+	entry->refs = 1;
+	*handle = TABLE_HANDLE(entry->generation, free_slot);
+	/* let the snapshot readers find the handle of the device */
+	table_publish_snapshot_locked(table);
+	ret = 0;
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(table->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Closes a target handle.
+ *
+ * Once the last reference to a handle is closed its generation changes, so the
+ * handle is detected as stale from then on even if its slot gets reused.
+ *
+ * @param[in] table the target device table
+ * @param[in] handle the handle to close
+ * @return 0 if the handle was closed, or -1 if the handle is not valid
+ */
+int table_close_target_handle(struct target_device_table *table, uint32_t handle)
+{
+	int slot = -1;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	slot = table_handle_slot(table, handle);
+	if (slot >= 0) {
+		table->handles[slot].refs--;
+		if (table->handles[slot].refs == 0) {
+			table->handles[slot].generation++;
+			table_publish_snapshot_locked(table);
+		}
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	return slot >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief Resolves a target handle to the current address of its target device.
+ *
+ * The resolution uses the PID index, or the address index for I2C target devices,
+ * so it takes constant time regardless of the number of devices in the table.
+ *
+ * @param[in] table the target device table
+ * @param[in] handle the handle of the target device
+ * @param[out] address the current address of the target device
+ * @return 0 if the handle was resolved, or -1 if the handle is stale or its target device is not in the table
+ */
+int table_resolve_target_handle(struct target_device_table *table, uint32_t handle, uint8_t *address)
+{
+	struct target_handle *entry = NULL;
+	struct target_device *device = NULL;
+	int slot = -1;
+
+	if (table == NULL || address == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	slot = table_handle_slot(table, handle);
+	if (slot < 0) {
+		DEBUG_PRINT("The target handle is stale\n");
+		goto UNLOCK_AND_EXIT;
+	}
+	entry = &table->handles[slot];
+	device = table_lookup_handle(table, entry);
+	if (device == NULL) {
+		DEBUG_PRINT("The target device of the handle is not in the bus\n");
+		goto UNLOCK_AND_EXIT;
+	}
+	*address = device->target_address;
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(table->mutex);
+
+	return device ? 0 : -1;
+}
+
+/* runs the on_insert event of the devices inserted while filling the table, once the
+ * devices are published and the table is unlocked */
+static void table_notify_inserted(struct target_device_table *table, const uint8_t *inserted, int count)
+{
+	if (!table->enable_events || table->on_insert_cb == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		table->on_insert_cb(inserted[i], table->user_data);
+	}
+}
+
+/**
+ * @brief Fill the target device table from the capability buffer.
+ *
+ * @param[in] table the target device table
+ * @param[in] buffer the capability buffer
+ * @param[in] buffer_size the buffer size
+ * @return 0 if the table was filled up successfully, or -1 on failure
+ */
+int table_fill_from_capability_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size)
+{
+	struct target_device *device = NULL;
+	uint8_t *inserted = NULL;
+	int inserted_count = 0;
+	int updated = FALSE;
+	int ret = 0;
+
+	if (table == NULL || buffer == NULL) {
+		return -1;
+	}
+
+	if (buffer_size == 0) {
+		return -1;
+	}
+
+	if (GET_CAPABILITY_HEADER(buffer)->error_code != DEVICE_CONTAINS_CAPABILITY_DATA) {
+		return 0;
+	}
+
+	/* create or update the table with the info from target devices */
 	uint16_t numentries = (buffer_size - CAPABILITY_DEVICES_OFFSET(buffer)) / CAPABILITY_DEVICE_SIZE;
+	inserted = (uint8_t *)malloc_or_die(numentries + 1);
+
+	pthread_mutex_lock(table->mutex);
 	for (int i = 0; i < numentries; i++) {
-		uint8_t address = GET_CAPABILITY_DEVICE_N(buffer, i)->address;
-		struct target_device *device = table_get_device(table, address);
+		device = table_lookup_address(table, GET_CAPABILITY_DEVICE_N(buffer, i)->address);
 		if (device != NULL) {
 			device_update_from_capability_entry(device, GET_CAPABILITY_DEVICE_N(buffer, i));
-		} else {
-			device = device_create_from_capability_entry(GET_CAPABILITY_DEVICE_N(buffer, i));
-			if (table_insert_device(table, device) < 0) {
-				FREE(device);
-				return -1;
-			}
+			updated = TRUE;
+			continue;
 		}
+		device = device_create_from_capability_entry(GET_CAPABILITY_DEVICE_N(buffer, i));
+		if (table_add_device_locked(table, device) < 0) {
+			FREE(device);
+			ret = -1;
+			break;
+		}
+		inserted[inserted_count++] = device->target_address;
 	}
-	return 0;
+
+	/* all the devices are published at once */
+	if (updated || inserted_count > 0) {
+		table_publish_snapshot_locked(table);
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	table_notify_inserted(table, inserted, inserted_count);
+	FREE(inserted);
+
+	return ret;
 }
 
 /**
@@ -505,6 +1110,12 @@ int table_fill_from_capability_buffer(struct target_device_table *table, uint8_t
  */
 int table_fill_from_device_table_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size)
 {
+	struct target_device *device = NULL;
+	uint8_t *inserted = NULL;
+	int inserted_count = 0;
+	int updated = FALSE;
+	int ret = 0;
+
 	if (table == NULL || buffer == NULL) {
 		return -1;
 	}
@@ -514,19 +1125,189 @@ int table_fill_from_device_table_buffer(struct target_device_table *table, uint8
 	}
 
 	uint8_t numentries = (buffer_size - TARGET_DEVICE_ENTRY_OFFSET) / TARGET_DEVICE_ENTRY_SIZE;
+	inserted = (uint8_t *)malloc_or_die(numentries + 1);
+
+	pthread_mutex_lock(table->mutex);
 	for (int i = 0; i < numentries; i++) {
-		uint8_t address = GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->address;
-		struct target_device *device = table_get_device(table, address);
+		device = table_lookup_address(table, GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->address);
 		if (device != NULL) {
 			device_update_from_device_table_entry(device, GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i));
-		} else {
-			device = device_create_from_device_table_entry(GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i));
-			if (table_insert_device(table, device) < 0) {
-				FREE(device);
-				return -1;
+			updated = TRUE;
+			continue;
+		}
+		device = device_create_from_device_table_entry(GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i));
+		if (table_add_device_locked(table, device) < 0) {
+			FREE(device);
+			ret = -1;
+			break;
+		}
+		inserted[inserted_count++] = device->target_address;
+	}
+
+	/* all the devices are published at once */
+	if (updated || inserted_count > 0) {
+		table_publish_snapshot_locked(table);
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	table_notify_inserted(table, inserted, inserted_count);
+	FREE(inserted);
+
+	return ret;
+}
+
+/* the device events found while applying a target device table */
+struct table_diff {
+	uint8_t inserted[ADDRESS_LEN];
+	uint8_t removed[ADDRESS_LEN];
+	uint8_t changed[ADDRESS_LEN];
+	int inserted_count;
+	int removed_count;
+	int changed_count;
+};
+
+/**
+ * @brief Applies a GET_TARGET_DEVICE_TABLE request buffer to the table as a diff.
+ *
+ * Unlike table_fill_from_device_table_buffer(), the buffer is taken as the complete
+ * table known by the I3C function: devices with an address that are not in the buffer
+ * are removed, devices whose data differs are updated in place and new devices are
+ * inserted. A device found at the address of another device with a different PID is
+ * replaced. Devices without an address are matched by their PID, and are left out if
+ * they don't have one. A single snapshot is published for the whole update, and the on_insert,
+ * on_remove and on_change events are run once the table is unlocked.
+ *
+ * @param[in] table the target device table
+ * @param[in] buffer the GET_TARGET_DEVICE_TABLE request buffer
+ * @param[in] buffer_size the buffer size
+ * @return 0 if the table was updated successfully, or -1 on failure
+ */
+int table_apply_device_table_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size)
+{
+	uint8_t seen[ADDRESS_LEN] = { 0 };
+	struct target_device_table_entry *entry = NULL;
+	struct target_device *device = NULL;
+	struct target_device_data previous;
+	struct list *removed_devices = NULL;
+	struct list *node = NULL;
+	struct list *next = NULL;
+	struct table_diff *diff = NULL;
+	int numentries = 0;
+
+	if (table == NULL || buffer == NULL) {
+		return -1;
+	}
+
+	if (buffer_size < TARGET_DEVICE_ENTRY_OFFSET) {
+		return -1;
+	}
+
+	numentries = (buffer_size - TARGET_DEVICE_ENTRY_OFFSET) / TARGET_DEVICE_ENTRY_SIZE;
+	if (numentries > ADDRESS_LEN) {
+		DEBUG_PRINT("The target device table has more devices than the bus can have\n");
+		return -1;
+	}
+
+	/* reject the table before touching anything if it has the same address twice */
+	for (int i = 0; i < numentries; i++) {
+		entry = GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i);
+		if (entry->address != 0 && seen[entry->address]) {
+			DEBUG_PRINT("Address %x is used by more than one device\n", entry->address);
+			return -1;
+		}
+		seen[entry->address] = TRUE;
+	}
+
+	diff = (struct table_diff *)malloc_or_die(sizeof(struct table_diff));
+
+	pthread_mutex_lock(table->mutex);
+
+	for (int i = 0; i < numentries; i++) {
+		entry = GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i);
+		device = entry->address ? table_lookup_address(table, entry->address) : NULL;
+
+		/* a device without an address can only be told apart by its PID, which
+		 * is also how it is found once it gets an address */
+		if (device == NULL && entry->valid_pid) {
+			device = table_lookup_pid(table, ((uint64_t)entry->pid_hi << 16) + entry->pid_lo);
+			if (device != NULL && device->target_address != 0) {
+				device = NULL;
 			}
 		}
+		if (device == NULL && entry->address == 0 && !entry->valid_pid) {
+			DEBUG_PRINT("A target device without an address or a PID can't be refreshed, ignoring it\n");
+			continue;
+		}
+		if (device != NULL && device->target_address != entry->address) {
+			table_unindex_device(table, device);
+			device->target_address = entry->address;
+			table_index_device(table, device);
+			diff->changed[diff->changed_count++] = entry->address;
+			device_update_from_device_table_entry(device, entry);
+			continue;
+		}
+
+		/* a different device took the address */
+		if (device != NULL && entry->valid_pid && device_get_pid(device) != 0 &&
+		    (device->pid_lo != entry->pid_lo || device->pid_hi != entry->pid_hi)) {
+			node = list_search_node(table->target_devices, &device->target_address, compare_device_address);
+			table->target_devices = list_free_node(table->target_devices, node, NULL);
+			table_unindex_device(table, device);
+			removed_devices = list_append(removed_devices, device);
+			diff->removed[diff->removed_count++] = entry->address;
+			device = NULL;
+		}
+
+		if (device != NULL) {
+			previous = device->device_data;
+			device_update_from_device_table_entry(device, entry);
+			if (memcmp(&previous, &device->device_data, sizeof(struct target_device_data)) != 0) {
+				diff->changed[diff->changed_count++] = entry->address;
+			}
+			continue;
+		}
+
+		device = device_create_from_device_table_entry(entry);
+		table->target_devices = list_append(table->target_devices, device);
+		table_index_device(table, device);
+		diff->inserted[diff->inserted_count++] = device->target_address;
+	}
+
+	/* the devices the I3C function no longer knows about left the bus */
+	for (node = table->target_devices; node; node = next) {
+		next = node->next;
+		device = (struct target_device *)node->data;
+		if (device->target_address == 0 || seen[device->target_address]) {
+			continue;
+		}
+		table->target_devices = list_free_node(table->target_devices, node, NULL);
+		table_unindex_device(table, device);
+		removed_devices = list_append(removed_devices, device);
+		diff->removed[diff->removed_count++] = device->target_address;
 	}
+
+	if (diff->inserted_count || diff->removed_count || diff->changed_count) {
+		table_publish_snapshot_locked(table);
+	}
+
+	pthread_mutex_unlock(table->mutex);
+
+	list_free_list_and_data(&removed_devices, free);
+
+	if (table->enable_events) {
+		for (int i = 0; i < diff->removed_count && table->on_remove_cb; i++) {
+			table->on_remove_cb(diff->removed[i], table->remove_user_data);
+		}
+		for (int i = 0; i < diff->changed_count && table->on_change_cb; i++) {
+			table->on_change_cb(diff->changed[i], table->change_user_data);
+		}
+		for (int i = 0; i < diff->inserted_count && table->on_insert_cb; i++) {
+			table->on_insert_cb(diff->inserted[i], table->user_data);
+		}
+	}
+
+	FREE(diff);
+
 	return 0;
 }
 
@@ -637,6 +1418,87 @@ int table_create_set_target_config_buffer(struct target_device_table *table, uin
 	return buffer_size;
 }
 
+/**
+ * @brief Creates an address change buffer that can be used in class-specific requests.
+ *
+ * The CHANGE_DYNAMIC_ADDRESS request uses this buffer to change the dynamic address of
+ * one or more target devices. The I3C function processes the entries in order, so the
+ * changes are validated against the table as it would be when each entry is processed:
+ * - the target device to change has to be in the table and can only be changed once
+ * - the new address has to be a valid 7-bit address not requested by another entry
+ * - the new address has to be free, or be released by an earlier entry
+ *
+ * @param[in] table the target device table
+ * @param[in] changes the address changes requested
+ * @param[in] count the number of address changes requested
+ * @param[out] buffer the created buffer
+ * @return the buffer length or -1 if the address changes are not valid
+ */
+int table_create_address_change_buffer(struct target_device_table *table, const struct usbi3c_address_change *changes, uint8_t count, uint8_t **buffer)
+{
+	uint8_t released[ADDRESS_LEN] = { 0 };
+	uint8_t requested[ADDRESS_LEN] = { 0 };
+	struct target_device *device = NULL;
+	struct target_device *occupant = NULL;
+	int buffer_size = 0;
+
+	if (table == NULL || changes == NULL || buffer == NULL) {
+		return -1;
+	}
+
+	buffer_size = TARGET_DEVICE_ADDRESS_CHANGE_HEADER_SIZE + (TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_SIZE * count);
+	*buffer = (uint8_t *)malloc_or_die(buffer_size);
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(*buffer)->address_change_command_type = ADDRESS_CHANGE_COMMAND_TYPE;
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(*buffer)->numentries = count;
+
+	pthread_mutex_lock(table->mutex);
+
+	for (int i = 0; i < count; i++) {
+		uint8_t current_address = changes[i].current_address;
+		uint8_t new_address = changes[i].new_address;
+
+		device = table_lookup_address(table, current_address);
+		if (device == NULL || current_address == 0) {
+			DEBUG_PRINT("Address %x not reachable\n", current_address);
+			goto INVALID;
+		}
+		if (released[current_address]) {
+			DEBUG_PRINT("The address of device %x is changed more than once\n", current_address);
+			goto INVALID;
+		}
+		if (new_address == 0 || new_address >= TABLE_ADDRESS_INDEX_LEN || new_address == USBI3C_BROADCAST_ADDRESS || new_address == current_address) {
+			DEBUG_PRINT("Invalid new address %x for device %x\n", new_address, current_address);
+			goto INVALID;
+		}
+		if (requested[new_address]) {
+			DEBUG_PRINT("New address %x is requested for more than one device\n", new_address);
+			goto INVALID;
+		}
+		occupant = table_lookup_address(table, new_address);
+		if (occupant != NULL && !released[new_address]) {
+			DEBUG_PRINT("New address %x is already being used by another device\n", new_address);
+			goto INVALID;
+		}
+		released[current_address] = TRUE;
+		requested[new_address] = TRUE;
+
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, i)->current_address = current_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, i)->new_address = new_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, i)->pid_lo = device->pid_lo;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(*buffer, i)->pid_hi = device->pid_hi;
+	}
+
+	pthread_mutex_unlock(table->mutex);
+
+	return buffer_size;
+
+INVALID:
+	pthread_mutex_unlock(table->mutex);
+	FREE(*buffer);
+
+	return -1;
+}
+
 /**
  * @brief Adds a callback function that will run when a new device is added to the table.
  *
@@ -658,6 +1520,45 @@ void table_on_insert_device(struct target_device_table *table, on_insert_fn on_i
 	pthread_mutex_unlock(table->mutex);
 }
 
+/**
+ * @brief Adds a callback function that will run when a device is removed from the table.
+ *
+ * Devices are removed from the target device table when a refresh of the table shows
+ * the I3C function no longer knows about them.
+ *
+ * @param[in] table target device table
+ * @param[in] on_remove_cb callback to be called when a device is removed
+ * @param[in] user_data data to share with callback
+ */
+void table_on_remove_device(struct target_device_table *table, on_remove_fn on_remove_cb, void *user_data)
+{
+	if (table == NULL || on_remove_cb == NULL) {
+		return;
+	}
+	pthread_mutex_lock(table->mutex);
+	table->on_remove_cb = on_remove_cb;
+	table->remove_user_data = user_data;
+	pthread_mutex_unlock(table->mutex);
+}
+
+/**
+ * @brief Adds a callback function that will run when the data of a device in the table changes.
+ *
+ * @param[in] table target device table
+ * @param[in] on_change_cb callback to be called when a device changes
+ * @param[in] user_data data to share with callback
+ */
+void table_on_change_device(struct target_device_table *table, on_change_fn on_change_cb, void *user_data)
+{
+	if (table == NULL || on_change_cb == NULL) {
+		return;
+	}
+	pthread_mutex_lock(table->mutex);
+	table->on_change_cb = on_change_cb;
+	table->change_user_data = user_data;
+	pthread_mutex_unlock(table->mutex);
+}
+
 /**
  * @brief Enable events for target device table
  *
@@ -681,6 +1582,23 @@ void table_enable_events(struct target_device_table *table)
  */
 int table_update_target_device_info(struct target_device_table *table)
 {
+	return table_fetch_target_device_info(table, NULL);
+}
+
+/**
+ * @brief Gets the target device info from the I3C function, updates the local table and fingerprints it.
+ *
+ * The fingerprint covers the whole target device table data structure as it was
+ * received, so it changes if any target device, its address or its configuration
+ * changes.
+ *
+ * @param[in] table target device table
+ * @param[out] fingerprint the fingerprint of the received target device table (optional)
+ * @return 0 if the local table was updated correctly, or -1 otherwise
+ */
+int table_fetch_target_device_info(struct target_device_table *table, uint64_t *fingerprint)
+{
+	uint16_t table_size = 0;
 	int ret = 0;
 	if (table == NULL) {
 		return -1;
@@ -701,7 +1619,12 @@ int table_update_target_device_info(struct target_device_table *table)
 		return ret;
 	}
 
-	return table_fill_from_device_table_buffer(table, buffer, GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size);
+	table_size = GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size;
+	if (fingerprint) {
+		*fingerprint = device_cache_fingerprint(buffer, table_size < USB_MAX_CONTROL_BUFFER_SIZE ? table_size : USB_MAX_CONTROL_BUFFER_SIZE);
+	}
+
+	return table_fill_from_device_table_buffer(table, buffer, table_size);
 }
 
 /**
@@ -768,3 +1691,442 @@ struct list *table_get_devices(struct target_device_table *table)
 
 	return table->target_devices;
 }
+
+/* sets the IBIT, CRR and TIR configuration of a device, the table has to be locked */
+static void device_set_config(struct target_device *device, uint8_t config)
+{
+	device->device_data.ibi_timestamp = (config >> 2) & 0x1;
+	device->device_data.controller_role_request = (config >> 1) & 0x1;
+	device->device_data.target_interrupt_request = config & 0x1;
+}
+
+/**
+ * @brief Updates the configuration of several target devices in the table.
+ *
+ * The configuration of every device is updated before publishing a single snapshot,
+ * so readers see either the old or the new configuration of all of them.
+ *
+ * @param[in] table the target device table
+ * @param[in] configs the configuration applied to each target device
+ * @param[in] count the number of target devices configured
+ */
+void table_set_device_configs(struct target_device_table *table, const struct usbi3c_target_device_config *configs, size_t count)
+{
+	struct target_device *device = NULL;
+
+	if (table == NULL || configs == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	for (size_t i = 0; i < count; i++) {
+		device = table_lookup_address(table, configs[i].address);
+		if (device == NULL) {
+			continue;
+		}
+		device_set_config(device, configs[i].config);
+		device->device_data.max_ibi_payload_size = configs[i].max_ibi_payload_size;
+	}
+	table_publish_snapshot_locked(table);
+	pthread_mutex_unlock(table->mutex);
+}
+
+/**
+ * @brief Updates the IBIT, CRR and TIR configuration of a target device in the table.
+ *
+ * @param[in] table the target device table
+ * @param[in] address the address of the target device
+ * @param[in] config the configuration value for IBIT, CRR and TIR (only the 3 LSB are used)
+ * @return 0 if the configuration was updated, or -1 if the target device is not in the table
+ */
+int table_set_device_config(struct target_device_table *table, uint8_t address, uint8_t config)
+{
+	struct target_device *device = NULL;
+	int ret = -1;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	device = table_lookup_address(table, address);
+	if (device) {
+		device_set_config(device, config);
+		table_publish_snapshot_locked(table);
+		ret = 0;
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Updates the max IBI payload size of a target device in the table.
+ *
+ * @param[in] table the target device table
+ * @param[in] address the address of the target device
+ * @param[in] max_payload the max IBI payload size the target device is allowed to send
+ * @return 0 if the max IBI payload size was updated, or -1 if the target device is not in the table
+ */
+int table_set_device_max_ibi_payload(struct target_device_table *table, uint8_t address, uint32_t max_payload)
+{
+	struct target_device *device = NULL;
+	int ret = -1;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	device = table_lookup_address(table, address);
+	if (device) {
+		device->device_data.max_ibi_payload_size = max_payload;
+		table_publish_snapshot_locked(table);
+		ret = 0;
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Stores the values read from target devices during a bus inventory scan.
+ *
+ * The values of a device are discarded if GETPID returned a provisioned ID other than
+ * the one in the table, since they were read from a different device. A single snapshot
+ * is published after all the devices are updated.
+ *
+ * @param[in] table the target device table
+ * @param[in] discoveries the values read from each target device
+ * @param[in] count the number of target devices in discoveries
+ * @return the number of target devices updated, or -1 on failure
+ */
+int table_set_device_inventory(struct target_device_table *table, const struct target_device_discovery *discoveries, size_t count)
+{
+	struct target_device *device = NULL;
+	int updated = 0;
+
+	if (table == NULL || discoveries == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	for (size_t i = 0; i < count; i++) {
+		const struct target_device_discovery *discovery = &discoveries[i];
+
+		device = table_lookup_address(table, discovery->address);
+		if (device == NULL || discovery->inventory.valid == 0) {
+			continue;
+		}
+		if ((discovery->inventory.valid & USBI3C_INVENTORY_PID) && device->device_data.valid_pid &&
+		    device_get_pid(device) != discovery->pid) {
+			DEBUG_PRINT("The PID read from target device %d does not match the table, ignoring it\n", discovery->address);
+			continue;
+		}
+		if (discovery->inventory.valid & USBI3C_INVENTORY_BCR) {
+			device->device_data.bus_characteristic_register = discovery->bus_characteristic_register;
+		}
+		if (discovery->inventory.valid & USBI3C_INVENTORY_DCR) {
+			device->device_data.device_characteristic_register = discovery->device_characteristic_register;
+		}
+		device->inventory = discovery->inventory;
+		updated++;
+	}
+	table_publish_snapshot_locked(table);
+	pthread_mutex_unlock(table->mutex);
+
+	return updated;
+}
+
+/**
+ * @brief Sets the max read and write lengths of a target device.
+ *
+ * @param[in] table the target device table
+ * @param[in] address the address of the target device
+ * @param[in] max_read_length the max read length of the target device, 0 if there is no limit
+ * @param[in] max_write_length the max write length of the target device, 0 if there is no limit
+ * @return 0 if the max lengths were set, or -1 if the target device is not in the table
+ */
+int table_set_device_max_lengths(struct target_device_table *table, uint8_t address, uint16_t max_read_length, uint16_t max_write_length)
+{
+	struct target_device *device = NULL;
+	int ret = -1;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	device = table_lookup_address(table, address);
+	if (device) {
+		device->inventory.max_read_length = max_read_length;
+		device->inventory.max_write_length = max_write_length;
+		device->inventory.valid |= USBI3C_INVENTORY_MRL | USBI3C_INVENTORY_MWL;
+		table_publish_snapshot_locked(table);
+		ret = 0;
+	}
+	pthread_mutex_unlock(table->mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Sets the transfer mode profile of a target device.
+ *
+ * I2C target devices can only be given the I2C mode, and I3C target devices any of
+ * the I3C modes.
+ *
+ * @param[in] table the target device table
+ * @param[in] address the address of the target device
+ * @param[in] i3c_mode the transfer mode, rate and mode specific info for the target device, NULL to remove its profile
+ * @param[in] origin where the profile comes from (enum target_device_profile_origin)
+ * @return 0 if the profile was set, or -1 otherwise
+ */
+int table_set_device_profile(struct target_device_table *table, uint8_t address, const struct i3c_mode *i3c_mode, uint8_t origin)
+{
+	struct target_device *device = NULL;
+	int ret = -1;
+
+	if (table == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	device = table_lookup_address(table, address);
+	if (device == NULL) {
+		goto UNLOCK_AND_EXIT;
+	}
+	if (i3c_mode && (device->device_data.target_type == USBI3C_I2C_DEVICE) != (i3c_mode->transfer_mode == USBI3C_I2C_MODE)) {
+		DEBUG_PRINT("The transfer mode is not supported by the type of target device %d\n", address);
+		goto UNLOCK_AND_EXIT;
+	}
+
+	if (i3c_mode) {
+		device->profile.origin = origin;
+		device->profile.i3c_mode = *i3c_mode;
+	} else {
+		memset(&device->profile, 0, sizeof(device->profile));
+	}
+	table_publish_snapshot_locked(table);
+	ret = 0;
+
+UNLOCK_AND_EXIT:
+	pthread_mutex_unlock(table->mutex);
+
+	return ret;
+}
+
+/* gets the fastest rate supported by the I3C controller that does not exceed the
+ * limit, bit N of the supported rates corresponds to the rate with value N */
+static uint8_t fastest_supported_rate(uint8_t supported_rates, uint8_t limit)
+{
+	for (int rate = limit; rate > 0; rate--) {
+		if (supported_rates & (1 << rate)) {
+			return rate;
+		}
+	}
+
+	return 0;
+}
+
+/* gets the I3C SDR rate limit of a target device from its max data speed (bits 2:0
+ * of the maxWr and maxRd bytes returned by GETMXDS) */
+static uint8_t max_data_speed_to_rate(uint8_t max_data_speed)
+{
+	switch (max_data_speed & 0b111) {
+	case 0b001:
+		return USBI3C_I3C_RATE_8_MHZ;
+	case 0b010:
+		return USBI3C_I3C_RATE_6_MHZ;
+	case 0b011:
+		return USBI3C_I3C_RATE_4_MHZ;
+	case 0b100:
+		return USBI3C_I3C_RATE_2_MHZ;
+	default:
+		return USBI3C_I3C_RATE_12_5_MHZ;
+	}
+}
+
+/* derives the transfer mode profile of a target device */
+static void device_derive_profile(struct target_device *device, const struct usbi3c_bus_capabilities *capabilities)
+{
+	struct i3c_mode *i3c_mode = &device->profile.i3c_mode;
+	uint8_t bcr = device->device_data.bus_characteristic_register;
+	uint8_t rate_limit = USBI3C_I3C_RATE_12_5_MHZ;
+
+	memset(i3c_mode, 0, sizeof(struct i3c_mode));
+	device->profile.origin = PROFILE_DERIVED;
+
+	if (device->device_data.target_type == USBI3C_I2C_DEVICE) {
+		/* bit 4 of the legacy virtual register (LVR) is clear for Fm+ devices */
+		i3c_mode->transfer_mode = USBI3C_I2C_MODE;
+		rate_limit = (device->device_data.device_characteristic_register & LVR_I2C_FM_MODE) ? USBI3C_I2C_RATE_400_KHZ : USBI3C_I2C_RATE_1_MHZ;
+		i3c_mode->transfer_rate = fastest_supported_rate(capabilities->i2c_data_transfer_rates, rate_limit);
+		return;
+	}
+
+	if (device->inventory.valid & USBI3C_INVENTORY_MXDS) {
+		/* the slowest of the max write and read speeds applies to the device */
+		rate_limit = max_data_speed_to_rate(device->inventory.max_write_speed);
+		if (max_data_speed_to_rate(device->inventory.max_read_speed) < rate_limit) {
+			rate_limit = max_data_speed_to_rate(device->inventory.max_read_speed);
+		}
+	} else if (bcr & BCR_MAX_DATA_SPEED_LIMITATION) {
+		/* the device is limited but its limits are not known */
+		rate_limit = USBI3C_I3C_RATE_2_MHZ;
+	}
+	i3c_mode->transfer_rate = fastest_supported_rate(capabilities->i3c_data_transfer_rates, rate_limit);
+
+	if ((bcr & BCR_HDR_CAPABLE) && (capabilities->i3c_data_transfer_modes & (1 << USBI3C_I3C_HDR_DDR_MODE))) {
+		i3c_mode->transfer_mode = USBI3C_I3C_HDR_DDR_MODE;
+	} else {
+		i3c_mode->transfer_mode = USBI3C_I3C_SDR_MODE;
+	}
+}
+
+/**
+ * @brief Derives the transfer mode profile of the target devices from their capabilities.
+ *
+ * I3C target devices that are HDR capable get the HDR-DDR mode if the I3C controller
+ * supports it, and the SDR mode otherwise, at the fastest rate supported by the I3C
+ * controller that does not exceed the max data speed of the device read with GETMXDS.
+ * I2C target devices get the I2C mode at the fastest rate their legacy virtual register
+ * allows. Profiles set by the user, or selected by autotuning, are left untouched.
+ *
+ * @param[in] table the target device table
+ * @param[in] capabilities the capabilities of the I3C controller
+ * @return the number of target devices that got a profile derived, or -1 on failure
+ */
+int table_derive_device_profiles(struct target_device_table *table, const struct usbi3c_bus_capabilities *capabilities)
+{
+	struct target_device *device = NULL;
+	int derived = 0;
+
+	if (table == NULL || capabilities == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	for (struct list *node = table->target_devices; node; node = node->next) {
+		device = (struct target_device *)node->data;
+		if (device->profile.origin == PROFILE_USER || device->profile.origin == PROFILE_TUNED) {
+			continue;
+		}
+		device_derive_profile(device, capabilities);
+		derived++;
+	}
+	table_publish_snapshot_locked(table);
+	pthread_mutex_unlock(table->mutex);
+
+	return derived;
+}
+
+/**
+ * @brief Publishes a new snapshot of the target device table.
+ *
+ * Writers that modify the devices in the table in place have to publish a new
+ * snapshot so the changes become visible to the snapshot readers.
+ *
+ * @param[in] table the target device table
+ */
+void table_publish_snapshot(struct target_device_table *table)
+{
+	if (table == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(table->mutex);
+	table_publish_snapshot_locked(table);
+	pthread_mutex_unlock(table->mutex);
+}
+
+/**
+ * @brief Gets the last published snapshot of the target device table.
+ *
+ * The snapshot is a consistent copy of the table that can be read without locking,
+ * it remains valid until it is released with table_snapshot_release() regardless
+ * of the changes made to the table in the meantime.
+ *
+ * @param[in] table the target device table
+ * @return the snapshot of the table, or NULL if the table has never been populated
+ */
+const struct table_snapshot *table_snapshot_acquire(struct target_device_table *table)
+{
+	const struct table_snapshot *snapshot = NULL;
+
+	if (table == NULL) {
+		return NULL;
+	}
+
+	/* announce the reader before loading the snapshot so writers don't free it
+	 * before the reader takes its reference */
+	atomic_fetch_add(&table->snapshot_acquiring, 1);
+	snapshot = atomic_load(&table->snapshot);
+	if (snapshot != NULL) {
+		atomic_fetch_add(&((struct table_snapshot *)snapshot)->refs, 1);
+	}
+	atomic_fetch_sub(&table->snapshot_acquiring, 1);
+
+	return snapshot;
+}
+
+/**
+ * @brief Releases a snapshot of the target device table.
+ *
+ * @param[in] table the target device table
+ * @param[in] snapshot the snapshot obtained with table_snapshot_acquire()
+ */
+void table_snapshot_release(struct target_device_table *table, const struct table_snapshot *snapshot)
+{
+	if (table == NULL || snapshot == NULL) {
+		return;
+	}
+
+	/* a retired snapshot is freed by the next writer once no reader holds it */
+	atomic_fetch_sub(&((struct table_snapshot *)snapshot)->refs, 1);
+}
+
+/**
+ * @brief Gets a device from a snapshot of the target device table.
+ *
+ * @param[in] snapshot the snapshot of the target device table
+ * @param[in] address the address of the device to get
+ * @return the copy of the target device in the snapshot, or NULL if no device with that address was found
+ */
+const struct target_device *table_snapshot_get_device(const struct table_snapshot *snapshot, uint8_t address)
+{
+	if (snapshot == NULL) {
+		return NULL;
+	}
+
+	if (address != 0 && address < TABLE_ADDRESS_INDEX_LEN) {
+		return snapshot->by_address[address];
+	}
+
+	for (int i = 0; i < snapshot->count; i++) {
+		if (snapshot->devices[i].target_address == address) {
+			return &snapshot->devices[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Gets the target handle of a device from a snapshot of the target device table.
+ *
+ * Only handles that are open when the snapshot is published are found, opening a
+ * handle for a device that had none publishes a new snapshot.
+ *
+ * @param[in] snapshot the snapshot of the target device table
+ * @param[in] address the address of the device
+ * @return the target handle of the device, or 0 if it has none
+ */
+uint32_t table_snapshot_get_handle(const struct table_snapshot *snapshot, uint8_t address)
+{
+	if (snapshot == NULL || address >= TABLE_ADDRESS_INDEX_LEN) {
+		return 0;
+	}
+
+	return snapshot->handles_by_address[address];
+}
@@ -16,6 +16,7 @@
 #define __TARGET_DEVICE_TABLE_I_H__
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "usbi3c_i.h"
@@ -25,17 +26,43 @@
 #define ADDRESS_BLOCK_SIZE (sizeof(uint64_t) * 8)
 #define ADDRESS_MASK_LEN (ADDRESS_LEN / ADDRESS_BLOCK_SIZE)
 
+/* target devices are indexed by their 7-bit address */
+#define TABLE_ADDRESS_INDEX_LEN 128
+/* open addressing hash of the 48-bit PIDs, kept at most half full */
+#define TABLE_PID_INDEX_LEN 256
+/* a bus cannot have more target devices than 7-bit addresses */
+#define TABLE_HANDLE_SLOTS 128
+/* target handles carry their generation in the upper 16 bits, and their slot + 1 in the lower 16 bits */
+#define TABLE_HANDLE(generation, slot) (((uint32_t)(generation) << 16) | (uint32_t)((slot) + 1))
+#define TABLE_HANDLE_SLOT(handle) ((int)((handle)&0xFFFF) - 1)
+
 #define USB_MAX_CONTROL_BUFFER_SIZE (CAPABILITY_HEADER_SIZE + CAPABILITY_BUS_SIZE + (ADDRESS_LEN * CAPABILITY_DEVICE_SIZE))
 
 #define TARGET_INTERRUPT_REQUEST_MASK 0b001
 #define CONTROLLER_ROLE_REQUEST_MASK 0b010
 #define IBI_TIMESTAMP_REQUEST_MASK 0b100
 
+/* bits of the bus characteristic register (BCR) of I3C target devices */
+#define BCR_MAX_DATA_SPEED_LIMITATION 0b00000001
+#define BCR_HDR_CAPABLE 0b00100000
+/* bit of the legacy virtual register (LVR) of I2C target devices set for Fm devices */
+#define LVR_I2C_FM_MODE 0b00010000
+
 /**
  * @brief Function to be called when a device is inserted into the table.
  */
 typedef void (*on_insert_fn)(uint8_t, void *);
 
+/**
+ * @brief Function to be called when a device is removed from the table.
+ */
+typedef void (*on_remove_fn)(uint8_t, void *);
+
+/**
+ * @brief Function to be called when the data of a device in the table changes.
+ */
+typedef void (*on_change_fn)(uint8_t, void *);
+
 /**
  * @brief Structure representing the capabilities of an I3C device.
  */
@@ -65,6 +92,24 @@ struct target_device_data {
 	uint8_t device_characteristic_register; ///< Device Characteristic Register
 };
 
+/**
+ * @brief Indicates where the transfer mode profile of a target device comes from.
+ */
+enum target_device_profile_origin {
+	PROFILE_NONE = 0,    ///< the target device has no profile, it uses the transfer mode of the usbi3c device
+	PROFILE_DERIVED = 1, ///< the profile was derived from the capabilities of the target device and the I3C controller
+	PROFILE_USER = 2,    ///< the profile was set by the user
+	PROFILE_TUNED = 3,   ///< the profile was selected by probing the target device at every mode and rate
+};
+
+/**
+ * @brief The transfer mode and rate used for the commands sent to a target device.
+ */
+struct target_device_profile {
+	uint8_t origin;		  ///< where the profile comes from (enum target_device_profile_origin)
+	struct i3c_mode i3c_mode; ///< transfer mode, rate and transfer mode specific info for the target device
+};
+
 /**
  * @brief A struct that represents an I3C device.
  */
@@ -74,6 +119,19 @@ struct target_device {
 	uint32_t pid_hi;	///< device’s provisional ID high
 	struct target_device_capability device_capability;
 	struct target_device_data device_data;
+	struct usbi3c_target_inventory inventory; ///< limits of the device read with the discovery CCCs
+	struct target_device_profile profile;	  ///< transfer mode and rate used for the commands sent to the device
+};
+
+/**
+ * @brief The values read from a target device during a bus inventory scan.
+ */
+struct target_device_discovery {
+	uint8_t address;			  ///< address of the target device the values were read from
+	uint64_t pid;				  ///< provisioned ID returned by GETPID
+	uint8_t bus_characteristic_register;	  ///< BCR returned by GETBCR
+	uint8_t device_characteristic_register; ///< DCR returned by GETDCR
+	struct usbi3c_target_inventory inventory; ///< the rest of the values, valid tells which of all of them were read
 };
 
 /**
@@ -85,17 +143,60 @@ struct address_change_request {
 	void *user_data;			   ///< User data to be shared with the on_address_change_cb callback function
 };
 
+/**
+ * @brief The identity of a target device referred to by a target handle.
+ */
+struct target_handle {
+	uint64_t pid;		///< provisioned ID of the target device, 0 for devices identified by static address
+	uint8_t static_address; ///< static address of the target device, only used when it has no provisioned ID
+	uint16_t generation;	///< incremented every time the handle is closed, to detect stale handles
+	uint32_t refs;		///< number of times the handle was opened and not closed yet, 0 if the slot is free
+};
+
+/**
+ * @brief An immutable copy of the target device table.
+ *
+ * Snapshots are published by the writers of the table every time it changes,
+ * readers can use them without taking the table mutex.
+ */
+struct table_snapshot {
+	uint64_t version;						   ///< Incremented every time a new snapshot is published
+	atomic_int refs;						   ///< Number of readers holding the snapshot
+	int count;							   ///< Number of devices in the snapshot
+	struct target_device *by_address[TABLE_ADDRESS_INDEX_LEN]; ///< The devices in the snapshot indexed by their address
+	uint32_t handles_by_address[TABLE_ADDRESS_INDEX_LEN];	   ///< The open target handles of the devices indexed by their address, 0 if none
+	struct target_device devices[];					   ///< Copy of the devices in the table, in list order
+};
+
 /**
  * @brief Structs that holds data related to the known I3C devices in the bus.
  */
 struct target_device_table {
 	struct usb_device *usb_dev;	     ///< USB session
 	struct list *target_devices;	     ///< The list of target devices in the I3C bus
-	struct list *address_change_tracker; ///< Tracks the submitted address change requests until they are processed
+	struct list *address_change_tracker[ADDRESS_LEN]; ///< Tracks the submitted address change requests until they are processed, indexed by current address
 	pthread_mutex_t *mutex;		     ///< Safe thread for table
 	int enable_events;		     ///< Enable events
 	on_insert_fn on_insert_cb;	     ///< callback function for on_insert event
 	void *user_data;		     ///< data to share with on_insert event
+	on_remove_fn on_remove_cb;	     ///< callback function for on_remove event
+	void *remove_user_data;		     ///< data to share with on_remove event
+	on_change_fn on_change_cb;	     ///< callback function for on_change event
+	void *change_user_data;		     ///< data to share with on_change event
+	int refresh_in_flight;		     ///< TRUE while a GET_TARGET_DEVICE_TABLE request to refresh the table is in flight
+	int refresh_pending;		     ///< TRUE if the table changed while the refresh was in flight and needs another one
+	uint64_t refresh_started_us;	     ///< Time the refresh in flight was submitted
+	uint32_t refresh_requests;	     ///< Number of GET_TARGET_DEVICE_TABLE requests submitted to refresh the table
+	uint32_t refresh_coalesced;	     ///< Number of refreshes absorbed by a refresh already in flight
+	struct target_device *devices_by_address[TABLE_ADDRESS_INDEX_LEN]; ///< The target devices in the list indexed by their address
+	struct target_device *devices_by_pid[TABLE_PID_INDEX_LEN];	   ///< Hash index (linear probing) of the target devices in the list by their PID
+	int indexed_pids;						   ///< Number of devices in the PID index
+	int unindexed_pids;						   ///< Number of devices with a PID that did not fit in the PID index
+	struct table_snapshot *_Atomic snapshot;			   ///< The last snapshot of the table published
+	atomic_int snapshot_acquiring;					   ///< Number of readers that loaded the snapshot and did not take their reference yet
+	struct list *retired_snapshots;					   ///< Snapshots replaced while readers were still holding them
+	uint64_t snapshot_version;					   ///< Version of the last snapshot published
+	struct target_handle handles[TABLE_HANDLE_SLOTS];		   ///< The target handles, a handle refers to its slot and generation
 };
 
 /* Target device table */
@@ -104,6 +205,8 @@ void table_destroy(struct target_device_table **table);
 void target_device_table_notification_handle(struct notification *notification, void *user_data);
 void table_enable_events(struct target_device_table *table);
 void table_on_insert_device(struct target_device_table *table, on_insert_fn callback, void *user_data);
+void table_on_remove_device(struct target_device_table *table, on_remove_fn callback, void *user_data);
+void table_on_change_device(struct target_device_table *table, on_change_fn callback, void *user_data);
 int table_insert_device(struct target_device_table *table, struct target_device *device);
 int table_address_list(struct target_device_table *table, uint8_t **list);
 int table_change_device_address(struct target_device_table *table, uint8_t addr_src, uint8_t addr_dest);
@@ -111,13 +214,34 @@ struct target_device *table_remove_device(struct target_device_table *table, uin
 struct target_device *table_get_device(struct target_device_table *table, uint8_t address);
 struct list *table_get_devices(struct target_device_table *table);
 struct target_device *table_get_device_by_pid(struct target_device_table *table, uint64_t pid);
+int table_open_target_handle(struct target_device_table *table, uint8_t address, uint32_t *handle);
+int table_close_target_handle(struct target_device_table *table, uint32_t handle);
+int table_resolve_target_handle(struct target_device_table *table, uint32_t handle, uint8_t *address);
 int table_fill_from_capability_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size);
 int table_fill_from_device_table_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size);
+int table_apply_device_table_buffer(struct target_device_table *table, uint8_t *buffer, const uint16_t buffer_size);
+int table_request_refresh(struct target_device_table *table);
 int table_create_device_table_buffer(struct target_device_table *table, uint8_t **buffer);
 int table_create_set_target_config_buffer(struct target_device_table *table, uint8_t config, uint32_t max_ibi_payload_size, uint8_t **buffer);
 int table_update_target_device_info(struct target_device_table *table);
-void table_free_address_change_request_tracker(struct list **tracker);
+int table_fetch_target_device_info(struct target_device_table *table, uint64_t *fingerprint);
+void table_free_address_change_request_tracker(struct target_device_table *table);
+void table_track_address_change(struct target_device_table *table, uint8_t current_address, uint8_t new_address, on_address_change_fn on_address_change_cb, void *user_data);
+void table_untrack_address_change(struct target_device_table *table, uint8_t current_address, uint8_t new_address);
+int table_create_address_change_buffer(struct target_device_table *table, const struct usbi3c_address_change *changes, uint8_t count, uint8_t **buffer);
 int table_identify_devices(struct target_device_table *table, int *support_static, int *support_dynamic);
+void table_set_device_configs(struct target_device_table *table, const struct usbi3c_target_device_config *configs, size_t count);
+int table_set_device_config(struct target_device_table *table, uint8_t address, uint8_t config);
+int table_set_device_max_ibi_payload(struct target_device_table *table, uint8_t address, uint32_t max_payload);
+int table_set_device_inventory(struct target_device_table *table, const struct target_device_discovery *discoveries, size_t count);
+int table_set_device_max_lengths(struct target_device_table *table, uint8_t address, uint16_t max_read_length, uint16_t max_write_length);
+int table_set_device_profile(struct target_device_table *table, uint8_t address, const struct i3c_mode *i3c_mode, uint8_t origin);
+int table_derive_device_profiles(struct target_device_table *table, const struct usbi3c_bus_capabilities *capabilities);
+void table_publish_snapshot(struct target_device_table *table);
+const struct table_snapshot *table_snapshot_acquire(struct target_device_table *table);
+void table_snapshot_release(struct target_device_table *table, const struct table_snapshot *snapshot);
+const struct target_device *table_snapshot_get_device(const struct table_snapshot *snapshot, uint8_t address);
+uint32_t table_snapshot_get_handle(const struct table_snapshot *snapshot, uint8_t address);
 
 /* Target device */
 struct device_event_handler;
@@ -126,7 +250,7 @@ void device_update_from_capability_entry(struct target_device *device, struct ca
 struct target_device *device_create_from_device_table_entry(struct target_device_table_entry *entry);
 void device_update_from_device_table_entry(struct target_device *device, struct target_device_table_entry *entry);
 int device_create_set_configuration_buffer(uint8_t address, uint8_t config, uint32_t max_ibi_payload_size, uint8_t **buffer);
-uint16_t device_create_address_change_buffer(struct target_device *device, uint8_t address, uint8_t new_address, uint8_t **buffer);
+int device_create_set_configurations_buffer(const struct usbi3c_target_device_config *configs, uint8_t count, uint8_t **buffer);
 int device_send_request_to_i3c_controller(struct usbi3c_device *usbi3c_dev, uint8_t target_address, uint8_t read_n_write);
 struct device_event_handler *device_event_handler_init(void);
 void device_destroy_event_handler(struct device_event_handler **device_event_handler);
@@ -0,0 +1,228 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#include "timer_wheel_i.h"
+#include "usbi3c_i.h"
+
+/* number of ticks in a revolution of the wheel, timers further away than a
+ * revolution share the slot with the timers of earlier revolutions */
+#define TIMER_WHEEL_SLOTS 512
+
+/**
+ * @brief A hashed timer wheel, every operation but expiring the timers is O(1).
+ *
+ * The wheel does not lock, it has to be protected by its owner.
+ */
+struct timer_wheel {
+	uint32_t tick_us;				   ///< the length of a tick
+	uint64_t start_us;				   ///< the time the first tick starts
+	uint64_t current_tick;				   ///< the tick the wheel is at, the timers due in earlier ticks have been popped
+	uint32_t count;					   ///< the number of timers armed
+	struct timer_wheel_entry slots[TIMER_WHEEL_SLOTS]; ///< the head of the circular list of timers of each slot
+};
+
+/**
+ * @brief Creates a timer wheel.
+ *
+ * @param[in] tick_us the length of a tick in microseconds, timers expire with this granularity
+ * @param[in] start_us the time the first tick starts in microseconds
+ * @return the timer wheel, or NULL if the tick length is invalid
+ */
+struct timer_wheel *timer_wheel_init(uint32_t tick_us, uint64_t start_us)
+{
+	struct timer_wheel *wheel = NULL;
+
+	if (tick_us == 0) {
+		return NULL;
+	}
+
+	wheel = (struct timer_wheel *)malloc_or_die(sizeof(struct timer_wheel));
+	wheel->tick_us = tick_us;
+	wheel->start_us = start_us;
+	for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+		wheel->slots[i].prev = &wheel->slots[i];
+		wheel->slots[i].next = &wheel->slots[i];
+	}
+
+	return wheel;
+}
+
+/**
+ * @brief Destroys a timer wheel, the timers still armed are left dangling.
+ *
+ * @param[in] wheel the timer wheel to destroy
+ */
+void timer_wheel_destroy(struct timer_wheel **wheel)
+{
+	if (wheel == NULL || *wheel == NULL) {
+		return;
+	}
+
+	FREE(*wheel);
+}
+
+/* gets the tick a time falls in */
+static uint64_t timer_wheel_tick(struct timer_wheel *wheel, uint64_t time_us)
+{
+	if (time_us < wheel->start_us) {
+		return 0;
+	}
+
+	return (time_us - wheel->start_us) / wheel->tick_us;
+}
+
+/**
+ * @brief Arms a timer, a timer that is already armed is moved to its new deadline.
+ *
+ * @param[in] wheel the timer wheel
+ * @param[in] entry the timer to arm
+ * @param[in] deadline_us the time the timer expires at in microseconds
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_entry *entry, uint64_t deadline_us)
+{
+	struct timer_wheel_entry *slot = NULL;
+	uint64_t tick = 0;
+
+	if (wheel == NULL || entry == NULL) {
+		return;
+	}
+
+	timer_wheel_remove(wheel, entry);
+
+	/* a deadline that already passed expires in the current tick */
+	tick = timer_wheel_tick(wheel, deadline_us);
+	if (tick < wheel->current_tick) {
+		tick = wheel->current_tick;
+	}
+
+	slot = &wheel->slots[tick % TIMER_WHEEL_SLOTS];
+	entry->deadline_us = deadline_us;
+	entry->next = slot;
+	entry->prev = slot->prev;
+	slot->prev->next = entry;
+	slot->prev = entry;
+	wheel->count++;
+}
+
+/**
+ * @brief Disarms a timer, nothing is done if the timer is not armed.
+ *
+ * @param[in] wheel the timer wheel
+ * @param[in] entry the timer to disarm
+ */
+void timer_wheel_remove(struct timer_wheel *wheel, struct timer_wheel_entry *entry)
+{
+	if (wheel == NULL || entry == NULL || entry->prev == NULL) {
+		return;
+	}
+
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->prev = NULL;
+	entry->next = NULL;
+	wheel->count--;
+}
+
+/**
+ * @brief Disarms one timer whose deadline has passed.
+ *
+ * The wheel is turned up to the current tick, only the slots of the ticks elapsed
+ * since the last call are looked at.
+ *
+ * @param[in] wheel the timer wheel
+ * @param[in] now_us the current time in microseconds
+ * @return the timer that expired, or NULL if no timer is due
+ */
+struct timer_wheel_entry *timer_wheel_pop_expired(struct timer_wheel *wheel, uint64_t now_us)
+{
+	uint64_t now_tick = 0;
+
+	if (wheel == NULL) {
+		return NULL;
+	}
+
+	now_tick = timer_wheel_tick(wheel, now_us);
+	while (wheel->count > 0 && wheel->current_tick <= now_tick) {
+		struct timer_wheel_entry *slot = &wheel->slots[wheel->current_tick % TIMER_WHEEL_SLOTS];
+
+		for (struct timer_wheel_entry *entry = slot->next; entry != slot; entry = entry->next) {
+			if (entry->deadline_us <= now_us) {
+				timer_wheel_remove(wheel, entry);
+				return entry;
+			}
+		}
+
+		/* timers armed later in the current tick still have to be found */
+		if (wheel->current_tick == now_tick) {
+			break;
+		}
+		wheel->current_tick++;
+		/* a single revolution goes through every slot */
+		if (now_tick - wheel->current_tick >= TIMER_WHEEL_SLOTS) {
+			wheel->current_tick = now_tick - TIMER_WHEEL_SLOTS + 1;
+		}
+	}
+
+	if (wheel->count == 0 && wheel->current_tick < now_tick) {
+		wheel->current_tick = now_tick;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Gets the earliest time a timer of the wheel may expire at.
+ *
+ * @param[in] wheel the timer wheel
+ * @return the time in microseconds, or UINT64_MAX if no timer is armed
+ */
+uint64_t timer_wheel_next_expiry(struct timer_wheel *wheel)
+{
+	if (wheel == NULL || wheel->count == 0) {
+		return UINT64_MAX;
+	}
+
+	for (uint64_t tick = wheel->current_tick; tick < wheel->current_tick + TIMER_WHEEL_SLOTS; tick++) {
+		struct timer_wheel_entry *slot = &wheel->slots[tick % TIMER_WHEEL_SLOTS];
+		uint64_t earliest_us = UINT64_MAX;
+
+		/* the timers of later revolutions are skipped */
+		for (struct timer_wheel_entry *entry = slot->next; entry != slot; entry = entry->next) {
+			if (timer_wheel_tick(wheel, entry->deadline_us) <= tick && entry->deadline_us < earliest_us) {
+				earliest_us = entry->deadline_us;
+			}
+		}
+		if (earliest_us != UINT64_MAX) {
+			return earliest_us;
+		}
+	}
+
+	/* every timer is more than a revolution away */
+	return wheel->start_us + (wheel->current_tick + TIMER_WHEEL_SLOTS) * wheel->tick_us;
+}
+
+/**
+ * @brief Gets the number of timers armed in a timer wheel.
+ *
+ * @param[in] wheel the timer wheel
+ * @return the number of timers armed
+ */
+uint32_t timer_wheel_count(struct timer_wheel *wheel)
+{
+	if (wheel == NULL) {
+		return 0;
+	}
+
+	return wheel->count;
+}
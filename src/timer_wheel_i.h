@@ -0,0 +1,40 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __TIMER_WHEEL_I_H__
+#define __TIMER_WHEEL_I_H__
+
+#include <stdint.h>
+
+struct timer_wheel;
+
+/**
+ * @brief A timer that can be armed in a timer wheel, meant to be embedded in the structure it times.
+ */
+struct timer_wheel_entry {
+	uint64_t deadline_us;		///< the time the timer expires at
+	struct timer_wheel_entry *prev;	///< the previous timer in the slot, NULL if the timer is not armed
+	struct timer_wheel_entry *next;	///< the next timer in the slot, NULL if the timer is not armed
+	void *data;			///< the structure the timer belongs to
+};
+
+struct timer_wheel *timer_wheel_init(uint32_t tick_us, uint64_t start_us);
+void timer_wheel_destroy(struct timer_wheel **wheel);
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_entry *entry, uint64_t deadline_us);
+void timer_wheel_remove(struct timer_wheel *wheel, struct timer_wheel_entry *entry);
+struct timer_wheel_entry *timer_wheel_pop_expired(struct timer_wheel *wheel, uint64_t now_us);
+uint64_t timer_wheel_next_expiry(struct timer_wheel *wheel);
+uint32_t timer_wheel_count(struct timer_wheel *wheel);
+
+#endif /* end of include guard: __TIMER_WHEEL_I_H__ */
@@ -1092,6 +1092,26 @@ void usb_wait_for_next_event(struct usb_device *usb_dev)
 	libusb_unlock_event_waiters(usb_ctx->libusb_context);
 }
 
+/**
+ * @brief Wakes up the threads waiting for the next event.
+ *
+ * The event thread is interrupted, so the threads blocked in usb_wait_for_next_event()
+ * return even if no transfer completed.
+ *
+ * @param[in] usb_dev the USB device
+ */
+void usb_wake_event_waiters(struct usb_device *usb_dev)
+{
+	struct priv_usb_device *priv_usb_dev = NULL;
+
+	if (usb_dev == NULL) {
+		return;
+	}
+	priv_usb_dev = container_of(usb_dev, struct priv_usb_device, usb_dev);
+
+	libusb_interrupt_event_handler(priv_usb_dev->usb_ctx->libusb_context);
+}
+
 /**
  * @brief Function to check if a USB device is initalized.
  *
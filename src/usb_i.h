@@ -113,6 +113,7 @@ void *usb_get_interrupt_context(struct usb_device *usb_dev);
 void usb_set_interrupt_buffer_length(struct usb_device *usb_dev, int buffer_length);
 int usb_interrupt_init(struct usb_device *usb_dev, interrupt_dispatcher_fn dispatcher);
 void usb_wait_for_next_event(struct usb_device *usb_dev);
+void usb_wake_event_waiters(struct usb_device *usb_dev);
 void usb_set_bulk_transfer_context(struct usb_device *usb_dev, void *bulk_transfer_context);
 int usb_get_max_bulk_response_buffer_size(struct usb_device *usb_dev);
 uint32_t usb_bulk_transfer_response_buffer_init(struct usb_device *usb_dev, unsigned char **buffer);
@@ -21,8 +21,18 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "batch_optimizer_i.h"
+#include "bus_inventory_i.h"
+#include "command_reorder_i.h"
+#include "device_cache_i.h"
 #include "ibi_i.h"
 #include "ibi_response_i.h"
+#include "poll_scheduler_i.h"
+#include "rate_autotune_i.h"
+#include "regmap_i.h"
+#include "request_id_i.h"
+#include "send_window_i.h"
+#include "submission_queue_i.h"
 #include "target_device_table_i.h"
 #include "usb_i.h"
 #include "usbi3c_i.h"
@@ -49,6 +59,128 @@ static void bus_error_notification_handle(struct notification *notification, voi
 	pthread_mutex_unlock(&usbi3c_dev->lock);
 }
 
+// Function to compare a request to disable the IBIs of a target device against a target handle
+static int compare_storm_disable_target(const void *a, const void *b)
+{
+	const struct ibi_storm_disable *disable = (const struct ibi_storm_disable *)a;
+	const uint32_t *target_id = (const uint32_t *)b;
+
+	return disable->target_id == *target_id ? 0 : 1;
+}
+
+// Function called once the I3C function accepted the configuration that disables the IBIs
+// of a target device, the target device is only marked as disabled from then on
+static void ibi_storm_target_disabled_handle(void *user_context, unsigned char *buffer, uint16_t buffer_size)
+{
+	struct ibi_storm_disable *disable = (struct ibi_storm_disable *)user_context;
+	struct usbi3c_device *usbi3c_dev = disable->usbi3c_dev;
+	uint8_t address = 0;
+
+	/* the target device may have changed its address while the request was in flight */
+	if (table_resolve_target_handle(usbi3c_dev->target_device_table, disable->target_id, &address) == 0) {
+		table_set_device_config(usbi3c_dev->target_device_table, address, disable->config);
+	}
+	ibi_storm_set_disabled(ibi_get_storm(usbi3c_dev->ibi), disable->target_id);
+}
+
+// Function to disable the IBIs of a target device that exceeded the IBI storm threshold,
+// it runs in the event thread so the configuration is pushed asynchronously and the I3C
+// function takes care of sending the DISEC CCC to the target device
+static void ibi_storm_disable_target_handle(uint32_t target_id, void *user_data)
+{
+	struct usbi3c_device *usbi3c_dev = (struct usbi3c_device *)user_data;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	struct ibi_storm_disable *disable = NULL;
+	uint32_t max_payload = 0;
+	uint8_t *buffer = NULL;
+	uint16_t buffer_size = 0;
+	uint8_t address = 0;
+	uint8_t config = 0;
+
+	if (table_resolve_target_handle(usbi3c_dev->target_device_table, target_id, &address)) {
+		DEBUG_PRINT("Target device %x not reachable\n", target_id);
+		return;
+	}
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return;
+	}
+	config = (device->device_data.ibi_timestamp << 2) | (device->device_data.controller_role_request << 1);
+	max_payload = device->device_data.max_ibi_payload_size;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	/* the request is kept until the device is released, a target device only has one
+	 * request in flight since it is not disabled again until its rate limit is reset */
+	disable = (struct ibi_storm_disable *)list_search(usbi3c_dev->storm_disables, &target_id, compare_storm_disable_target);
+	if (disable == NULL) {
+		disable = (struct ibi_storm_disable *)malloc_or_die(sizeof(struct ibi_storm_disable));
+		disable->usbi3c_dev = usbi3c_dev;
+		disable->target_id = target_id;
+		usbi3c_dev->storm_disables = list_append(usbi3c_dev->storm_disables, disable);
+	}
+	disable->config = config;
+
+	buffer_size = device_create_set_configuration_buffer(address, config, max_payload, &buffer);
+	if (usb_output_control_transfer_async(usbi3c_dev->usb_dev, SET_TARGET_DEVICE_CONFIG, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size, ibi_storm_target_disabled_handle, disable) < 0) {
+		DEBUG_PRINT("Failed to disable the IBIs of target device %x\n", address);
+	}
+	FREE(buffer);
+}
+
+// Function to get the identity of a target device in the IBI storm protection, the state
+// is kept by target handle so it stays with the target device when its address changes.
+// The IBI storm protection holds a reference to the handle of every target device it tracks
+static uint32_t ibi_storm_target_handle(uint8_t address, void *user_data)
+{
+	struct usbi3c_device *usbi3c_dev = (struct usbi3c_device *)user_data;
+	struct ibi_storm *storm = ibi_get_storm(usbi3c_dev->ibi);
+	const struct table_snapshot *snapshot = NULL;
+	uint32_t target_id = 0;
+
+	/* this runs for every IBI, read the snapshot so the table mutex is not contended */
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	target_id = table_snapshot_get_handle(snapshot, address);
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+	if (target_id && ibi_storm_has_target(storm, target_id)) {
+		return target_id;
+	}
+
+	/* first IBI of the target device, or the first one after its rate limit was set */
+	if (table_open_target_handle(usbi3c_dev->target_device_table, address, &target_id)) {
+		return 0;
+	}
+	if (!ibi_storm_track_target(storm, target_id)) {
+		/* the handle was already referenced by the IBI storm protection */
+		table_close_target_handle(usbi3c_dev->target_device_table, target_id);
+	}
+
+	return target_id;
+}
+
+// Function to get the IBI prioritization of a target device, target devices
+// that are not in the target device table get the lowest priority
+static uint8_t ibi_priority_handle(uint8_t address, void *user_data)
+{
+	struct usbi3c_device *usbi3c_dev = (struct usbi3c_device *)user_data;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	uint8_t priority = UINT8_MAX;
+
+	/* this runs for every IBI, read the snapshot so the table mutex is not contended */
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device != NULL) {
+		priority = device->device_capability.ibi_prioritization;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return priority;
+}
+
 // This function increments the reference counter of an usbi3c context
 static struct usbi3c_context *usbi3c_ref_context(struct usbi3c_context *usbi3c_ctx)
 {
@@ -114,10 +246,14 @@ static struct usbi3c_device *usbi3c_device_create(struct usbi3c_context *usb_ctx
 					NOTIFICATION_I3C_IBI,
 					ibi_handle_notification,
 					usbi3c_dev->ibi);
+	ibi_set_storm_callback(usbi3c_dev->ibi, ibi_storm_disable_target_handle, usbi3c_dev);
+	ibi_set_storm_target_callback(usbi3c_dev->ibi, ibi_storm_target_handle, usbi3c_dev);
+	ibi_set_priority_callback(usbi3c_dev->ibi, ibi_priority_handle, usbi3c_dev);
 
 	/* initialize the structs required for bulk transfers */
 	usbi3c_dev->i3c_mode = i3c_mode_init();
 	usbi3c_dev->command_queue = NULL;
+	usbi3c_dev->bulk_chunk_size = DEFAULT_BULK_CHUNK_SIZE;
 	usbi3c_dev->request_tracker = bulk_transfer_request_tracker_init(usb_dev, response_queue, usbi3c_dev->ibi);
 	usbi3c_add_notification_handler(usbi3c_dev, NOTIFICATION_STALL_ON_NACK, stall_on_nack_handle, usbi3c_dev->request_tracker);
 	usb_set_bulk_transfer_context(usb_dev, usbi3c_dev->request_tracker);
@@ -298,6 +434,25 @@ void usbi3c_free_devices(struct usbi3c_device ***devices)
 	*devices = NULL;
 }
 
+/* stops sending the commands submitted by class, the ones not sent yet are reported as not attempted */
+static void usbi3c_destroy_submission_queue(struct usbi3c_device *usbi3c_dev)
+{
+	struct bulk_requests *regular_requests = NULL;
+
+	if (usbi3c_dev->submission_queue == NULL) {
+		return;
+	}
+
+	/* no more responses can be reported to the queue once it is unhooked from the tracker */
+	regular_requests = usbi3c_dev->request_tracker->regular_requests;
+	pthread_mutex_lock(regular_requests->mutex);
+	regular_requests->on_request_answered = NULL;
+	regular_requests->request_answered_context = NULL;
+	pthread_mutex_unlock(regular_requests->mutex);
+
+	submission_queue_destroy(&usbi3c_dev->submission_queue);
+}
+
 /**
  * @ingroup library_setup
  * @brief This function deinitalize a usbi3c device
@@ -315,6 +470,11 @@ void usbi3c_device_deinit(struct usbi3c_device **usbi3c_dev)
 		return;
 	}
 
+	/* stop sending polls and submitted commands, and expiring requests, before anything they use goes away */
+	poll_scheduler_destroy(&(*usbi3c_dev)->poll_scheduler);
+	usbi3c_destroy_submission_queue(*usbi3c_dev);
+	bulk_transfer_stop_expiry((*usbi3c_dev)->request_tracker);
+
 	if ((*usbi3c_dev)->usb_dev) {
 		usb_device_deinit((*usbi3c_dev)->usb_dev);
 	}
@@ -347,6 +507,10 @@ void usbi3c_device_deinit(struct usbi3c_device **usbi3c_dev)
 		FREE((*usbi3c_dev)->i3c_mode);
 	}
 
+	FREE((*usbi3c_dev)->warm_start_cache);
+	regmap_free_list(&(*usbi3c_dev)->regmaps);
+	list_free_list_and_data(&(*usbi3c_dev)->storm_disables, free);
+
 	pthread_mutex_destroy(&(*usbi3c_dev)->lock);
 	usbi3c_deinit(&(*usbi3c_dev)->usbi3c_ctx);
 	FREE(*usbi3c_dev);
@@ -358,9 +522,10 @@ void usbi3c_device_deinit(struct usbi3c_device **usbi3c_dev)
  * @brief Sets a default configuration in all target devices in the table.
  *
  * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] table_fingerprint the fingerprint of the target device table once configured
  * @return 0 if the devices are configured correctly, or -1 otherwise
  */
-static int usbi3c_set_default_target_device_config(struct usbi3c_device *usbi3c_dev)
+static int usbi3c_set_default_target_device_config(struct usbi3c_device *usbi3c_dev, uint64_t *table_fingerprint)
 {
 	uint8_t *buffer = NULL;
 	uint16_t buffer_size = 0;
@@ -382,7 +547,7 @@ static int usbi3c_set_default_target_device_config(struct usbi3c_device *usbi3c_
 		return -1;
 	}
 	/* get the updated target device table from the I3C controller */
-	if (table_update_target_device_info(usbi3c_dev->target_device_table)) {
+	if (table_fetch_target_device_info(usbi3c_dev->target_device_table, table_fingerprint)) {
 		DEBUG_PRINT("The target device table could not be retrieved, aborting...\n");
 		FREE(buffer);
 		return -1;
@@ -450,11 +615,20 @@ static int initialize_i3c_bus(struct usbi3c_device *usbi3c_dev)
 /**
  * @brief Initializes the usbi3c device as I3C controller.
  *
+ * If the warm-start cache is enabled and the target device table reported after the
+ * bus initialization is identical to the one left configured by a previous run, the
+ * target devices already have their default configuration, so neither the configuration
+ * nor the retrieval of the updated table that follows it are sent again. The bus
+ * initialization and the first retrieval of the table are always performed.
+ *
  * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] cache_key the identity of the I3C function in the warm-start cache
  * @return 0 if the I3C controller was initialized correctly, or -1 otherwise
  */
-static int usbi3c_initialize_controller(struct usbi3c_device *usbi3c_dev)
+static int usbi3c_initialize_controller(struct usbi3c_device *usbi3c_dev, const struct device_cache_key *cache_key)
 {
+	struct device_cache_entry cache_entry = { 0 };
+	uint64_t table_fingerprint = 0;
 	int init_status = I3C_BUS_UNINITIALIZED;
 
 	/* initialize the I3C bus */
@@ -476,16 +650,31 @@ static int usbi3c_initialize_controller(struct usbi3c_device *usbi3c_dev)
 	}
 
 	/* get the updated target device table from the I3C controller */
-	if (table_update_target_device_info(usbi3c_dev->target_device_table)) {
+	if (table_fetch_target_device_info(usbi3c_dev->target_device_table, &table_fingerprint)) {
 		DEBUG_PRINT("The target device table could not be retrieved, aborting...\n");
 		return -1;
 	}
 
-	/* set an initial configuration in all I3C target devices using the I3C controller
-	 * capabilities */
-	if (usbi3c_set_default_target_device_config(usbi3c_dev)) {
-		DEBUG_PRINT("The table devices configuration has failed, aborting...\n");
-		return -1;
+	if (usbi3c_dev->warm_start_cache &&
+	    device_cache_load(usbi3c_dev->warm_start_cache, cache_key, &cache_entry) == 0 &&
+	    cache_entry.table_fingerprint == table_fingerprint) {
+		/* the table already reflects the configuration set by a previous run */
+		usbi3c_dev->startup_stats.warm_start = TRUE;
+	} else {
+		/* set an initial configuration in all I3C target devices using the I3C controller
+		 * capabilities */
+		if (usbi3c_set_default_target_device_config(usbi3c_dev, &table_fingerprint)) {
+			DEBUG_PRINT("The table devices configuration has failed, aborting...\n");
+			return -1;
+		}
+
+		if (usbi3c_dev->warm_start_cache) {
+			cache_entry.table_fingerprint = table_fingerprint;
+			if (device_cache_store(usbi3c_dev->warm_start_cache, cache_key, &cache_entry)) {
+				/* the cache is only an optimization, the device is initialized anyway */
+				DEBUG_PRINT("The warm-start cache could not be updated\n");
+			}
+		}
 	}
 
 	table_enable_events(usbi3c_dev->target_device_table);
@@ -609,35 +798,8 @@ static struct device_info *device_info_create_from_capability_buffer(uint8_t *bu
 	return device;
 }
 
-/**
- * @ingroup library_setup
- * @brief Initialize the usbi3c device depending on its capabilities.
- *
- * The I3C Device inside a USB Device shall support one of the following three roles:
- * - I3C Controller role
- * - I3C Target device role
- * - I3C Target device capable of Secondary Controller role
- *
- * If the device's role is I3C Controller, it performs the initial configuration of the
- * I3C Bus and all the Target devices on the I3C Bus, including the dynamic address
- * assignment of the I3C Target devices.
- *
- * If the device's role is I3C Target device, on Host’s request I3C Target device Hot-Joins
- * an already initialized I3C Bus.
- *
- * These are the steps performed as part of the initialization:
- * - Gets the capabilities of the I3C device and target devices
- * - Starts listening for USB interrupts
- * - Starts listening for bulk response transfers
- * - Initializes the I3C bus (I3C Controller role only)
- *   - The I3C controller performs I3C target device discovery
- *   - I3C function generates and stores the target device table
- * - Gets the updated target device table (I3C Controller role only)
- *
- * @param[in] usbi3c_dev the usbi3c device
- * @return 0 if the device was initalized correctly, or -1 otherwise
- */
-int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
+/* performs the initialization of the usbi3c device, see usbi3c_initialize_device() */
+static int usbi3c_initialize_device_role(struct usbi3c_device *usbi3c_dev)
 {
 	/* We cannot know in advanced how big the control transfer input buffer needs to be,
 	 * we won't know the size of the I3C Capability data structure until after
@@ -646,11 +808,8 @@ int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
 	uint8_t cap_buffer[USB_MAX_CONTROL_BUFFER_SIZE] = { 0 };
 	unsigned char *buffer = NULL;
 	uint32_t buffer_size = 0;
-
-	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return -1;
-	}
+	uint16_t cap_size = 0;
+	struct device_cache_key cache_key = { 0 };
 
 	if (usbi3c_dev->usb_dev == NULL || !usb_device_is_initialized(usbi3c_dev->usb_dev)) {
 		DEBUG_PRINT("The USB device is not initialized, aborting...\n");
@@ -677,6 +836,12 @@ int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
 		return -1;
 	}
 
+	/* the capability is part of the identity of the I3C function in the warm-start cache */
+	cap_size = GET_CAPABILITY_HEADER(cap_buffer)->total_length;
+	cache_key.vendor_id = usbi3c_dev->usb_dev->idVendor;
+	cache_key.product_id = usbi3c_dev->usb_dev->idProduct;
+	cache_key.capability_fingerprint = device_cache_fingerprint(cap_buffer, cap_size < USB_MAX_CONTROL_BUFFER_SIZE ? cap_size : USB_MAX_CONTROL_BUFFER_SIZE);
+
 	/* parse the info from each target device (if it exists) from the buffer
 	 * and fill up the target device table with it */
 	if (table_fill_from_capability_buffer(usbi3c_dev->target_device_table, cap_buffer,
@@ -708,7 +873,7 @@ int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
 
 	if (usbi3c_get_device_role(usbi3c_dev) == USBI3C_PRIMARY_CONTROLLER_ROLE) {
 
-		return usbi3c_initialize_controller(usbi3c_dev);
+		return usbi3c_initialize_controller(usbi3c_dev, &cache_key);
 	}
 	if (usbi3c_get_device_role(usbi3c_dev) == USBI3C_TARGET_DEVICE_ROLE || usbi3c_get_device_role(usbi3c_dev) == USBI3C_TARGET_DEVICE_SECONDARY_CONTROLLER_ROLE) {
 
@@ -720,6 +885,120 @@ int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
 	return -1;
 }
 
+/**
+ * @ingroup library_setup
+ * @brief Initialize the usbi3c device depending on its capabilities.
+ *
+ * The I3C Device inside a USB Device shall support one of the following three roles:
+ * - I3C Controller role
+ * - I3C Target device role
+ * - I3C Target device capable of Secondary Controller role
+ *
+ * If the device's role is I3C Controller, it performs the initial configuration of the
+ * I3C Bus and all the Target devices on the I3C Bus, including the dynamic address
+ * assignment of the I3C Target devices.
+ *
+ * If the device's role is I3C Target device, on Host’s request I3C Target device Hot-Joins
+ * an already initialized I3C Bus.
+ *
+ * These are the steps performed as part of the initialization:
+ * - Gets the capabilities of the I3C device and target devices
+ * - Starts listening for USB interrupts
+ * - Starts listening for bulk response transfers
+ * - Initializes the I3C bus (I3C Controller role only)
+ *   - The I3C controller performs I3C target device discovery
+ *   - I3C function generates and stores the target device table
+ * - Gets the updated target device table (I3C Controller role only)
+ * - Sets a default configuration in the target devices, unless the warm-start cache shows
+ *   they are already configured (I3C Controller role only)
+ *
+ * The time spent in the initialization can be retrieved afterwards using
+ * usbi3c_get_startup_stats().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @return 0 if the device was initalized correctly, or -1 otherwise
+ */
+int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev)
+{
+	uint64_t start_us = 0;
+	int ret = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	memset(&usbi3c_dev->startup_stats, 0, sizeof(usbi3c_dev->startup_stats));
+	start_us = monotonic_time_us();
+	ret = usbi3c_initialize_device_role(usbi3c_dev);
+	usbi3c_dev->startup_stats.duration_us = monotonic_time_us() - start_us;
+
+	return ret;
+}
+
+/**
+ * @ingroup library_setup
+ * @brief Enables a warm-start cache for the initialization of the usbi3c device.
+ *
+ * On test benches the I3C function and the topology of its I3C bus rarely change between
+ * runs. When the cache is enabled, usbi3c_initialize_device() remembers a fingerprint of the
+ * target device table it left configured, keyed by the USB vendor and product IDs of the
+ * I3C function and a fingerprint of its I3C capability. If a later initialization finds an
+ * identical capability and an identical target device table after the bus initialization,
+ * the target devices are known to be configured already, so the SET_TARGET_DEVICE_CONFIG
+ * request and the retrieval of the table that follows it are skipped. The capability and
+ * the table are still read on every initialization, since they are compared against the
+ * cache. Any difference falls back to the regular initialization.
+ *
+ * @note This function has to be called before usbi3c_initialize_device().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] directory an existing directory to store the cache files in, or NULL to disable the cache
+ * @return 0 if the cache was configured correctly, or -1 otherwise
+ */
+int usbi3c_set_warm_start_cache(struct usbi3c_device *usbi3c_dev, const char *directory)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	FREE(usbi3c_dev->warm_start_cache);
+	if (directory) {
+		usbi3c_dev->warm_start_cache = strdup(directory);
+		if (usbi3c_dev->warm_start_cache == NULL) {
+			DEBUG_PRINT("The warm-start cache directory could not be stored, aborting...\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @ingroup library_setup
+ * @brief Gets information about the last initialization of the usbi3c device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] stats the information about the last call to usbi3c_initialize_device()
+ * @return 0 if the information was retrieved, or -1 otherwise
+ */
+int usbi3c_get_startup_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_startup_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	*stats = usbi3c_dev->startup_stats;
+
+	return 0;
+}
+
 /**
  * @brief I3C Device class-specific request used to enable/disable features defined by the value of selector.
  *
@@ -1183,7 +1462,9 @@ int usbi3c_get_address_list(struct usbi3c_device *usbi3c_dev, uint8_t **address_
  */
 int usbi3c_set_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t config)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	uint32_t max_payload = 0;
 	uint8_t *buffer = NULL;
 	uint16_t buffer_size = 0;
 
@@ -1200,20 +1481,22 @@ int usbi3c_set_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t ad
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
+	max_payload = device->device_data.max_ibi_payload_size;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 
-	buffer_size = device_create_set_configuration_buffer(address, config, device->device_data.max_ibi_payload_size, &buffer);
+	buffer_size = device_create_set_configuration_buffer(address, config, max_payload, &buffer);
 	if (usb_output_control_transfer(usbi3c_dev->usb_dev, SET_TARGET_DEVICE_CONFIG, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size) < 0) {
 		FREE(buffer);
 		return -1;
 	}
-	device->device_data.ibi_timestamp = (config >> 2) & 0x1;
-	device->device_data.controller_role_request = (config >> 1) & 0x1;
-	device->device_data.target_interrupt_request = config & 0x1;
+	table_set_device_config(usbi3c_dev->target_device_table, address, config);
 
 	FREE(buffer);
 
@@ -1231,7 +1514,8 @@ int usbi3c_set_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t ad
  */
 int usbi3c_get_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t *config)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
@@ -1242,17 +1526,97 @@ int usbi3c_get_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t ad
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
 
 	*config = (device->device_data.ibi_timestamp << 2) | (device->device_data.controller_role_request << 1) | device->device_data.target_interrupt_request;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 
 	return 0;
 }
 
+/**
+ * @ingroup bus_info
+ * @brief Gets a handle that refers to a target device regardless of its address.
+ *
+ * The dynamic address of an I3C target device can change when it is re-addressed,
+ * when it Hot-Joins the bus, or when the bus is initialized again. A target handle is
+ * bound to the provisioned ID of the target device instead (or to its static address
+ * for I2C target devices), and is resolved to the current address of the target device
+ * every time it is used. Commands queued with usbi3c_enqueue_command_to_target() are
+ * sent to the address the target device has when they are transmitted.
+ *
+ * Getting the handle of a target device that already has one returns the same handle,
+ * every handle obtained has to be released with usbi3c_release_target_handle().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the current address of the target device
+ * @param[out] handle the handle of the target device, it is never 0
+ * @return 0 if the handle was obtained, or -1 otherwise
+ */
+int usbi3c_get_target_handle(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t *handle)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (handle == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return table_open_target_handle(usbi3c_dev->target_device_table, address, handle);
+}
+
+/**
+ * @ingroup bus_info
+ * @brief Releases a target handle.
+ *
+ * Once every reference to a handle has been released, the handle becomes stale and
+ * any further use of it fails, even if the target device is still in the bus.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] handle the handle to release
+ * @return 0 if the handle was released, or -1 if the handle is not valid
+ */
+int usbi3c_release_target_handle(struct usbi3c_device *usbi3c_dev, uint32_t handle)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return table_close_target_handle(usbi3c_dev->target_device_table, handle);
+}
+
+/**
+ * @ingroup bus_info
+ * @brief Gets the current address of the target device referred to by a handle.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] handle the handle of the target device
+ * @param[out] address the current address of the target device
+ * @return 0 if the address was retrieved, or -1 if the handle is stale or the target device is not in the bus
+ */
+int usbi3c_get_target_handle_address(struct usbi3c_device *usbi3c_dev, uint32_t handle, uint8_t *address)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (address == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return table_resolve_target_handle(usbi3c_dev->target_device_table, handle, address);
+}
+
 /**
  * @ingroup bus_configuration
  * @brief Set USB transaction timeout.
@@ -1312,7 +1676,8 @@ int usbi3c_get_timeout(struct usbi3c_device *usbi3c_dev, unsigned int *timeout)
  */
 int usbi3c_set_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t max_payload)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
 	uint8_t *buffer = NULL;
 	uint16_t buffer_size = 0;
 	uint8_t config = 0;
@@ -1330,8 +1695,10 @@ int usbi3c_set_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, u
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
@@ -1340,13 +1707,14 @@ int usbi3c_set_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, u
 	config = device->device_data.target_interrupt_request;
 	config = config | (device->device_data.controller_role_request << 1);
 	config = config | (device->device_data.ibi_timestamp << 2);
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 
 	buffer_size = device_create_set_configuration_buffer(address, config, max_payload, &buffer);
 	if (usb_output_control_transfer(usbi3c_dev->usb_dev, SET_TARGET_DEVICE_CONFIG, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size) < 0) {
 		FREE(buffer);
 		return -1;
 	}
-	device->device_data.max_ibi_payload_size = max_payload;
+	table_set_device_max_ibi_payload(usbi3c_dev->target_device_table, address, max_payload);
 
 	FREE(buffer);
 
@@ -1355,70 +1723,112 @@ int usbi3c_set_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, u
 
 /**
  * @ingroup bus_configuration
- * @brief Gets the target device max ibi payload of one target device.
+ * @brief Sets the configurable parameters of several target devices in a single request.
+ *
+ * Each entry sets the IBIT, CRR and TIR configuration (see usbi3c_set_target_device_config())
+ * and the max IBI payload size (see usbi3c_set_target_device_max_ibi_payload()) of one target
+ * device. All the target devices are configured with a single SET_TARGET_DEVICE_CONFIG request,
+ * so either all of them or none of them get configured.
+ *
+ * This request is applicable when the I3C device is the active I3C controller.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] address the address of the target device to have its configuration retrieved
- * @param[out] max_payload the max ibi payload set
- * @return 0 if the device max ibi payload was retrieved correctly, or -1 otherwise
+ * @param[in] configs the configuration of each target device, every address can only be listed once
+ * @param[in] count the number of target devices to configure
+ * @return 0 if the target devices were configured correctly, or -1 otherwise
  */
-int usbi3c_get_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t *max_payload)
+int usbi3c_set_target_device_configs(struct usbi3c_device *usbi3c_dev, const struct usbi3c_target_device_config *configs, size_t count)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	uint8_t requested[ADDRESS_LEN] = { 0 };
+	uint8_t *buffer = NULL;
+	uint16_t buffer_size = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
-	if (max_payload == NULL) {
-		DEBUG_PRINT("A required argument is missing, aborting...\n");
+	if (configs == NULL || count == 0) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
 		return -1;
 	}
-
-	device = table_get_device(usbi3c_dev->target_device_table, address);
-	if (device == NULL) {
-		DEBUG_PRINT("Address %x not reachable\n", address);
+	if (count > UINT8_MAX) {
+		DEBUG_PRINT("Too many target devices to configure in a single request, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->device_info == NULL) {
+		DEBUG_PRINT("The device capabilities are unknown, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_device_is_active_controller(usbi3c_dev) == FALSE) {
+		DEBUG_PRINT("The I3C device is not the active I3C controller\n");
 		return -1;
 	}
 
-	*max_payload = device->device_data.max_ibi_payload_size;
-
-	return 0;
-}
-
+	/* validate the whole batch before sending anything */
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	for (size_t i = 0; i < count; i++) {
+		if (table_snapshot_get_device(snapshot, configs[i].address) == NULL) {
+			table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+			DEBUG_PRINT("Address %x not reachable\n", configs[i].address);
+			return -1;
+		}
+		if (requested[configs[i].address]) {
+			table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+			DEBUG_PRINT("Address %x is configured more than once\n", configs[i].address);
+			return -1;
+		}
+		requested[configs[i].address] = TRUE;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	buffer_size = device_create_set_configurations_buffer(configs, count, &buffer);
+	if (usb_output_control_transfer(usbi3c_dev->usb_dev, SET_TARGET_DEVICE_CONFIG, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size) < 0) {
+		FREE(buffer);
+		return -1;
+	}
+	table_set_device_configs(usbi3c_dev->target_device_table, configs, count);
+
+	FREE(buffer);
+
+	return 0;
+}
+
 /**
- * @brief Changes the previously assigned dynamic address of an I3C target device.
- *
- * @note: This request is applicable when the I3C Device is the Active I3C Controller.
+ * @ingroup bus_configuration
+ * @brief Gets the target device max ibi payload of one target device.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] address 7 bits of target device address (bits 0 to 6) and bit 7 set to zero
- * @param[in] new_address new device address
- * @return 0 if the request to change the device address was submitted correctly, or -1 otherwise
+ * @param[in] address the address of the target device to have its configuration retrieved
+ * @param[out] max_payload the max ibi payload set
+ * @return 0 if the device max ibi payload was retrieved correctly, or -1 otherwise
  */
-static int usbi3c_change_dynamic_address(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t new_address)
+int usbi3c_get_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t *max_payload)
 {
-	struct target_device *device = NULL;
-	uint16_t buffer_size = 0;
-	uint8_t *buffer = NULL;
-	int res = -1;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
-	if (device == NULL) {
-		DEBUG_PRINT("Address %x not reachable\n", address);
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (max_payload == NULL) {
+		DEBUG_PRINT("A required argument is missing, aborting...\n");
 		return -1;
 	}
 
-	if (table_get_device(usbi3c_dev->target_device_table, new_address) != NULL) {
-		DEBUG_PRINT("New address %x is already being used by another device\n", address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
 
-	buffer_size = device_create_address_change_buffer(device, address, new_address, &buffer);
-	res = usb_output_control_transfer(usbi3c_dev->usb_dev, CHANGE_DYNAMIC_ADDRESS, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size);
-	FREE(buffer);
+	*max_payload = device->device_data.max_ibi_payload_size;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 
-	return res;
+	return 0;
 }
 
 /**
@@ -1440,12 +1850,50 @@ static int usbi3c_change_dynamic_address(struct usbi3c_device *usbi3c_dev, uint8
  */
 int usbi3c_change_i3c_device_address(struct usbi3c_device *usbi3c_dev, uint8_t current_address, uint8_t new_address, on_address_change_fn on_address_change_cb, void *data)
 {
-	struct address_change_request *request = NULL;
+	struct usbi3c_address_change change = {
+		.current_address = current_address,
+		.new_address = new_address,
+	};
+
+	return usbi3c_change_i3c_device_addresses(usbi3c_dev, &change, 1, on_address_change_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Changes the previously assigned dynamic addresses of several I3C target devices.
+ *
+ * This function changes the dynamic address of multiple I3C devices using a single
+ * CHANGE_DYNAMIC_ADDRESS request, and updates the target device table to reflect the
+ * changes. The I3C function processes the changes in the order provided, so a device can
+ * take the address released by a device changed earlier in the same request. The whole
+ * request is rejected without being sent if any of the changes is not valid.
+ *
+ * The on_address_change_cb callback function is executed once per address change with
+ * the result of that change.
+ *
+ * @note: This request is applicable when the I3C Device is the Active I3C Controller.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] changes the address changes to request
+ * @param[in] count the number of address changes in the request
+ * @param[in] on_address_change_cb a callback function that will be executed when each address change is processed
+ * @param[in] data the user data to be shared with the on_address_change_cb callback function
+ * @return 0 if the request to change the device addresses was submitted correctly, or -1 otherwise
+ */
+int usbi3c_change_i3c_device_addresses(struct usbi3c_device *usbi3c_dev, const struct usbi3c_address_change *changes, size_t count, on_address_change_fn on_address_change_cb, void *data)
+{
+	uint8_t *buffer = NULL;
+	int buffer_size = 0;
+	int res = -1;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
+	if (changes == NULL || count == 0 || count > UINT8_MAX) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
 	if (usbi3c_dev->device_info == NULL) {
 		DEBUG_PRINT("The device capabilities are unknown, aborting...\n");
 		return -1;
@@ -1455,21 +1903,28 @@ int usbi3c_change_i3c_device_address(struct usbi3c_device *usbi3c_dev, uint8_t c
 		return -1;
 	}
 
-	/* submit the request to change the address */
-	if (usbi3c_change_dynamic_address(usbi3c_dev, current_address, new_address) < 0) {
-		DEBUG_PRINT("The CHANGE_DYNAMIC_ADDRESS request failed\n");
+	buffer_size = table_create_address_change_buffer(usbi3c_dev->target_device_table, changes, (uint8_t)count, &buffer);
+	if (buffer_size < 0) {
+		DEBUG_PRINT("Invalid address change request\n");
 		return -1;
 	}
 
-	/* add the address change request to the tracker so we can run
-	 * the callback when the address change is processed */
-	request = (struct address_change_request *)malloc_or_die(sizeof(struct address_change_request));
-	request->request_id = (current_address << 8) + new_address;
-	request->on_address_change_cb = on_address_change_cb;
-	request->user_data = data;
-	pthread_mutex_lock(usbi3c_dev->target_device_table->mutex);
-	usbi3c_dev->target_device_table->address_change_tracker = list_append(usbi3c_dev->target_device_table->address_change_tracker, request);
-	pthread_mutex_unlock(usbi3c_dev->target_device_table->mutex);
+	/* add the address change requests to the tracker before submitting them, so
+	 * the callback can be run even if the result arrives before this returns */
+	for (size_t i = 0; i < count; i++) {
+		table_track_address_change(usbi3c_dev->target_device_table, changes[i].current_address, changes[i].new_address, on_address_change_cb, data);
+	}
+
+	/* submit the request to change the addresses */
+	res = usb_output_control_transfer(usbi3c_dev->usb_dev, CHANGE_DYNAMIC_ADDRESS, 0, USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size);
+	FREE(buffer);
+	if (res < 0) {
+		DEBUG_PRINT("The CHANGE_DYNAMIC_ADDRESS request failed\n");
+		for (size_t i = 0; i < count; i++) {
+			table_untrack_address_change(usbi3c_dev->target_device_table, changes[i].current_address, changes[i].new_address);
+		}
+		return -1;
+	}
 
 	return 0;
 }
@@ -1484,20 +1939,27 @@ int usbi3c_change_i3c_device_address(struct usbi3c_device *usbi3c_dev, uint8_t c
  */
 int usbi3c_get_target_BCR(struct usbi3c_device *usbi3c_dev, uint8_t address)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	int value = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
 
-	return device->device_data.bus_characteristic_register;
+	value = device->device_data.bus_characteristic_register;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return value;
 }
 
 /**
@@ -1510,20 +1972,27 @@ int usbi3c_get_target_BCR(struct usbi3c_device *usbi3c_dev, uint8_t address)
  */
 int usbi3c_get_target_DCR(struct usbi3c_device *usbi3c_dev, uint8_t address)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	int value = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
 
-	return device->device_data.device_characteristic_register;
+	value = device->device_data.device_characteristic_register;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return value;
 }
 
 /**
@@ -1536,20 +2005,27 @@ int usbi3c_get_target_DCR(struct usbi3c_device *usbi3c_dev, uint8_t address)
  */
 int usbi3c_get_target_type(struct usbi3c_device *usbi3c_dev, uint8_t address)
 {
-	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	int value = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
 
-	device = table_get_device(usbi3c_dev->target_device_table, address);
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
 	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		DEBUG_PRINT("Address %x not reachable\n", address);
 		return -1;
 	}
 
-	return device->device_data.target_type;
+	value = device->device_data.target_type;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return value;
 }
 
 /**
@@ -1568,6 +2044,41 @@ int usbi3c_get_usb_error(struct usbi3c_device *usbi3c_dev)
 	return usb_get_errno(usbi3c_dev->usb_dev);
 }
 
+/* gets the commands of the queue as they have to be sent, the adjacent writes are
+ * coalesced and the duplicate reads removed if batch optimizations are enabled, and the
+ * queue is reordered to reduce the mode switches if it was marked as order independent */
+static struct list *usbi3c_get_commands_to_send(struct usbi3c_device *usbi3c_dev, struct batch_optimization *optimization, struct command_reorder *reorder)
+{
+	struct list *commands = usbi3c_dev->command_queue;
+
+	if (usbi3c_dev->batch_optimizations &&
+	    batch_optimize(usbi3c_dev->target_device_table, commands, usbi3c_dev->batch_optimizations, usbi3c_dev->register_address_size, optimization) == 0) {
+		commands = optimization->commands;
+	}
+	if (usbi3c_dev->order_independent == FALSE ||
+	    command_reorder_batch(usbi3c_dev->target_device_table, commands, reorder) < 0) {
+		return commands;
+	}
+
+	return reorder->commands;
+}
+
+/* updates the batch counters once an optimized or reordered batch was sent */
+static void usbi3c_update_batch_stats(struct usbi3c_device *usbi3c_dev, struct batch_optimization *optimization, struct command_reorder *reorder)
+{
+	if (optimization->commands) {
+		usbi3c_dev->batch_optimization_stats.batches++;
+		usbi3c_dev->batch_optimization_stats.writes_coalesced += optimization->writes_coalesced;
+		usbi3c_dev->batch_optimization_stats.reads_deduplicated += optimization->reads_deduplicated;
+		usbi3c_dev->batch_optimization_stats.commands_eliminated += optimization->count - optimization->sent;
+	}
+	if (reorder->commands) {
+		usbi3c_dev->reorder_stats.batches++;
+		usbi3c_dev->reorder_stats.mode_switches += reorder->mode_switches_after;
+		usbi3c_dev->reorder_stats.mode_switches_saved += reorder->mode_switches_before - reorder->mode_switches_after;
+	}
+}
+
 /**
  * @ingroup command_execution
  * @brief Sends one or many commands and their associated data.
@@ -1588,6 +2099,10 @@ int usbi3c_get_usb_error(struct usbi3c_device *usbi3c_dev)
  * stalls on NACK (if exists) and it gets cancelled because of it, it will cause all the commands
  * in this request to get cancelled too.
  *
+ * If the commands were marked with usbi3c_mark_commands_order_independent(), they may be
+ * executed in a different order, but the responses are still returned in the order the
+ * commands were queued.
+ *
  * @param[in] usbi3c_dev the usbi3c device
  * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request
  * @param[in] timeout the maximum time in seconds to wait for a response after sending the commands
@@ -1595,6 +2110,8 @@ int usbi3c_get_usb_error(struct usbi3c_device *usbi3c_dev)
  */
 struct list *usbi3c_send_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous, int timeout)
 {
+	struct batch_optimization optimization = { 0 };
+	struct command_reorder reorder = { 0 };
 	struct usbi3c_response *response = NULL;
 	struct list *commands = NULL;
 	struct list *request_ids = NULL;
@@ -1632,8 +2149,9 @@ struct list *usbi3c_send_commands(struct usbi3c_device *usbi3c_dev, uint8_t depe
 	}
 
 	/* send the list of dependent commands and wait until we get a response */
-	request_ids = bulk_transfer_send_commands(usbi3c_dev, commands, dependent_on_previous);
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, usbi3c_get_commands_to_send(usbi3c_dev, &optimization, &reorder), dependent_on_previous);
 	if (request_ids) {
+		usbi3c_update_batch_stats(usbi3c_dev, &optimization, &reorder);
 		initial_time = time(NULL);
 		/* when multiple commands are sent together, their responses are received together
 		 * as well, that means we can look for the first request ID in the list only, once
@@ -1643,6 +2161,9 @@ struct list *usbi3c_send_commands(struct usbi3c_device *usbi3c_dev, uint8_t depe
 			current_time = time(NULL);
 			if (timeout > 0 && (current_time > initial_time + timeout)) {
 				DEBUG_PRINT("Timeout waiting for responses\n");
+				/* nobody is going to collect the responses, so the requests have to
+				 * stop being tracked or their IDs and window slots are never freed */
+				bulk_transfer_untrack_requests(usbi3c_dev->request_tracker->regular_requests, request_ids);
 				goto FREE_QUEUE_AND_EXIT;
 			}
 
@@ -1667,10 +2188,24 @@ struct list *usbi3c_send_commands(struct usbi3c_device *usbi3c_dev, uint8_t depe
 		}
 	}
 
+	/* the responses of a reordered or optimized batch are returned in the order the commands were queued */
+	if (reorder.commands) {
+		responses = command_reorder_restore_responses(&reorder, responses);
+	}
+	if (optimization.commands) {
+		responses = batch_optimization_restore_responses(&optimization, responses);
+	}
+
+	/* commands that were split in chunks get a single response */
+	bulk_transfer_merge_chunked_responses(commands, &responses);
+
 	/* we can clean up the command queue now */
 FREE_QUEUE_AND_EXIT:
 	list_free_list_and_data(&request_ids, free);
+	command_reorder_free(&reorder);
+	batch_optimization_free(&optimization);
 	bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+	usbi3c_dev->order_independent = FALSE;
 
 	return responses;
 }
@@ -1702,6 +2237,8 @@ FREE_QUEUE_AND_EXIT:
  */
 int usbi3c_submit_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous)
 {
+	struct batch_optimization optimization = { 0 };
+	struct command_reorder reorder = { 0 };
 	struct list *request_ids = NULL;
 	struct list *node = NULL;
 	struct list *commands = NULL;
@@ -1733,253 +2270,1950 @@ int usbi3c_submit_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_o
 	}
 
 	/* submit the commands for execution */
-	request_ids = bulk_transfer_send_commands(usbi3c_dev, commands, dependent_on_previous);
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, usbi3c_get_commands_to_send(usbi3c_dev, &optimization, &reorder), dependent_on_previous);
 	if (request_ids == NULL) {
 		list_free_list_and_data(&request_ids, free);
 		goto FREE_QUEUE_AND_EXIT;
 	}
+	usbi3c_update_batch_stats(usbi3c_dev, &optimization, &reorder);
 	list_free_list_and_data(&request_ids, free);
 	ret = 0;
 
 	/* we can clean up the command queue now */
 FREE_QUEUE_AND_EXIT:
+	command_reorder_free(&reorder);
+	batch_optimization_free(&optimization);
 	bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+	usbi3c_dev->order_independent = FALSE;
 
 	return ret;
 }
 
 /**
  * @ingroup command_execution
- * @brief Submits a vendor specific request consisting of one vendor specified data block to the I3C function.
- *
- * The data block in the vendor specific request does not need to be manually aligned
- * by the user, if the block provided is not 32-bit aligned, it will be padded
- * automatically before is transferred.
+ * @brief Submits a list of dependent commands for execution, unless it would have to wait for the requests in flight.
  *
- * @note Before submitting this request, a callback function for vendor specific requests
- * has to be registered using the usbi3c_on_vendor_specific_response(). This callback will
- * be triggered whenever a response to a vendor specific request is received.
+ * This function works like usbi3c_submit_commands(), but instead of waiting for room in the
+ * I3C function, it returns USBI3C_WOULD_BLOCK right away when the window of requests in flight
+ * configured with usbi3c_set_submit_window() is full, or when the I3C function does not have
+ * enough buffer for the commands while other requests are in flight. In that case the commands
+ * are kept in the command queue, so they can be submitted again once the window becomes writable.
+ * Producers can be notified of that with usbi3c_on_submit_writable() or with the file descriptor
+ * returned by usbi3c_get_submit_writable_fd().
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] data a buffer with the vendor specific data
- * @param[in] data_size the size of the vendor specific data to be transmitted
- * @return 0 if the request was transferred correctly, or -1 otherwise
+ * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request
+ * @return 0 if the commands were submitted to the I3C function successfully, USBI3C_WOULD_BLOCK if they
+ * have to wait for the requests in flight, or -1 otherwise
  */
-int usbi3c_submit_vendor_specific_request(struct usbi3c_device *usbi3c_dev, unsigned char *data, uint32_t data_size)
+int usbi3c_try_submit_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous)
 {
-	int ret = 0;
-	uint32_t buffer_size;
-	unsigned char *buffer = NULL;
+	struct batch_optimization optimization = { 0 };
+	struct command_reorder reorder = { 0 };
+	struct list *request_ids = NULL;
+	struct list *node = NULL;
+	struct usbi3c_command *command = NULL;
+	int ret = -1;
 
-	/* validate data */
+	/* input validation */
 	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("Missing usbi3c context\n");
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
-	if (data == NULL || data_size == 0) {
-		DEBUG_PRINT("Missing data or incorrect data size\n");
+	if (usbi3c_dev->command_queue == NULL) {
+		DEBUG_PRINT("The command queue is empty\n");
 		return -1;
 	}
 
-	if (usbi3c_dev->request_tracker->vendor_request->on_vendor_response_cb == NULL) {
-		DEBUG_PRINT("Missing callback function for vendor responses\n");
-		return -1;
+	for (node = usbi3c_dev->command_queue; node; node = node->next) {
+		command = (struct usbi3c_command *)node->data;
+
+		if (command == NULL) {
+			DEBUG_PRINT("A command to transfer is missing, aborting...\n");
+			goto FREE_QUEUE_AND_EXIT;
+		}
+		if (command->on_response_cb == NULL) {
+			DEBUG_PRINT("The command is missing its callback function, aborting...\n");
+			goto FREE_QUEUE_AND_EXIT;
+		}
 	}
 
-	buffer_size = bulk_transfer_create_vendor_specific_buffer(&buffer, data, data_size);
-	ret = usb_output_bulk_transfer(usbi3c_dev->usb_dev, buffer, buffer_size);
+	/* submit the commands for execution if they don't have to wait */
+	ret = bulk_transfer_try_send_commands(usbi3c_dev, usbi3c_get_commands_to_send(usbi3c_dev, &optimization, &reorder), dependent_on_previous, &request_ids);
+	if (ret == USBI3C_WOULD_BLOCK) {
+		/* the command queue is kept as it is so it can be submitted again */
+		command_reorder_free(&reorder);
+		batch_optimization_free(&optimization);
+		return USBI3C_WOULD_BLOCK;
+	}
+	if (ret == 0) {
+		usbi3c_update_batch_stats(usbi3c_dev, &optimization, &reorder);
+	}
+	list_free_list_and_data(&request_ids, free);
 
-	FREE(buffer);
+	/* we can clean up the command queue now */
+FREE_QUEUE_AND_EXIT:
+	command_reorder_free(&reorder);
+	batch_optimization_free(&optimization);
+	bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+	usbi3c_dev->order_independent = FALSE;
 
 	return ret;
 }
 
-/*
- * @brief Wrapper to bulk_transfer_free_response() to be used to free lists of commands.
- *
- * The list_free_list_and_data() function receives as one of its arguments a  function of
- * the type list_free_data_fn_t, and this has a void pointer as argument. This wrapper
- * function type casts the data pointed by the void pointer to the correct type so it can
- * be used to free a list of commands.
+/**
+ * @ingroup command_execution
+ * @brief Configures the max amount of work that can be in flight before usbi3c_try_submit_commands() refuses more commands.
  *
- * @param[in] data the usbi3c_response struct to free.
+ * A bulk request is in flight from the time it is sent until its response is received. The
+ * bytes in flight are the bytes of the I3C function buffer the requests and their responses
+ * take. A request is always accepted when there are no other requests in flight, so a request
+ * larger than the window does not wait forever. The window is not limited by default.
  *
- * @note This function should be used as an argument of function list_free_list_and_data().
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] max_requests the max number of bulk requests in flight, 0 to not limit them
+ * @param[in] max_bytes the max number of bytes in flight, 0 to not limit them
+ * @return 0 if the window was configured, or -1 otherwise
  */
-static void free_response_in_list(void *data)
+int usbi3c_set_submit_window(struct usbi3c_device *usbi3c_dev, uint32_t max_requests, uint32_t max_bytes)
 {
-	struct usbi3c_response *response = (struct usbi3c_response *)data;
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
 
-	bulk_transfer_free_response(&response);
+	send_window_set_limits(usbi3c_dev->request_tracker->regular_requests->window, max_requests, max_bytes);
+
+	return 0;
 }
 
 /**
  * @ingroup command_execution
- * @brief Frees the memory allocated for a list of usbi3c responses.
+ * @brief Assigns a callback function that will run when commands can be submitted again without blocking.
  *
- * @param[in] responses the list of responses (struct usbi3c_response) to be freed.
+ * The callback runs once, the first time a request in flight is answered after
+ * usbi3c_try_submit_commands() returned USBI3C_WOULD_BLOCK. It can run in the thread that
+ * handles the responses, but no lock of the library is held while it runs, so it can
+ * resubmit the refused commands with usbi3c_try_submit_commands().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_writable_cb the callback function to run, or NULL to remove it
+ * @param[in] data the data to share with the callback function
+ * @return 0 if the callback was assigned successfully, or -1 otherwise
  */
-void usbi3c_free_responses(struct list **responses)
+int usbi3c_on_submit_writable(struct usbi3c_device *usbi3c_dev, on_submit_writable_fn on_writable_cb, void *data)
 {
-	list_free_list_and_data(responses, free_response_in_list);
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	send_window_set_writable_callback(usbi3c_dev->request_tracker->regular_requests->window, on_writable_cb, data);
+
+	return 0;
 }
 
 /**
- * @ingroup bus_configuration
- * @brief Sets the I3C communication mode options.
+ * @ingroup command_execution
+ * @brief Gets a file descriptor that becomes readable when commands can be submitted again without blocking.
+ *
+ * The file descriptor is an eventfd that is signaled every time the producers would be
+ * notified with the callback assigned using usbi3c_on_submit_writable(), so it can be
+ * waited on with poll(), select() or epoll alongside other file descriptors. The producer
+ * has to read it to clear it. The file descriptor is owned by the library and is closed
+ * when the device is deinitialized.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] transfer_mode sets the transfer mode for the I3C or I2C commands
- * @param[in] transfer_rate sets the transfer rate for the selected transfer mode
- * @param[in] tm_specific_info sets transfer mode specific information
+ * @return the file descriptor, or -1 on failure
  */
-void usbi3c_set_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t transfer_mode, uint8_t transfer_rate, uint8_t tm_specific_info)
+int usbi3c_get_submit_writable_fd(struct usbi3c_device *usbi3c_dev)
 {
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return;
+		return -1;
 	}
 
-	usbi3c_dev->i3c_mode->transfer_mode = transfer_mode;
-	usbi3c_dev->i3c_mode->transfer_rate = transfer_rate;
-	usbi3c_dev->i3c_mode->tm_specific_info = tm_specific_info;
+	return send_window_get_event_fd(usbi3c_dev->request_tracker->regular_requests->window);
 }
 
 /**
- * @ingroup bus_configuration
- * @brief Gets the I3C communication mode options.
+ * @ingroup command_execution
+ * @brief Gets the counters of the window of bulk requests in flight.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[out] transfer_mode gets the transfer mode for the I3C or I2C commands
- * @param[out] transfer_rate gets the transfer rate for the selected transfer mode
- * @param[out] tm_specific_info gets transfer mode specific information
- * @return 0 if the values where retrieved successfully, or -1 otherwise
+ * @param[out] stats the requests and bytes in flight, and the submissions refused because of them
+ * @return 0 if the counters were retrieved, or -1 otherwise
  */
-int usbi3c_get_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t *transfer_mode, uint8_t *transfer_rate, uint8_t *tm_specific_info)
+int usbi3c_get_submit_window_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_submit_window_stats *stats)
 {
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
-	if (transfer_mode == NULL || transfer_rate == NULL || tm_specific_info == NULL) {
-		DEBUG_PRINT("A required argument is missing, aborting...\n");
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
 		return -1;
 	}
 
-	*transfer_mode = usbi3c_dev->i3c_mode->transfer_mode;
-	*transfer_rate = usbi3c_dev->i3c_mode->transfer_rate;
-	*tm_specific_info = usbi3c_dev->i3c_mode->tm_specific_info;
+	if (send_window_get_stats(usbi3c_dev->request_tracker->regular_requests->window, stats) < 0) {
+		return -1;
+	}
+	stats->commands_in_flight = request_id_in_use(usbi3c_dev->request_tracker->regular_requests->request_ids);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Configures the max number of commands that can be awaiting their response at once.
+ *
+ * Every command sent gets a 16-bit request ID that is not reused until the command stops
+ * being tracked, either because its response was received and handled, or because it was
+ * cancelled. Once the max number of commands is awaiting a response, no more commands are
+ * sent until some of them are answered: usbi3c_try_submit_commands() returns USBI3C_WOULD_BLOCK
+ * and the rest of the functions that send commands fail. Since request IDs wrap around, at
+ * most half of them (32768) can be in use at once, which is the default.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] max_commands the max number of commands awaiting their response, from 1 to 32768
+ * @return 0 if the max was configured, or -1 otherwise
+ */
+int usbi3c_set_max_commands_in_flight(struct usbi3c_device *usbi3c_dev, uint32_t max_commands)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (request_id_set_max_in_flight(usbi3c_dev->request_tracker->regular_requests->request_ids, max_commands) < 0) {
+		DEBUG_PRINT("Invalid max number of commands in flight, aborting...\n");
+		return -1;
+	}
 
 	return 0;
 }
 
+/**
+ * @ingroup command_execution
+ * @brief Sets the time the response to a request is awaited before the request expires.
+ *
+ * If the response to a request never arrives (e.g. the adapter was reset, the bulk response
+ * transfer failed, or the I3C function dropped the request), the request would otherwise be
+ * tracked forever. Once a request expires, each one of its commands is completed with a
+ * response whose attempted field is USBI3C_COMMAND_TIMED_OUT: through its callback if it
+ * has one, or as the response returned by usbi3c_send_commands() otherwise. The request
+ * IDs and the room in the send window taken by the request are released, and a response
+ * received after the request expired is discarded.
+ *
+ * The timeout applies to the requests sent after it is set. Requests never expire by default.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] timeout_ms the time to wait for the response in milliseconds, 0 for requests to never expire
+ * @return 0 if the timeout was set, or -1 otherwise
+ */
+int usbi3c_set_response_timeout(struct usbi3c_device *usbi3c_dev, uint32_t timeout_ms)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return bulk_transfer_set_response_timeout(usbi3c_dev->request_tracker, timeout_ms);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters of the requests that expired before their response was received.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] stats the counters of the requests expired
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_request_expiry_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_request_expiry_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return bulk_transfer_get_request_expiry_stats(usbi3c_dev->request_tracker->regular_requests, stats);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Marks the commands in the command queue as independent of the order in which they are executed.
+ *
+ * Commands sent in the same request are executed in the order they were queued, so a
+ * request that alternates commands with different transfer modes or rates (e.g. SDR,
+ * HDR-DDR and I2C commands to different target devices) switches modes between each
+ * one of them, and every switch costs bus time. When the commands are marked as order
+ * independent, the next usbi3c_send_commands() or usbi3c_submit_commands() groups them by
+ * transfer mode and rate before sending them.
+ *
+ * The commands to the same target device are still executed in the order they were
+ * queued, and no command is moved across a broadcast command or a target reset pattern.
+ * Since the order of execution changes, the commands affected by an error depend on the
+ * new order, so only commands that do not depend on each other should be marked. The
+ * mark is cleared once the commands are sent.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @return 0 if the commands were marked, or -1 otherwise
+ */
+int usbi3c_mark_commands_order_independent(struct usbi3c_device *usbi3c_dev)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->command_queue == NULL) {
+		DEBUG_PRINT("The command queue is empty\n");
+		return -1;
+	}
+
+	usbi3c_dev->order_independent = TRUE;
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters of the order-independent batches of commands sent.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] stats the number of order-independent batches sent, and the transfer mode switches made and saved
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_reorder_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_reorder_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	*stats = usbi3c_dev->reorder_stats;
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Sets the optimizations applied to the batches of commands before they are sent.
+ *
+ * The optimizations reduce the number of commands sent by usbi3c_send_commands() and
+ * usbi3c_submit_commands(), every command queued still gets its own response:
+ * - USBI3C_COALESCE_WRITES: a write queued right after a write to the same target device,
+ *   with the same settings, is appended to it. Every write is expected to start with a
+ *   register address of register_address_size bytes (MSB first), and a write is only
+ *   appended if it starts at the register where the previous write ended, its register
+ *   address is not sent. Writes are never coalesced if register_address_size is 0, since
+ *   there is no way to tell whether they are contiguous. The coalesced write never
+ *   exceeds the max write length of the target device, if known. If the coalesced write
+ *   fails, all the writes coalesced into it get the error.
+ * - USBI3C_DEDUPLICATE_READS: a read identical to a previous read from the same target
+ *   device is served by the previous read, as long as no other command was queued for
+ *   the target device, and no broadcast command or target reset pattern was queued, in
+ *   between. All the reads served by the same read get the same response and data, and
+ *   the callback of each one of them is called with it.
+ *
+ * Commands that were split in chunks, CCCs and target reset patterns are never merged.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] optimizations bitmask of enum usbi3c_batch_optimization to apply, 0 to send the commands as queued
+ * @param[in] register_address_size the number of bytes of register address the writes start with (0 to 4)
+ * @return 0 if the optimizations were set, or -1 otherwise
+ */
+int usbi3c_set_batch_optimization(struct usbi3c_device *usbi3c_dev, uint8_t optimizations, uint8_t register_address_size)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if ((optimizations & ~(USBI3C_COALESCE_WRITES | USBI3C_DEDUPLICATE_READS)) || register_address_size > sizeof(uint32_t)) {
+		DEBUG_PRINT("Invalid batch optimization settings, aborting...\n");
+		return -1;
+	}
+
+	usbi3c_dev->batch_optimizations = optimizations;
+	usbi3c_dev->register_address_size = register_address_size;
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters of the commands eliminated by the batch optimizations.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] stats the number of optimized batches sent, and the writes coalesced and reads deduplicated in them
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_batch_optimization_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_batch_optimization_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	*stats = usbi3c_dev->batch_optimization_stats;
+
+	return 0;
+}
+
+/* gets the register map of a target device, the register maps are kept by target handle */
+static struct regmap *usbi3c_get_regmap(struct usbi3c_device *usbi3c_dev, uint8_t address)
+{
+	const struct table_snapshot *snapshot = NULL;
+	struct regmap *regmap = NULL;
+	uint32_t handle = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return NULL;
+	}
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	handle = table_snapshot_get_handle(snapshot, address);
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+	if (handle) {
+		regmap = regmap_find(usbi3c_dev->regmaps, handle);
+	}
+	if (regmap == NULL) {
+		DEBUG_PRINT("The target device has no register map, aborting...\n");
+	}
+
+	return regmap;
+}
+
+/* removes the register map of a target device and the reference it holds to its target handle */
+static void usbi3c_remove_regmap(struct usbi3c_device *usbi3c_dev, uint32_t handle)
+{
+	if (regmap_find(usbi3c_dev->regmaps, handle) == NULL) {
+		return;
+	}
+	usbi3c_dev->regmaps = regmap_remove(usbi3c_dev->regmaps, handle);
+	table_close_target_handle(usbi3c_dev->target_device_table, handle);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Describes the registers of a target device so they can be accessed through a cache.
+ *
+ * Once a target device has a register map, its registers can be read and written
+ * with usbi3c_regmap_read() and usbi3c_regmap_write(). A read of a register is sent
+ * as a write of the register address followed by a read of its value, and a write of
+ * a register as a write of the register address followed by the value.
+ *
+ * The registers that are not in any of the volatile ranges are cached: they are read
+ * from the target device only once, and the following reads are served locally. Writes
+ * go through the cache, so the cache always has the last value written. A register map
+ * that already existed for the target device is replaced, and its cache is dropped.
+ *
+ * The register map belongs to the target device rather than to its address, it keeps
+ * being used with the new address of the target device after its dynamic address changes,
+ * and a different target device that takes the previous address does not get it.
+ *
+ * @note The register map operations send their commands right away, so they fail if
+ * there are commands in the command queue.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] config the layout of the registers of the target device, it can be discarded after the call
+ * @return 0 if the register map was created, or -1 otherwise
+ */
+int usbi3c_regmap_init(struct usbi3c_device *usbi3c_dev, uint8_t address, const struct usbi3c_regmap_config *config)
+{
+	struct regmap *regmap = NULL;
+	uint32_t handle = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (config == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+	if (table_get_device(usbi3c_dev->target_device_table, address) == NULL) {
+		DEBUG_PRINT("Target device %x not found, aborting...\n", address);
+		return -1;
+	}
+
+	/* the register map holds a reference to the target handle until it is removed */
+	if (table_open_target_handle(usbi3c_dev->target_device_table, address, &handle) < 0) {
+		DEBUG_PRINT("Failed to open the target handle of target device %x, aborting...\n", address);
+		return -1;
+	}
+	regmap = regmap_create(handle, config);
+	if (regmap == NULL) {
+		table_close_target_handle(usbi3c_dev->target_device_table, handle);
+		return -1;
+	}
+	usbi3c_remove_regmap(usbi3c_dev, handle);
+	usbi3c_dev->regmaps = list_append(usbi3c_dev->regmaps, regmap);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Removes the register map of a target device, the registers that were not synced are lost.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @return 0 if the register map was removed, or -1 otherwise
+ */
+int usbi3c_regmap_exit(struct usbi3c_device *usbi3c_dev, uint8_t address)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+
+	usbi3c_remove_regmap(usbi3c_dev, regmap_get_handle(regmap));
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Reads a register of a target device.
+ *
+ * Cacheable registers are only read from the target device if their value is not
+ * cached yet, volatile registers are always read from the target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] reg the register to read
+ * @param[out] value the value of the register
+ * @param[in] timeout the maximum time in seconds to wait for the response
+ * @return 0 if the register was read, or -1 otherwise
+ */
+int usbi3c_regmap_read(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t reg, uint32_t *value, int timeout)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+	if (value == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return regmap_read(usbi3c_dev, regmap, reg, value, timeout);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Writes a register of a target device.
+ *
+ * The value is written to the target device and, once the write succeeds, to the
+ * cache. If the write fails, the register is read from the target device the next
+ * time. If writes are deferred with usbi3c_regmap_defer_writes(), the writes to
+ * cacheable registers are only written to the cache until usbi3c_regmap_sync().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] reg the register to write
+ * @param[in] value the value to write
+ * @param[in] timeout the maximum time in seconds to wait for the response
+ * @return 0 if the register was written, or -1 otherwise
+ */
+int usbi3c_regmap_write(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t reg, uint32_t value, int timeout)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+
+	return regmap_write(usbi3c_dev, regmap, reg, value, timeout);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Defers the writes to the cacheable registers of a target device until they are synced.
+ *
+ * While the writes are deferred, writing a cacheable register only updates its value
+ * in the cache and marks it as dirty, so many registers can be configured and then
+ * written to the target device in a single request with usbi3c_regmap_sync(). Writes
+ * to volatile registers are always sent right away.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] defer TRUE to defer the writes, FALSE to write them through again
+ * @return 0 if the setting was changed, or -1 otherwise
+ */
+int usbi3c_regmap_defer_writes(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t defer)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+	regmap_defer_writes(regmap, defer);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Writes the dirty registers of a target device in a single request.
+ *
+ * Only the registers written while the writes were deferred, and not synced yet, are
+ * written. The registers whose write fails remain dirty, so the sync can be retried.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] timeout the maximum time in seconds to wait for the responses
+ * @return the number of registers written, or -1 if any of them could not be written
+ */
+int usbi3c_regmap_sync(struct usbi3c_device *usbi3c_dev, uint8_t address, int timeout)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+
+	return regmap_sync(usbi3c_dev, regmap, timeout);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Drops the values cached for a target device, e.g. after it was reset.
+ *
+ * The dirty registers that were not synced are dropped as well.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @return 0 if the cache was dropped, or -1 otherwise
+ */
+int usbi3c_regmap_invalidate(struct usbi3c_device *usbi3c_dev, uint8_t address)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+	regmap_invalidate(regmap);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters of the register map of a target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[out] stats the reads served from the cache, and the reads and writes sent to the target device
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_regmap_get_stats(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_regmap_stats *stats)
+{
+	struct regmap *regmap = usbi3c_get_regmap(usbi3c_dev, address);
+
+	if (regmap == NULL) {
+		return -1;
+	}
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+	regmap_get_stats(regmap, stats);
+
+	return 0;
+}
+
+/* gets the mode a command to a target device is sent with */
+static void usbi3c_get_command_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address, struct i3c_mode *i3c_mode)
+{
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+
+	*i3c_mode = *usbi3c_dev->i3c_mode;
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device && device->profile.origin != PROFILE_NONE) {
+		*i3c_mode = device->profile.i3c_mode;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+}
+
+/* sends the reads of the polls that fell due in the same tick as a single request */
+static int usbi3c_send_polls(struct list *requests, void *context)
+{
+	struct usbi3c_device *usbi3c_dev = (struct usbi3c_device *)context;
+	struct list *batch = NULL;
+	struct list *request_ids = NULL;
+	const int NOT_APPLICABLE = 0;
+
+	for (struct list *node = requests; node; node = node->next) {
+		struct poll_request *request = (struct poll_request *)node->data;
+		struct i3c_mode i3c_mode;
+
+		usbi3c_get_command_i3c_mode(usbi3c_dev, request->address, &i3c_mode);
+		/* the polls are independent, an error in one of them does not cancel the rest */
+		if (bulk_transfer_enqueue_command(&batch,
+						  REGULAR_COMMAND,
+						  request->address,
+						  USBI3C_READ,
+						  USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK,
+						  &i3c_mode,
+						  NOT_APPLICABLE,
+						  NOT_APPLICABLE,
+						  NULL,
+						  request->length,
+						  request->on_response_cb,
+						  request->user_data) < 0) {
+			bulk_transfer_free_commands(&batch);
+			return -1;
+		}
+	}
+
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, batch, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	bulk_transfer_free_commands(&batch);
+	if (request_ids == NULL) {
+		return -1;
+	}
+	list_free_list_and_data(&request_ids, free);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Starts the scheduler that sends the periodic reads registered with usbi3c_add_poll().
+ *
+ * Time is divided in ticks, and all the reads that fall due in the same tick are sent
+ * to the I3C function as a single request by a thread owned by the library, so polling
+ * many target devices does not need a timer and a transfer per target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] tick_us the length of a tick in microseconds, the periods of the polls are rounded to whole ticks
+ * @return 0 if the scheduler was started, or -1 otherwise
+ */
+int usbi3c_start_polling(struct usbi3c_device *usbi3c_dev, uint32_t tick_us)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (tick_us == 0) {
+		DEBUG_PRINT("Invalid tick length, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->poll_scheduler) {
+		DEBUG_PRINT("The poll scheduler is already running\n");
+		return -1;
+	}
+
+	usbi3c_dev->poll_scheduler = poll_scheduler_init(tick_us, monotonic_time_us(), usbi3c_send_polls, usbi3c_dev);
+	if (poll_scheduler_start(usbi3c_dev->poll_scheduler) < 0) {
+		poll_scheduler_destroy(&usbi3c_dev->poll_scheduler);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Stops the poll scheduler and unregisters all the polls.
+ *
+ * The reads already sent still get their callback called when their response is received.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @return 0 if the scheduler was stopped, or -1 otherwise
+ */
+int usbi3c_stop_polling(struct usbi3c_device *usbi3c_dev)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->poll_scheduler == NULL) {
+		DEBUG_PRINT("The poll scheduler is not running\n");
+		return -1;
+	}
+
+	poll_scheduler_destroy(&usbi3c_dev->poll_scheduler);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Registers a read from a target device to be sent periodically.
+ *
+ * The read is sent by the poll scheduler started with usbi3c_start_polling() once per
+ * period, together with all the other reads that fall due in the same tick. Each poll
+ * is given the phase (the tick within its period it falls due in) that spreads the
+ * reads most evenly across the ticks. If a read falls due again before the previous
+ * one could be sent, only one read is sent and the period skipped is counted as a
+ * deadline miss.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device to read from
+ * @param[in] data_size the number of bytes to read, it has to be a multiple of 4
+ * @param[in] period_us the period of the read in microseconds
+ * @param[in] on_response_cb the callback to call with the response of each read
+ * @param[in] user_data the user data of the callback
+ * @return the ID of the poll, or -1 on failure
+ */
+int usbi3c_add_poll(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t data_size, uint32_t period_us, on_response_fn on_response_cb, void *user_data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->poll_scheduler == NULL) {
+		DEBUG_PRINT("The poll scheduler is not running\n");
+		return -1;
+	}
+	if (on_response_cb == NULL || period_us == 0) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+	if (data_size == 0 || data_size % 4 != 0) {
+		DEBUG_PRINT("The data size to Read has to be a multiple of 4 (32-bit aligned), aborting...\n");
+		return -1;
+	}
+
+	return poll_scheduler_add(usbi3c_dev->poll_scheduler, address, data_size, period_us, on_response_cb, user_data, monotonic_time_us());
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Unregisters a periodic read.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] poll_id the ID of the poll returned by usbi3c_add_poll()
+ * @return 0 if the poll was unregistered, or -1 otherwise
+ */
+int usbi3c_remove_poll(struct usbi3c_device *usbi3c_dev, int poll_id)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return poll_scheduler_remove(usbi3c_dev->poll_scheduler, poll_id);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters of a periodic read.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] poll_id the ID of the poll returned by usbi3c_add_poll()
+ * @param[out] stats the reads sent, the deadlines missed and the jitter of the poll
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_poll_stats(struct usbi3c_device *usbi3c_dev, int poll_id, struct usbi3c_poll_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return poll_scheduler_get_stats(usbi3c_dev->poll_scheduler, poll_id, stats);
+}
+
+/**
+ * @brief A batch of commands submitted in a class, waiting in the submission queue.
+ */
+struct submitted_batch {
+	struct list *commands;		       ///< the commands as they were queued
+	struct batch_optimization optimization; ///< the commands merged by the batch optimizations
+	struct command_reorder reorder;	       ///< the order the commands are sent in, if they were marked as order independent
+	struct list *next;		       ///< the first command to send that was not sent yet
+	uint8_t dependent_on_previous;	       ///< indicates if the first command depends on the previous bulk request
+	uint8_t sent;			       ///< TRUE once a chunk of the batch was sent
+};
+
+/* reports the commands of a batch that were not sent as not attempted */
+static void usbi3c_fail_batch(struct submitted_batch *batch)
+{
+	for (struct list *node = batch->next; node; node = node->next) {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+		struct usbi3c_response response = { 0 };
+
+		response.attempted = USBI3C_COMMAND_NOT_ATTEMPTED;
+		command->on_response_cb(&response, command->user_data);
+		/* a callback that failed may have left the data of a whole transfer in the response */
+		FREE(response.data);
+	}
+	batch->next = NULL;
+}
+
+/* sends the next bulk request of a batch submitted in a class, with as many commands as
+ * fit in the chunk size (at least one) */
+static enum submission_send_result usbi3c_send_batch(void *data, uint32_t max_chunk_size, uint16_t *request_id, void *context)
+{
+	struct usbi3c_device *usbi3c_dev = (struct usbi3c_device *)context;
+	struct submitted_batch *batch = (struct submitted_batch *)data;
+	struct list *chunk = NULL;
+	struct list *request_ids = NULL;
+	struct list *node = batch->next;
+	uint32_t size = 0;
+
+	do {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+		size += command->command_descriptor->data_length;
+		chunk = list_append(chunk, command);
+		node = node->next;
+	} while (node && (max_chunk_size == 0 ||
+			  size + ((struct usbi3c_command *)node->data)->command_descriptor->data_length <= max_chunk_size));
+
+	/* a more urgent request may be sent in between the chunks, so only the first one
+	 * can depend on the previous request */
+	request_ids = bulk_transfer_send_commands(usbi3c_dev, chunk, batch->sent ? USBI3C_NOT_DEPENDENT_ON_PREVIOUS : batch->dependent_on_previous);
+	list_free_list(&chunk);
+	if (request_ids == NULL) {
+		usbi3c_fail_batch(batch);
+		return SUBMISSION_SEND_FAILED;
+	}
+	*request_id = *(uint16_t *)request_ids->data;
+	list_free_list_and_data(&request_ids, free);
+	batch->sent = TRUE;
+	batch->next = node;
+	if (node) {
+		return SUBMISSION_SEND_PARTIAL;
+	}
+	usbi3c_update_batch_stats(usbi3c_dev, &batch->optimization, &batch->reorder);
+
+	return SUBMISSION_SEND_DONE;
+}
+
+static void usbi3c_free_batch(void *data)
+{
+	struct submitted_batch *batch = (struct submitted_batch *)data;
+
+	if (batch->next) {
+		usbi3c_fail_batch(batch);
+	}
+	command_reorder_free(&batch->reorder);
+	batch_optimization_free(&batch->optimization);
+	bulk_transfer_free_commands(&batch->commands);
+	FREE(batch);
+}
+
+static void usbi3c_request_answered(uint16_t request_id, void *context)
+{
+	submission_queue_complete((struct submission_queue *)context, request_id);
+}
+
+/* creates the submission queue and starts its thread */
+static int usbi3c_create_submission_queue(struct usbi3c_device *usbi3c_dev)
+{
+	struct bulk_requests *regular_requests = usbi3c_dev->request_tracker->regular_requests;
+
+	usbi3c_dev->submission_queue = submission_queue_init(usbi3c_send_batch, usbi3c_free_batch, usbi3c_dev);
+	submission_queue_set_chunk_size(usbi3c_dev->submission_queue, usbi3c_dev->bulk_chunk_size);
+
+	pthread_mutex_lock(regular_requests->mutex);
+	regular_requests->on_request_answered = usbi3c_request_answered;
+	regular_requests->request_answered_context = usbi3c_dev->submission_queue;
+	pthread_mutex_unlock(regular_requests->mutex);
+
+	if (submission_queue_start(usbi3c_dev->submission_queue) < 0) {
+		usbi3c_destroy_submission_queue(usbi3c_dev);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Submits the commands in the command queue to be sent in a submission class.
+ *
+ * This function is similar to usbi3c_submit_commands(), but instead of being sent right
+ * away the commands wait in the queue of their class, and a thread owned by the library
+ * sends them to the I3C function one bulk request at a time, sending the next one once
+ * the I3C function answered the previous one. The next bulk request sent is always the
+ * one of the most urgent class, and within a class the one with the earliest deadline,
+ * the commands without a deadline go last in the order they were submitted. A bulk
+ * request that was already sent is never interrupted, so a realtime command waits for
+ * at most the bulk request in progress. The next bulk request is sent once the previous
+ * one is answered or expires, so usbi3c_set_response_timeout() has to be used for a lost
+ * response not to stop the queue.
+ *
+ * The commands submitted in the USBI3C_BULK_SUBMISSION class are split in bulk requests
+ * of up to the chunk size set with usbi3c_set_bulk_chunk_size(), so they give way to more
+ * urgent commands between chunks. Only the first chunk depends on the previous request,
+ * and an error in a chunk only cancels the subsequent commands of the same chunk.
+ *
+ * The function returns once the commands are queued, so commands that cannot be sent
+ * later on get a response that indicates they were not attempted through their callback.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] dependent_on_previous indicates if these commands are dependent on the previous bulk request sent
+ * @param[in] submission_class the class to submit the commands in
+ * @param[in] deadline_us the max time in microseconds from now to send the last of the commands, 0 if there is no deadline
+ * @return 0 if the commands were queued, or -1 otherwise
+ */
+int usbi3c_submit_commands_in_class(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous, enum usbi3c_submission_class submission_class, uint32_t deadline_us)
+{
+	struct submitted_batch *batch = NULL;
+	struct list *node = NULL;
+	int ret = -1;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->command_queue == NULL) {
+		DEBUG_PRINT("The command queue is empty\n");
+		return -1;
+	}
+	if (dependent_on_previous != USBI3C_NOT_DEPENDENT_ON_PREVIOUS && dependent_on_previous != USBI3C_DEPENDENT_ON_PREVIOUS) {
+		DEBUG_PRINT("Invalid value for dependent_on_previous, aborting...\n");
+		goto FREE_QUEUE_AND_EXIT;
+	}
+	if (submission_class >= USBI3C_SUBMISSION_CLASSES) {
+		DEBUG_PRINT("Invalid submission class, aborting...\n");
+		goto FREE_QUEUE_AND_EXIT;
+	}
+	for (node = usbi3c_dev->command_queue; node; node = node->next) {
+		struct usbi3c_command *command = (struct usbi3c_command *)node->data;
+
+		if (command == NULL) {
+			DEBUG_PRINT("A command to transfer is missing, aborting...\n");
+			goto FREE_QUEUE_AND_EXIT;
+		}
+		if (command->on_response_cb == NULL) {
+			DEBUG_PRINT("The command is missing its callback function, aborting...\n");
+			goto FREE_QUEUE_AND_EXIT;
+		}
+	}
+	if (usbi3c_dev->submission_queue == NULL && usbi3c_create_submission_queue(usbi3c_dev) < 0) {
+		goto FREE_QUEUE_AND_EXIT;
+	}
+
+	batch = (struct submitted_batch *)malloc_or_die(sizeof(struct submitted_batch));
+	batch->commands = usbi3c_dev->command_queue;
+	batch->next = usbi3c_get_commands_to_send(usbi3c_dev, &batch->optimization, &batch->reorder);
+	batch->dependent_on_previous = dependent_on_previous;
+	usbi3c_dev->command_queue = NULL;
+	usbi3c_dev->order_independent = FALSE;
+
+	return submission_queue_push(usbi3c_dev->submission_queue, submission_class, batch, deadline_us, monotonic_time_us());
+
+FREE_QUEUE_AND_EXIT:
+	bulk_transfer_free_commands(&usbi3c_dev->command_queue);
+	usbi3c_dev->order_independent = FALSE;
+
+	return ret;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Sets the max size of the bulk requests the commands submitted in the bulk class are split in.
+ *
+ * The chunk size bounds the time a command submitted in a more urgent class waits for a
+ * bulk request of the bulk class already in progress. A command with more data than the
+ * chunk size is sent in a bulk request of its own.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] chunk_size the max number of bytes of data written and read per bulk request, 0 to never split the commands
+ * @return 0 if the chunk size was set, or -1 otherwise
+ */
+int usbi3c_set_bulk_chunk_size(struct usbi3c_device *usbi3c_dev, uint32_t chunk_size)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	usbi3c_dev->bulk_chunk_size = chunk_size;
+	submission_queue_set_chunk_size(usbi3c_dev->submission_queue, chunk_size);
+
+	return 0;
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Gets the counters and the queueing latency of a submission class.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] submission_class the submission class
+ * @param[out] stats the counters of the class, all 0 if no commands were ever submitted in a class
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_submission_stats(struct usbi3c_device *usbi3c_dev, enum usbi3c_submission_class submission_class, struct usbi3c_submission_stats *stats)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (stats == NULL || submission_class >= USBI3C_SUBMISSION_CLASSES) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->submission_queue == NULL) {
+		memset(stats, 0, sizeof(struct usbi3c_submission_stats));
+		return 0;
+	}
+
+	return submission_queue_get_stats(usbi3c_dev->submission_queue, submission_class, stats);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Submits a vendor specific request consisting of one vendor specified data block to the I3C function.
+ *
+ * The data block in the vendor specific request does not need to be manually aligned
+ * by the user, if the block provided is not 32-bit aligned, it will be padded
+ * automatically before is transferred.
+ *
+ * @note Before submitting this request, a callback function for vendor specific requests
+ * has to be registered using the usbi3c_on_vendor_specific_response(). This callback will
+ * be triggered whenever a response to a vendor specific request is received.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] data a buffer with the vendor specific data
+ * @param[in] data_size the size of the vendor specific data to be transmitted
+ * @return 0 if the request was transferred correctly, or -1 otherwise
+ */
+int usbi3c_submit_vendor_specific_request(struct usbi3c_device *usbi3c_dev, unsigned char *data, uint32_t data_size)
+{
+	int ret = 0;
+	uint32_t buffer_size;
+	unsigned char *buffer = NULL;
+
+	/* validate data */
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("Missing usbi3c context\n");
+		return -1;
+	}
+	if (data == NULL || data_size == 0) {
+		DEBUG_PRINT("Missing data or incorrect data size\n");
+		return -1;
+	}
+
+	if (usbi3c_dev->request_tracker->vendor_request->on_vendor_response_cb == NULL) {
+		DEBUG_PRINT("Missing callback function for vendor responses\n");
+		return -1;
+	}
+
+	buffer_size = bulk_transfer_create_vendor_specific_buffer(&buffer, data, data_size);
+	ret = usb_output_bulk_transfer(usbi3c_dev->usb_dev, buffer, buffer_size);
+
+	FREE(buffer);
+
+	return ret;
+}
+
+/*
+ * @brief Wrapper to bulk_transfer_free_response() to be used to free lists of commands.
+ *
+ * The list_free_list_and_data() function receives as one of its arguments a  function of
+ * the type list_free_data_fn_t, and this has a void pointer as argument. This wrapper
+ * function type casts the data pointed by the void pointer to the correct type so it can
+ * be used to free a list of commands.
+ *
+ * @param[in] data the usbi3c_response struct to free.
+ *
+ * @note This function should be used as an argument of function list_free_list_and_data().
+ */
+static void free_response_in_list(void *data)
+{
+	struct usbi3c_response *response = (struct usbi3c_response *)data;
+
+	bulk_transfer_free_response(&response);
+}
+
+/**
+ * @ingroup command_execution
+ * @brief Frees the memory allocated for a list of usbi3c responses.
+ *
+ * @param[in] responses the list of responses (struct usbi3c_response) to be freed.
+ */
+void usbi3c_free_responses(struct list **responses)
+{
+	list_free_list_and_data(responses, free_response_in_list);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the I3C communication mode options.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] transfer_mode sets the transfer mode for the I3C or I2C commands
+ * @param[in] transfer_rate sets the transfer rate for the selected transfer mode
+ * @param[in] tm_specific_info sets transfer mode specific information
+ */
+void usbi3c_set_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t transfer_mode, uint8_t transfer_rate, uint8_t tm_specific_info)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	usbi3c_dev->i3c_mode->transfer_mode = transfer_mode;
+	usbi3c_dev->i3c_mode->transfer_rate = transfer_rate;
+	usbi3c_dev->i3c_mode->tm_specific_info = tm_specific_info;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Gets the I3C communication mode options.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] transfer_mode gets the transfer mode for the I3C or I2C commands
+ * @param[out] transfer_rate gets the transfer rate for the selected transfer mode
+ * @param[out] tm_specific_info gets transfer mode specific information
+ * @return 0 if the values where retrieved successfully, or -1 otherwise
+ */
+int usbi3c_get_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t *transfer_mode, uint8_t *transfer_rate, uint8_t *tm_specific_info)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (transfer_mode == NULL || transfer_rate == NULL || tm_specific_info == NULL) {
+		DEBUG_PRINT("A required argument is missing, aborting...\n");
+		return -1;
+	}
+
+	*transfer_mode = usbi3c_dev->i3c_mode->transfer_mode;
+	*transfer_rate = usbi3c_dev->i3c_mode->transfer_rate;
+	*tm_specific_info = usbi3c_dev->i3c_mode->tm_specific_info;
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the communication mode options used for the commands sent to a specific target device.
+ *
+ * Read/Write commands queued for a target device with a mode of its own use that mode
+ * instead of the one set with usbi3c_set_i3c_mode(), so target devices with different
+ * capabilities can be addressed at their own mode and rate within the same request.
+ * The mode is applied when the commands are queued.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] transfer_mode the transfer mode for the target device, I2C target devices only support the I2C mode
+ * @param[in] transfer_rate the transfer rate for the selected transfer mode
+ * @param[in] tm_specific_info the transfer mode specific information
+ * @return 0 if the mode was set, or -1 otherwise
+ */
+int usbi3c_set_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t transfer_mode, uint8_t transfer_rate, uint8_t tm_specific_info)
+{
+	struct i3c_mode i3c_mode = { .transfer_mode = transfer_mode, .transfer_rate = transfer_rate, .tm_specific_info = tm_specific_info };
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	if (table_set_device_profile(usbi3c_dev->target_device_table, address, &i3c_mode, PROFILE_USER) < 0) {
+		DEBUG_PRINT("The mode of target device %x could not be set, aborting...\n", address);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Removes the communication mode options of a specific target device.
+ *
+ * Commands queued for the target device afterwards use the mode set with usbi3c_set_i3c_mode().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @return 0 if the mode was removed, or -1 otherwise
+ */
+int usbi3c_clear_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	if (table_set_device_profile(usbi3c_dev->target_device_table, address, NULL, PROFILE_NONE) < 0) {
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Gets the communication mode options used for the commands sent to a specific target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[out] transfer_mode the transfer mode used for the target device
+ * @param[out] transfer_rate the transfer rate used for the target device
+ * @param[out] tm_specific_info the transfer mode specific information used for the target device
+ * @return 1 if the target device has a mode of its own, 0 if it uses the mode of the usbi3c device, or -1 on failure
+ */
+int usbi3c_get_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t *transfer_mode, uint8_t *transfer_rate, uint8_t *tm_specific_info)
+{
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	const struct i3c_mode *i3c_mode = NULL;
+	int ret = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (transfer_mode == NULL || transfer_rate == NULL || tm_specific_info == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+
+	i3c_mode = usbi3c_dev->i3c_mode;
+	if (device->profile.origin != PROFILE_NONE) {
+		i3c_mode = &device->profile.i3c_mode;
+		ret = 1;
+	}
+	*transfer_mode = i3c_mode->transfer_mode;
+	*transfer_rate = i3c_mode->transfer_rate;
+	*tm_specific_info = i3c_mode->tm_specific_info;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return ret;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the communication mode options of every target device from their capabilities.
+ *
+ * The mode of each target device is derived from the capabilities of the I3C controller
+ * and of the target device:
+ * - HDR capable I3C target devices get the HDR-DDR mode when the I3C controller supports
+ *   it, the rest of I3C target devices get the SDR mode.
+ * - I3C target devices get the fastest rate supported by the I3C controller that does not
+ *   exceed their max data speed. Run usbi3c_scan_bus_inventory() beforehand so the max
+ *   data speed of the target devices reported by GETMXDS is known.
+ * - I2C target devices get the I2C mode, at Fast-mode Plus or Fast-mode rate as reported
+ *   by their legacy virtual register, if the I3C controller supports it.
+ *
+ * Modes set with usbi3c_set_target_device_i3c_mode(), or selected with usbi3c_autotune_target_device(),
+ * are kept.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @return the number of target devices whose mode was set, or -1 on failure
+ */
+int usbi3c_derive_target_device_i3c_modes(struct usbi3c_device *usbi3c_dev)
+{
+	if (usbi3c_dev == NULL || usbi3c_dev->device_info == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return table_derive_device_profiles(usbi3c_dev->target_device_table, &usbi3c_dev->device_info->capabilities);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Selects the fastest mode and rate at which a target device works reliably.
+ *
+ * A short loopback transfer is sent to the target device at every transfer mode and
+ * rate supported by the I3C controller (usbi3c_bus_capabilities). The CRC, parity and
+ * frame errors reported for each of them are counted along with the throughput
+ * achieved. Among the modes and rates without errors, the one with the highest bit
+ * rate is set as the mode of the target device, so the commands sent to it from then
+ * on use it automatically. The selection is kept by usbi3c_derive_target_device_i3c_modes(),
+ * and can be replaced with usbi3c_set_target_device_i3c_mode().
+ *
+ * @note: This request is applicable when the I3C Device is the Active I3C Controller.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] probe the loopback transfer to send at every mode and rate
+ * @param[out] results the outcome of every mode and rate probed, can be NULL
+ * @param[in] max_results the max number of results that fit in results
+ * @param[in] timeout the maximum time in seconds to wait for the responses of each round of the probe
+ * @return the number of modes and rates probed, or -1 if the target device did not work reliably at any of them or on failure
+ */
+int usbi3c_autotune_target_device(struct usbi3c_device *usbi3c_dev, uint8_t address, const struct usbi3c_autotune_probe *probe, struct usbi3c_autotune_result *results, size_t max_results, int timeout)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (probe == NULL || probe->rounds == 0 || (probe->write_size == 0 && probe->read_size == 0) ||
+	    (probe->write_size > 0 && probe->write_data == NULL)) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->device_info == NULL) {
+		DEBUG_PRINT("The device capabilities are unknown, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_device_is_active_controller(usbi3c_dev) == FALSE) {
+		DEBUG_PRINT("The I3C device is not the active I3C controller\n");
+		return -1;
+	}
+
+	return rate_autotune_target(usbi3c_dev, address, probe, results, max_results, timeout);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the maximum number of reattempts for trying to resume a stalled request before canceling it.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] reattempt_max the maximum number of reattempts to set
+ */
+void usbi3c_set_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int reattempt_max)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+	usbi3c_dev->request_tracker->reattempt_max = reattempt_max;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Gets the maximum number of reattempts set for trying to resume a stalled request before canceling it.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] reattempt_max the maximum number of reattempts set
+ * @return 0 if the value was retrieved successfully, or -1 otherwise
+ */
+int usbi3c_get_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int *reattempt_max)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (reattempt_max == NULL) {
+		DEBUG_PRINT("A required argument is missing, aborting...\n");
+		return -1;
+	}
+
+	*reattempt_max = usbi3c_dev->request_tracker->reattempt_max;
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Enables or disables splitting reads and writes that exceed the max lengths of their target device.
+ *
+ * When enabled, a Read/Write command queued with usbi3c_enqueue_command() or
+ * usbi3c_enqueue_command_to_target() that is longer than the max read length (MRL), or
+ * max write length (MWL), known for its target device is split in consecutive commands
+ * that fit the limit. The max lengths are learned with usbi3c_scan_bus_inventory(), or set
+ * with usbi3c_set_target_device_max_lengths(). The chunks are transmitted together and
+ * get a single response with the data of all of them, so the split is transparent to the
+ * user, both with usbi3c_send_commands() and usbi3c_submit_commands().
+ *
+ * Transfer chunking is disabled by default.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] enable TRUE to split the transfers, FALSE to queue them as they are
+ */
+void usbi3c_set_transfer_chunking(struct usbi3c_device *usbi3c_dev, uint8_t enable)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+	usbi3c_dev->transfer_chunking = enable ? TRUE : FALSE;
+}
+
+/**
+ * @ingroup error_handling
+ * @brief Function to assign callback to call on I3C bus error
+ *
+ *  When an I3C bus error notification is triggered the callback assigned
+ *  here is going to be called, if there is no callback nothing is going
+ *  to be called
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_bus_error_cb callback function to call on event
+ * @param[in] data data to share with the callback function when it is called
+ */
+void usbi3c_on_bus_error(struct usbi3c_device *usbi3c_dev, on_bus_error_fn on_bus_error_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	usbi3c_dev->bus_error_handler.on_bus_error_cb = on_bus_error_cb;
+	usbi3c_dev->bus_error_handler.data = data;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Assigns a callback function that will run after a successful hot-join operation.
+ *
+ * When a NOTIFICATION_ADDRESS_CHANGE_STATUS notification is received as a result
+ * of a successful hot-join operation, the callback function assigned here is going
+ * to be executed, if there is no callback, nothing will be called.
+ *
+ * @note There is no need to use this callback to update the local copy of the target
+ * device table, this is automatically handled by the library.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_hotjoin_cb the callback function to run after a hot-join event
+ * @param[in] data the data to share with the callback function
+ */
+void usbi3c_on_hotjoin(struct usbi3c_device *usbi3c_dev, on_hotjoin_fn on_hotjoin_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	table_on_insert_device(usbi3c_dev->target_device_table, on_hotjoin_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Assigns a callback function that will run when a target device leaves the I3C bus.
+ *
+ * The local copy of the target device table is refreshed after every successful hot-join,
+ * the callback function assigned here is going to be executed for every device that the
+ * I3C function no longer reports, after it has been removed from the table.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_removed_cb the callback function to run when a target device is removed
+ * @param[in] data the data to share with the callback function
+ */
+void usbi3c_on_target_device_removed(struct usbi3c_device *usbi3c_dev, on_target_device_event_fn on_removed_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	table_on_remove_device(usbi3c_dev->target_device_table, on_removed_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Assigns a callback function that will run when the data of a target device changes.
+ *
+ * The local copy of the target device table is refreshed after every successful hot-join,
+ * the callback function assigned here is going to be executed for every device whose
+ * data in the table was changed by the refresh.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_changed_cb the callback function to run when a target device changes
+ * @param[in] data the data to share with the callback function
+ */
+void usbi3c_on_target_device_changed(struct usbi3c_device *usbi3c_dev, on_target_device_event_fn on_changed_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	table_on_change_device(usbi3c_dev->target_device_table, on_changed_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Function to assign callback to call on IBI
+ *
+ * When an In Band Interrupt is raised this callback is going to be called with the
+ * interrupt information
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_ibi_cb callback function to call on event
+ * @param[in] data data to share with the callback function when it is called
+ */
+void usbi3c_on_ibi(struct usbi3c_device *usbi3c_dev, on_ibi_fn on_ibi_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	ibi_set_callback(usbi3c_dev->ibi, on_ibi_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Function to assign a callback to stream the payload of IBIs with pending read
+ *
+ * Target devices can send large amounts of data as the pending read of an IBI. By default
+ * this data is collected until the IBI is completed and then passed as the IBI payload to
+ * the callback assigned with usbi3c_on_ibi(). When a chunk callback is assigned, every
+ * fragment of pending read data is passed to it as soon as it is received instead, so the
+ * memory used does not grow with the size of the pending read, and the IBI is then completed
+ * without payload. Changing the callback does not affect an IBI that is already being received,
+ * it applies from the next IBI on.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] on_ibi_chunk_cb callback function to call with every payload fragment, or NULL to go back to buffering the payload
+ * @param[in] data data to share with the callback function when it is called
+ */
+void usbi3c_on_ibi_chunk(struct usbi3c_device *usbi3c_dev, on_ibi_chunk_fn on_ibi_chunk_cb, void *data)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	ibi_set_chunk_callback(usbi3c_dev->ibi, on_ibi_chunk_cb, data);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Enables a bounded queue to retrieve completed IBIs by polling.
+ *
+ * Once enabled, every completed IBI is stored in the queue in addition to being
+ * passed to the callback assigned with usbi3c_on_ibi() (if any), so users can
+ * retrieve them from their own thread with usbi3c_ibi_poll() and usbi3c_ibi_wait()
+ * instead of processing them in the USB event thread. When the queue is full new
+ * IBIs are dropped, the number of IBIs dropped can be retrieved with
+ * usbi3c_get_ibi_poll_overruns().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] max_records the max number of completed IBIs the queue can hold
+ * @return 0 if polling was enabled, or -1 otherwise
+ */
+int usbi3c_enable_ibi_polling(struct usbi3c_device *usbi3c_dev, size_t max_records)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	if (max_records == 0) {
+		DEBUG_PRINT("The IBI poll queue needs room for at least one record, aborting...\n");
+		return -1;
+	}
+
+	return ibi_enable_polling(usbi3c_dev->ibi, max_records);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Disables the queue used to retrieve completed IBIs by polling.
+ *
+ * Completed IBIs that have not been retrieved yet are discarded, and threads
+ * blocked in usbi3c_ibi_wait() are woken up.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ */
+void usbi3c_disable_ibi_polling(struct usbi3c_device *usbi3c_dev)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	ibi_disable_polling(usbi3c_dev->ibi);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Retrieves completed IBIs from the poll queue without blocking.
+ *
+ * Completed IBIs are returned in the same order they were received. The payload of
+ * every record retrieved is owned by the user and has to be released with
+ * usbi3c_free_ibi_records().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] records array where the completed IBIs are stored
+ * @param[in] max the max number of records that fit in the array
+ * @return the number of records retrieved (0 if there were none), or -1 on failure
+ */
+int usbi3c_ibi_poll(struct usbi3c_device *usbi3c_dev, struct usbi3c_ibi_record *records, size_t max)
+{
+	if (usbi3c_dev == NULL || records == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	return ibi_poll(usbi3c_dev->ibi, records, max);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Waits until at least one completed IBI is available in the poll queue.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] timeout_us the max time to wait in microseconds, 0 returns immediately and a negative value waits indefinitely
+ * @return the number of completed IBIs available, 0 if the timeout expired, or -1 on failure (including polling being disabled while waiting)
+ */
+int usbi3c_ibi_wait(struct usbi3c_device *usbi3c_dev, int timeout_us)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return ibi_wait(usbi3c_dev->ibi, timeout_us);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Gets the number of completed IBIs dropped because the poll queue was full.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[out] overruns the number of IBIs dropped
+ * @return 0 if the number of overruns was retrieved, or -1 otherwise
+ */
+int usbi3c_get_ibi_poll_overruns(struct usbi3c_device *usbi3c_dev, uint32_t *overruns)
+{
+	if (usbi3c_dev == NULL || overruns == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	*overruns = ibi_get_poll_overruns(usbi3c_dev->ibi);
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Limits the rate at which IBIs from a target device are delivered.
+ *
+ * The IBIs of the target device are rate limited using a token bucket that holds up to
+ * burst tokens and gets refilled at a rate of max_ibis_per_second. IBIs that arrive when
+ * the bucket is empty are dropped and counted. If a storm threshold was set using
+ * usbi3c_set_ibi_storm_threshold(), a target device that keeps exceeding its rate limit
+ * gets its IBIs disabled.
+ *
+ * The rate limit, like the rest of the IBI storm protection state, belongs to the target
+ * device and not to its address, so it follows the target device if its address changes.
+ * Target devices with neither a provisioned ID nor a static address cannot be identified,
+ * so their IBIs are not rate limited.
+ *
+ * @note Setting the rate limit of a target device clears its disabled state in the IBI
+ * storm counters, but its IBIs have to be re-enabled using usbi3c_set_target_device_config().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] max_ibis_per_second the sustained number of IBIs per second allowed, 0 to remove the limit
+ * @param[in] burst the max number of IBIs allowed in a burst
+ * @return 0 if the rate limit was set, or -1 otherwise
+ */
+int usbi3c_set_ibi_rate_limit(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t max_ibis_per_second, uint32_t burst)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	return ibi_storm_set_rate_limit(ibi_get_storm(usbi3c_dev->ibi), ibi_storm_target_handle(address, usbi3c_dev), max_ibis_per_second, burst);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the window in which identical IBIs from a target device are coalesced.
+ *
+ * The first IBI from a target device is delivered right away and opens a window, any
+ * IBI from the same target device with the same MDB that arrives during the window is
+ * counted and dropped. When the window closes, an additional IBI with the descriptor
+ * of the first one, no payload and the number of IBIs coalesced in its repeat_count is
+ * delivered. The window closes when another IBI is received after it expired, or when
+ * usbi3c_ibi_poll() or usbi3c_ibi_wait() are called after it expired, so users that poll
+ * for IBIs get the summary without having to wait for another IBI. Summaries closed by
+ * usbi3c_ibi_poll() or usbi3c_ibi_wait() are only queued for polling, they are not passed
+ * to the IBI callback.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] window_us the length of the window in microseconds, 0 to disable coalescing
+ */
+void usbi3c_set_ibi_coalescing_window(struct usbi3c_device *usbi3c_dev, uint32_t window_us)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	ibi_storm_set_coalescing_window(ibi_get_storm(usbi3c_dev->ibi), window_us);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Sets the number of rate limited IBIs after which a target device gets its IBIs disabled.
+ *
+ * When a rate limited target device drops more IBIs than the threshold without its token
+ * bucket getting a chance to refill, the Target Interrupt Request of the target device is
+ * disabled so the I3C function stops accepting its IBIs. The IBIs of the target device are
+ * dropped from then on, but it is only reported as disabled in its IBI storm counters once
+ * the I3C function accepted the new configuration of the target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] threshold the number of IBIs dropped, 0 to never disable target devices
+ */
+void usbi3c_set_ibi_storm_threshold(struct usbi3c_device *usbi3c_dev, uint32_t threshold)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return;
+	}
+
+	ibi_storm_set_disable_threshold(ibi_get_storm(usbi3c_dev->ibi), threshold);
+}
+
+/**
+ * @ingroup bus_configuration
+ * @brief Gets the IBI storm protection counters of a target device.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[out] counters the counters of the target device
+ * @return 0 if the counters were retrieved, or -1 otherwise
+ */
+int usbi3c_get_ibi_storm_counters(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_ibi_storm_counters *counters)
+{
+	const struct table_snapshot *snapshot = NULL;
+	uint32_t target_id = 0;
+
+	if (usbi3c_dev == NULL || counters == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	target_id = table_snapshot_get_handle(snapshot, address);
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+	if (target_id == 0) {
+		/* the IBI storm protection does not track target devices without a handle */
+		memset(counters, 0, sizeof(struct usbi3c_ibi_storm_counters));
+		return 0;
+	}
+
+	return ibi_storm_get_counters(ibi_get_storm(usbi3c_dev->ibi), target_id, counters);
+}
+
 /**
  * @ingroup bus_configuration
- * @brief Sets the maximum number of reattempts for trying to resume a stalled request before canceling it.
+ * @brief Maps a timestamp given by the I3C function to the host monotonic clock.
+ *
+ * Every IBI received from a target device with IBI time-stamping enabled carries the timestamp
+ * of the I3C function in its device_timestamp field, and the host time it was received in its
+ * response_time_us field. The most recent pairs are used to estimate the rate and offset of the
+ * I3C function clock, so its timestamps can be converted to the host monotonic clock (the one
+ * used by clock_gettime(CLOCK_MONOTONIC)) correcting the drift between both clocks.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] reattempt_max the maximum number of reattempts to set
+ * @param[in] device_timestamp the timestamp given by the I3C function
+ * @param[out] host_time_us the host monotonic time in microseconds
+ * @return 0 if the timestamp was mapped, or -1 otherwise (including not having received enough timestamped IBIs yet)
  */
-void usbi3c_set_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int reattempt_max)
+int usbi3c_ibi_device_time_to_host(struct usbi3c_device *usbi3c_dev, uint32_t device_timestamp, uint64_t *host_time_us)
 {
-	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return;
+	if (usbi3c_dev == NULL || host_time_us == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
 	}
-	usbi3c_dev->request_tracker->reattempt_max = reattempt_max;
+
+	return ibi_clock_device_to_host(ibi_get_clock(usbi3c_dev->ibi), device_timestamp, host_time_us);
 }
 
 /**
  * @ingroup bus_configuration
- * @brief Gets the maximum number of reattempts set for trying to resume a stalled request before canceling it.
+ * @brief Gets the rate of the I3C function clock used to timestamp IBIs, as measured by the host.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[out] reattempt_max the maximum number of reattempts set
- * @return 0 if the value was retrieved successfully, or -1 otherwise
+ * @param[out] ticks_per_second the number of I3C function clock ticks per second of the host clock
+ * @return 0 if the rate was retrieved, or -1 otherwise (including not having received enough timestamped IBIs yet)
  */
-int usbi3c_get_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int *reattempt_max)
+int usbi3c_get_ibi_device_clock_rate(struct usbi3c_device *usbi3c_dev, double *ticks_per_second)
 {
-	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return -1;
-	}
-	if (reattempt_max == NULL) {
-		DEBUG_PRINT("A required argument is missing, aborting...\n");
+	if (usbi3c_dev == NULL || ticks_per_second == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
 		return -1;
 	}
 
-	*reattempt_max = usbi3c_dev->request_tracker->reattempt_max;
-
-	return 0;
+	return ibi_clock_get_rate(ibi_get_clock(usbi3c_dev->ibi), ticks_per_second);
 }
 
 /**
- * @ingroup error_handling
- * @brief Function to assign callback to call on I3C bus error
+ * @ingroup bus_configuration
+ * @brief Sets the order in which completed IBIs are delivered.
  *
- *  When an I3C bus error notification is triggered the callback assigned
- *  here is going to be called, if there is no callback nothing is going
- *  to be called
+ * By default IBIs are delivered in the order they are completed. When they are delivered
+ * by priority, the completed IBIs waiting to be delivered, either to the IBI callback or in
+ * the poll queue, are ordered using the IBI prioritization of their target device (lower
+ * values have higher priority). The range of IBI prioritization values is split in
+ * USBI3C_IBI_PRIORITY_LEVELS levels, and the IBIs of one level are delivered in the order
+ * they were completed, so the IBIs of a target device are always delivered in order.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] on_bus_error_cb callback function to call on event
- * @param[in] data data to share with the callback function when it is called
+ * @param[in] order the order in which completed IBIs are delivered
  */
-void usbi3c_on_bus_error(struct usbi3c_device *usbi3c_dev, on_bus_error_fn on_bus_error_cb, void *data)
+void usbi3c_set_ibi_delivery_order(struct usbi3c_device *usbi3c_dev, enum usbi3c_ibi_delivery_order order)
 {
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return;
 	}
 
-	usbi3c_dev->bus_error_handler.on_bus_error_cb = on_bus_error_cb;
-	usbi3c_dev->bus_error_handler.data = data;
+	ibi_set_delivery_order(usbi3c_dev->ibi, order);
 }
 
 /**
  * @ingroup bus_configuration
- * @brief Assigns a callback function that will run after a successful hot-join operation.
- *
- * When a NOTIFICATION_ADDRESS_CHANGE_STATUS notification is received as a result
- * of a successful hot-join operation, the callback function assigned here is going
- * to be executed, if there is no callback, nothing will be called.
+ * @brief Gets the delivery statistics of the IBIs of one priority level.
  *
- * @note There is no need to use this callback to update the local copy of the target
- * device table, this is automatically handled by the library.
+ * The delay of an IBI is the time since it was completed until it was passed to the IBI
+ * callback, or until it was retrieved using usbi3c_ibi_poll() if polling is enabled.
  *
  * @param[in] usbi3c_dev the usbi3c device
- * @param[in] on_hotjoin_cb the callback function to run after a hot-join event
- * @param[in] data the data to share with the callback function
+ * @param[in] level the priority level, from 0 (highest priority) to USBI3C_IBI_PRIORITY_LEVELS - 1
+ * @param[out] stats the delivery statistics of the priority level
+ * @return 0 if the statistics were retrieved, or -1 otherwise
  */
-void usbi3c_on_hotjoin(struct usbi3c_device *usbi3c_dev, on_hotjoin_fn on_hotjoin_cb, void *data)
+int usbi3c_get_ibi_priority_stats(struct usbi3c_device *usbi3c_dev, uint8_t level, struct usbi3c_ibi_priority_stats *stats)
 {
-	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
-		return;
+	if (usbi3c_dev == NULL || stats == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
 	}
 
-	table_on_insert_device(usbi3c_dev->target_device_table, on_hotjoin_cb, data);
+	return ibi_get_priority_stats(usbi3c_dev->ibi, level, stats);
 }
 
 /**
  * @ingroup bus_configuration
- * @brief Function to assign callback to call on IBI
- *
- * When an In Band Interrupt is raised this callback is going to be called with the
- * interrupt information
+ * @brief Releases the payload of IBI records retrieved with usbi3c_ibi_poll().
  *
- * @param[in] usbi3c_dev the usbi3c device
- * @param[in] on_ibi_cb callback function to call on event
- * @param[in] data data to share with the callback function when it is called
+ * @param[in] records the array of records to release
+ * @param[in] count the number of records retrieved in the array
  */
-void usbi3c_on_ibi(struct usbi3c_device *usbi3c_dev, on_ibi_fn on_ibi_cb, void *data)
+void usbi3c_free_ibi_records(struct usbi3c_ibi_record *records, size_t count)
 {
-	if (usbi3c_dev == NULL) {
-		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+	if (records == NULL) {
 		return;
 	}
 
-	ibi_set_callback(usbi3c_dev->ibi, on_ibi_cb, data);
+	for (size_t i = 0; i < count; i++) {
+		FREE(records[i].data);
+		records[i].size = 0;
+	}
 }
 
 /**
@@ -2180,18 +4414,54 @@ int usbi3c_enqueue_command(struct usbi3c_device *usbi3c_dev,
 			   void *user_data)
 {
 	const int NOT_APPLICABLE = 0;
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+	struct i3c_mode *i3c_mode = NULL;
+	struct i3c_mode target_i3c_mode;
+	uint32_t max_chunk_size = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
 		return -1;
 	}
 
+	/* target devices with a mode of their own use it instead of the device one */
+	i3c_mode = usbi3c_dev->i3c_mode;
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, target_address);
+	if (device && device->profile.origin != PROFILE_NONE) {
+		target_i3c_mode = device->profile.i3c_mode;
+		i3c_mode = &target_i3c_mode;
+	}
+	if (device && usbi3c_dev->transfer_chunking) {
+		/* a max length of 0 means the target device has no limit */
+		if (command_direction == USBI3C_READ && (device->inventory.valid & USBI3C_INVENTORY_MRL)) {
+			max_chunk_size = device->inventory.max_read_length;
+		} else if (command_direction == USBI3C_WRITE && (device->inventory.valid & USBI3C_INVENTORY_MWL)) {
+			max_chunk_size = device->inventory.max_write_length;
+		}
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	if (max_chunk_size > 0) {
+		return bulk_transfer_enqueue_chunked_command(&usbi3c_dev->command_queue,
+							     target_address,
+							     command_direction,
+							     error_handling,
+							     i3c_mode,
+							     data,
+							     data_size,
+							     max_chunk_size,
+							     on_response_cb,
+							     user_data);
+	}
+
 	return bulk_transfer_enqueue_command(&usbi3c_dev->command_queue,
 					     REGULAR_COMMAND,
 					     target_address,
 					     command_direction,
 					     error_handling,
-					     usbi3c_dev->i3c_mode,
+					     i3c_mode,
 					     NOT_APPLICABLE,
 					     NOT_APPLICABLE,
 					     data,
@@ -2200,6 +4470,61 @@ int usbi3c_enqueue_command(struct usbi3c_device *usbi3c_dev,
 					     user_data);
 }
 
+/**
+ * @ingroup command_execution
+ * @brief Adds a Read/Write command for the target device referred to by a handle to the queue of commands.
+ *
+ * This function behaves like usbi3c_enqueue_command(), but the command follows its
+ * target device: the handle is resolved when the command is queued, to validate it, and
+ * again when the command is transmitted, so the command is sent to the current address of
+ * the target device even if it changed in between.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] handle the handle of the target device, obtained with usbi3c_get_target_handle()
+ * @param[in] command_direction indicates the READ/WRITE direction of the command
+ * @param[in] error_handling indicates the condition for the I3C controller to abort subsequent commands
+ * @param[in] data_size indicates the number of bytes of data to be read or written
+ * @param[in] data the data to be transferred (required with WRITE)
+ * @param[in] on_response_cb a callback function to execute when a response to the command is received (optional)
+ * @param[in] user_data the data to share with the on_response_cb callback function (optional)
+ * @return 0 if the command was added to the queue correctly, or -1 otherwise
+ */
+int usbi3c_enqueue_command_to_target(struct usbi3c_device *usbi3c_dev,
+				     uint32_t handle,
+				     enum usbi3c_command_direction command_direction,
+				     enum usbi3c_command_error_handling error_handling,
+				     uint32_t data_size,
+				     unsigned char *data,
+				     on_response_fn on_response_cb,
+				     void *user_data)
+{
+	struct list *tail = NULL;
+	struct list *node = NULL;
+	uint8_t target_address = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	if (table_resolve_target_handle(usbi3c_dev->target_device_table, handle, &target_address) < 0) {
+		DEBUG_PRINT("The target handle could not be resolved, aborting...\n");
+		return -1;
+	}
+
+	tail = list_tail(usbi3c_dev->command_queue);
+	if (usbi3c_enqueue_command(usbi3c_dev, target_address, command_direction, error_handling, data_size, data, on_response_cb, user_data) < 0) {
+		return -1;
+	}
+
+	/* the command was appended to the queue, possibly split in several chunks */
+	for (node = tail ? tail->next : usbi3c_dev->command_queue; node; node = node->next) {
+		((struct usbi3c_command *)node->data)->target_handle = handle;
+	}
+
+	return 0;
+}
+
 /**
  * @ingroup command_execution
  * @brief Adds a Target Reset Pattern to the queue of commands to be transmitted to the I3C function.
@@ -2465,6 +4790,22 @@ int usbi3c_get_device_address(struct usbi3c_device *usbi3c_dev)
 	return usbi3c_dev->device_info->address;
 }
 
+/* copies the data of a target device into its public representation */
+static void target_device_to_public(const struct target_device *target_device, struct usbi3c_target_device *pub_device)
+{
+	pub_device->type = target_device->device_data.target_type;
+	pub_device->static_address = target_device->device_capability.static_address;
+	/* from this point on all configs are I3C specific */
+	pub_device->provisioned_id = (uint64_t)target_device->pid_hi << 16 | target_device->pid_lo;
+	pub_device->dynamic_address = target_device->target_address;
+	pub_device->assignment_from_static_address = target_device->device_data.asa;
+	pub_device->dynamic_address_assignment_enabled = target_device->device_data.daa;
+	pub_device->target_interrupt_request_enabled = target_device->device_data.target_interrupt_request ? FALSE : TRUE;
+	pub_device->controller_role_request_enabled = target_device->device_data.controller_role_request ? FALSE : TRUE;
+	pub_device->ibi_timestamp_enabled = target_device->device_data.ibi_timestamp;
+	pub_device->max_ibi_payload_size = target_device->device_data.max_ibi_payload_size;
+}
+
 /**
  * @ingroup usbi3c_target_device
  * @brief Gets the devices in the target device table.
@@ -2482,11 +4823,8 @@ int usbi3c_get_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi
 {
 	struct usbi3c_target_device **pub_devices = NULL;
 	struct usbi3c_target_device *pub_device = NULL;
-	struct target_device *target_device = NULL;
-	struct list *target_devices = NULL;
-	struct list *node = NULL;
+	const struct table_snapshot *snapshot = NULL;
 	int number_of_devices = 0;
-	int i = 0;
 
 	if (usbi3c_dev == NULL) {
 		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
@@ -2497,36 +4835,26 @@ int usbi3c_get_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi
 		return -1;
 	}
 
-	target_devices = table_get_devices(usbi3c_dev->target_device_table);
-	if (target_devices == NULL) {
+	/* the devices are copied from a snapshot, since the ones in the table can be
+	 * removed by the event thread while we go through them */
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	if (snapshot == NULL || snapshot->count == 0) {
 		/* list empty*/
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 		return 0;
 	}
 
 	/* allocate memory to keep the list of devices */
-	for (node = target_devices; node; node = node->next) {
-		number_of_devices++;
-	}
+	number_of_devices = snapshot->count;
 	pub_devices = malloc_or_die((number_of_devices + 1) * sizeof(struct usbi3c_target_device *));
 
-	for (node = target_devices; node; node = node->next) {
-		target_device = (struct target_device *)node->data;
-
+	for (int i = 0; i < number_of_devices; i++) {
 		pub_device = (struct usbi3c_target_device *)malloc_or_die(sizeof(struct usbi3c_target_device));
-		pub_device->type = target_device->device_data.target_type;
-		pub_device->static_address = target_device->device_capability.static_address;
-		/* from this point on all configs are I3C specific */
-		pub_device->provisioned_id = (uint64_t)target_device->pid_hi << 16 | target_device->pid_lo;
-		pub_device->dynamic_address = target_device->target_address;
-		pub_device->assignment_from_static_address = target_device->device_data.asa;
-		pub_device->dynamic_address_assignment_enabled = target_device->device_data.daa;
-		pub_device->target_interrupt_request_enabled = target_device->device_data.target_interrupt_request ? FALSE : TRUE;
-		pub_device->controller_role_request_enabled = target_device->device_data.controller_role_request ? FALSE : TRUE;
-		pub_device->ibi_timestamp_enabled = target_device->device_data.ibi_timestamp;
-		pub_device->max_ibi_payload_size = target_device->device_data.max_ibi_payload_size;
+		target_device_to_public(&snapshot->devices[i], pub_device);
 
-		pub_devices[i++] = pub_device;
+		pub_devices[i] = pub_device;
 	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
 
 	/* add NULL to the last element to denote the end of the list */
 	pub_devices[number_of_devices] = NULL;
@@ -2536,6 +4864,273 @@ int usbi3c_get_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi
 	return number_of_devices;
 }
 
+/**
+ * @ingroup usbi3c_target_device
+ * @brief Gets the generation of the target device table.
+ *
+ * The generation changes every time the target device table changes, so callers
+ * polling the table can skip copying it when the generation is the one they saw last.
+ * The generation of a table that was never populated is 0.
+ *
+ * @param[in] usbi3c_dev the usbi3c device (I3C controller)
+ * @param[out] generation the current generation of the target device table
+ * @return 0 if the generation was retrieved, or -1 otherwise
+ */
+int usbi3c_get_target_device_table_generation(struct usbi3c_device *usbi3c_dev, uint64_t *generation)
+{
+	const struct table_snapshot *snapshot = NULL;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (generation == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	*generation = snapshot ? snapshot->version : 0;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return 0;
+}
+
+/**
+ * @ingroup usbi3c_target_device
+ * @brief Copies the devices in the target device table into a buffer provided by the caller.
+ *
+ * Unlike usbi3c_get_target_device_table() this function does not allocate memory. The
+ * devices are copied from a consistent snapshot of the table, if the buffer is too small
+ * only the first max devices are copied.
+ *
+ * @param[in] usbi3c_dev the usbi3c device (I3C controller)
+ * @param[out] devices the buffer where the devices are copied (optional if max is 0)
+ * @param[in] max the number of devices that fit in the buffer
+ * @param[out] generation the generation of the table that was copied (optional)
+ * @return the number of devices in the table, which can be bigger than max, or -1 on failure
+ */
+int usbi3c_copy_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi3c_target_device *devices, size_t max, uint64_t *generation)
+{
+	const struct table_snapshot *snapshot = NULL;
+	int count = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (devices == NULL && max > 0) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	if (snapshot) {
+		count = snapshot->count;
+		for (int i = 0; i < count && (size_t)i < max; i++) {
+			target_device_to_public(&snapshot->devices[i], &devices[i]);
+		}
+	}
+	if (generation) {
+		*generation = snapshot ? snapshot->version : 0;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return count;
+}
+
+/**
+ * @ingroup usbi3c_target_device
+ * @brief Copies the addresses of the devices in the target device table into a buffer provided by the caller.
+ *
+ * Unlike usbi3c_get_address_list() this function does not allocate memory. If the buffer
+ * is too small only the first max addresses are copied.
+ *
+ * @param[in] usbi3c_dev the usbi3c device (I3C controller)
+ * @param[out] addresses the buffer where the addresses are copied (optional if max is 0)
+ * @param[in] max the number of addresses that fit in the buffer
+ * @param[out] generation the generation of the table the addresses were copied from (optional)
+ * @return the number of devices in the table, which can be bigger than max, or -1 on failure
+ */
+int usbi3c_copy_address_list(struct usbi3c_device *usbi3c_dev, uint8_t *addresses, size_t max, uint64_t *generation)
+{
+	const struct table_snapshot *snapshot = NULL;
+	int count = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (addresses == NULL && max > 0) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	if (snapshot) {
+		count = snapshot->count;
+		for (int i = 0; i < count && (size_t)i < max; i++) {
+			addresses[i] = snapshot->devices[i].target_address;
+		}
+	}
+	if (generation) {
+		*generation = snapshot ? snapshot->version : 0;
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return count;
+}
+
+/**
+ * @ingroup usbi3c_target_device
+ * @brief Executes a callback function for every device in the target device table.
+ *
+ * The devices are visited in the order of the table, from a consistent snapshot of the
+ * table, so changes made to the table during the iteration are not seen by it. No memory
+ * is allocated.
+ *
+ * @param[in] usbi3c_dev the usbi3c device (I3C controller)
+ * @param[in] visitor the callback function to execute for each device, returning a value other than 0 stops the iteration
+ * @param[in] user_data the data to share with the visitor callback function (optional)
+ * @param[out] generation the generation of the table that was visited (optional)
+ * @return the number of devices visited, or -1 on failure
+ */
+int usbi3c_visit_target_devices(struct usbi3c_device *usbi3c_dev, on_target_device_visit_fn visitor, void *user_data, uint64_t *generation)
+{
+	const struct table_snapshot *snapshot = NULL;
+	struct usbi3c_target_device device;
+	int visited = 0;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (visitor == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	if (generation) {
+		*generation = snapshot ? snapshot->version : 0;
+	}
+	while (snapshot && visited < snapshot->count) {
+		target_device_to_public(&snapshot->devices[visited], &device);
+		visited++;
+		if (visitor(&device, user_data)) {
+			break;
+		}
+	}
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return visited;
+}
+
+/**
+ * @ingroup bus_info
+ * @brief Reads the limits of every I3C target device in the bus with the discovery CCCs.
+ *
+ * GETPID, GETBCR, GETDCR, GETMXDS, GETMRL and GETMWL are sent to every I3C target device
+ * in the target device table. Instead of sending the CCCs one at a time, the CCCs of many
+ * target devices are grouped in a single request, and the requests are pipelined so the
+ * next one is queued in the I3C function while the previous one is being executed. The
+ * requests are split automatically according to the buffer available in the I3C function.
+ *
+ * The values read are stored in the target device table and can be retrieved using
+ * usbi3c_get_target_device_inventory(). A target device that does not support one of the
+ * CCCs still gets the values of the rest of them.
+ *
+ * @note: This request is applicable when the I3C Device is the Active I3C Controller.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] timeout the maximum time in seconds to wait for the responses
+ * @return the number of target devices whose inventory was updated, or -1 on failure
+ */
+int usbi3c_scan_bus_inventory(struct usbi3c_device *usbi3c_dev, int timeout)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_dev->device_info == NULL) {
+		DEBUG_PRINT("The device capabilities are unknown, aborting...\n");
+		return -1;
+	}
+	if (usbi3c_device_is_active_controller(usbi3c_dev) == FALSE) {
+		DEBUG_PRINT("The I3C device is not the active I3C controller\n");
+		return -1;
+	}
+
+	return bus_inventory_scan(usbi3c_dev, timeout);
+}
+
+/**
+ * @ingroup bus_info
+ * @brief Gets the limits of a target device read during the last bus inventory scan.
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[out] inventory the limits of the target device, its valid field is 0 if it was never scanned
+ * @return 0 if the inventory was retrieved correctly, or -1 otherwise
+ */
+int usbi3c_get_target_device_inventory(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_target_inventory *inventory)
+{
+	const struct table_snapshot *snapshot = NULL;
+	const struct target_device *device = NULL;
+
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+	if (inventory == NULL) {
+		DEBUG_PRINT("Missing required parameters, aborting...\n");
+		return -1;
+	}
+
+	snapshot = table_snapshot_acquire(usbi3c_dev->target_device_table);
+	device = table_snapshot_get_device(snapshot, address);
+	if (device == NULL) {
+		table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+
+	*inventory = device->inventory;
+	table_snapshot_release(usbi3c_dev->target_device_table, snapshot);
+
+	return 0;
+}
+
+/**
+ * @ingroup bus_info
+ * @brief Sets the max read and write lengths of a target device.
+ *
+ * The max lengths are normally learned with usbi3c_scan_bus_inventory(). This function
+ * can be used to record them after changing them with the SETMRL and SETMWL CCCs, or
+ * for target devices whose limits are known beforehand. They are used to split long
+ * transfers when transfer chunking is enabled with usbi3c_set_transfer_chunking().
+ *
+ * @param[in] usbi3c_dev the usbi3c device
+ * @param[in] address the address of the target device
+ * @param[in] max_read_length the max number of bytes that can be read from the target device in a single command, 0 if there is no limit
+ * @param[in] max_write_length the max number of bytes that can be written to the target device in a single command, 0 if there is no limit
+ * @return 0 if the max lengths were set, or -1 otherwise
+ */
+int usbi3c_set_target_device_max_lengths(struct usbi3c_device *usbi3c_dev, uint8_t address, uint16_t max_read_length, uint16_t max_write_length)
+{
+	if (usbi3c_dev == NULL) {
+		DEBUG_PRINT("The usbi3c device is missing, aborting...\n");
+		return -1;
+	}
+
+	if (table_set_device_max_lengths(usbi3c_dev->target_device_table, address, max_read_length, max_write_length) < 0) {
+		DEBUG_PRINT("Address %x not reachable\n", address);
+		return -1;
+	}
+
+	return 0;
+}
+
 /**
  * @ingroup usbi3c_target_device
  * @brief Frees the list of target devices (target device table).
@@ -80,6 +80,29 @@ typedef void (*on_controller_event_fn)(enum usbi3c_controller_event_code event_c
  */
 typedef void (*on_hotjoin_fn)(uint8_t address, void *user_data);
 
+/**
+ * @ingroup bus_configuration
+ * @brief Definition of a callback function used when a target device leaves or changes.
+ *
+ * The callback will be executed after a refresh of the target device table finds that
+ * a target device is no longer in the I3C bus, or that its data changed. This callback
+ * function has to be passed as an argument in the usbi3c_on_target_device_removed() or
+ * usbi3c_on_target_device_changed() functions.
+ */
+typedef void (*on_target_device_event_fn)(uint8_t address, void *user_data);
+
+struct usbi3c_target_device;
+
+/**
+ * @ingroup usbi3c_target_device
+ * @brief Definition of a callback function used to visit the devices of the target device table.
+ *
+ * The callback is executed once per target device by usbi3c_visit_target_devices(). The
+ * target device is only valid during the call, and returning a value other than 0 stops
+ * the iteration.
+ */
+typedef int (*on_target_device_visit_fn)(const struct usbi3c_target_device *device, void *user_data);
+
 struct usbi3c_ibi;
 
 /**
@@ -97,6 +120,29 @@ typedef void (*on_ibi_fn)(uint8_t report,
 			  size_t size,
 			  void *user_data);
 
+/**
+ * @ingroup bus_configuration
+ * @brief Definition of a callback function used to stream the payload of an IBI with pending read.
+ *
+ * The callback will be executed every time a fragment of the pending read data of an IBI is
+ * received, so the payload can be processed before the IBI is completed without having to
+ * store all of it. This callback function has to be passed as an argument in the
+ * usbi3c_on_ibi_chunk() function.
+ *
+ * param[in] descriptor structure describing the IBI the fragment belongs to
+ * param[in] sequence_id the sequence ID of the IBI response that carried the fragment
+ * param[in] last_fragment TRUE if this is the last fragment of the payload, FALSE otherwise
+ * param[in] data the payload fragment, only valid during the execution of the callback
+ * param[in] size the size of the payload fragment (can be 0 for the last fragment)
+ * param[in] user_data that from user to share with the chunk callback
+ */
+typedef void (*on_ibi_chunk_fn)(struct usbi3c_ibi *descriptor,
+				uint16_t sequence_id,
+				uint8_t last_fragment,
+				uint8_t *data,
+				size_t size,
+				void *user_data);
+
 /**
  * @ingroup command_execution
  * @brief Definition of a callback function used after a vendor specific response is received.
@@ -127,6 +173,57 @@ struct usbi3c_ibi {
 			uint8_t interrupt_group_id : 3;	   ///< Interrupt group identifier that this IBI belongs
 		} MDB_specific;
 	};
+	uint32_t repeat_count;	       ///< Number of identical IBIs coalesced into this one, 0 if the IBI was not coalesced
+	uint64_t notification_time_us; ///< Host monotonic time in microseconds when the IBI notification was received
+	uint64_t response_time_us;     ///< Host monotonic time in microseconds when the first IBI response was received
+	uint32_t device_timestamp;     ///< Timestamp given by the I3C function, only valid if ibi_timestamp is 1
+};
+
+/**
+ * @ingroup bus_configuration
+ * @brief A structure with the IBI storm protection counters of a target device.
+ */
+struct usbi3c_ibi_storm_counters {
+	uint64_t delivered;    ///< Number of IBIs delivered to the user, including summaries of coalesced IBIs
+	uint64_t rate_limited; ///< Number of IBIs dropped because the target device exceeded its rate limit
+	uint64_t coalesced;    ///< Number of IBIs coalesced into a previous identical IBI
+	uint8_t ibi_disabled;  ///< TRUE if the IBIs of the target device were disabled for exceeding the storm threshold
+};
+
+/* Number of priority levels used to order the delivery of IBIs */
+#define USBI3C_IBI_PRIORITY_LEVELS 4
+
+/**
+ * @ingroup bus_configuration
+ * @brief Enumeration of the orders in which completed IBIs can be delivered.
+ */
+enum usbi3c_ibi_delivery_order {
+	USBI3C_IBI_DELIVERY_FIFO = 0,	 ///< IBIs are delivered in the order they were completed
+	USBI3C_IBI_DELIVERY_PRIORITY = 1 ///< IBIs waiting to be delivered are ordered by the IBI prioritization of their target device
+};
+
+/**
+ * @ingroup bus_configuration
+ * @brief A structure with the delivery statistics of the IBIs of one priority level.
+ */
+struct usbi3c_ibi_priority_stats {
+	uint64_t delivered;	 ///< Number of IBIs delivered to the user
+	uint64_t total_delay_us; ///< Sum of the time the IBIs waited to be delivered once completed, in microseconds
+	uint64_t max_delay_us;	 ///< Longest time an IBI waited to be delivered once completed, in microseconds
+};
+
+/**
+ * @ingroup bus_configuration
+ * @brief A structure representing a completed IBI retrieved with usbi3c_ibi_poll().
+ *
+ * The payload of the IBI is owned by the user once the record is retrieved, and it
+ * has to be released using usbi3c_free_ibi_records().
+ */
+struct usbi3c_ibi_record {
+	uint8_t report;		      ///< The reason why this IBI was triggered
+	struct usbi3c_ibi descriptor; ///< Structure describing the completed IBI
+	uint8_t *data;		      ///< Data associated with this IBI if it exists, if not NULL
+	size_t size;		      ///< The size of the data associated with this IBI if it exists, if not 0
 };
 
 /**
@@ -139,6 +236,29 @@ struct usbi3c_ibi {
  */
 typedef void (*on_address_change_fn)(uint8_t old_address, uint8_t new_address, enum usbi3c_address_change_status request_status, void *user_data);
 
+/**
+ * @ingroup bus_configuration
+ * @brief A structure describing the dynamic address change of one I3C target device.
+ *
+ * This structure is used to change the address of several I3C target devices in a single
+ * request using usbi3c_change_i3c_device_addresses().
+ */
+struct usbi3c_address_change {
+	uint8_t current_address; ///< The current dynamic address of the I3C target device
+	uint8_t new_address;	 ///< The new dynamic address to be assigned to the I3C target device
+};
+
+/**
+ * @ingroup library_setup
+ * @brief A structure with information about the last initialization of an I3C device.
+ *
+ * This structure is populated by usbi3c_get_startup_stats().
+ */
+struct usbi3c_startup_stats {
+	uint64_t duration_us; ///< Time spent by usbi3c_initialize_device() in microseconds
+	uint8_t warm_start;   ///< TRUE if the warm-start cache allowed the initialization to skip the target device configuration
+};
+
 /**
  * @brief A structure storing @lib_name version information.
  */
@@ -179,6 +299,147 @@ struct usbi3c_response {
  */
 typedef int (*on_response_fn)(struct usbi3c_response *response, void *user_data);
 
+/**
+ * @ingroup command_execution
+ * @brief Counters of the order-independent batches of commands reordered to reduce the transfer mode switches.
+ */
+struct usbi3c_reorder_stats {
+	uint64_t batches;	      ///< The number of order-independent batches sent
+	uint64_t mode_switches;	      ///< The number of transfer mode or rate switches between consecutive commands, as sent
+	uint64_t mode_switches_saved; ///< The number of transfer mode or rate switches avoided by reordering the commands
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Enumeration of the optimizations that can be applied to a batch of commands before sending it.
+ */
+enum usbi3c_batch_optimization {
+	USBI3C_COALESCE_WRITES = 0x1,	///< Adjacent writes to the same target device are sent as a single write
+	USBI3C_DEDUPLICATE_READS = 0x2	///< Identical reads from the same target device are served by a single read
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of the commands eliminated by the batch optimizations.
+ */
+struct usbi3c_batch_optimization_stats {
+	uint64_t batches;	      ///< The number of batches sent with at least one command eliminated
+	uint64_t writes_coalesced;    ///< The number of writes merged into a previous write
+	uint64_t reads_deduplicated;  ///< The number of reads served by a previous identical read
+	uint64_t commands_eliminated; ///< The number of commands that were not sent to the I3C function
+};
+
+/**
+ * @ingroup command_execution
+ * @brief A range of registers of a target device, both ends included.
+ */
+struct usbi3c_register_range {
+	uint32_t first; ///< The first register of the range
+	uint32_t last;	///< The last register of the range
+};
+
+/**
+ * @ingroup command_execution
+ * @brief The layout of the registers of a target device.
+ */
+struct usbi3c_regmap_config {
+	uint8_t register_address_size;			     ///< The number of bytes of the register address, sent MSB first (1 to 4)
+	uint8_t value_size;				     ///< The number of bytes of the value of a register (1, 2 or 4)
+	uint8_t big_endian;				     ///< TRUE if the values are sent MSB first, FALSE if they are sent LSB first
+	uint32_t max_register;				     ///< The highest register of the target device (up to 0xFFFF)
+	const struct usbi3c_register_range *volatile_ranges; ///< The ranges of registers whose value can change on its own, these are never cached
+	uint32_t volatile_ranges_count;			     ///< The number of volatile ranges
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of the register map of a target device.
+ */
+struct usbi3c_regmap_stats {
+	uint64_t cache_hits;	   ///< The number of reads served from the cache
+	uint64_t bus_reads;	   ///< The number of reads sent to the target device
+	uint64_t bus_writes;	   ///< The number of writes sent to the target device, including the ones sent by a sync
+	uint64_t deferred_writes;  ///< The number of writes kept in the cache until the next sync
+	uint64_t registers_synced; ///< The number of dirty registers written by a sync
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of a periodic read sent by the poll scheduler.
+ */
+struct usbi3c_poll_stats {
+	uint64_t polls;		  ///< The number of reads sent
+	uint64_t deadline_misses; ///< The number of periods skipped because the read was late, plus the reads that could not be sent
+	uint32_t max_jitter_us;	  ///< The longest delay between the time a read fell due and the time it was sent
+	uint32_t mean_jitter_us;  ///< The mean delay between the time a read fell due and the time it was sent
+	uint32_t period_us;	  ///< The period of the read, rounded to a whole number of ticks
+	uint32_t phase_offset_us; ///< The offset within its period the read falls due at
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Enumeration of the classes commands can be submitted in, from the most to the least urgent.
+ */
+enum usbi3c_submission_class {
+	USBI3C_REALTIME_SUBMISSION = 0, ///< Latency critical commands, sent before the commands of any other class
+	USBI3C_NORMAL_SUBMISSION = 1,	///< Regular commands, sent before the bulk commands
+	USBI3C_BULK_SUBMISSION = 2	///< Long batches of commands (e.g. a firmware update), sent in chunks so they only hold back the other classes for one chunk
+};
+
+/* Number of classes commands can be submitted in */
+#define USBI3C_SUBMISSION_CLASSES 3
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of the batches of commands submitted in a class.
+ */
+struct usbi3c_submission_stats {
+	uint64_t submitted;	  ///< The number of batches of commands submitted
+	uint64_t requests;	  ///< The number of bulk requests sent, a batch split in chunks takes one per chunk
+	uint64_t failed;	  ///< The number of batches that could not be sent, their unsent commands are reported as not attempted
+	uint64_t deadline_misses; ///< The number of batches whose last command was sent after their deadline
+	uint32_t pending;	  ///< The number of batches waiting to be sent
+	uint32_t max_latency_us;  ///< The longest time a bulk request waited in the queue before being sent
+	uint32_t mean_latency_us; ///< The mean time a bulk request waited in the queue before being sent
+};
+
+/* Returned by usbi3c_try_submit_commands() when the commands have to wait for the requests in flight */
+#define USBI3C_WOULD_BLOCK 1
+
+/**
+ * @ingroup command_execution
+ * @brief Definition of a callback function used when more commands can be submitted without blocking.
+ *
+ * The callback is executed once the requests in flight make room for more commands, after
+ * usbi3c_try_submit_commands() returned USBI3C_WOULD_BLOCK. It can be executed from the thread
+ * handling the responses, so it should only let the producers know they can submit again.
+ * This callback function has to be passed as an argument in the usbi3c_on_submit_writable()
+ * function.
+ */
+typedef void (*on_submit_writable_fn)(void *user_data);
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of the window of bulk requests in flight.
+ */
+struct usbi3c_submit_window_stats {
+	uint64_t would_block;	     ///< The number of submissions refused because the window was full
+	uint64_t notifications;	     ///< The number of times the producers were notified the window became writable
+	uint32_t requests_in_flight; ///< The bulk requests sent whose response has not been received yet
+	uint32_t bytes_in_flight;    ///< The bytes of the I3C function buffer taken by the requests in flight and their responses
+	uint32_t commands_in_flight; ///< The commands whose request ID is in use, they were sent but are still being tracked
+};
+
+/**
+ * @ingroup command_execution
+ * @brief Counters of the requests given up on because their response never arrived.
+ */
+struct usbi3c_request_expiry_stats {
+	uint64_t expired_requests; ///< The number of bulk requests that expired before their response was received
+	uint64_t expired_commands; ///< The number of commands completed with USBI3C_COMMAND_TIMED_OUT
+	uint32_t timeout_ms;	   ///< The time a response is awaited before its request expires, 0 if requests never expire
+};
+
 /**
  * @ingroup bus_configuration
  * @brief Enumeration of target device types.
@@ -236,6 +497,78 @@ struct usbi3c_target_device {
 	uint32_t max_ibi_payload_size;				///< indicates the maximum IBI payload size that this I3C device is allowed to send for an IBI
 };
 
+/**
+ * @ingroup bus_configuration
+ * @brief A structure with the configuration to apply to one target device.
+ *
+ * This structure is used to configure several target devices in a single request
+ * using usbi3c_set_target_device_configs().
+ */
+struct usbi3c_target_device_config {
+	uint8_t address;	       ///< The address of the target device to configure
+	uint8_t config;		       ///< The configuration value for IBIT, CRR and TIR (only the 3 LSB are used)
+	uint32_t max_ibi_payload_size; ///< The maximum IBI payload size the target device is allowed to send for an IBI
+};
+
+/**
+ * @ingroup bus_info
+ * @brief Enumeration of the discovery CCCs read during a bus inventory scan.
+ */
+enum usbi3c_inventory_field {
+	USBI3C_INVENTORY_PID = 0x01,  ///< The provisioned ID was read with GETPID and matches the target device table
+	USBI3C_INVENTORY_BCR = 0x02,  ///< The Bus Characteristic Register was read with GETBCR
+	USBI3C_INVENTORY_DCR = 0x04,  ///< The Device Characteristic Register was read with GETDCR
+	USBI3C_INVENTORY_MXDS = 0x08, ///< The max data speed was read with GETMXDS
+	USBI3C_INVENTORY_MRL = 0x10,  ///< The max read length was read with GETMRL
+	USBI3C_INVENTORY_MWL = 0x20   ///< The max write length was read with GETMWL
+};
+
+/**
+ * @ingroup bus_info
+ * @brief The limits of an I3C target device read from it with the discovery CCCs.
+ *
+ * The inventory of the target devices is filled by usbi3c_scan_bus_inventory().
+ */
+struct usbi3c_target_inventory {
+	uint8_t valid;			  ///< Bitmask of enum usbi3c_inventory_field, fields not read are 0
+	uint16_t max_write_length;	  ///< The max number of bytes the device accepts in a write
+	uint16_t max_read_length;	  ///< The max number of bytes the device returns in a read
+	uint8_t max_write_speed;	  ///< The maxWr byte reported by GETMXDS
+	uint8_t max_read_speed;		  ///< The maxRd byte reported by GETMXDS
+	uint32_t max_read_turnaround_us; ///< The max read turnaround in microseconds reported by GETMXDS, 0 if not reported
+};
+
+/**
+ * @ingroup bus_configuration
+ * @brief The loopback transfer used to test a target device at every transfer mode and rate.
+ *
+ * Every round of the probe writes the data provided to the target device, then reads
+ * back from it. Either transfer can be skipped by setting its size to 0.
+ */
+struct usbi3c_autotune_probe {
+	unsigned char *write_data;    ///< The data written to the target device in every round
+	uint32_t write_size;	      ///< The number of bytes to write, 0 to skip the write
+	uint32_t read_size;	      ///< The number of bytes to read, 0 to skip the read
+	unsigned char *expected_data; ///< The data the read has to return, NULL to not verify it
+	uint32_t rounds;	      ///< The number of times the probe is repeated at each mode and rate
+};
+
+/**
+ * @ingroup bus_configuration
+ * @brief The outcome of probing a target device at a transfer mode and rate.
+ */
+struct usbi3c_autotune_result {
+	uint8_t transfer_mode;	///< The transfer mode probed
+	uint8_t transfer_rate;	///< The transfer rate probed
+	uint32_t commands;	///< The number of commands sent
+	uint32_t crc_errors;	///< The number of commands that failed with a CRC error
+	uint32_t parity_errors; ///< The number of commands that failed with a parity error
+	uint32_t frame_errors;	///< The number of commands that failed with a frame error
+	uint32_t other_errors;	///< The number of commands that failed otherwise, were not attempted, or read unexpected data
+	uint64_t elapsed_us;	///< The time it took to complete all the rounds in microseconds
+	double throughput;	///< The bytes written and read successfully per second
+};
+
 struct usbi3c_context;
 
 struct usbi3c_device;
@@ -257,7 +590,9 @@ int usbi3c_get_usb_error(struct usbi3c_device *usbi3c_dev);
 unsigned int usbi3c_set_timeout(struct usbi3c_device *usbi3c_dev, unsigned int timeout);
 
 /* bus functions */
+int usbi3c_set_warm_start_cache(struct usbi3c_device *usbi3c_dev, const char *directory);
 int usbi3c_initialize_device(struct usbi3c_device *usbi3c_dev);
+int usbi3c_get_startup_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_startup_stats *stats);
 int device_request_hotjoin(struct usbi3c_device *usbi3c_dev);
 int usbi3c_request_i3c_controller_role(struct usbi3c_device *usbi3c_dev);
 int usbi3c_enable_i3c_controller_role_handoff(struct usbi3c_device *usbi3c_dev);
@@ -279,11 +614,19 @@ int usbi3c_exit_hdr_mode_for_recovery(struct usbi3c_device *usbi3c_dev);
 int usbi3c_get_address_list(struct usbi3c_device *usbi3c_dev, uint8_t **list);
 int usbi3c_set_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t config);
 int usbi3c_set_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t max_payload);
+int usbi3c_set_target_device_configs(struct usbi3c_device *usbi3c_dev, const struct usbi3c_target_device_config *configs, size_t count);
 int usbi3c_change_i3c_device_address(struct usbi3c_device *usbi3c_dev, uint8_t current_address, uint8_t new_address, on_address_change_fn on_address_change_cb, void *data);
+int usbi3c_change_i3c_device_addresses(struct usbi3c_device *usbi3c_dev, const struct usbi3c_address_change *changes, size_t count, on_address_change_fn on_address_change_cb, void *data);
 int usbi3c_request_i3c_controller_role(struct usbi3c_device *usbi3c_dev);
 int usbi3c_add_device_to_table(struct usbi3c_device *usbi3c_dev, struct usbi3c_target_device device);
 int usbi3c_get_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi3c_target_device ***devices);
 void usbi3c_free_target_device_table(struct usbi3c_target_device ***devices);
+int usbi3c_get_target_device_table_generation(struct usbi3c_device *usbi3c_dev, uint64_t *generation);
+int usbi3c_copy_target_device_table(struct usbi3c_device *usbi3c_dev, struct usbi3c_target_device *devices, size_t max, uint64_t *generation);
+int usbi3c_copy_address_list(struct usbi3c_device *usbi3c_dev, uint8_t *addresses, size_t max, uint64_t *generation);
+int usbi3c_visit_target_devices(struct usbi3c_device *usbi3c_dev, on_target_device_visit_fn visitor, void *user_data, uint64_t *generation);
+int usbi3c_scan_bus_inventory(struct usbi3c_device *usbi3c_dev, int timeout);
+int usbi3c_set_target_device_max_lengths(struct usbi3c_device *usbi3c_dev, uint8_t address, uint16_t max_read_length, uint16_t max_write_length);
 
 /* get target device info */
 int usbi3c_get_device_address(struct usbi3c_device *usbi3c_dev);
@@ -292,22 +635,49 @@ int usbi3c_get_target_DCR(struct usbi3c_device *usbi3c_dev, uint8_t address);
 int usbi3c_get_target_type(struct usbi3c_device *usbi3c_dev, uint8_t address);
 enum usbi3c_device_role usbi3c_get_device_role(struct usbi3c_device *usbi3c_dev);
 int usbi3c_get_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t *transfer_mode, uint8_t *transfer_rate, uint8_t *tm_specific_info);
+int usbi3c_get_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t *transfer_mode, uint8_t *transfer_rate, uint8_t *tm_specific_info);
 int usbi3c_get_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int *reattempt_max);
 int usbi3c_get_target_device_config(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t *config);
 int usbi3c_get_target_device_max_ibi_payload(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t *max_payload);
 int usbi3c_get_timeout(struct usbi3c_device *usbi3c_dev, unsigned int *timeout);
 int usbi3c_device_is_active_controller(struct usbi3c_device *usbi3c_dev);
+int usbi3c_get_target_handle(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t *handle);
+int usbi3c_release_target_handle(struct usbi3c_device *usbi3c_dev, uint32_t handle);
+int usbi3c_get_target_handle_address(struct usbi3c_device *usbi3c_dev, uint32_t handle, uint8_t *address);
+int usbi3c_get_target_device_inventory(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_target_inventory *inventory);
 
 /* Event functions */
 void usbi3c_on_bus_error(struct usbi3c_device *usbi3c_dev, on_bus_error_fn on_bus_error_cb, void *data);
 void usbi3c_on_hotjoin(struct usbi3c_device *usbi3c_dev, on_hotjoin_fn on_hotjoin, void *data);
+void usbi3c_on_target_device_removed(struct usbi3c_device *usbi3c_dev, on_target_device_event_fn on_removed_cb, void *data);
+void usbi3c_on_target_device_changed(struct usbi3c_device *usbi3c_dev, on_target_device_event_fn on_changed_cb, void *data);
 void usbi3c_on_ibi(struct usbi3c_device *usbi3c_dev, on_ibi_fn on_ibi_cb, void *data);
+void usbi3c_on_ibi_chunk(struct usbi3c_device *usbi3c_dev, on_ibi_chunk_fn on_ibi_chunk_cb, void *data);
 int usbi3c_on_controller_event(struct usbi3c_device *usbi3c_dev, on_controller_event_fn on_controller_event_cb, void *data);
 int usbi3c_on_vendor_specific_response(struct usbi3c_device *usbi3c_dev, on_vendor_response_fn on_vendor_response_cb, void *data);
+int usbi3c_enable_ibi_polling(struct usbi3c_device *usbi3c_dev, size_t max_records);
+void usbi3c_disable_ibi_polling(struct usbi3c_device *usbi3c_dev);
+int usbi3c_ibi_poll(struct usbi3c_device *usbi3c_dev, struct usbi3c_ibi_record *records, size_t max);
+int usbi3c_ibi_wait(struct usbi3c_device *usbi3c_dev, int timeout_us);
+int usbi3c_get_ibi_poll_overruns(struct usbi3c_device *usbi3c_dev, uint32_t *overruns);
+void usbi3c_free_ibi_records(struct usbi3c_ibi_record *records, size_t count);
+int usbi3c_set_ibi_rate_limit(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t max_ibis_per_second, uint32_t burst);
+void usbi3c_set_ibi_coalescing_window(struct usbi3c_device *usbi3c_dev, uint32_t window_us);
+void usbi3c_set_ibi_storm_threshold(struct usbi3c_device *usbi3c_dev, uint32_t threshold);
+int usbi3c_get_ibi_storm_counters(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_ibi_storm_counters *counters);
+int usbi3c_ibi_device_time_to_host(struct usbi3c_device *usbi3c_dev, uint32_t device_timestamp, uint64_t *host_time_us);
+int usbi3c_get_ibi_device_clock_rate(struct usbi3c_device *usbi3c_dev, double *ticks_per_second);
+void usbi3c_set_ibi_delivery_order(struct usbi3c_device *usbi3c_dev, enum usbi3c_ibi_delivery_order order);
+int usbi3c_get_ibi_priority_stats(struct usbi3c_device *usbi3c_dev, uint8_t level, struct usbi3c_ibi_priority_stats *stats);
 
 /* bulk transfer functions */
 void usbi3c_set_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t transfer_mode, uint8_t transfer_rate, uint8_t tm_specific_info);
 void usbi3c_set_request_reattempt_max(struct usbi3c_device *usbi3c_dev, unsigned int reattempt_max);
+void usbi3c_set_transfer_chunking(struct usbi3c_device *usbi3c_dev, uint8_t enable);
+int usbi3c_set_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t transfer_mode, uint8_t transfer_rate, uint8_t tm_specific_info);
+int usbi3c_clear_target_device_i3c_mode(struct usbi3c_device *usbi3c_dev, uint8_t address);
+int usbi3c_derive_target_device_i3c_modes(struct usbi3c_device *usbi3c_dev);
+int usbi3c_autotune_target_device(struct usbi3c_device *usbi3c_dev, uint8_t address, const struct usbi3c_autotune_probe *probe, struct usbi3c_autotune_result *results, size_t max_results, int timeout);
 void usbi3c_free_responses(struct list **responses);
 int usbi3c_enqueue_command(struct usbi3c_device *usbi3c_dev,
 			   uint8_t target_address,
@@ -317,6 +687,14 @@ int usbi3c_enqueue_command(struct usbi3c_device *usbi3c_dev,
 			   unsigned char *data,
 			   on_response_fn on_response_cb,
 			   void *user_data);
+int usbi3c_enqueue_command_to_target(struct usbi3c_device *usbi3c_dev,
+				     uint32_t handle,
+				     enum usbi3c_command_direction command_direction,
+				     enum usbi3c_command_error_handling error_handling,
+				     uint32_t data_size,
+				     unsigned char *data,
+				     on_response_fn on_response_cb,
+				     void *user_data);
 int usbi3c_enqueue_ccc(struct usbi3c_device *usbi3c_dev,
 		       uint8_t target_address,
 		       enum usbi3c_command_direction command_direction,
@@ -339,6 +717,34 @@ int usbi3c_enqueue_target_reset_pattern(struct usbi3c_device *usbi3c_dev, on_res
 struct list *usbi3c_send_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous, int timeout);
 int usbi3c_submit_vendor_specific_request(struct usbi3c_device *usbi3c_dev, unsigned char *data, uint32_t data_size);
 int usbi3c_submit_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous);
+int usbi3c_mark_commands_order_independent(struct usbi3c_device *usbi3c_dev);
+int usbi3c_get_reorder_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_reorder_stats *stats);
+int usbi3c_set_batch_optimization(struct usbi3c_device *usbi3c_dev, uint8_t optimizations, uint8_t register_address_size);
+int usbi3c_get_batch_optimization_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_batch_optimization_stats *stats);
+int usbi3c_regmap_init(struct usbi3c_device *usbi3c_dev, uint8_t address, const struct usbi3c_regmap_config *config);
+int usbi3c_regmap_exit(struct usbi3c_device *usbi3c_dev, uint8_t address);
+int usbi3c_regmap_read(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t reg, uint32_t *value, int timeout);
+int usbi3c_regmap_write(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t reg, uint32_t value, int timeout);
+int usbi3c_regmap_defer_writes(struct usbi3c_device *usbi3c_dev, uint8_t address, uint8_t defer);
+int usbi3c_regmap_sync(struct usbi3c_device *usbi3c_dev, uint8_t address, int timeout);
+int usbi3c_regmap_invalidate(struct usbi3c_device *usbi3c_dev, uint8_t address);
+int usbi3c_regmap_get_stats(struct usbi3c_device *usbi3c_dev, uint8_t address, struct usbi3c_regmap_stats *stats);
+int usbi3c_start_polling(struct usbi3c_device *usbi3c_dev, uint32_t tick_us);
+int usbi3c_stop_polling(struct usbi3c_device *usbi3c_dev);
+int usbi3c_add_poll(struct usbi3c_device *usbi3c_dev, uint8_t address, uint32_t data_size, uint32_t period_us, on_response_fn on_response_cb, void *user_data);
+int usbi3c_remove_poll(struct usbi3c_device *usbi3c_dev, int poll_id);
+int usbi3c_get_poll_stats(struct usbi3c_device *usbi3c_dev, int poll_id, struct usbi3c_poll_stats *stats);
+int usbi3c_submit_commands_in_class(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous, enum usbi3c_submission_class submission_class, uint32_t deadline_us);
+int usbi3c_set_bulk_chunk_size(struct usbi3c_device *usbi3c_dev, uint32_t chunk_size);
+int usbi3c_get_submission_stats(struct usbi3c_device *usbi3c_dev, enum usbi3c_submission_class submission_class, struct usbi3c_submission_stats *stats);
+int usbi3c_try_submit_commands(struct usbi3c_device *usbi3c_dev, uint8_t dependent_on_previous);
+int usbi3c_set_submit_window(struct usbi3c_device *usbi3c_dev, uint32_t max_requests, uint32_t max_bytes);
+int usbi3c_on_submit_writable(struct usbi3c_device *usbi3c_dev, on_submit_writable_fn on_writable_cb, void *data);
+int usbi3c_get_submit_writable_fd(struct usbi3c_device *usbi3c_dev);
+int usbi3c_get_submit_window_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_submit_window_stats *stats);
+int usbi3c_set_max_commands_in_flight(struct usbi3c_device *usbi3c_dev, uint32_t max_commands);
+int usbi3c_set_response_timeout(struct usbi3c_device *usbi3c_dev, uint32_t timeout_ms);
+int usbi3c_get_request_expiry_stats(struct usbi3c_device *usbi3c_dev, struct usbi3c_request_expiry_stats *stats);
 int usbi3c_request_i3c_controller_role(struct usbi3c_device *usbi3c_dev);
 
 #ifdef __cplusplus
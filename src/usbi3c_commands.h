@@ -104,7 +104,8 @@ enum usbi3c_response_data_availability {
  */
 enum usbi3c_command_status {
 	USBI3C_COMMAND_NOT_ATTEMPTED = 0x0, ///< Indicates that the command was not attempted
-	USBI3C_COMMAND_ATTEMPTED = 0x1	    ///< Indicates that the command was attempted
+	USBI3C_COMMAND_ATTEMPTED = 0x1,	    ///< Indicates that the command was attempted
+	USBI3C_COMMAND_TIMED_OUT = 0x2	    ///< Indicates that no response to the command was received in time, it may or may not have been attempted
 };
 
 /**
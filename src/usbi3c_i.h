@@ -16,12 +16,15 @@
 #ifndef __libusbi3c_i_h__
 #define __libusbi3c_i_h__
 
+#include <stdatomic.h>
+
 #include "common_i.h"
 #include "list.h"
 #include "usb_i.h"
 
 #include "ibi_i.h"
 #include "ibi_response_i.h"
+#include "timer_wheel_i.h"
 #include "usbi3c.h"
 #include "usbi3c_spec_i.h"
 
@@ -32,6 +35,9 @@
 #define POLLING_NOT_INITIATED 0
 #define POLLING_INITIATED 1
 
+/* default max bytes of data per bulk request of the commands submitted in the bulk class */
+#define DEFAULT_BULK_CHUNK_SIZE 1024
+
 /**
  * @brief Gets the size of a data block padded to the closest 32-bit chunk.
  *
@@ -99,6 +105,15 @@ struct bus_error_handler {
 	void *data;			 ///< Data to share with bus error callback
 };
 
+/**
+ * @brief A request to disable the IBIs of a target device that exceeded the IBI storm threshold.
+ */
+struct ibi_storm_disable {
+	struct usbi3c_device *usbi3c_dev; ///< The usbi3c device the target device is connected to
+	uint32_t target_id;		  ///< The target handle of the target device
+	uint8_t config;			  ///< The configuration of the target device with its IBIs disabled
+};
+
 /**
  * @brief Structure representing an usbi3c device (a USB device with an I3C interface).
  *
@@ -119,6 +134,19 @@ struct usbi3c_device {
 	struct request_tracker *request_tracker;			  ///< Tracks all unanswered requests sent to an I3C function
 	struct ibi *ibi;						  ///< IBI handler
 	struct device_event_handler *device_event_handler;		  ///< Handles events received from the active I3C controller
+	char *warm_start_cache;						  ///< Directory of the warm-start cache, NULL if the cache is disabled
+	struct usbi3c_startup_stats startup_stats;			  ///< Information about the last initialization of the device
+	uint8_t transfer_chunking;					  ///< TRUE if reads and writes longer than the max length of their target device are split
+	uint8_t order_independent;					  ///< TRUE if the commands in the queue can be reordered to reduce mode switches
+	struct usbi3c_reorder_stats reorder_stats;			  ///< Counters of the order-independent batches sent
+	uint8_t batch_optimizations;					  ///< Bitmask of enum usbi3c_batch_optimization applied to the batches sent
+	uint8_t register_address_size;					  ///< Bytes of register address at the start of the writes to coalesce
+	struct usbi3c_batch_optimization_stats batch_optimization_stats;  ///< Counters of the commands eliminated by the batch optimizations
+	struct list *regmaps;						  ///< Register maps of the target devices
+	struct list *storm_disables;					  ///< Requests to disable the IBIs of the target devices that exceeded the IBI storm threshold
+	struct poll_scheduler *poll_scheduler;				  ///< Scheduler of the periodic reads, NULL if it is not running
+	struct submission_queue *submission_queue;			  ///< Queues of the commands submitted by class, NULL until commands are first submitted in a class
+	uint32_t bulk_chunk_size;					  ///< Max bytes of data per bulk request of the commands submitted in the bulk class, 0 to not split them
 	int ref_count;							  ///< The number of references to this device.
 };
 
@@ -210,13 +238,20 @@ struct command_descriptor {
  *   to act on this request if the previous dependent request stalls.
  */
 struct regular_request {
-	uint16_t request_id;		  ///< the ID of the command being tracked
-	int total_commands;		  ///< the total number of commands sent to the I3C function in the same request transfer
-	int dependent_on_previous;	  ///< indicates if that particular request is dependent on the correct execution of a previous command
-	int reattempt_count;		  ///< number of times the request has been reattempted after stalling
-	struct usbi3c_response *response; ///< a pointer to the corresponding response received from the I3C function when available
-	on_response_fn on_response_cb;	  ///< callback function to execute when the response is received
-	void *user_data;		  ///< user data to share with the on_response_cb callback function
+	uint16_t request_id;			  ///< the ID of the command being tracked
+	struct request_id_allocator *request_ids; ///< the allocator the ID of the command has to be freed to
+	int total_commands;			  ///< the total number of commands sent to the I3C function in the same request transfer
+	int dependent_on_previous;		  ///< indicates if that particular request is dependent on the correct execution of a previous command
+	int reattempt_count;			  ///< number of times the request has been reattempted after stalling
+	struct usbi3c_response *response;	  ///< a pointer to the corresponding response received from the I3C function when available
+	on_response_fn on_response_cb;		  ///< callback function to execute when the response is received
+	void *user_data;			  ///< user data to share with the on_response_cb callback function
+	struct chunked_transfer *chunked;	  ///< the transfer the command is a chunk of, NULL if the transfer was not split
+	struct batch_fanout *fanout;		  ///< the callbacks of the commands merged into the command, NULL if the command was not merged
+	struct send_window *window;		  ///< the send window the bulk request takes room in, only set in the first command of the request until it is answered
+	uint32_t window_bytes;			  ///< the bytes of the bulk request accounted in the send window
+	struct timer_wheel *expiry;		  ///< the wheel the deadline of the command is armed in, NULL if the command can't expire
+	struct timer_wheel_entry expiry_timer;	  ///< the deadline of the command, only armed while its response is awaited
 };
 
 /**
@@ -227,12 +262,28 @@ struct vendor_specific_request {
 	void *user_data;			     ///< user data to share with the on_vendor_response_cb callback function
 };
 
+/**
+ * @brief Function called with the ID of the first command of a bulk request once its responses were received.
+ */
+typedef void (*on_request_answered_fn)(uint16_t request_id, void *context);
+
 /**
  * @brief Data structure to track bulk requests.
  */
 struct bulk_requests {
-	struct list *requests;	///< A list of requests that are being tracked
-	pthread_mutex_t *mutex; ///< Race condition protection to access the request tracker
+	struct list *requests;				 ///< A list of requests that are being tracked
+	pthread_mutex_t *mutex;				 ///< Race condition protection to access the request tracker
+	on_request_answered_fn on_request_answered;	 ///< Function called once the responses to a bulk request are received, NULL if not needed
+	void *request_answered_context;			 ///< Context of the on_request_answered function
+	struct send_window *window;			 ///< The bulk requests in flight and the room left for more
+	struct request_id_allocator *request_ids;	 ///< The IDs of the requests being tracked
+	struct timer_wheel *expiry;			 ///< The deadlines of the requests awaiting a response
+	uint32_t response_timeout_ms;			 ///< The time a response is awaited before its request expires, 0 if requests never expire
+	struct usbi3c_request_expiry_stats expiry_stats; ///< Counters of the requests expired
+	uint8_t expiry_running;				 ///< TRUE while the expiry thread has to keep running
+	uint64_t expiry_wake_us;			 ///< The time the expiry thread wakes up at, UINT64_MAX while no request can expire
+	pthread_t expiry_thread;			 ///< The thread that expires the requests as their deadlines pass
+	pthread_cond_t *expiry_changed;			 ///< Condition signaled when an earlier deadline is armed or the expiry thread is stopped
 };
 
 /**
@@ -247,6 +298,41 @@ struct request_tracker {
 	struct vendor_specific_request *vendor_request; ///< vendor request handler
 };
 
+/**
+ * @brief A read or write split in several commands to fit the max length of its target device.
+ *
+ * The commands the transfer was split in share this structure, their responses are
+ * reassembled into a single one that is delivered once all of them are received.
+ */
+struct chunked_transfer {
+	on_response_fn on_response_cb;	 ///< Callback function to execute when the response to the whole transfer is received
+	void *user_data;		 ///< User data to share with the on_response_cb callback function
+	uint32_t chunks;		 ///< Number of commands the transfer was split in
+	uint32_t received;		 ///< Number of responses to the commands received so far
+	struct usbi3c_response response; ///< The response to the whole transfer, reassembled from the responses to the commands
+	atomic_int refs;		 ///< Number of commands and tracked requests referring to the transfer
+};
+
+/**
+ * @brief A command of a batch that has to be called back with the response of a merged command.
+ */
+struct batch_fanout_member {
+	on_response_fn on_response_cb; ///< Callback function of the command
+	void *user_data;	       ///< User data to share with the on_response_cb callback function
+};
+
+/**
+ * @brief The callbacks of the commands of a batch carried by a merged command.
+ *
+ * The merged command and the request tracking it share this structure, it is freed
+ * once both of them are, whether the response was delivered or the request was dropped.
+ */
+struct batch_fanout {
+	atomic_int refs;		      ///< Number of commands and tracked requests referring to the callbacks
+	uint32_t count;			      ///< Number of commands merged
+	struct batch_fanout_member members[]; ///< The callbacks of the commands merged, in the order they were queued
+};
+
 /**
  * @brief A structure representing an I3C command along with its data.
  *
@@ -257,6 +343,9 @@ struct usbi3c_command {
 	unsigned char *data;			       ///< Optional data buffer to attach to a command
 	on_response_fn on_response_cb;		       ///< Callback function to executed when the response is received
 	void *user_data;			       ///< User data to share with the on_response_cb callback function
+	uint32_t target_handle;			       ///< Handle of the target device the command was queued for, 0 if queued by address
+	struct chunked_transfer *chunked;	       ///< The transfer the command is a chunk of, NULL if the transfer was not split
+	struct batch_fanout *fanout;		       ///< The callbacks of the commands merged into the command, NULL if the command was not merged
 };
 
 /**
@@ -269,6 +358,18 @@ enum bulk_request_command_descriptor_command_type {
 	TARGET_RESET_PATTERN = 0X3,
 };
 
+/**
+ * @brief Enumeration of the direct GET CCCs used to discover the target devices.
+ */
+enum i3c_discovery_ccc {
+	CCC_DIRECT_GETMWL = 0x8B,  ///< get max write length
+	CCC_DIRECT_GETMRL = 0x8C,  ///< get max read length
+	CCC_DIRECT_GETPID = 0x8D,  ///< get provisioned ID
+	CCC_DIRECT_GETBCR = 0x8E,  ///< get bus characteristic register
+	CCC_DIRECT_GETDCR = 0x8F,  ///< get device characteristic register
+	CCC_DIRECT_GETMXDS = 0x94, ///< get max data speed
+};
+
 /**
  * @brief Data structure that specifies the I3C communication mode options.
  */
@@ -291,11 +392,19 @@ uint32_t bulk_transfer_create_vendor_specific_buffer(unsigned char **buffer, uns
 /* commands */
 struct usbi3c_command *bulk_transfer_alloc_command(void);
 int bulk_transfer_validate_command(struct usbi3c_command *command);
+int bulk_transfer_get_buffer_available(struct usbi3c_device *usbi3c_dev, uint32_t *buffer_available);
 struct list *bulk_transfer_send_commands(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous);
+int bulk_transfer_try_send_commands(struct usbi3c_device *usbi3c_dev, struct list *commands, uint8_t dependent_on_previous, struct list **request_ids);
+void bulk_transfer_untrack_requests(struct bulk_requests *regular_requests, struct list *request_ids);
+int bulk_transfer_expire_requests(struct request_tracker *request_tracker, uint64_t now_us);
+int bulk_transfer_set_response_timeout(struct request_tracker *request_tracker, uint32_t timeout_ms);
+void bulk_transfer_stop_expiry(struct request_tracker *request_tracker);
+int bulk_transfer_get_request_expiry_stats(struct bulk_requests *regular_requests, struct usbi3c_request_expiry_stats *stats);
 int bulk_transfer_remove_command_and_dependent(struct bulk_requests *regular_requests, uint16_t request_id);
 int bulk_transfer_cancel_request_async(struct usb_device *usb_dev, struct bulk_requests *regular_requests, uint16_t request_id);
 int bulk_transfer_resume_request_async(struct usb_device *usb_dev);
 int bulk_transfer_enqueue_command(struct list **command_queue, uint8_t command_type, uint8_t target_address, uint8_t command_direction, uint8_t error_handling, struct i3c_mode *i3c_mode, uint8_t ccc, uint8_t defining_byte, unsigned char *data, uint32_t data_size, on_response_fn on_response_cb, void *user_data);
+int bulk_transfer_enqueue_chunked_command(struct list **command_queue, uint8_t target_address, uint8_t command_direction, uint8_t error_handling, struct i3c_mode *i3c_mode, unsigned char *data, uint32_t data_size, uint32_t max_chunk_size, on_response_fn on_response_cb, void *user_data);
 void bulk_transfer_free_command(struct usbi3c_command **command);
 void bulk_transfer_free_commands(struct list **commands);
 void bulk_transfer_free_response(struct usbi3c_response **response);
@@ -304,6 +413,7 @@ void bulk_transfer_get_response(void *context, unsigned char *buffer, uint32_t b
 int bulk_transfer_get_regular_response(struct bulk_requests *regular_requests, unsigned char *buffer, uint32_t buffer_size);
 int bulk_transfer_get_vendor_specific_response(struct vendor_specific_request *vendor_request, unsigned char *buffer, uint32_t buffer_size);
 struct usbi3c_response *bulk_transfer_search_response_in_tracker(struct bulk_requests *regular_requests, int request_id);
+void bulk_transfer_merge_chunked_responses(struct list *commands, struct list **responses);
 
 /* matchers */
 int compare_request_id(const void *a, const void *b);
@@ -155,7 +155,7 @@ int helper_create_command_buffer(int request_id, unsigned char **buffer, int tar
 }
 
 static int add_to_command_buffer(int request_id, int command_type, int ccc, int defining_byte, unsigned char **buffer, int current_buffer_size, int target_address,
-				 int command_direction, int error_handling, int data_size, unsigned char *data)
+				 int command_direction, int error_handling, int data_size, unsigned char *data, int transfer_mode, int transfer_rate)
 {
 	struct usbi3c_command *cmd = NULL;
 	unsigned char *cmd_buffer = NULL;
@@ -172,8 +172,8 @@ static int add_to_command_buffer(int request_id, int command_type, int ccc, int
 	cmd->command_descriptor->data_length = data_size;
 	cmd->command_descriptor->common_command_code = ccc;
 	cmd->command_descriptor->defining_byte = defining_byte;
-	cmd->command_descriptor->transfer_mode = USBI3C_I3C_SDR_MODE;
-	cmd->command_descriptor->transfer_rate = USBI3C_I3C_RATE_2_MHZ;
+	cmd->command_descriptor->transfer_mode = transfer_mode;
+	cmd->command_descriptor->transfer_rate = transfer_rate;
 	cmd->command_descriptor->tm_specific_info = 0;
 
 	/* if the command is a Read then the data_size indicates the number of bytes to
@@ -212,18 +212,28 @@ static int add_to_command_buffer(int request_id, int command_type, int ccc, int
 int helper_add_ccc_with_defining_byte_to_command_buffer(int request_id, int ccc, int defining_byte, unsigned char **buffer, int current_buffer_size, int target_address,
 							int command_direction, int error_handling, int data_size, unsigned char *data)
 {
-	return add_to_command_buffer(request_id, CCC_WITH_DEFINING_BYTE, ccc, defining_byte, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data);
+	return add_to_command_buffer(request_id, CCC_WITH_DEFINING_BYTE, ccc, defining_byte, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data,
+				     USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
 }
 
 int helper_add_ccc_to_command_buffer(int request_id, int ccc, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling,
 				     int data_size, unsigned char *data)
 {
-	return add_to_command_buffer(request_id, CCC_WITHOUT_DEFINING_BYTE, ccc, 0, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data);
+	return add_to_command_buffer(request_id, CCC_WITHOUT_DEFINING_BYTE, ccc, 0, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data,
+				     USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
 }
 
 int helper_add_to_command_buffer(int request_id, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling, int data_size, unsigned char *data)
 {
-	return add_to_command_buffer(request_id, REGULAR_COMMAND, 0, 0, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data);
+	return add_to_command_buffer(request_id, REGULAR_COMMAND, 0, 0, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data,
+				     USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+}
+
+int helper_add_to_command_buffer_with_mode(int request_id, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling,
+					   int data_size, unsigned char *data, int transfer_mode, int transfer_rate)
+{
+	return add_to_command_buffer(request_id, REGULAR_COMMAND, 0, 0, buffer, current_buffer_size, target_address, command_direction, error_handling, data_size, data,
+				     transfer_mode, transfer_rate);
 }
 
 int helper_add_target_reset_pattern_to_command_buffer(int request_id, unsigned char **buffer, int current_buffer_size)
@@ -269,7 +279,7 @@ int helper_add_target_reset_pattern_to_command_buffer(int request_id, unsigned c
 	return new_buffer_size;
 }
 
-struct usbi3c_command *helper_create_command(on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id)
+struct usbi3c_command *helper_create_command(struct usbi3c_device *usbi3c_dev, on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id)
 {
 	struct usbi3c_command *command = NULL;
 	unsigned char *cmd_buffer = NULL;
@@ -312,13 +322,13 @@ struct usbi3c_command *helper_create_command(on_response_fn on_response_cb, void
 	command->on_response_cb = on_response_cb;
 	command->user_data = user_data;
 
-	*request_id = bulk_request_id;
+	*request_id = helper_next_request_id(usbi3c_dev);
 	create_command_block_buffer(cmd_buffer, command, *request_id);
 
 	return command;
 }
 
-struct list *helper_create_commands(on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id, uint8_t dependent_on_previous)
+struct list *helper_create_commands(struct usbi3c_device *usbi3c_dev, on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id, uint8_t dependent_on_previous)
 {
 	struct list *commands = NULL;
 	struct usbi3c_command *command = NULL;
@@ -328,7 +338,7 @@ struct list *helper_create_commands(on_response_fn on_response_cb, void *user_da
 	unsigned char data2[] = "Shorter test data - 29 bytes";
 
 	/* let's return a copy of the current id that are to be used */
-	*request_id = bulk_request_id;
+	*request_id = helper_next_request_id(usbi3c_dev);
 
 	/* let's allocate memory for a buffer that will contain these commands
 	 * to get the expected buffer size, we need to add:
@@ -368,7 +378,7 @@ struct list *helper_create_commands(on_response_fn on_response_cb, void *user_da
 
 	commands = list_append(commands, command);
 
-	req_id = bulk_request_id;
+	req_id = helper_next_request_id(usbi3c_dev);
 	cmd_buffer += create_command_block_buffer(cmd_buffer, command, req_id);
 
 	/*************/
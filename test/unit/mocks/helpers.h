@@ -34,9 +34,6 @@
 
 #define USB_ENDPOINT_MASK 0x0F
 
-/* holds the current request ID */
-extern uint16_t bulk_request_id;
-
 /* flags used to enable mocks disabled by default */
 extern int enable_mock_libusb_alloc_transfer;
 extern int enable_mock_libusb_free_transfer;
@@ -44,6 +41,7 @@ extern int enable_mock_libusb_free_transfer;
 /* test_helpers.c */
 struct usbi3c_device *helper_usbi3c_init(void *fake_handle);
 void helper_usbi3c_deinit(struct usbi3c_device **usbi3c, void *fake_handle);
+uint16_t helper_next_request_id(struct usbi3c_device *usbi3c_dev);
 struct list *helper_create_test_list(int a, int b);
 void helper_create_dummy_devices_in_target_device_table(struct usbi3c_device *usbi3c_dev, int number_of_devices);
 int helper_initialize_controller(struct usbi3c_device *usbi3c, void *fake_handle, uint8_t **address_list);
@@ -72,9 +70,10 @@ int helper_create_command_buffer(int request_id, unsigned char **buffer, int tar
 int helper_add_ccc_with_defining_byte_to_command_buffer(int request_id, int ccc, int defining_byte, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling, int data_size, unsigned char *data);
 int helper_add_ccc_to_command_buffer(int request_id, int ccc, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling, int data_size, unsigned char *data);
 int helper_add_to_command_buffer(int request_id, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling, int data_size, unsigned char *data);
+int helper_add_to_command_buffer_with_mode(int request_id, unsigned char **buffer, int current_buffer_size, int target_address, int command_direction, int error_handling, int data_size, unsigned char *data, int transfer_mode, int transfer_rate);
 int helper_add_target_reset_pattern_to_command_buffer(int request_id, unsigned char **buffer, int current_buffer_size);
-struct usbi3c_command *helper_create_command(on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id);
-struct list *helper_create_commands(on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id, uint8_t dependent_on_previous);
+struct usbi3c_command *helper_create_command(struct usbi3c_device *usbi3c_dev, on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id);
+struct list *helper_create_commands(struct usbi3c_device *usbi3c_dev, on_response_fn on_response_cb, void *user_data, unsigned char **buffer, int *buffer_size, int *request_id, uint8_t dependent_on_previous);
 int helper_create_response_buffer(unsigned char **buffer, struct usbi3c_response *response, int request_id);
 int helper_create_multiple_response_buffer(unsigned char **buffer, struct list *responses, int request_id);
 void helper_add_request_to_tracker(struct request_tracker *request_tracker, int request_id, int total_commands, struct usbi3c_response *response);
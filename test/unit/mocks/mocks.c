@@ -201,6 +201,11 @@ void __wrap_libusb_unlock_event_waiters(struct libusb_context *ctx)
 	/* Intentionally left empty */
 }
 
+void __wrap_libusb_interrupt_event_handler(struct libusb_context *ctx)
+{
+	/* Intentionally left empty */
+}
+
 int __wrap_libusb_wait_for_event(struct libusb_context *ctx, struct timeval *tv)
 {
 	int trigger = mock_type(int);
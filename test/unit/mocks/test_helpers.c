@@ -15,6 +15,7 @@
 
 #include "helpers.h"
 #include "mocks.h"
+#include "request_id_i.h"
 #include "target_device_table_i.h"
 
 #include "usbi3c.h"
@@ -66,6 +67,12 @@ void helper_usbi3c_deinit(struct usbi3c_device **usbi3c_dev, void *handle)
 	usbi3c_device_deinit(usbi3c_dev);
 }
 
+/* gets the request ID the next command sent to the I3C function is going to get */
+uint16_t helper_next_request_id(struct usbi3c_device *usbi3c_dev)
+{
+	return usbi3c_dev->request_tracker->regular_requests->request_ids->next;
+}
+
 struct list *helper_create_test_list(int a, int b)
 {
 	struct list *head = NULL;
@@ -195,7 +202,7 @@ void helper_initialize_target_device(struct usbi3c_device *usbi3c, void *handle)
 	 * with a hot-join request to the active controller.
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(usbi3c),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -217,7 +224,7 @@ void helper_initialize_target_device(struct usbi3c_device *usbi3c, void *handle)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(usbi3c));
 	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
 
 	ret = usbi3c_initialize_device(usbi3c);
@@ -89,7 +89,7 @@ static int test_setup(void **state)
 {
 	struct test_deps *deps = (struct test_deps *)*state;
 
-	deps->command = helper_create_command(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id);
+	deps->command = helper_create_command(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id);
 
 	return 0;
 }
@@ -73,7 +73,7 @@ static void test_negative_invalid_dependency_value(void **state)
 	struct list *request_ids = NULL;
 	const int INVALID_VALUE = 2;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, INVALID_VALUE);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, INVALID_VALUE);
 
 	request_ids = bulk_transfer_send_commands(deps->usbi3c_dev, deps->commands, INVALID_VALUE);
 	assert_null(request_ids);
@@ -86,7 +86,7 @@ static void test_negative_libusb_failure_getting_buffer_size(void **state)
 	struct list *request_ids = NULL;
 	int buffer_available = 0;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = deps->buffer_size + 100;
@@ -109,7 +109,7 @@ static void test_negative_sending_commands_fails_with_empty_tracker(void **state
 	struct list *request_ids = NULL;
 	int buffer_available = 0;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = deps->buffer_size + 100;
@@ -135,7 +135,7 @@ static void test_negative_sending_commands_fails_with_non_empty_tracker(void **s
 	struct list *request_ids = NULL;
 	int buffer_available = 0;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = deps->buffer_size + 100;
@@ -169,10 +169,10 @@ static void test_bulk_transfer_send_commands(void **state)
 	struct regular_request *regular_request = NULL;
 	struct list *request_ids = NULL;
 	struct list *node = NULL;
-	int initial_id = bulk_request_id;
+	int initial_id = helper_next_request_id(deps->usbi3c_dev);
 	int buffer_available = 0;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = deps->buffer_size + 100;
@@ -225,10 +225,10 @@ static void test_bulk_transfer_send_dependent_commands(void **state)
 	struct regular_request *regular_request = NULL;
 	struct list *request_ids = NULL;
 	struct list *node = NULL;
-	int initial_id = bulk_request_id;
+	int initial_id = helper_next_request_id(deps->usbi3c_dev);
 	int buffer_available = 0;
 
-	deps->commands = helper_create_commands(response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_DEPENDENT_ON_PREVIOUS);
+	deps->commands = helper_create_commands(deps->usbi3c_dev, response_cb, NULL, &deps->buffer, &deps->buffer_size, &deps->request_id, USBI3C_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = deps->buffer_size + 100;
@@ -126,7 +126,7 @@ static void test_negative_libusb_failure(void **state)
 	/* the hot-join request is sent as a sync bulk request transfer,
 	 * let's create the type of buffer we expect so we can compare it
 	 * against the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -163,7 +163,7 @@ static void test_negative_command_not_attempted(void **state)
 	/* the hot-join request is sent as a sync bulk request transfer,
 	 * let's create the type of buffer we expect so we can compare it
 	 * against the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -185,7 +185,7 @@ static void test_negative_command_not_attempted(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the USB related functions */
 	mock_get_buffer_available(NULL, &buffer_available, RETURN_SUCCESS);
@@ -214,7 +214,7 @@ static void test_bus_request_hotjoin(void **state)
 	/* the hot-join request is sent as a sync bulk request transfer,
 	 * let's create the type of buffer we expect so we can compare it
 	 * against the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -236,7 +236,7 @@ static void test_bus_request_hotjoin(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the USB related functions */
 	mock_get_buffer_available(NULL, &buffer_available, RETURN_SUCCESS);
@@ -0,0 +1,157 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "ibi_i.h"
+#include "mocks.h"
+
+struct test_deps {
+	struct ibi_clock *clock;
+	struct ibi_response_queue *queue;
+	struct ibi *ibi;
+};
+
+int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+	deps->clock = ibi_clock_init();
+	deps->queue = ibi_response_queue_get_queue();
+	deps->ibi = ibi_init(deps->queue);
+	*state = deps;
+	return 0;
+}
+
+int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	ibi_clock_destroy(&deps->clock);
+	ibi_destroy(&deps->ibi);
+	ibi_response_queue_clear(deps->queue);
+	free(deps);
+	return 0;
+}
+
+static void on_ibi_cb(uint8_t report, struct usbi3c_ibi *descriptor, uint8_t *data, size_t size, void *user_data)
+{
+	struct usbi3c_ibi *delivered = (struct usbi3c_ibi *)user_data;
+	*delivered = *descriptor;
+}
+
+static void test_negative_ibi_clock_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint64_t host_time = 0;
+	double rate = 0;
+
+	ibi_clock_add_sample(NULL, 0, 0);
+	assert_int_equal(ibi_clock_device_to_host(NULL, 0, &host_time), RETURN_FAILURE);
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, 0, NULL), RETURN_FAILURE);
+	assert_int_equal(ibi_clock_get_rate(NULL, &rate), RETURN_FAILURE);
+	assert_int_equal(ibi_clock_get_rate(deps->clock, NULL), RETURN_FAILURE);
+}
+
+static void test_ibi_clock_not_enough_samples(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint64_t host_time = 0;
+	double rate = 0;
+
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, 100, &host_time), RETURN_FAILURE);
+	ibi_clock_add_sample(deps->clock, 100, 5000);
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, 100, &host_time), RETURN_FAILURE);
+	assert_int_equal(ibi_clock_get_rate(deps->clock, &rate), RETURN_FAILURE);
+}
+
+static void test_ibi_clock_drift_correction(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint64_t host_time = 0;
+	double rate = 0;
+
+	// the device clock runs at 2 MHz plus 100 ppm, and IBIs take between
+	// 50 and 80 us to reach the host
+	for (uint32_t i = 0; i < 20; i++) {
+		uint64_t host_event = 1000000 + (i * 10000);
+		uint32_t device_ticks = (uint32_t)((host_event - 1000000) * 2.0002);
+		ibi_clock_add_sample(deps->clock, device_ticks, host_event + 50 + ((i * 7) % 31));
+	}
+
+	assert_int_equal(ibi_clock_get_rate(deps->clock, &rate), 0);
+	assert_true(rate > 2000150 && rate < 2000250);
+
+	// an event 200 ms after the first sample
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, 400040, &host_time), 0);
+	assert_true(host_time >= 1200000 && host_time <= 1200000 + 80);
+}
+
+static void test_ibi_clock_wraparound(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint64_t host_time = 0;
+
+	// a 1 MHz device clock about to wrap around
+	for (uint32_t i = 0; i < 10; i++) {
+		ibi_clock_add_sample(deps->clock, UINT32_MAX - 5000 + (i * 1000), 7000000 + (i * 1000));
+	}
+
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, 3999, &host_time), 0);
+	assert_int_equal(host_time, 7009000);
+	assert_int_equal(ibi_clock_device_to_host(deps->clock, UINT32_MAX - 5000, &host_time), 0);
+	assert_int_equal(host_time, 7000000);
+}
+
+static void test_ibi_clock_delivery(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct notification notification = {
+		.type = NOTIFICATION_I3C_IBI,
+		.code = REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER
+	};
+	struct usbi3c_ibi delivered = { 0 };
+	uint64_t host_time = 0;
+
+	ibi_set_callback(deps->ibi, on_ibi_cb, &delivered);
+	for (uint32_t i = 0; i < 2; i++) {
+		struct ibi_response *response = calloc(1, sizeof(struct ibi_response));
+		response->descriptor.address = 0x08;
+		response->descriptor.ibi_timestamp = 1;
+		response->descriptor.device_timestamp = 1000 + (i * 1000);
+		response->descriptor.response_time_us = 5000 + (i * 1000);
+		response->completed = 1;
+		ibi_response_queue_enqueue(deps->queue, response);
+		ibi_handle_notification(&notification, deps->ibi);
+	}
+
+	// the time the notification was received is added to the descriptor
+	assert_int_equal(delivered.device_timestamp, 2000);
+	assert_true(delivered.notification_time_us > 0);
+	assert_true(delivered.notification_time_us <= monotonic_time_us());
+
+	// timestamped IBIs are used to correlate the clocks
+	assert_int_equal(ibi_clock_device_to_host(ibi_get_clock(deps->ibi), 1500, &host_time), 0);
+	assert_int_equal(host_time, 5500);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_ibi_clock_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_clock_not_enough_samples, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_clock_drift_correction, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_clock_wraparound, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_clock_delivery, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -165,6 +165,104 @@ static void test_negative_ibi_call_pending(void **state)
 	ibi_destroy(&ibi);
 }
 
+void ibi_chunk_callback(struct usbi3c_ibi *descriptor, uint16_t sequence_id, uint8_t last_fragment, uint8_t *data, size_t size, void *user_data)
+{
+	check_expected(size);
+	check_expected(user_data);
+}
+
+/* builds a single IBI response carrying a DWORD of pending read data */
+static void helper_pending_read_response(uint8_t *buffer, uint32_t payload)
+{
+	struct bulk_ibi_response_header *header = (struct bulk_ibi_response_header *)buffer;
+	struct bulk_ibi_response_footer *footer = (struct bulk_ibi_response_footer *)(buffer + 2 * DWORD_SIZE);
+
+	header->tag = INTERRUPT_BULK_RESPONSE;
+	memcpy(buffer + DWORD_SIZE, &payload, sizeof(payload));
+	footer->pending_read = 1;
+	footer->last_byte = 1;
+}
+
+// test the chunk callback only streams the IBI responses received for the device it was set on
+static void test_ibi_set_chunk_callback_per_device(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint8_t buffer[3 * DWORD_SIZE] = { 0 };
+	uint32_t payload = 0xBADBEEF;
+	int data = 0;
+	struct ibi *streaming = ibi_init(deps->queue);
+	struct ibi *buffering = ibi_init(deps->queue);
+
+	ibi_set_chunk_callback(NULL, ibi_chunk_callback, &data);
+	ibi_set_chunk_callback(streaming, ibi_chunk_callback, &data);
+	helper_pending_read_response(buffer, payload);
+
+	// no chunk callback is set for this device so the payload is buffered
+	assert_int_equal(ibi_handle_response(buffering, buffer, sizeof(buffer)), 0);
+	struct ibi_response *response = ibi_response_queue_back(deps->queue);
+	assert_true(response->completed);
+	assert_int_equal(response->size, sizeof(payload));
+	assert_memory_equal(response->data, &payload, sizeof(payload));
+
+	expect_value(ibi_chunk_callback, size, sizeof(payload));
+	expect_value(ibi_chunk_callback, user_data, &data);
+	assert_int_equal(ibi_handle_response(streaming, buffer, sizeof(buffer)), 0);
+	response = ibi_response_queue_back(deps->queue);
+	assert_true(response->completed);
+	assert_int_equal(response->size, 0);
+
+	ibi_response_queue_clear(deps->queue);
+	ibi_destroy(&buffering);
+	ibi_destroy(&streaming);
+}
+
+/* builds one fragment of the pending read data of an IBI */
+static void helper_pending_read_fragment(uint8_t *buffer, uint16_t sequence_id, uint8_t last_byte, uint32_t payload)
+{
+	struct bulk_ibi_response_header *header = (struct bulk_ibi_response_header *)buffer;
+	struct bulk_ibi_response_footer *footer = (struct bulk_ibi_response_footer *)(buffer + 2 * DWORD_SIZE);
+
+	helper_pending_read_response(buffer, payload);
+	header->sequence_id = sequence_id;
+	footer->last_byte = last_byte;
+}
+
+// test changing the chunk callback while an IBI is received does not change how that IBI is handled
+static void test_ibi_set_chunk_callback_mid_ibi(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint8_t buffer[3 * DWORD_SIZE] = { 0 };
+	uint32_t payload[2] = { 0xAAAAAAAA, 0xBBBBBBBB };
+	int data = 0;
+	struct ibi *ibi = ibi_init(deps->queue);
+
+	// the IBI started to be buffered so it is buffered until it completes
+	helper_pending_read_fragment(buffer, 0, FALSE, payload[0]);
+	assert_int_equal(ibi_handle_response(ibi, buffer, sizeof(buffer)), 0);
+	ibi_set_chunk_callback(ibi, ibi_chunk_callback, &data);
+	helper_pending_read_fragment(buffer, 1, TRUE, payload[1]);
+	assert_int_equal(ibi_handle_response(ibi, buffer, sizeof(buffer)), 0);
+	struct ibi_response *response = ibi_response_queue_back(deps->queue);
+	assert_true(response->completed);
+	assert_int_equal(response->size, sizeof(payload));
+	assert_memory_equal(response->data, payload, sizeof(payload));
+
+	// the IBI started to be streamed so it is streamed until it completes
+	expect_value_count(ibi_chunk_callback, size, sizeof(uint32_t), 2);
+	expect_value_count(ibi_chunk_callback, user_data, &data, 2);
+	helper_pending_read_fragment(buffer, 0, FALSE, payload[0]);
+	assert_int_equal(ibi_handle_response(ibi, buffer, sizeof(buffer)), 0);
+	ibi_set_chunk_callback(ibi, NULL, NULL);
+	helper_pending_read_fragment(buffer, 1, TRUE, payload[1]);
+	assert_int_equal(ibi_handle_response(ibi, buffer, sizeof(buffer)), 0);
+	response = ibi_response_queue_back(deps->queue);
+	assert_true(response->completed);
+	assert_int_equal(response->size, 0);
+
+	ibi_response_queue_clear(deps->queue);
+	ibi_destroy(&ibi);
+}
+
 int main()
 {
 	const struct CMUnitTest tests[] = {
@@ -177,6 +275,8 @@ int main()
 		cmocka_unit_test_setup_teardown(test_negative_ibi_call_pending_with_not_completed_responses, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_negative_ibi_call_pending_no_callback, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_negative_ibi_call_pending, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_set_chunk_callback_per_device, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_set_chunk_callback_mid_ibi, setup, teardown),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
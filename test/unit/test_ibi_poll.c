@@ -0,0 +1,180 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "ibi_i.h"
+#include "mocks.h"
+
+struct test_deps {
+	struct ibi_response_queue *queue;
+	struct ibi *ibi;
+};
+
+int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+	deps->queue = ibi_response_queue_get_queue();
+	deps->ibi = ibi_init(deps->queue);
+	*state = deps;
+	return 0;
+}
+
+int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	ibi_destroy(&deps->ibi);
+	ibi_response_queue_clear(deps->queue);
+	free(deps);
+	return 0;
+}
+
+/* simulates the arrival of an IBI notification followed by its completed IBI response */
+static void helper_complete_ibi(struct test_deps *deps, uint8_t address, uint32_t payload)
+{
+	struct notification notification = {
+		.type = NOTIFICATION_I3C_IBI,
+		.code = REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER
+	};
+	struct ibi_response *response = calloc(1, sizeof(struct ibi_response));
+	response->descriptor.address = address;
+	response->completed = 1;
+	response->data = calloc(1, sizeof(uint32_t));
+	memcpy(response->data, &payload, sizeof(payload));
+	response->size = sizeof(uint32_t);
+	ibi_response_queue_enqueue(deps->queue, response);
+	ibi_handle_notification(&notification, deps->ibi);
+}
+
+static void test_negative_ibi_poll_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[1];
+
+	assert_int_equal(ibi_enable_polling(NULL, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_enable_polling(deps->ibi, 0), RETURN_FAILURE);
+	assert_int_equal(ibi_poll(NULL, records, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_poll(deps->ibi, NULL, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_wait(NULL, 0), RETURN_FAILURE);
+	ibi_disable_polling(NULL);
+}
+
+static void test_negative_ibi_poll_polling_disabled(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[1];
+
+	helper_complete_ibi(deps, 0x08, 0xBADBEEF);
+
+	assert_int_equal(ibi_poll(deps->ibi, records, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_wait(deps->ibi, 0), RETURN_FAILURE);
+}
+
+static void test_ibi_wait_timeout(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[1];
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	assert_int_equal(ibi_wait(deps->ibi, 0), 0);
+	assert_int_equal(ibi_wait(deps->ibi, 1000), 0);
+	assert_int_equal(ibi_poll(deps->ibi, records, 1), 0);
+}
+
+static void test_ibi_poll_in_order(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[4];
+	uint32_t payload = 0;
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	helper_complete_ibi(deps, 0x08, 0xAAAAAAAA);
+	helper_complete_ibi(deps, 0x09, 0xBBBBBBBB);
+	helper_complete_ibi(deps, 0x0A, 0xCCCCCCCC);
+
+	assert_int_equal(ibi_wait(deps->ibi, -1), 3);
+
+	// only retrieve as many records as requested
+	assert_int_equal(ibi_poll(deps->ibi, records, 2), 2);
+	assert_int_equal(records[0].report, REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+	assert_int_equal(records[0].descriptor.address, 0x08);
+	assert_int_equal(records[0].size, sizeof(uint32_t));
+	memcpy(&payload, records[0].data, sizeof(payload));
+	assert_int_equal(payload, 0xAAAAAAAA);
+	assert_int_equal(records[1].descriptor.address, 0x09);
+	usbi3c_free_ibi_records(records, 2);
+	assert_null(records[0].data);
+
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 1);
+	assert_int_equal(records[0].descriptor.address, 0x0A);
+	usbi3c_free_ibi_records(records, 1);
+
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 0);
+	assert_int_equal(ibi_get_poll_overruns(deps->ibi), 0);
+}
+
+static void test_ibi_poll_queue_full(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[4];
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 2), 0);
+	helper_complete_ibi(deps, 0x08, 0xAAAAAAAA);
+	helper_complete_ibi(deps, 0x09, 0xBBBBBBBB);
+	helper_complete_ibi(deps, 0x0A, 0xCCCCCCCC);
+
+	// the newest IBI is the one dropped
+	assert_int_equal(ibi_get_poll_overruns(deps->ibi), 1);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 2);
+	assert_int_equal(records[0].descriptor.address, 0x08);
+	assert_int_equal(records[1].descriptor.address, 0x09);
+	usbi3c_free_ibi_records(records, 2);
+}
+
+static void test_ibi_poll_resize_queue(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[4];
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	helper_complete_ibi(deps, 0x08, 0xAAAAAAAA);
+	helper_complete_ibi(deps, 0x09, 0xBBBBBBBB);
+	helper_complete_ibi(deps, 0x0A, 0xCCCCCCCC);
+
+	// shrinking the queue keeps the oldest records
+	assert_int_equal(ibi_enable_polling(deps->ibi, 2), 0);
+	assert_int_equal(ibi_get_poll_overruns(deps->ibi), 1);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 2);
+	assert_int_equal(records[0].descriptor.address, 0x08);
+	assert_int_equal(records[1].descriptor.address, 0x09);
+	usbi3c_free_ibi_records(records, 2);
+
+	// pending records are discarded when polling is disabled
+	helper_complete_ibi(deps, 0x0B, 0xDDDDDDDD);
+	ibi_disable_polling(deps->ibi);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), RETURN_FAILURE);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_ibi_poll_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_negative_ibi_poll_polling_disabled, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_wait_timeout, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_poll_in_order, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_poll_queue_full, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_poll_resize_queue, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,200 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "ibi_i.h"
+#include "mocks.h"
+
+#define CHATTY_ADDRESS 0x08
+#define URGENT_ADDRESS 0x09
+#define NORMAL_ADDRESS 0x0A
+
+struct test_deps {
+	struct ibi_response_queue *queue;
+	struct ibi *ibi;
+};
+
+int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+	deps->queue = ibi_response_queue_get_queue();
+	deps->ibi = ibi_init(deps->queue);
+	*state = deps;
+	return 0;
+}
+
+int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	ibi_destroy(&deps->ibi);
+	ibi_response_queue_clear(deps->queue);
+	free(deps);
+	return 0;
+}
+
+static uint8_t priority_cb(uint8_t address, void *user_data)
+{
+	switch (address) {
+	case URGENT_ADDRESS:
+		return 10;
+	case NORMAL_ADDRESS:
+		return 100;
+	default:
+		return 200;
+	}
+}
+
+static void on_ibi_cb(uint8_t report, struct usbi3c_ibi *descriptor, uint8_t *data, size_t size, void *user_data)
+{
+	uint8_t address = descriptor->address;
+	uint8_t MDB = descriptor->MDB;
+	check_expected(address);
+	check_expected(MDB);
+}
+
+/* queues a completed IBI response */
+static void helper_enqueue_response(struct test_deps *deps, uint8_t address, uint8_t MDB)
+{
+	struct ibi_response *response = calloc(1, sizeof(struct ibi_response));
+	response->descriptor.address = address;
+	response->descriptor.MDB = MDB;
+	response->completed = 1;
+	ibi_response_queue_enqueue(deps->queue, response);
+}
+
+/* simulates the arrival of an IBI notification */
+static void helper_notify(struct test_deps *deps)
+{
+	struct notification notification = {
+		.type = NOTIFICATION_I3C_IBI,
+		.code = REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER
+	};
+	ibi_handle_notification(&notification, deps->ibi);
+}
+
+static void helper_expect_ibi(uint8_t address, uint8_t MDB)
+{
+	expect_value(on_ibi_cb, address, address);
+	expect_value(on_ibi_cb, MDB, MDB);
+}
+
+static void test_negative_ibi_priority_stats_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_priority_stats stats;
+
+	assert_int_equal(ibi_get_priority_stats(NULL, 0, &stats), RETURN_FAILURE);
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 0, NULL), RETURN_FAILURE);
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, USBI3C_IBI_PRIORITY_LEVELS, &stats), RETURN_FAILURE);
+	ibi_set_delivery_order(NULL, USBI3C_IBI_DELIVERY_PRIORITY);
+	ibi_set_priority_callback(NULL, priority_cb, NULL);
+}
+
+static void test_ibi_fifo_delivery(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	ibi_set_priority_callback(deps->ibi, priority_cb, NULL);
+	ibi_set_callback(deps->ibi, on_ibi_cb, NULL);
+	helper_notify(deps);
+	helper_notify(deps);
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x01);
+	helper_enqueue_response(deps, URGENT_ADDRESS, 0x02);
+
+	// IBIs are delivered one at a time in the order they were completed
+	helper_expect_ibi(CHATTY_ADDRESS, 0x01);
+	ibi_call_pending(deps->ibi);
+	helper_expect_ibi(URGENT_ADDRESS, 0x02);
+	ibi_call_pending(deps->ibi);
+}
+
+static void test_ibi_priority_delivery_callback(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_priority_stats stats;
+
+	ibi_set_priority_callback(deps->ibi, priority_cb, NULL);
+	ibi_set_delivery_order(deps->ibi, USBI3C_IBI_DELIVERY_PRIORITY);
+	ibi_set_callback(deps->ibi, on_ibi_cb, NULL);
+	for (int i = 0; i < 5; i++) {
+		helper_notify(deps);
+	}
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x01);
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x02);
+	helper_enqueue_response(deps, NORMAL_ADDRESS, 0x03);
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x04);
+	helper_enqueue_response(deps, URGENT_ADDRESS, 0x05);
+
+	// the IBIs of each target device are kept in order
+	helper_expect_ibi(URGENT_ADDRESS, 0x05);
+	helper_expect_ibi(NORMAL_ADDRESS, 0x03);
+	helper_expect_ibi(CHATTY_ADDRESS, 0x01);
+	helper_expect_ibi(CHATTY_ADDRESS, 0x02);
+	helper_expect_ibi(CHATTY_ADDRESS, 0x04);
+	ibi_call_pending(deps->ibi);
+	assert_int_equal(ibi_response_queue_size(deps->queue), 0);
+
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 0, &stats), 0);
+	assert_int_equal(stats.delivered, 1);
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 1, &stats), 0);
+	assert_int_equal(stats.delivered, 1);
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 2, &stats), 0);
+	assert_int_equal(stats.delivered, 0);
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 3, &stats), 0);
+	assert_int_equal(stats.delivered, 3);
+	assert_true(stats.max_delay_us <= stats.total_delay_us);
+}
+
+static void test_ibi_priority_delivery_poll(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_record records[4];
+	struct usbi3c_ibi_priority_stats stats;
+
+	ibi_set_priority_callback(deps->ibi, priority_cb, NULL);
+	ibi_set_delivery_order(deps->ibi, USBI3C_IBI_DELIVERY_PRIORITY);
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x01);
+	helper_notify(deps);
+	helper_enqueue_response(deps, CHATTY_ADDRESS, 0x02);
+	helper_notify(deps);
+	helper_enqueue_response(deps, URGENT_ADDRESS, 0x03);
+	helper_notify(deps);
+	helper_enqueue_response(deps, NORMAL_ADDRESS, 0x04);
+	helper_notify(deps);
+
+	// IBIs waiting in the poll queue are ordered by priority
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 4);
+	assert_int_equal(records[0].descriptor.MDB, 0x03);
+	assert_int_equal(records[1].descriptor.MDB, 0x04);
+	assert_int_equal(records[2].descriptor.MDB, 0x01);
+	assert_int_equal(records[3].descriptor.MDB, 0x02);
+	usbi3c_free_ibi_records(records, 4);
+
+	// the delay is measured until the IBIs are polled
+	assert_int_equal(ibi_get_priority_stats(deps->ibi, 3, &stats), 0);
+	assert_int_equal(stats.delivered, 2);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_ibi_priority_stats_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_fifo_delivery, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_priority_delivery_callback, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_priority_delivery_poll, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -134,6 +134,7 @@ static void test_ibi_response_queue_size_null(void **state)
 #define SET_SEQUENCE_ID(id) (((uint32_t)(id)) << 16)
 
 // Footer macros
+#define IBI_TIMESTAMP (1 << 10)
 #define PENDING_READ (1 << 12)
 #define LAST_BYTE (1 << 13)
 #define SET_VALID_BYTES(bytes) ((uint32_t)(bytes) << 14)
@@ -175,9 +176,9 @@ static int create_response_buffer(uint8_t **buffer_out, uint16_t sequence_id, ui
 static void test_ibi_response_handle_null(void **state)
 {
 	uint8_t fake_buffer = 1;
-	assert_int_equal(ibi_response_handle(NULL, &fake_buffer, 1), RETURN_FAILURE);
-	assert_int_equal(ibi_response_handle(queue, NULL, 0), RETURN_FAILURE);
-	assert_int_equal(ibi_response_handle(NULL, NULL, 0), RETURN_FAILURE);
+	assert_int_equal(ibi_response_handle(NULL, &fake_buffer, 1, NULL), RETURN_FAILURE);
+	assert_int_equal(ibi_response_handle(queue, NULL, 0, NULL), RETURN_FAILURE);
+	assert_int_equal(ibi_response_handle(NULL, NULL, 0, NULL), RETURN_FAILURE);
 }
 
 // test ibi_response handle buffers with small sizes
@@ -187,7 +188,7 @@ static void test_ibi_response_handle_small_buffer(void **state)
 	uint32_t buffer_size = sizeof(buffer);
 	int ret = 0;
 
-	ret = ibi_response_handle(queue, (uint8_t *)&buffer, buffer_size);
+	ret = ibi_response_handle(queue, (uint8_t *)&buffer, buffer_size, NULL);
 	assert_int_equal(ret, RETURN_FAILURE);
 }
 
@@ -203,7 +204,7 @@ static void test_ibi_response_handler_no_payload(void **state)
 	size_t buffer_size = create_response_buffer(&buffer, sequence_id, footer, NULL, 0);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	struct ibi_response *response = ibi_response_queue_back(queue);
@@ -227,7 +228,7 @@ static void test_ibi_response_handler_with_payload(void **state)
 	size_t buffer_size = create_response_buffer(&buffer, sequence_id, footer, NULL, 0);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	struct ibi_response *response = ibi_response_queue_back(queue);
@@ -247,7 +248,7 @@ static void test_ibi_response_handler_with_payload(void **state)
 	buffer_size = create_response_buffer(&buffer, sequence_id, footer, &payload_content, payload_size);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	response = ibi_response_queue_back(queue);
@@ -271,7 +272,7 @@ static void test_ibi_response_handler_multiple_initial_responses(void **state)
 	size_t buffer_size = create_response_buffer(&buffer, sequence_id, footer, NULL, 0);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	struct ibi_response *response = ibi_response_queue_back(queue);
@@ -291,7 +292,7 @@ static void test_ibi_response_handler_multiple_initial_responses(void **state)
 	buffer_size = create_response_buffer(&buffer, sequence_id, footer, (uint8_t *)&payload_content, payload_size);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	response = ibi_response_queue_back(queue);
@@ -310,7 +311,7 @@ static void test_ibi_response_handler_multiple_initial_responses(void **state)
 	buffer_size = create_response_buffer(&buffer, sequence_id, footer, NULL, 0);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	response = ibi_response_queue_front(queue);
@@ -336,7 +337,7 @@ static void test_ibi_response_handler_last_byte_without_initial_response(void **
 	size_t buffer_size = create_response_buffer(&buffer, sequence_id, footer, (uint8_t *)&payload_content, payload_size);
 
 	// handle response
-	ret = ibi_response_handle(queue, buffer, buffer_size);
+	ret = ibi_response_handle(queue, buffer, buffer_size, NULL);
 
 	// check response
 	assert_int_equal(ret, RETURN_FAILURE);
@@ -344,6 +345,181 @@ static void test_ibi_response_handler_last_byte_without_initial_response(void **
 	free(buffer);
 }
 
+// test ibi response handler joins all the fragments of a pending read payload
+static void test_ibi_response_handler_pending_read_multiple_fragments(void **state)
+{
+	uint8_t *buffer = NULL;
+	uint8_t payload_content[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+	size_t buffer_size = 0;
+
+	buffer_size = create_response_buffer(&buffer, 0, 0, NULL, 0);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, NULL), RETURN_SUCCESS);
+	free(buffer);
+
+	buffer_size = create_response_buffer(&buffer, 1, PENDING_READ, payload_content, 4);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, NULL), RETURN_SUCCESS);
+	free(buffer);
+
+	buffer_size = create_response_buffer(&buffer, 2, PENDING_READ | LAST_BYTE, payload_content + 4, 3);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, NULL), RETURN_SUCCESS);
+	free(buffer);
+
+	struct ibi_response *response = ibi_response_queue_back(queue);
+	assert_true(response->completed);
+	assert_int_equal(response->size, sizeof(payload_content));
+	assert_memory_equal(response->data, payload_content, sizeof(payload_content));
+}
+
+static void ibi_chunk_callback(struct usbi3c_ibi *descriptor, uint16_t sequence_id, uint8_t last_fragment, uint8_t *data, size_t size, void *user_data)
+{
+	check_expected(sequence_id);
+	check_expected(last_fragment);
+	check_expected(size);
+	if (size > 0) {
+		check_expected(data);
+	}
+	check_expected(user_data);
+}
+
+// test ibi response handler streams the pending read payload when a chunk callback is set
+static void test_ibi_response_handler_pending_read_streaming(void **state)
+{
+	uint8_t *buffer = NULL;
+	uint8_t payload_content[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A };
+	int user_data = 0;
+	size_t buffer_size = 0;
+	struct ibi_response_handlers handlers = { .on_ibi_chunk_cb = ibi_chunk_callback, .chunk_user_data = &user_data };
+
+	buffer_size = create_response_buffer(&buffer, 0, 0, NULL, 0);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	buffer_size = create_response_buffer(&buffer, 1, PENDING_READ, payload_content, 8);
+	expect_value(ibi_chunk_callback, sequence_id, 1);
+	expect_value(ibi_chunk_callback, last_fragment, FALSE);
+	expect_value(ibi_chunk_callback, size, 8);
+	expect_memory(ibi_chunk_callback, data, payload_content, 8);
+	expect_value(ibi_chunk_callback, user_data, &user_data);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	// the IBI is not completed until the last fragment is received
+	struct ibi_response *response = ibi_response_queue_back(queue);
+	assert_false(response->completed);
+
+	buffer_size = create_response_buffer(&buffer, 2, PENDING_READ | LAST_BYTE, payload_content + 8, 2);
+	expect_value(ibi_chunk_callback, sequence_id, 2);
+	expect_value(ibi_chunk_callback, last_fragment, TRUE);
+	expect_value(ibi_chunk_callback, size, 2);
+	expect_memory(ibi_chunk_callback, data, payload_content + 8, 2);
+	expect_value(ibi_chunk_callback, user_data, &user_data);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	// the payload was already delivered so the completed IBI has none
+	assert_true(response->completed);
+	assert_int_equal(response->size, 0);
+	assert_null(response->data);
+}
+
+// test the end of the stream is signaled even if the last response carries no pending read data
+static void test_ibi_response_handler_pending_read_streaming_empty_last_fragment(void **state)
+{
+	uint8_t *buffer = NULL;
+	uint32_t payload_content = 0x0BADBEEF;
+	size_t buffer_size = 0;
+	struct ibi_response_handlers handlers = { .on_ibi_chunk_cb = ibi_chunk_callback, .chunk_user_data = NULL };
+
+	buffer_size = create_response_buffer(&buffer, 0, PENDING_READ, (uint8_t *)&payload_content, sizeof(payload_content));
+	expect_value(ibi_chunk_callback, sequence_id, 0);
+	expect_value(ibi_chunk_callback, last_fragment, FALSE);
+	expect_value(ibi_chunk_callback, size, sizeof(payload_content));
+	expect_memory(ibi_chunk_callback, data, &payload_content, sizeof(payload_content));
+	expect_value(ibi_chunk_callback, user_data, NULL);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	buffer_size = create_response_buffer(&buffer, 1, LAST_BYTE, NULL, 0);
+	expect_value(ibi_chunk_callback, sequence_id, 1);
+	expect_value(ibi_chunk_callback, last_fragment, TRUE);
+	expect_value(ibi_chunk_callback, size, 0);
+	expect_value(ibi_chunk_callback, user_data, NULL);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	assert_true(ibi_response_queue_back(queue)->completed);
+}
+
+// test the timestamps of the host and the I3C function are captured with the IBI response
+static void test_ibi_response_handler_timestamp(void **state)
+{
+	uint8_t payload_content[] = { 0xAB, 0x00, 0x00, 0x00, 0x78, 0x56, 0x34, 0x12 };
+	uint64_t before = monotonic_time_us();
+	uint8_t *buffer = NULL;
+	size_t buffer_size = 0;
+
+	buffer_size = create_response_buffer(&buffer, 0, LAST_BYTE | IBI_TIMESTAMP, payload_content, sizeof(payload_content));
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, NULL), RETURN_SUCCESS);
+	free(buffer);
+
+	struct ibi_response *response = ibi_response_queue_back(queue);
+	assert_int_equal(response->descriptor.MDB, 0xAB);
+	assert_true(response->descriptor.ibi_timestamp);
+	assert_int_equal(response->descriptor.device_timestamp, 0x12345678);
+	assert_true(response->descriptor.response_time_us >= before);
+	assert_true(response->descriptor.response_time_us <= monotonic_time_us());
+}
+
+static int ibi_admit_callback(const struct usbi3c_ibi *descriptor, void *user_data)
+{
+	int *admitted = (int *)user_data;
+	uint8_t MDB = descriptor->MDB;
+
+	check_expected(MDB);
+
+	return (*admitted)-- > 0;
+}
+
+// test an IBI rejected when its response starts is dropped along with the rest of its payload
+static void test_ibi_response_handler_dropped(void **state)
+{
+	uint8_t payload_content[] = { 0xAB, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+	struct ibi_response_handlers handlers = { 0 };
+	uint8_t *buffer = NULL;
+	size_t buffer_size = 0;
+	int admitted = 0;
+
+	handlers.admit_cb = ibi_admit_callback;
+	handlers.user_data = &admitted;
+
+	buffer_size = create_response_buffer(&buffer, 0, PENDING_READ, payload_content, 4);
+	expect_value(ibi_admit_callback, MDB, 0xAB);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+
+	// the rest of the payload is not checked again nor buffered
+	buffer_size = create_response_buffer(&buffer, 1, PENDING_READ | LAST_BYTE, payload_content + 4, 4);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+	assert_int_equal(ibi_response_queue_size(queue), 0);
+
+	// the next IBI is queued after the one dropped
+	admitted = 1;
+	payload_content[0] = 0xCD;
+	buffer_size = create_response_buffer(&buffer, 0, LAST_BYTE, payload_content, 4);
+	expect_value(ibi_admit_callback, MDB, 0xCD);
+	assert_int_equal(ibi_response_handle(queue, buffer, buffer_size, &handlers), RETURN_SUCCESS);
+	free(buffer);
+	assert_int_equal(ibi_response_queue_size(queue), 1);
+	assert_true(ibi_response_queue_back(queue)->completed);
+	assert_int_equal(ibi_response_queue_back(queue)->size, 0);
+
+	// the notification of the IBI dropped is the first one to be discarded
+	assert_true(ibi_response_queue_take_dropped(queue));
+	assert_false(ibi_response_queue_take_dropped(queue));
+	assert_false(ibi_response_queue_take_dropped(NULL));
+}
+
 int main()
 {
 	const struct CMUnitTest tests[] = {
@@ -365,6 +541,11 @@ int main()
 		cmocka_unit_test_setup_teardown(test_ibi_response_handler_with_payload, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_ibi_response_handler_multiple_initial_responses, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_ibi_response_handler_last_byte_without_initial_response, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_response_handler_pending_read_multiple_fragments, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_response_handler_pending_read_streaming, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_response_handler_pending_read_streaming_empty_last_fragment, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_response_handler_timestamp, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_response_handler_dropped, setup, teardown),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
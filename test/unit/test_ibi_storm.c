@@ -0,0 +1,386 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <unistd.h>
+#include "helpers.h"
+#include "ibi_i.h"
+#include "mocks.h"
+
+#define TARGET_ADDRESS 0x08
+
+struct test_deps {
+	struct ibi_storm *storm;
+	struct ibi_response_queue *queue;
+	struct ibi *ibi;
+};
+
+int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+	deps->storm = ibi_storm_init();
+	deps->queue = ibi_response_queue_get_queue();
+	deps->ibi = ibi_init(deps->queue);
+	*state = deps;
+	return 0;
+}
+
+int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	ibi_storm_destroy(&deps->storm);
+	ibi_destroy(&deps->ibi);
+	ibi_response_queue_clear(deps->queue);
+	free(deps);
+	return 0;
+}
+
+/* runs an IBI from the target device with the given MDB through the storm protection */
+static enum ibi_storm_verdict helper_filter(struct test_deps *deps, uint8_t MDB, uint64_t now_us, struct ibi_storm_summary *summary)
+{
+	struct usbi3c_ibi descriptor = { 0 };
+	enum ibi_storm_verdict verdict;
+	descriptor.address = TARGET_ADDRESS;
+	descriptor.MDB = MDB;
+	summary->descriptor.repeat_count = 0;
+	verdict = ibi_storm_admit(deps->storm, TARGET_ADDRESS, now_us);
+	if (verdict != IBI_STORM_DELIVER) {
+		return verdict;
+	}
+	return ibi_storm_filter(deps->storm, TARGET_ADDRESS, REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER, &descriptor, now_us, summary);
+}
+
+/* simulates the arrival of a completed IBI response from the target device */
+static void helper_receive_response(struct test_deps *deps, uint8_t MDB)
+{
+	uint8_t buffer[3 * DWORD_SIZE] = { 0 };
+	struct bulk_ibi_response_header *header = (struct bulk_ibi_response_header *)buffer;
+	struct bulk_ibi_response_footer *footer = (struct bulk_ibi_response_footer *)(buffer + 2 * DWORD_SIZE);
+
+	header->tag = INTERRUPT_BULK_RESPONSE;
+	buffer[DWORD_SIZE] = MDB;
+	footer->target_address = TARGET_ADDRESS;
+	footer->last_byte = 1;
+	assert_int_equal(ibi_handle_response(deps->ibi, buffer, sizeof(buffer)), 0);
+	ibi_call_pending(deps->ibi);
+}
+
+/* simulates the arrival of an IBI notification */
+static void helper_notify(struct test_deps *deps, uint8_t code)
+{
+	struct notification notification = {
+		.type = NOTIFICATION_I3C_IBI,
+		.code = code
+	};
+	ibi_handle_notification(&notification, deps->ibi);
+}
+
+/* simulates the arrival of a completed IBI response followed by its IBI notification */
+static void helper_complete_ibi(struct test_deps *deps, uint8_t MDB)
+{
+	helper_receive_response(deps, MDB);
+	helper_notify(deps, REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+}
+
+static void on_ibi_storm_cb(uint32_t target_id, void *user_data)
+{
+	int *disabled = (int *)user_data;
+	check_expected(target_id);
+	(*disabled)++;
+}
+
+static void test_negative_ibi_storm_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct ibi_storm_summary summary;
+
+	assert_int_equal(ibi_storm_set_rate_limit(NULL, TARGET_ADDRESS, 1, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_storm_set_rate_limit(deps->storm, 0, 1, 1), RETURN_FAILURE);
+	assert_int_equal(ibi_storm_get_counters(NULL, TARGET_ADDRESS, &counters), RETURN_FAILURE);
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, NULL), RETURN_FAILURE);
+	assert_int_equal(ibi_storm_get_counters(deps->storm, 0, &counters), RETURN_FAILURE);
+	assert_int_equal(ibi_storm_pop_expired(NULL, 0, &summary), FALSE);
+	// without a storm protection every IBI is delivered
+	assert_int_equal(ibi_storm_filter(NULL, TARGET_ADDRESS, 0, NULL, 0, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(summary.descriptor.repeat_count, 0);
+	// IBIs from target devices that cannot be identified are not protected
+	assert_int_equal(ibi_storm_admit(deps->storm, 0, 0), IBI_STORM_DELIVER);
+}
+
+static void test_ibi_storm_disabled_by_default(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct ibi_storm_summary summary;
+
+	for (int i = 0; i < 100; i++) {
+		assert_int_equal(helper_filter(deps, 0xAB, i, &summary), IBI_STORM_DELIVER);
+		assert_int_equal(summary.descriptor.repeat_count, 0);
+	}
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_int_equal(counters.delivered, 100);
+	assert_int_equal(counters.rate_limited, 0);
+	assert_int_equal(counters.coalesced, 0);
+}
+
+static void test_ibi_storm_rate_limit(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct ibi_storm_summary summary;
+	uint64_t now = 0;
+
+	// 10 IBIs per second with bursts of 2
+	assert_int_equal(ibi_storm_set_rate_limit(deps->storm, TARGET_ADDRESS, 10, 2), 0);
+	now = monotonic_time_us();
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x02, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x03, now, &summary), IBI_STORM_RATE_LIMITED);
+
+	// a token is added every 100 ms
+	now += 100000;
+	assert_int_equal(helper_filter(deps, 0x04, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x05, now, &summary), IBI_STORM_RATE_LIMITED);
+
+	// the bucket does not hold more tokens than the burst
+	now += 10000000;
+	assert_int_equal(helper_filter(deps, 0x06, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x07, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x08, now, &summary), IBI_STORM_RATE_LIMITED);
+
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_int_equal(counters.delivered, 5);
+	assert_int_equal(counters.rate_limited, 3);
+	assert_false(counters.ibi_disabled);
+}
+
+static void test_ibi_storm_coalescing(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct ibi_storm_summary summary;
+
+	ibi_storm_set_coalescing_window(deps->storm, 1000);
+	assert_int_equal(helper_filter(deps, 0xAB, 0, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0xAB, 100, &summary), IBI_STORM_COALESCED);
+	assert_int_equal(helper_filter(deps, 0xAB, 200, &summary), IBI_STORM_COALESCED);
+	assert_int_equal(ibi_storm_pop_expired(deps->storm, 500, &summary), FALSE);
+
+	// a different MDB closes the window and the summary has to be delivered first
+	assert_int_equal(helper_filter(deps, 0xCD, 300, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(summary.descriptor.address, TARGET_ADDRESS);
+	assert_int_equal(summary.descriptor.MDB, 0xAB);
+	assert_int_equal(summary.descriptor.repeat_count, 2);
+
+	// the window of the new MDB closes once it expires
+	assert_int_equal(helper_filter(deps, 0xCD, 400, &summary), IBI_STORM_COALESCED);
+	assert_int_equal(summary.descriptor.repeat_count, 0);
+	assert_int_equal(ibi_storm_pop_expired(deps->storm, 1300, &summary), TRUE);
+	assert_int_equal(summary.descriptor.MDB, 0xCD);
+	assert_int_equal(summary.descriptor.repeat_count, 1);
+	assert_int_equal(ibi_storm_pop_expired(deps->storm, 1300, &summary), FALSE);
+
+	// windows without coalesced IBIs have no summary
+	assert_int_equal(helper_filter(deps, 0xCD, 2000, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(ibi_storm_pop_expired(deps->storm, 5000, &summary), FALSE);
+
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_int_equal(counters.delivered, 5);
+	assert_int_equal(counters.coalesced, 3);
+}
+
+static void test_ibi_storm_disable_threshold(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct ibi_storm_summary summary;
+	uint64_t now = 0;
+
+	assert_int_equal(ibi_storm_set_rate_limit(deps->storm, TARGET_ADDRESS, 1, 1), 0);
+	now = monotonic_time_us();
+	ibi_storm_set_disable_threshold(deps->storm, 2);
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_DELIVER);
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_RATE_LIMITED);
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_RATE_LIMITED);
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_DISABLE_TARGET);
+
+	// the target is only disabled once, and its IBIs are dropped even after the bucket refills
+	now += 10000000;
+	assert_int_equal(helper_filter(deps, 0x01, now, &summary), IBI_STORM_RATE_LIMITED);
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_int_equal(counters.rate_limited, 4);
+
+	// the target is reported as disabled once the request to disable it completes
+	assert_false(counters.ibi_disabled);
+	ibi_storm_set_disabled(deps->storm, TARGET_ADDRESS);
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_true(counters.ibi_disabled);
+
+	// configuring the rate limit again clears the disabled state
+	assert_int_equal(ibi_storm_set_rate_limit(deps->storm, TARGET_ADDRESS, 1, 1), 0);
+	assert_int_equal(ibi_storm_get_counters(deps->storm, TARGET_ADDRESS, &counters), 0);
+	assert_false(counters.ibi_disabled);
+}
+
+static void test_ibi_storm_delivery(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct ibi_storm *storm = ibi_get_storm(deps->ibi);
+	struct usbi3c_ibi_record records[4];
+	int disabled = 0;
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	ibi_set_storm_callback(deps->ibi, on_ibi_storm_cb, &disabled);
+	ibi_storm_set_coalescing_window(storm, 10000000);
+	assert_int_equal(ibi_storm_set_rate_limit(storm, TARGET_ADDRESS, 1, 3), 0);
+	ibi_storm_set_disable_threshold(storm, 1);
+
+	helper_complete_ibi(deps, 0xAB);
+	helper_complete_ibi(deps, 0xAB);
+	helper_complete_ibi(deps, 0xCD);
+	helper_complete_ibi(deps, 0xCD);
+	expect_value(on_ibi_storm_cb, target_id, TARGET_ADDRESS);
+	helper_complete_ibi(deps, 0xCD);
+	assert_int_equal(disabled, 1);
+
+	// the summary of the coalesced IBIs is delivered before the IBI that closed the window
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 3);
+	assert_int_equal(records[0].descriptor.MDB, 0xAB);
+	assert_int_equal(records[0].descriptor.repeat_count, 0);
+	assert_int_equal(records[1].descriptor.MDB, 0xAB);
+	assert_int_equal(records[1].descriptor.repeat_count, 1);
+	assert_null(records[1].data);
+	assert_int_equal(records[2].descriptor.MDB, 0xCD);
+	assert_int_equal(records[2].descriptor.repeat_count, 0);
+	usbi3c_free_ibi_records(records, 3);
+}
+
+static void test_ibi_storm_rate_limit_notifications(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct ibi_storm *storm = ibi_get_storm(deps->ibi);
+	struct usbi3c_ibi_record records[4];
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	assert_int_equal(ibi_storm_set_rate_limit(storm, TARGET_ADDRESS, 1, 1), 0);
+
+	// notifications received before their IBI response
+	helper_notify(deps, REGULAR_IBI_NO_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+	helper_receive_response(deps, 0x01);
+	helper_notify(deps, REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+	helper_receive_response(deps, 0x02);
+
+	// notifications received after their IBI response
+	assert_int_equal(ibi_storm_set_rate_limit(storm, TARGET_ADDRESS, 1, 1), 0);
+	helper_receive_response(deps, 0x03);
+	helper_notify(deps, IBI_AUTOCOMMAND_INITIATED_BY_I3C_CONTROLLER);
+	helper_receive_response(deps, 0x04);
+	helper_notify(deps, REGULAR_IBI_NACKD_BY_I3C_CONTROLLER);
+
+	assert_int_equal(ibi_storm_set_rate_limit(storm, TARGET_ADDRESS, 1, 1), 0);
+	helper_complete_ibi(deps, 0x05);
+
+	// the notifications of the IBIs dropped are discarded along with them
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 3);
+	assert_int_equal(records[0].report, REGULAR_IBI_NO_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+	assert_int_equal(records[0].descriptor.MDB, 0x01);
+	assert_int_equal(records[1].report, IBI_AUTOCOMMAND_INITIATED_BY_I3C_CONTROLLER);
+	assert_int_equal(records[1].descriptor.MDB, 0x03);
+	assert_int_equal(records[2].report, REGULAR_IBI_PAYLOAD_ACK_BY_I3C_CONTROLLER);
+	assert_int_equal(records[2].descriptor.MDB, 0x05);
+	usbi3c_free_ibi_records(records, 3);
+}
+
+static void test_ibi_storm_summary_flushed(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct ibi_storm *storm = ibi_get_storm(deps->ibi);
+	struct usbi3c_ibi_record records[4];
+	uint64_t start = 0;
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	ibi_storm_set_coalescing_window(storm, 20000);
+
+	helper_complete_ibi(deps, 0xAB);
+	helper_complete_ibi(deps, 0xAB);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 1);
+	usbi3c_free_ibi_records(records, 1);
+
+	// the wait is woken up by the summary once the window expires, without another IBI
+	start = monotonic_time_us();
+	assert_int_equal(ibi_wait(deps->ibi, 1000000), 1);
+	assert_true(monotonic_time_us() - start >= 15000);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 1);
+	assert_int_equal(records[0].descriptor.MDB, 0xAB);
+	assert_int_equal(records[0].descriptor.repeat_count, 1);
+	usbi3c_free_ibi_records(records, 1);
+
+	// polling delivers the summaries of the windows that already expired
+	helper_complete_ibi(deps, 0xCD);
+	helper_complete_ibi(deps, 0xCD);
+	helper_complete_ibi(deps, 0xCD);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 1);
+	usbi3c_free_ibi_records(records, 1);
+	usleep(25000);
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 1);
+	assert_int_equal(records[0].descriptor.MDB, 0xCD);
+	assert_int_equal(records[0].descriptor.repeat_count, 2);
+	usbi3c_free_ibi_records(records, 1);
+}
+
+static void on_ibi_cb(uint8_t report, struct usbi3c_ibi *descriptor, uint8_t *data, size_t size, void *user_data)
+{
+	int *called = (int *)user_data;
+	(*called)++;
+}
+
+static void test_ibi_storm_summary_flushed_not_called_back(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct ibi_storm *storm = ibi_get_storm(deps->ibi);
+	struct usbi3c_ibi_record records[4];
+	int called = 0;
+
+	assert_int_equal(ibi_enable_polling(deps->ibi, 4), 0);
+	ibi_set_callback(deps->ibi, on_ibi_cb, &called);
+	ibi_storm_set_coalescing_window(storm, 10000);
+
+	helper_complete_ibi(deps, 0xAB);
+	helper_complete_ibi(deps, 0xAB);
+	assert_int_equal(called, 1);
+	usleep(15000);
+
+	// the summary is only queued for polling, the callback runs on the thread handling the responses
+	assert_int_equal(ibi_poll(deps->ibi, records, 4), 2);
+	assert_int_equal(records[1].descriptor.repeat_count, 1);
+	assert_int_equal(called, 1);
+	usbi3c_free_ibi_records(records, 2);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_ibi_storm_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_disabled_by_default, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_rate_limit, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_coalescing, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_disable_threshold, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_delivery, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_rate_limit_notifications, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_summary_flushed, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ibi_storm_summary_flushed_not_called_back, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -242,6 +242,57 @@ static void test_stalled_request_canceled_with_dependent(void **state)
 	free(buffer);
 }
 
+/* adds a command to the request tracker list to simulate it was already transferred */
+static struct list *helper_track_command(struct list *requests, uint16_t request_id, int dependent_on_previous, int reattempt_count)
+{
+	struct regular_request *request = (struct regular_request *)calloc(1, sizeof(struct regular_request));
+
+	request->request_id = request_id;
+	request->total_commands = 2;
+	request->dependent_on_previous = dependent_on_previous;
+	request->reattempt_count = reattempt_count;
+
+	return list_append(requests, request);
+}
+
+/* Test to validate that the requests that depend on a cancelled request are found when the request IDs wrap around */
+static void test_stalled_request_canceled_with_dependent_wraparound(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct regular_request *request = NULL;
+	struct list *requests = NULL;
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+	const int REATTEMPT_MAX = 2;
+
+	/* two requests with two commands each, the second request depends on the first one
+	 * and the IDs wrap around in the middle of it, the third request does not depend on them */
+	requests = helper_track_command(requests, UINT16_MAX - 2, FALSE, 0);
+	requests = helper_track_command(requests, UINT16_MAX - 1, TRUE, REATTEMPT_MAX);
+	requests = helper_track_command(requests, UINT16_MAX, TRUE, 0);
+	requests = helper_track_command(requests, 0, TRUE, 0);
+	requests = helper_track_command(requests, 1, FALSE, 0);
+	requests = helper_track_command(requests, 2, TRUE, 0);
+	deps->usbi3c_dev->request_tracker->regular_requests->requests = requests;
+
+	buffer_size = helper_create_notification_buffer(&buffer, NOTIFICATION_STALL_ON_NACK, UINT16_MAX - 1);
+	helper_trigger_notification(buffer, buffer_size);
+	mock_cancel_or_resume_bulk_request(RETURN_SUCCESS);
+	usb_wait_for_next_event(deps->usbi3c_dev->usb_dev);
+
+	/* the commands after the stalled one are cancelled until the third request */
+	requests = deps->usbi3c_dev->request_tracker->regular_requests->requests;
+	assert_int_equal(list_len(requests), 3);
+	request = (struct regular_request *)requests->data;
+	assert_int_equal(request->request_id, UINT16_MAX - 2);
+	request = (struct regular_request *)requests->next->data;
+	assert_int_equal(request->request_id, 1);
+	request = (struct regular_request *)requests->next->next->data;
+	assert_int_equal(request->request_id, 2);
+
+	free(buffer);
+}
+
 int main(void)
 {
 	/* Unit tests for the "Stall on Nack" notification handler */
@@ -251,6 +302,7 @@ int main(void)
 		cmocka_unit_test_setup_teardown(test_stalled_request_reattempted, test_setup, test_teardown),
 		cmocka_unit_test_setup_teardown(test_stalled_request_canceled, test_setup, test_teardown),
 		cmocka_unit_test_setup_teardown(test_stalled_request_canceled_with_dependent, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_stalled_request_canceled_with_dependent_wraparound, test_setup, test_teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
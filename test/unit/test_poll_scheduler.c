@@ -0,0 +1,202 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+#include "poll_scheduler_i.h"
+
+#define TICK_US 1000
+#define READ_SIZE 4
+
+struct test_deps {
+	struct poll_scheduler *scheduler;
+	atomic_int requests_sent;
+	atomic_int reads_sent;
+	int send_result;
+};
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	return 0;
+}
+
+static int send_cb(struct list *requests, void *context)
+{
+	struct test_deps *deps = (struct test_deps *)context;
+
+	atomic_fetch_add(&deps->requests_sent, 1);
+	atomic_fetch_add(&deps->reads_sent, list_len(requests));
+
+	return deps->send_result;
+}
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->scheduler = poll_scheduler_init(TICK_US, 0, send_cb, deps);
+	*state = deps;
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	poll_scheduler_destroy(&deps->scheduler);
+	free(deps);
+
+	return 0;
+}
+
+/* collects the reads due at a time and returns the address of each one of them */
+static int helper_collect(struct test_deps *deps, uint64_t now_us, uint8_t *addresses)
+{
+	struct list *requests = NULL;
+	struct list *node = NULL;
+	int count = 0;
+	int i = 0;
+
+	count = poll_scheduler_collect(deps->scheduler, now_us, &requests);
+	for (node = requests, i = 0; node; node = node->next, i++) {
+		addresses[i] = ((struct poll_request *)node->data)->address;
+	}
+	list_free_list_and_data(&requests, free);
+
+	return count;
+}
+
+static void test_negative_poll_scheduler_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_poll_stats stats;
+	struct list *requests = NULL;
+
+	assert_null(poll_scheduler_init(0, 0, send_cb, deps));
+	assert_null(poll_scheduler_init(TICK_US, 0, NULL, deps));
+	assert_int_equal(poll_scheduler_add(NULL, 0x08, READ_SIZE, TICK_US, on_response_cb, NULL, 0), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_add(deps->scheduler, 0x08, READ_SIZE, TICK_US, NULL, NULL, 0), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_add(deps->scheduler, 0x08, READ_SIZE, 0, on_response_cb, NULL, 0), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_remove(deps->scheduler, 0), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_get_stats(deps->scheduler, 0, &stats), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_collect(NULL, 0, &requests), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_start(NULL), RETURN_FAILURE);
+}
+
+/* the polls that fall due in the same tick are collected together, and the phases
+ * of the polls spread them across the ticks */
+static void test_poll_scheduler_tick_batching(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_poll_stats stats;
+	uint8_t addresses[3];
+	int a, b, c;
+
+	a = poll_scheduler_add(deps->scheduler, 0x08, READ_SIZE, 2 * TICK_US, on_response_cb, NULL, 0);
+	b = poll_scheduler_add(deps->scheduler, 0x09, READ_SIZE, 2 * TICK_US, on_response_cb, NULL, 0);
+	c = poll_scheduler_add(deps->scheduler, 0x0A, READ_SIZE, 4 * TICK_US, on_response_cb, NULL, 0);
+	assert_true(a >= 0 && b > a && c > b);
+
+	// the second poll with the same period is moved to the idle ticks of the first one
+	assert_int_equal(poll_scheduler_get_stats(deps->scheduler, a, &stats), 0);
+	assert_int_equal(stats.phase_offset_us, 0);
+	assert_int_equal(poll_scheduler_get_stats(deps->scheduler, b, &stats), 0);
+	assert_int_equal(stats.phase_offset_us, TICK_US);
+	assert_int_equal(stats.period_us, 2 * TICK_US);
+
+	assert_int_equal(helper_collect(deps, 1 * TICK_US, addresses), 1);
+	assert_int_equal(addresses[0], 0x09);
+	assert_int_equal(helper_collect(deps, 2 * TICK_US, addresses), 1);
+	assert_int_equal(addresses[0], 0x08);
+	assert_int_equal(helper_collect(deps, 3 * TICK_US, addresses), 1);
+	assert_int_equal(addresses[0], 0x09);
+	// the polls due in the same tick are sent together
+	assert_int_equal(helper_collect(deps, 4 * TICK_US, addresses), 2);
+	assert_int_equal(addresses[0], 0x08);
+	assert_int_equal(addresses[1], 0x0A);
+	// nothing else is due in the same tick
+	assert_int_equal(helper_collect(deps, 4 * TICK_US + 500, addresses), 0);
+
+	assert_int_equal(poll_scheduler_remove(deps->scheduler, b), 0);
+	assert_int_equal(helper_collect(deps, 5 * TICK_US, addresses), 0);
+	assert_int_equal(poll_scheduler_tick(deps->scheduler, 6 * TICK_US), 1);
+	assert_int_equal(atomic_load(&deps->requests_sent), 1);
+}
+
+/* late reads are counted as jitter, and skipped periods as deadline misses */
+static void test_poll_scheduler_deadline_misses(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_poll_stats stats;
+	uint8_t addresses[1];
+	int id;
+
+	id = poll_scheduler_add(deps->scheduler, 0x08, READ_SIZE, TICK_US, on_response_cb, NULL, 0);
+
+	assert_int_equal(helper_collect(deps, TICK_US + 500, addresses), 1);
+	// the reads due in ticks 2 to 4 were not sent in time, only one read is sent for them
+	assert_int_equal(helper_collect(deps, 5 * TICK_US + 200, addresses), 1);
+
+	assert_int_equal(poll_scheduler_get_stats(deps->scheduler, id, &stats), 0);
+	assert_int_equal(stats.polls, 2);
+	assert_int_equal(stats.deadline_misses, 3);
+	assert_int_equal(stats.max_jitter_us, 500);
+	assert_int_equal(stats.mean_jitter_us, 350);
+
+	// the reads that cannot be sent are deadline misses too
+	deps->send_result = RETURN_FAILURE;
+	assert_int_equal(poll_scheduler_tick(deps->scheduler, 6 * TICK_US), RETURN_FAILURE);
+	assert_int_equal(poll_scheduler_get_stats(deps->scheduler, id, &stats), 0);
+	assert_int_equal(stats.deadline_misses, 4);
+}
+
+/* the scheduler thread sends the polls on its own */
+static void test_poll_scheduler_thread(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	poll_scheduler_destroy(&deps->scheduler);
+	deps->scheduler = poll_scheduler_init(TICK_US, monotonic_time_us(), send_cb, deps);
+	assert_int_equal(poll_scheduler_start(deps->scheduler), 0);
+	assert_int_equal(poll_scheduler_start(deps->scheduler), RETURN_FAILURE);
+	poll_scheduler_add(deps->scheduler, 0x08, READ_SIZE, TICK_US, on_response_cb, NULL, monotonic_time_us());
+	poll_scheduler_add(deps->scheduler, 0x09, READ_SIZE, TICK_US, on_response_cb, NULL, monotonic_time_us());
+
+	for (int i = 0; i < 1000 && atomic_load(&deps->requests_sent) < 5; i++) {
+		usleep(1000);
+	}
+	assert_true(atomic_load(&deps->requests_sent) >= 5);
+
+	// the scheduler is stopped when destroyed
+	poll_scheduler_destroy(&deps->scheduler);
+	// both polls fall due in every tick and are always sent together
+	assert_int_equal(atomic_load(&deps->reads_sent), 2 * atomic_load(&deps->requests_sent));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_poll_scheduler_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_poll_scheduler_tick_batching, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_poll_scheduler_deadline_misses, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_poll_scheduler_thread, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,174 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "request_id_i.h"
+
+struct test_deps {
+	struct request_id_allocator *allocator;
+};
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->allocator = request_id_allocator_init();
+	*state = deps;
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	request_id_allocator_destroy(&deps->allocator);
+	free(deps);
+
+	return 0;
+}
+
+static void test_negative_request_id_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint16_t ids[1];
+
+	assert_int_equal(request_id_alloc(NULL, ids, 1), RETURN_FAILURE);
+	assert_int_equal(request_id_alloc(deps->allocator, NULL, 1), RETURN_FAILURE);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 0), RETURN_FAILURE);
+	assert_int_equal(request_id_set_max_in_flight(NULL, 1), RETURN_FAILURE);
+	assert_int_equal(request_id_set_max_in_flight(deps->allocator, 0), RETURN_FAILURE);
+	assert_int_equal(request_id_set_max_in_flight(deps->allocator, REQUEST_ID_HALF_RANGE + 1), RETURN_FAILURE);
+	assert_int_equal(request_id_in_use(NULL), 0);
+	request_id_free(NULL, 0);
+	request_id_allocator_destroy(NULL);
+}
+
+/* every ID is issued, including the last one, before wrapping around */
+static void test_request_id_wraparound(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint16_t ids[3];
+
+	deps->allocator->next = UINT16_MAX - 1;
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 3), 0);
+	assert_int_equal(ids[0], UINT16_MAX - 1);
+	assert_int_equal(ids[1], UINT16_MAX);
+	assert_int_equal(ids[2], 0);
+	assert_int_equal(deps->allocator->next, 1);
+	assert_int_equal(request_id_in_use(deps->allocator), 3);
+
+	assert_true(request_id_is_after(0, UINT16_MAX));
+	assert_true(request_id_is_after(ids[2], ids[0]));
+	assert_false(request_id_is_after(UINT16_MAX, 0));
+	assert_false(request_id_is_after(5, 5));
+	assert_true(request_id_is_after(5, 4));
+	assert_false(request_id_is_after(REQUEST_ID_HALF_RANGE, 0));
+}
+
+/* an ID is not issued again while it is in use */
+static void test_request_id_skip_in_use(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint16_t ids[4];
+
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), 0);
+	assert_int_equal(ids[0], 0);
+	assert_int_equal(ids[1], 1);
+	request_id_free(deps->allocator, ids[1]);
+
+	/* the counter went around while ID 0 was still in use */
+	deps->allocator->next = 0;
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), 0);
+	assert_int_equal(ids[0], 1);
+	assert_int_equal(ids[1], 2);
+	assert_int_equal(request_id_in_use(deps->allocator), 3);
+
+	// freeing an ID twice does nothing
+	request_id_free(deps->allocator, 2);
+	request_id_free(deps->allocator, 2);
+	assert_int_equal(request_id_in_use(deps->allocator), 2);
+}
+
+/* no IDs are issued past the max in flight, and none of the IDs requested is issued in that case */
+static void test_request_id_max_in_flight(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint16_t ids[4];
+
+	assert_int_equal(request_id_set_max_in_flight(deps->allocator, 4), 0);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 3), 0);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), RETURN_FAILURE);
+	assert_int_equal(request_id_in_use(deps->allocator), 3);
+	assert_int_equal(deps->allocator->next, 3);
+
+	request_id_free(deps->allocator, 0);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), 0);
+	assert_int_equal(ids[0], 3);
+	assert_int_equal(ids[1], 4);
+	assert_int_equal(request_id_in_use(deps->allocator), 4);
+}
+
+/* the IDs in use are kept within half the range from the oldest one so they can be compared */
+static void test_request_id_half_range(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint16_t ids[2];
+
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 1), 0);
+	assert_int_equal(ids[0], 0);
+
+	deps->allocator->next = REQUEST_ID_HALF_RANGE - 1;
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), RETURN_FAILURE);
+	assert_int_equal(request_id_in_use(deps->allocator), 1);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 1), 0);
+	assert_int_equal(ids[0], REQUEST_ID_HALF_RANGE - 1);
+
+	/* once the oldest ID is freed the next one in use becomes the oldest */
+	request_id_free(deps->allocator, 0);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), 0);
+	assert_int_equal(ids[0], REQUEST_ID_HALF_RANGE);
+	assert_int_equal(ids[1], REQUEST_ID_HALF_RANGE + 1);
+}
+
+/* each allocator issues its IDs regardless of the IDs issued by the others */
+static void test_request_id_per_allocator(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct request_id_allocator *other = request_id_allocator_init();
+	uint16_t ids[2];
+
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 2), 0);
+	assert_int_equal(request_id_alloc(other, ids, 1), 0);
+	assert_int_equal(ids[0], 0);
+	assert_int_equal(request_id_alloc(deps->allocator, ids, 1), 0);
+	assert_int_equal(ids[0], 2);
+
+	request_id_allocator_destroy(&other);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_request_id_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_request_id_wraparound, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_request_id_skip_in_use, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_request_id_max_in_flight, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_request_id_half_range, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_request_id_per_allocator, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,167 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <unistd.h>
+
+#include "helpers.h"
+#include "send_window_i.h"
+
+struct test_deps {
+	struct send_window *window;
+	int writable_called;
+};
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->window = send_window_init();
+	*state = deps;
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	send_window_destroy(&deps->window);
+	free(deps);
+
+	return 0;
+}
+
+static void on_writable_cb(void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+
+	deps->writable_called++;
+}
+
+static void test_negative_send_window_null_params(void **state)
+{
+	struct usbi3c_submit_window_stats stats;
+
+	assert_int_equal(send_window_reserve(NULL, 100, TRUE), 0);
+	assert_int_equal(send_window_refuse(NULL, 100), RETURN_FAILURE);
+	assert_int_equal(send_window_get_event_fd(NULL), RETURN_FAILURE);
+	assert_int_equal(send_window_get_stats(NULL, &stats), RETURN_FAILURE);
+	send_window_release(NULL, 100);
+	send_window_cancel(NULL, 100);
+	send_window_set_limits(NULL, 1, 1);
+	send_window_set_writable_callback(NULL, on_writable_cb, NULL);
+	send_window_destroy(NULL);
+}
+
+/* the requests in flight are not limited by default */
+static void test_send_window_unlimited(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+
+	for (int i = 0; i < 100; i++) {
+		assert_int_equal(send_window_reserve(deps->window, 1000, TRUE), 0);
+	}
+	assert_int_equal(send_window_get_stats(deps->window, &stats), 0);
+	assert_int_equal(stats.requests_in_flight, 100);
+	assert_int_equal(stats.bytes_in_flight, 100000);
+	assert_int_equal(stats.would_block, 0);
+}
+
+/* a request is refused if it does not fit in the bytes left, unless nothing is in flight */
+static void test_send_window_byte_limit(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+
+	send_window_set_limits(deps->window, 0, 100);
+	send_window_set_writable_callback(deps->window, on_writable_cb, deps);
+
+	// a request larger than the window is accepted when it is the only one
+	assert_int_equal(send_window_reserve(deps->window, 150, TRUE), 0);
+	assert_int_equal(send_window_reserve(deps->window, 10, TRUE), USBI3C_WOULD_BLOCK);
+	send_window_release(deps->window, 150);
+	// the callback is left pending until the caller can run it without holding its locks
+	assert_int_equal(deps->writable_called, 0);
+	send_window_notify(deps->window);
+	assert_int_equal(deps->writable_called, 1);
+	send_window_notify(deps->window);
+	assert_int_equal(deps->writable_called, 1);
+
+	assert_int_equal(send_window_reserve(deps->window, 60, TRUE), 0);
+	assert_int_equal(send_window_reserve(deps->window, 40, TRUE), 0);
+	assert_int_equal(send_window_reserve(deps->window, 1, TRUE), USBI3C_WOULD_BLOCK);
+	// blocking requests are never refused
+	assert_int_equal(send_window_reserve(deps->window, 1, FALSE), 0);
+
+	// the producers are only notified once per refusal
+	send_window_release(deps->window, 1);
+	send_window_notify(deps->window);
+	send_window_release(deps->window, 40);
+	send_window_notify(deps->window);
+	assert_int_equal(deps->writable_called, 2);
+
+	assert_int_equal(send_window_get_stats(deps->window, &stats), 0);
+	assert_int_equal(stats.would_block, 2);
+	assert_int_equal(stats.notifications, 2);
+	assert_int_equal(stats.requests_in_flight, 1);
+	assert_int_equal(stats.bytes_in_flight, 60);
+}
+
+/* a request the I3C function has no buffer for waits only if others are in flight */
+static void test_send_window_refuse(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+	uint64_t events = 0;
+	int fd = send_window_get_event_fd(deps->window);
+
+	assert_true(fd >= 0);
+
+	assert_int_equal(send_window_reserve(deps->window, 10, TRUE), 0);
+	assert_int_equal(send_window_refuse(deps->window, 10), RETURN_FAILURE);
+
+	assert_int_equal(send_window_reserve(deps->window, 10, TRUE), 0);
+	assert_int_equal(send_window_reserve(deps->window, 20, TRUE), 0);
+	assert_int_equal(send_window_refuse(deps->window, 20), USBI3C_WOULD_BLOCK);
+	assert_int_equal(read(fd, &events, sizeof(events)), -1);
+
+	send_window_release(deps->window, 10);
+	assert_int_equal(read(fd, &events, sizeof(events)), sizeof(events));
+	assert_int_equal(events, 1);
+
+	// cancelling a request does not notify anybody
+	assert_int_equal(send_window_reserve(deps->window, 10, TRUE), 0);
+	send_window_cancel(deps->window, 10);
+	assert_int_equal(read(fd, &events, sizeof(events)), -1);
+
+	assert_int_equal(send_window_get_stats(deps->window, &stats), 0);
+	assert_int_equal(stats.would_block, 1);
+	assert_int_equal(stats.notifications, 1);
+	assert_int_equal(stats.requests_in_flight, 0);
+	assert_int_equal(stats.bytes_in_flight, 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_send_window_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_send_window_unlimited, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_send_window_byte_limit, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_send_window_refuse, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
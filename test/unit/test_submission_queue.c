@@ -0,0 +1,262 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+#include "submission_queue_i.h"
+
+#define CHUNK_SIZE 64
+#define MAX_BATCHES 8
+
+/* a fake batch of commands that takes a number of bulk requests to be sent */
+struct fake_batch {
+	int id;
+	int chunks;
+};
+
+struct test_deps {
+	struct submission_queue *queue;
+	int sent[MAX_BATCHES * 4];
+	uint32_t chunk_sizes[MAX_BATCHES * 4];
+	atomic_int requests_sent;
+	atomic_int batches_freed;
+	uint16_t next_request_id;
+	enum submission_send_result send_result;
+	int answer_while_sending;
+};
+
+static enum submission_send_result send_cb(void *batch, uint32_t max_chunk_size, uint16_t *request_id, void *context)
+{
+	struct test_deps *deps = (struct test_deps *)context;
+	struct fake_batch *fake = (struct fake_batch *)batch;
+	int sent = atomic_load(&deps->requests_sent);
+
+	if (deps->send_result == SUBMISSION_SEND_FAILED) {
+		return SUBMISSION_SEND_FAILED;
+	}
+
+	deps->sent[sent] = fake->id;
+	deps->chunk_sizes[sent] = max_chunk_size;
+	*request_id = deps->next_request_id++;
+	if (deps->answer_while_sending) {
+		// the response arrives before the request is tracked
+		submission_queue_complete(deps->queue, *request_id);
+	}
+	atomic_fetch_add(&deps->requests_sent, 1);
+
+	return --fake->chunks > 0 ? SUBMISSION_SEND_PARTIAL : SUBMISSION_SEND_DONE;
+}
+
+static void free_cb(void *batch)
+{
+	free(batch);
+}
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->queue = submission_queue_init(send_cb, free_cb, deps);
+	deps->next_request_id = 100;
+	deps->send_result = SUBMISSION_SEND_DONE;
+	*state = deps;
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	submission_queue_destroy(&deps->queue);
+	free(deps);
+
+	return 0;
+}
+
+static void helper_push(struct test_deps *deps, enum usbi3c_submission_class submission_class, int id, int chunks, uint32_t deadline_us, uint64_t now_us)
+{
+	struct fake_batch *batch = calloc(1, sizeof(struct fake_batch));
+
+	batch->id = id;
+	batch->chunks = chunks;
+	assert_int_equal(submission_queue_push(deps->queue, submission_class, batch, deadline_us, now_us), 0);
+}
+
+/* answers the last bulk request sent and sends the next one */
+static int helper_answer_and_dispatch(struct test_deps *deps, uint64_t now_us)
+{
+	submission_queue_complete(deps->queue, deps->next_request_id - 1);
+	return submission_queue_dispatch(deps->queue, now_us);
+}
+
+static void test_negative_submission_queue_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submission_stats stats;
+	int batch = 0;
+
+	assert_null(submission_queue_init(NULL, free_cb, deps));
+	assert_null(submission_queue_init(send_cb, NULL, deps));
+	assert_int_equal(submission_queue_push(NULL, USBI3C_NORMAL_SUBMISSION, &batch, 0, 0), RETURN_FAILURE);
+	assert_int_equal(submission_queue_push(deps->queue, USBI3C_NORMAL_SUBMISSION, NULL, 0, 0), RETURN_FAILURE);
+	assert_int_equal(submission_queue_push(deps->queue, USBI3C_SUBMISSION_CLASSES, &batch, 0, 0), RETURN_FAILURE);
+	assert_int_equal(submission_queue_dispatch(NULL, 0), RETURN_FAILURE);
+	assert_int_equal(submission_queue_get_stats(deps->queue, USBI3C_SUBMISSION_CLASSES, &stats), RETURN_FAILURE);
+	assert_int_equal(submission_queue_get_stats(deps->queue, USBI3C_NORMAL_SUBMISSION, NULL), RETURN_FAILURE);
+	assert_int_equal(submission_queue_start(NULL), RETURN_FAILURE);
+	submission_queue_complete(NULL, 0);
+}
+
+/* the most urgent class goes first, and within a class the earliest deadline */
+static void test_submission_queue_priority_and_deadline(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_push(deps, USBI3C_BULK_SUBMISSION, 1, 1, 0, 0);
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 2, 1, 0, 0);
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 3, 1, 500, 0);
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 4, 1, 100, 0);
+	helper_push(deps, USBI3C_REALTIME_SUBMISSION, 5, 1, 0, 0);
+
+	// only one bulk request is sent until it is answered
+	assert_int_equal(submission_queue_dispatch(deps->queue, 10), 1);
+	assert_int_equal(submission_queue_dispatch(deps->queue, 10), 0);
+	for (int i = 0; i < 4; i++) {
+		assert_int_equal(helper_answer_and_dispatch(deps, 10), 1);
+	}
+	assert_int_equal(helper_answer_and_dispatch(deps, 10), 0);
+
+	assert_int_equal(deps->sent[0], 5);
+	assert_int_equal(deps->sent[1], 4);
+	assert_int_equal(deps->sent[2], 3);
+	assert_int_equal(deps->sent[3], 2);
+	assert_int_equal(deps->sent[4], 1);
+	assert_int_equal(atomic_load(&deps->requests_sent), 5);
+}
+
+/* a bulk batch is sent in chunks and a more urgent batch goes in between them */
+static void test_submission_queue_bulk_chunks(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submission_stats stats;
+
+	submission_queue_set_chunk_size(deps->queue, CHUNK_SIZE);
+	helper_push(deps, USBI3C_BULK_SUBMISSION, 1, 3, 1000, 0);
+	assert_int_equal(submission_queue_dispatch(deps->queue, 0), 1);
+
+	// the realtime batch only waits for the chunk in progress
+	helper_push(deps, USBI3C_REALTIME_SUBMISSION, 2, 1, 0, 100);
+	assert_int_equal(helper_answer_and_dispatch(deps, 300), 1);
+	assert_int_equal(helper_answer_and_dispatch(deps, 400), 1);
+	assert_int_equal(helper_answer_and_dispatch(deps, 1500), 1);
+
+	assert_int_equal(deps->sent[0], 1);
+	assert_int_equal(deps->sent[1], 2);
+	assert_int_equal(deps->sent[2], 1);
+	assert_int_equal(deps->sent[3], 1);
+	// only the bulk class is split in chunks
+	assert_int_equal(deps->chunk_sizes[0], CHUNK_SIZE);
+	assert_int_equal(deps->chunk_sizes[1], 0);
+
+	assert_int_equal(submission_queue_get_stats(deps->queue, USBI3C_REALTIME_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 1);
+	assert_int_equal(stats.requests, 1);
+	assert_int_equal(stats.max_latency_us, 200);
+	assert_int_equal(stats.deadline_misses, 0);
+
+	// every chunk waits from the time the previous one was sent
+	assert_int_equal(submission_queue_get_stats(deps->queue, USBI3C_BULK_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 1);
+	assert_int_equal(stats.requests, 3);
+	assert_int_equal(stats.pending, 0);
+	assert_int_equal(stats.max_latency_us, 1100);
+	assert_int_equal(stats.mean_latency_us, 500);
+	// the last chunk was sent after the deadline
+	assert_int_equal(stats.deadline_misses, 1);
+	assert_int_equal(atomic_load(&deps->requests_sent), 4);
+}
+
+/* a response received while the request is being sent still makes room for the next one */
+static void test_submission_queue_early_response(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	deps->answer_while_sending = TRUE;
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 1, 1, 0, 0);
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 2, 1, 0, 0);
+
+	assert_int_equal(submission_queue_dispatch(deps->queue, 0), 2);
+}
+
+/* the batches that cannot be sent are dropped */
+static void test_submission_queue_send_failure(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submission_stats stats;
+
+	deps->send_result = SUBMISSION_SEND_FAILED;
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 1, 1, 0, 0);
+	helper_push(deps, USBI3C_NORMAL_SUBMISSION, 2, 1, 0, 0);
+
+	assert_int_equal(submission_queue_dispatch(deps->queue, 0), 0);
+	assert_int_equal(submission_queue_get_stats(deps->queue, USBI3C_NORMAL_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 2);
+	assert_int_equal(stats.failed, 2);
+	assert_int_equal(stats.requests, 0);
+	assert_int_equal(stats.pending, 0);
+}
+
+/* the dispatcher thread sends the batches as the previous ones are answered */
+static void test_submission_queue_thread(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_int_equal(submission_queue_start(deps->queue), 0);
+	assert_int_equal(submission_queue_start(deps->queue), RETURN_FAILURE);
+
+	deps->answer_while_sending = TRUE;
+	for (int i = 0; i < MAX_BATCHES; i++) {
+		helper_push(deps, USBI3C_NORMAL_SUBMISSION, i, 1, 0, monotonic_time_us());
+	}
+	for (int i = 0; i < 1000 && atomic_load(&deps->requests_sent) < MAX_BATCHES; i++) {
+		usleep(1000);
+	}
+	assert_int_equal(atomic_load(&deps->requests_sent), MAX_BATCHES);
+
+	// the batches not sent yet are freed when the queue is destroyed
+	deps->answer_while_sending = FALSE;
+	helper_push(deps, USBI3C_BULK_SUBMISSION, MAX_BATCHES, 1, 0, monotonic_time_us());
+	helper_push(deps, USBI3C_BULK_SUBMISSION, MAX_BATCHES + 1, 1, 0, monotonic_time_us());
+	submission_queue_destroy(&deps->queue);
+	assert_true(atomic_load(&deps->requests_sent) <= MAX_BATCHES + 1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_submission_queue_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_submission_queue_priority_and_deadline, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_submission_queue_bulk_chunks, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_submission_queue_early_response, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_submission_queue_send_failure, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_submission_queue_thread, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
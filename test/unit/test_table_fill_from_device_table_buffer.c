@@ -121,9 +121,7 @@ void test_table_fill_from_device_table_buffer_update_device(void **state)
 	device->device_data.bus_characteristic_register = 0xAA;
 	device->device_data.device_characteristic_register = 0xFF;
 	device->target_address = DEVICE_ADDRESS;
-	pthread_mutex_lock(deps->usbi3c_dev->target_device_table->mutex);
-	deps->usbi3c_dev->target_device_table->target_devices = list_append(deps->usbi3c_dev->target_device_table->target_devices, device);
-	pthread_mutex_unlock(deps->usbi3c_dev->target_device_table->mutex);
+	table_insert_device(deps->usbi3c_dev->target_device_table, device);
 
 	/* create target device buffer buffer */
 	buffer = create_target_device_table_buffer(DEVICES_IN_BUS, TARGET_CONFIG, TARGET_CAPABILITY);
@@ -802,6 +802,356 @@ void test_target_device_table_notification_over_thread(void **state)
 	free(hotjoin_buffer);
 }
 
+/* test a burst of hot-join notifications results in a single table refresh in flight */
+void test_target_device_table_notification_hotjoin_burst(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device *device = (struct target_device *)calloc(1, sizeof(struct target_device));
+	struct notification notification = {
+		.type = NOTIFICATION_ADDRESS_CHANGE_STATUS,
+		.code = HOTJOIN_ADDRESS_ASSIGNMENT_SUCCEEDED
+	};
+
+	const int TARGET_ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+	const int TARGET_ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+	const int DEVICES_IN_BUS = 2;
+	const int HOTJOINS_IN_BURST = 30;
+	const int TARGET_CAPABILITY = 0b1000000000;
+	const int TARGET_CONFIG = 0b00000000;
+	device->target_address = TARGET_ADDRESS_1;
+
+	table_insert_device(deps->table, device);
+	unsigned char *hotjoin_buffer = create_target_device_table_buffer(DEVICES_IN_BUS, TARGET_CONFIG, TARGET_CAPABILITY);
+	int hotjoin_buffer_size = sizeof(struct target_device_table_header) + (sizeof(struct target_device_table_entry) * 2);
+
+	// fake input control transfer
+	fake_transfer_add_data(USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, hotjoin_buffer, hotjoin_buffer_size);
+	for (int i = 0; i < HOTJOINS_IN_BURST; i++) {
+		target_device_table_notification_handle(&notification, deps->table);
+	}
+
+	// only the first notification submits a request, the rest are coalesced into a follow-up
+	assert_int_equal(deps->table->refresh_requests, 1);
+	assert_int_equal(deps->table->refresh_coalesced, HOTJOINS_IN_BURST - 1);
+	assert_true(deps->table->refresh_in_flight);
+	assert_true(deps->table->refresh_pending);
+
+	// the follow-up request is submitted when the first one completes, make it fail
+	mock_libusb_submit_transfer(LIBUSB_ERROR_BUSY);
+	mock_libusb_wait_for_events_trigger(USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, RETURN_SUCCESS);
+	usb_wait_for_next_event(deps->usb_dev);
+
+	assert_non_null(table_get_device(deps->table, TARGET_ADDRESS_1));
+	assert_non_null(table_get_device(deps->table, TARGET_ADDRESS_2));
+	assert_int_equal(deps->table->refresh_requests, 2);
+	assert_false(deps->table->refresh_in_flight);
+	assert_false(deps->table->refresh_pending);
+
+	free(hotjoin_buffer);
+}
+
+struct table_events {
+	int count;
+	uint8_t addresses[8];
+};
+
+static void record_table_event(uint8_t address, void *user_data)
+{
+	struct table_events *events = (struct table_events *)user_data;
+
+	assert_in_range(events->count, 0, 7);
+	events->addresses[events->count++] = address;
+}
+
+static void helper_set_device_table_entry(uint8_t *buffer, int i, uint8_t address, uint16_t pid_lo, uint8_t target_interrupt_request)
+{
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->address = address;
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->valid_pid = TRUE;
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->pid_lo = pid_lo;
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->pid_hi = 0x04A1;
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, i)->target_interrupt_request = target_interrupt_request;
+}
+
+/* test a target device table is applied to the local one as a diff */
+void test_target_device_table_apply_device_table_buffer(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct table_events inserted = { 0 };
+	struct table_events removed = { 0 };
+	struct table_events changed = { 0 };
+	struct target_device *device = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	uint64_t version = 0;
+	uint8_t *buffer = NULL;
+	int buffer_size = TARGET_DEVICE_HEADER_SIZE + (TARGET_DEVICE_ENTRY_SIZE * 3);
+
+	const uint8_t ADDRESS_KEPT = INITIAL_TARGET_ADDRESS_POOL;
+	const uint8_t ADDRESS_LEFT = INITIAL_TARGET_ADDRESS_POOL + 1;
+	const uint8_t ADDRESS_REPLACED = INITIAL_TARGET_ADDRESS_POOL + 2;
+	const uint8_t ADDRESS_JOINED = INITIAL_TARGET_ADDRESS_POOL + 3;
+
+	for (int i = 0; i < 3; i++) {
+		device = (struct target_device *)calloc(1, sizeof(struct target_device));
+		device->target_address = INITIAL_TARGET_ADDRESS_POOL + i;
+		device->pid_lo = 0x100 + i;
+		device->pid_hi = 0x04A1;
+		device->device_data.valid_pid = TRUE;
+		assert_int_equal(table_insert_device(deps->table, device), 0);
+	}
+	table_on_insert_device(deps->table, record_table_event, &inserted);
+	table_on_remove_device(deps->table, record_table_event, &removed);
+	table_on_change_device(deps->table, record_table_event, &changed);
+	table_enable_events(deps->table);
+
+	// the first device changed its configuration, the second one left the bus,
+	// a different device took the address of the third one, and a new device joined
+	buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size = buffer_size;
+	helper_set_device_table_entry(buffer, 0, ADDRESS_KEPT, 0x100, TRUE);
+	helper_set_device_table_entry(buffer, 1, ADDRESS_REPLACED, 0x200, FALSE);
+	helper_set_device_table_entry(buffer, 2, ADDRESS_JOINED, 0x201, FALSE);
+
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), 0);
+
+	assert_int_equal(changed.count, 1);
+	assert_int_equal(changed.addresses[0], ADDRESS_KEPT);
+	assert_int_equal(removed.count, 2);
+	assert_int_equal(removed.addresses[0], ADDRESS_REPLACED);
+	assert_int_equal(removed.addresses[1], ADDRESS_LEFT);
+	assert_int_equal(inserted.count, 2);
+	assert_int_equal(inserted.addresses[0], ADDRESS_REPLACED);
+	assert_int_equal(inserted.addresses[1], ADDRESS_JOINED);
+
+	assert_null(table_get_device(deps->table, ADDRESS_LEFT));
+	assert_non_null(table_get_device_by_pid(deps->table, ((uint64_t)0x04A1 << 16) + 0x200));
+	assert_null(table_get_device_by_pid(deps->table, ((uint64_t)0x04A1 << 16) + 0x102));
+	assert_true(table_get_device(deps->table, ADDRESS_KEPT)->device_data.target_interrupt_request);
+
+	// applying the same table again changes nothing
+	snapshot = table_snapshot_acquire(deps->table);
+	version = snapshot->version;
+	table_snapshot_release(deps->table, snapshot);
+
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), 0);
+	assert_int_equal(changed.count, 1);
+	assert_int_equal(removed.count, 2);
+	assert_int_equal(inserted.count, 2);
+
+	snapshot = table_snapshot_acquire(deps->table);
+	assert_int_equal(snapshot->version, version);
+	assert_int_equal(snapshot->count, 3);
+	table_snapshot_release(deps->table, snapshot);
+
+	// a table with the same address twice is rejected
+	helper_set_device_table_entry(buffer, 2, ADDRESS_LEFT, 0x300, FALSE);
+	helper_set_device_table_entry(buffer, 1, ADDRESS_LEFT, 0x301, FALSE);
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), RETURN_FAILURE);
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, TARGET_DEVICE_HEADER_SIZE - 1), RETURN_FAILURE);
+	assert_int_equal(table_apply_device_table_buffer(NULL, buffer, buffer_size), RETURN_FAILURE);
+
+	free(buffer);
+}
+
+/* test the devices without an address are matched by their PID when a target device table is applied */
+void test_target_device_table_apply_unaddressed_devices(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct table_events inserted = { 0 };
+	struct table_events changed = { 0 };
+	const struct table_snapshot *snapshot = NULL;
+	uint8_t *buffer = NULL;
+	int buffer_size = TARGET_DEVICE_HEADER_SIZE + (TARGET_DEVICE_ENTRY_SIZE * 2);
+
+	const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+
+	table_on_insert_device(deps->table, record_table_event, &inserted);
+	table_on_change_device(deps->table, record_table_event, &changed);
+	table_enable_events(deps->table);
+
+	// the second device has neither an address nor a PID so it can't be tracked
+	buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size = buffer_size;
+	helper_set_device_table_entry(buffer, 0, 0, 0x100, FALSE);
+	GET_TARGET_DEVICE_TABLE_ENTRY_N(buffer, 1)->valid_pid = FALSE;
+
+	// refreshing the table again does not duplicate the device
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), 0);
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), 0);
+	assert_int_equal(list_len(deps->table->target_devices), 1);
+	assert_int_equal(inserted.count, 1);
+	assert_int_equal(changed.count, 0);
+
+	// the same device once it got an address
+	helper_set_device_table_entry(buffer, 0, ADDRESS, 0x100, FALSE);
+	assert_int_equal(table_apply_device_table_buffer(deps->table, buffer, buffer_size), 0);
+	assert_int_equal(list_len(deps->table->target_devices), 1);
+	assert_int_equal(inserted.count, 1);
+	assert_int_equal(changed.count, 1);
+	assert_int_equal(changed.addresses[0], ADDRESS);
+	snapshot = table_snapshot_acquire(deps->table);
+	assert_non_null(table_snapshot_get_device(snapshot, ADDRESS));
+	table_snapshot_release(deps->table, snapshot);
+
+	free(buffer);
+}
+
+/* test a target device table buffer is filled into the table with a single snapshot */
+void test_target_device_table_fill_single_snapshot(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct table_events inserted = { 0 };
+	const struct table_snapshot *snapshot = NULL;
+	uint8_t *buffer = NULL;
+	int buffer_size = TARGET_DEVICE_HEADER_SIZE + (TARGET_DEVICE_ENTRY_SIZE * 3);
+
+	table_on_insert_device(deps->table, record_table_event, &inserted);
+	table_enable_events(deps->table);
+
+	buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_TABLE_HEADER(buffer)->table_size = buffer_size;
+	for (int i = 0; i < 3; i++) {
+		helper_set_device_table_entry(buffer, i, INITIAL_TARGET_ADDRESS_POOL + i, 0x100 + i, FALSE);
+	}
+	assert_int_equal(table_fill_from_device_table_buffer(deps->table, buffer, buffer_size), 0);
+
+	snapshot = table_snapshot_acquire(deps->table);
+	assert_int_equal(snapshot->version, 1);
+	assert_int_equal(snapshot->count, 3);
+	table_snapshot_release(deps->table, snapshot);
+	assert_int_equal(inserted.count, 3);
+	assert_int_equal(inserted.addresses[2], INITIAL_TARGET_ADDRESS_POOL + 2);
+
+	free(buffer);
+}
+
+/* Negative test to validate that snapshots handle missing parameters gracefully */
+void test_negative_target_device_table_snapshot_null(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_null(table_snapshot_acquire(NULL));
+	assert_null(table_snapshot_get_device(NULL, 0x01));
+	table_snapshot_release(NULL, NULL);
+	table_publish_snapshot(NULL);
+
+	// nothing has been published in an empty table
+	assert_null(table_snapshot_acquire(deps->table));
+}
+
+/* Test to validate that a snapshot is a consistent view of the table that does not change while it is held */
+void test_target_device_table_snapshot(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	const struct table_snapshot *snapshot = NULL;
+	const struct table_snapshot *latest = NULL;
+	struct target_device *device = NULL;
+
+	device = (struct target_device *)calloc(1, sizeof(struct target_device));
+	device->target_address = 0x01;
+	device->device_data.max_ibi_payload_size = 100;
+	table_insert_device(deps->table, device);
+	device = (struct target_device *)calloc(1, sizeof(struct target_device));
+	device->target_address = 0x02;
+	table_insert_device(deps->table, device);
+
+	snapshot = table_snapshot_acquire(deps->table);
+	assert_non_null(snapshot);
+	assert_int_equal(snapshot->count, 2);
+	assert_int_equal(table_snapshot_get_device(snapshot, 0x01)->device_data.max_ibi_payload_size, 100);
+	assert_non_null(table_snapshot_get_device(snapshot, 0x02));
+	assert_null(table_snapshot_get_device(snapshot, 0x03));
+
+	// writers publish new versions without affecting the snapshot being held
+	assert_int_equal(table_change_device_address(deps->table, 0x02, 0x03), RETURN_SUCCESS);
+	table_get_device(deps->table, 0x01)->device_data.max_ibi_payload_size = 200;
+	table_publish_snapshot(deps->table);
+	assert_non_null(table_snapshot_get_device(snapshot, 0x02));
+	assert_null(table_snapshot_get_device(snapshot, 0x03));
+	assert_int_equal(table_snapshot_get_device(snapshot, 0x01)->device_data.max_ibi_payload_size, 100);
+
+	latest = table_snapshot_acquire(deps->table);
+	assert_true(latest->version > snapshot->version);
+	assert_null(table_snapshot_get_device(latest, 0x02));
+	assert_non_null(table_snapshot_get_device(latest, 0x03));
+	assert_int_equal(table_snapshot_get_device(latest, 0x01)->device_data.max_ibi_payload_size, 200);
+	table_snapshot_release(deps->table, latest);
+	table_snapshot_release(deps->table, snapshot);
+
+	// the replaced snapshots are freed once no reader holds them
+	assert_non_null(deps->table->retired_snapshots);
+	free(table_remove_device(deps->table, 0x03));
+	assert_null(deps->table->retired_snapshots);
+	snapshot = table_snapshot_acquire(deps->table);
+	assert_int_equal(snapshot->count, 1);
+	table_snapshot_release(deps->table, snapshot);
+}
+
+/* Test to validate that a reader holding a snapshot does not keep the snapshots published after it alive */
+void test_target_device_table_snapshot_retired_bounded(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	const struct table_snapshot *held = NULL;
+	const struct table_snapshot *snapshot = NULL;
+	struct target_device *device = NULL;
+
+	device = (struct target_device *)calloc(1, sizeof(struct target_device));
+	device->target_address = 0x01;
+	table_insert_device(deps->table, device);
+
+	held = table_snapshot_acquire(deps->table);
+	for (int i = 0; i < 100; i++) {
+		snapshot = table_snapshot_acquire(deps->table);
+		table_publish_snapshot(deps->table);
+		table_snapshot_release(deps->table, snapshot);
+		// only the snapshot held for the whole loop and the one just released are still retired
+		assert_true(list_len(deps->table->retired_snapshots) <= 2);
+	}
+	assert_int_equal(table_snapshot_get_device(held, 0x01)->target_address, 0x01);
+
+	table_snapshot_release(deps->table, held);
+	table_publish_snapshot(deps->table);
+	assert_null(deps->table->retired_snapshots);
+}
+
+void *snapshot_reader_thread(void *data)
+{
+	struct target_device_table *table = (struct target_device_table *)data;
+	const struct table_snapshot *snapshot = NULL;
+	int consistent = TRUE;
+
+	for (int i = 0; i < 10000; i++) {
+		snapshot = table_snapshot_acquire(table);
+		// the device is always in exactly one of the two addresses
+		if ((table_snapshot_get_device(snapshot, 0x01) == NULL) == (table_snapshot_get_device(snapshot, 0x02) == NULL)) {
+			consistent = FALSE;
+		}
+		table_snapshot_release(table, snapshot);
+	}
+
+	return consistent ? data : NULL;
+}
+
+/* Test to validate that snapshots can be read while writers publish new versions */
+void test_target_device_table_snapshot_over_thread(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device *device = (struct target_device *)calloc(1, sizeof(struct target_device));
+	void *result = NULL;
+	pthread_t tid;
+
+	device->target_address = 0x01;
+	table_insert_device(deps->table, device);
+
+	pthread_create(&tid, NULL, &snapshot_reader_thread, deps->table);
+	for (int i = 0; i < 1000; i++) {
+		table_change_device_address(deps->table, 0x01, 0x02);
+		table_change_device_address(deps->table, 0x02, 0x01);
+	}
+	pthread_join(tid, &result);
+
+	assert_ptr_equal(result, deps->table);
+}
+
 int main(int argc, char *argv[])
 {
 	struct CMUnitTest tests[] = {
@@ -845,6 +1195,14 @@ int main(int argc, char *argv[])
 		cmocka_unit_test_setup_teardown(test_negative_target_device_table_notification_handle_hotjoin, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_target_device_table_notification_handle_hotjoin, setup, teardown),
 		cmocka_unit_test_setup_teardown(test_target_device_table_notification_over_thread, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_notification_hotjoin_burst, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_apply_device_table_buffer, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_apply_unaddressed_devices, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_fill_single_snapshot, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_negative_target_device_table_snapshot_null, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_snapshot, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_snapshot_retired_bounded, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_snapshot_over_thread, setup, teardown),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,216 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <pthread.h>
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+/* a fully populated bus uses every 7-bit address but 0 */
+#define FULL_BUS_DEVICES 127
+#define BENCHMARK_ROUNDS 2000
+
+/* PIDs of devices from the same vendor only differ in the lower bits */
+#define PID_BASE 0x04A1C0DE0000
+
+struct test_deps {
+	struct target_device_table *table;
+	struct target_device devices[FULL_BUS_DEVICES];
+};
+
+static uint64_t device_pid(struct target_device *device)
+{
+	return ((uint64_t)device->pid_hi << 16) + device->pid_lo;
+}
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->table = calloc(1, sizeof(struct target_device_table));
+	deps->table->mutex = malloc_or_die(sizeof(pthread_mutex_t));
+	pthread_mutex_init(deps->table->mutex, NULL);
+
+	for (int i = 0; i < FULL_BUS_DEVICES; i++) {
+		uint64_t pid = PID_BASE + i;
+		deps->devices[i].target_address = i + 1;
+		deps->devices[i].pid_hi = (uint32_t)(pid >> 16);
+		deps->devices[i].pid_lo = (uint16_t)pid;
+		assert_int_equal(table_insert_device(deps->table, &deps->devices[i]), 0);
+	}
+
+	*state = deps;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	list_free_list(&deps->table->target_devices);
+	list_free_list_and_data(&deps->table->retired_snapshots, free);
+	free(deps->table->snapshot);
+	pthread_mutex_destroy(deps->table->mutex);
+	free(deps->table->mutex);
+	free(deps->table);
+	free(deps);
+	return 0;
+}
+
+static int compare_address(const void *a, const void *b)
+{
+	return ((struct target_device *)a)->target_address - *(uint8_t *)b;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* every device of a fully populated bus is found by address and by PID */
+static void test_table_lookup_full_bus(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	for (int i = 0; i < FULL_BUS_DEVICES; i++) {
+		assert_ptr_equal(table_get_device(deps->table, i + 1), &deps->devices[i]);
+		assert_ptr_equal(table_get_device_by_pid(deps->table, PID_BASE + i), &deps->devices[i]);
+	}
+
+	assert_null(table_get_device(deps->table, 0));
+	assert_null(table_get_device(deps->table, 200));
+	assert_null(table_get_device_by_pid(deps->table, PID_BASE + FULL_BUS_DEVICES));
+	assert_null(table_get_device_by_pid(deps->table, 0));
+
+	// the address is already taken
+	struct target_device duplicate = { .target_address = 0x10 };
+	assert_int_equal(table_insert_device(deps->table, &duplicate), RETURN_FAILURE);
+}
+
+/* removing devices keeps the rest of them reachable through the PID index */
+static void test_table_lookup_after_remove(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	for (int i = 0; i < FULL_BUS_DEVICES; i += 2) {
+		assert_ptr_equal(table_remove_device(deps->table, i + 1), &deps->devices[i]);
+	}
+
+	for (int i = 0; i < FULL_BUS_DEVICES; i++) {
+		if (i % 2 == 0) {
+			assert_null(table_get_device(deps->table, i + 1));
+			assert_null(table_get_device_by_pid(deps->table, PID_BASE + i));
+		} else {
+			assert_ptr_equal(table_get_device(deps->table, i + 1), &deps->devices[i]);
+			assert_ptr_equal(table_get_device_by_pid(deps->table, PID_BASE + i), &deps->devices[i]);
+		}
+	}
+	assert_int_equal(list_len(deps->table->target_devices), FULL_BUS_DEVICES / 2);
+
+	// the removed devices can be inserted again
+	for (int i = 0; i < FULL_BUS_DEVICES; i += 2) {
+		assert_int_equal(table_insert_device(deps->table, &deps->devices[i]), 0);
+	}
+	for (int i = 0; i < FULL_BUS_DEVICES; i++) {
+		assert_ptr_equal(table_get_device_by_pid(deps->table, PID_BASE + i), &deps->devices[i]);
+	}
+}
+
+/* the address index follows address changes */
+static void test_table_lookup_after_address_change(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	// the new address is taken
+	assert_int_equal(table_change_device_address(deps->table, 0x10, 0x11), RETURN_FAILURE);
+
+	assert_non_null(table_remove_device(deps->table, 0x11));
+	assert_int_equal(table_change_device_address(deps->table, 0x10, 0x11), 0);
+	assert_null(table_get_device(deps->table, 0x10));
+	assert_ptr_equal(table_get_device(deps->table, 0x11), &deps->devices[0x10 - 1]);
+	assert_ptr_equal(table_get_device_by_pid(deps->table, PID_BASE + 0x10 - 1), &deps->devices[0x10 - 1]);
+}
+
+/* devices without an address are only in the list but are still found */
+static void test_table_lookup_device_without_address(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device device = { 0 };
+
+	device.pid_hi = 0x11223344;
+	device.pid_lo = 0x5566;
+	assert_int_equal(table_insert_device(deps->table, &device), 0);
+
+	assert_ptr_equal(table_get_device(deps->table, 0), &device);
+	assert_ptr_equal(table_get_device_by_pid(deps->table, 0x112233445566), &device);
+
+	assert_ptr_equal(table_remove_device(deps->table, 0), &device);
+	assert_null(table_get_device_by_pid(deps->table, 0x112233445566));
+}
+
+/* micro-benchmark of the lookup cost with a fully populated bus, the indexed lookups
+ * are compared against a linear search of the list of devices */
+static void test_table_lookup_benchmark(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct timespec start, end;
+	double list_ns, address_ns, pid_ns;
+	uint64_t checksum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for (uint8_t address = 1; address <= FULL_BUS_DEVICES; address++) {
+			checksum += ((struct target_device *)list_search(deps->table->target_devices, &address, compare_address))->target_address;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	list_ns = elapsed_ns(&start, &end) / (BENCHMARK_ROUNDS * FULL_BUS_DEVICES);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for (uint8_t address = 1; address <= FULL_BUS_DEVICES; address++) {
+			checksum -= table_get_device(deps->table, address)->target_address;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	address_ns = elapsed_ns(&start, &end) / (BENCHMARK_ROUNDS * FULL_BUS_DEVICES);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for (int i = 0; i < FULL_BUS_DEVICES; i++) {
+			checksum += device_pid(table_get_device_by_pid(deps->table, PID_BASE + i)) - PID_BASE - i;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pid_ns = elapsed_ns(&start, &end) / (BENCHMARK_ROUNDS * FULL_BUS_DEVICES);
+
+	assert_int_equal(checksum, 0);
+	print_message("lookup cost with %d devices: list search %.1f ns, by address %.1f ns, by PID %.1f ns\n",
+		      FULL_BUS_DEVICES, list_ns, address_ns, pid_ns);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_table_lookup_full_bus, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_table_lookup_after_remove, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_table_lookup_after_address_change, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_table_lookup_device_without_address, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_table_lookup_benchmark, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -70,7 +70,7 @@ static void test_send_target_reset(void **state)
 	int expected_response_buffer_size = 0;
 	struct list *expected_responses = NULL;
 	struct usbi3c_response r1, r2;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int buffer_available = 0;
 
 	/*******************************/
@@ -121,7 +121,7 @@ static void test_send_target_reset(void **state)
 	r2.data_length = 0;
 	expected_responses = list_append(expected_responses, &r2);
 
-	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, bulk_request_id);
+	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -171,7 +171,7 @@ static void test_submit_target_reset(void **state)
 	int expected_response_buffer_size = 0;
 	struct list *expected_responses = NULL;
 	struct usbi3c_response r1, r2;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int buffer_available = 0;
 
 	/*******************************/
@@ -222,7 +222,7 @@ static void test_submit_target_reset(void **state)
 	r2.data_length = 0;
 	expected_responses = list_append(expected_responses, &r2);
 
-	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, bulk_request_id);
+	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, helper_next_request_id(deps->usbi3c_dev));
 
 	/* first a user would enqueue a ccc to configure the reset action to use */
 	ret = usbi3c_enqueue_ccc_with_defining_byte(deps->usbi3c_dev,
@@ -0,0 +1,164 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "timer_wheel_i.h"
+
+#define TICK_US 1000
+#define START_US 5000000
+/* one revolution of the wheel */
+#define REVOLUTION_US (512 * TICK_US)
+
+struct test_deps {
+	struct timer_wheel *wheel;
+	struct timer_wheel_entry timers[4];
+};
+
+static int setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	deps->wheel = timer_wheel_init(TICK_US, START_US);
+	for (int i = 0; i < 4; i++) {
+		deps->timers[i].data = &deps->timers[i];
+	}
+	*state = deps;
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	timer_wheel_destroy(&deps->wheel);
+	free(deps);
+
+	return 0;
+}
+
+static void test_negative_timer_wheel_null_params(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_null(timer_wheel_init(0, START_US));
+	assert_null(timer_wheel_pop_expired(NULL, START_US));
+	assert_int_equal(timer_wheel_next_expiry(NULL), UINT64_MAX);
+	assert_int_equal(timer_wheel_count(NULL), 0);
+	timer_wheel_add(NULL, &deps->timers[0], START_US);
+	timer_wheel_add(deps->wheel, NULL, START_US);
+	timer_wheel_remove(NULL, &deps->timers[0]);
+	timer_wheel_remove(deps->wheel, NULL);
+	timer_wheel_destroy(NULL);
+	assert_int_equal(timer_wheel_count(deps->wheel), 0);
+}
+
+/* timers only expire once their deadline passes, in the order of their deadlines */
+static void test_timer_wheel_expire_in_order(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	timer_wheel_add(deps->wheel, &deps->timers[0], START_US + 3 * TICK_US);
+	timer_wheel_add(deps->wheel, &deps->timers[1], START_US + 1 * TICK_US + 10);
+	timer_wheel_add(deps->wheel, &deps->timers[2], START_US + 3 * TICK_US + 500);
+	assert_int_equal(timer_wheel_count(deps->wheel), 3);
+	assert_int_equal(timer_wheel_next_expiry(deps->wheel), START_US + 1 * TICK_US + 10);
+
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 1 * TICK_US));
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 1 * TICK_US + 10), &deps->timers[1]);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 1 * TICK_US + 10));
+	assert_int_equal(timer_wheel_next_expiry(deps->wheel), START_US + 3 * TICK_US);
+
+	// a timer later in the same tick is not expired early
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 3 * TICK_US + 100), &deps->timers[0]);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 3 * TICK_US + 100));
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 3 * TICK_US + 500), &deps->timers[2]);
+
+	assert_int_equal(timer_wheel_count(deps->wheel), 0);
+	assert_int_equal(timer_wheel_next_expiry(deps->wheel), UINT64_MAX);
+	assert_null(deps->timers[0].prev);
+}
+
+/* timers that are disarmed or moved do not expire at their old deadline */
+static void test_timer_wheel_remove(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	timer_wheel_add(deps->wheel, &deps->timers[0], START_US + TICK_US);
+	timer_wheel_add(deps->wheel, &deps->timers[1], START_US + TICK_US);
+	timer_wheel_remove(deps->wheel, &deps->timers[0]);
+	// removing a timer that is not armed does nothing
+	timer_wheel_remove(deps->wheel, &deps->timers[0]);
+	timer_wheel_remove(deps->wheel, &deps->timers[2]);
+	assert_int_equal(timer_wheel_count(deps->wheel), 1);
+
+	// re-arming a timer moves it
+	timer_wheel_add(deps->wheel, &deps->timers[1], START_US + 5 * TICK_US);
+	assert_int_equal(timer_wheel_count(deps->wheel), 1);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 4 * TICK_US));
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 5 * TICK_US), &deps->timers[1]);
+	assert_int_equal(timer_wheel_count(deps->wheel), 0);
+}
+
+/* a deadline that already passed expires right away */
+static void test_timer_wheel_deadline_in_the_past(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 10 * TICK_US));
+	timer_wheel_add(deps->wheel, &deps->timers[0], START_US + 2 * TICK_US);
+	timer_wheel_add(deps->wheel, &deps->timers[1], START_US - TICK_US);
+	assert_int_equal(timer_wheel_next_expiry(deps->wheel), START_US - TICK_US);
+
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 10 * TICK_US), &deps->timers[0]);
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 10 * TICK_US), &deps->timers[1]);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 10 * TICK_US));
+}
+
+/* timers more than a revolution away share their slot with earlier timers but only expire in their revolution */
+static void test_timer_wheel_several_revolutions(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	timer_wheel_add(deps->wheel, &deps->timers[0], START_US + 2 * REVOLUTION_US + TICK_US);
+	timer_wheel_add(deps->wheel, &deps->timers[1], START_US + TICK_US);
+	timer_wheel_add(deps->wheel, &deps->timers[2], START_US + 3 * REVOLUTION_US + 7 * TICK_US);
+
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + TICK_US), &deps->timers[1]);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + TICK_US));
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + REVOLUTION_US + TICK_US));
+	// every timer is a revolution away, the wheel wakes up to turn
+	assert_int_equal(timer_wheel_next_expiry(deps->wheel), START_US + 2 * REVOLUTION_US + TICK_US);
+
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 2 * REVOLUTION_US + TICK_US), &deps->timers[0]);
+	assert_null(timer_wheel_pop_expired(deps->wheel, START_US + 2 * REVOLUTION_US + TICK_US));
+
+	// jumping over several revolutions at once still finds the timer
+	assert_ptr_equal(timer_wheel_pop_expired(deps->wheel, START_US + 10 * REVOLUTION_US), &deps->timers[2]);
+	assert_int_equal(timer_wheel_count(deps->wheel), 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_timer_wheel_null_params, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_timer_wheel_expire_in_order, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_timer_wheel_remove, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_timer_wheel_deadline_in_the_past, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_timer_wheel_several_revolutions, setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -93,10 +93,12 @@ static void test_negative_pid_already_taken(void **state)
 	device.provisioned_id = 0x112233445566;
 
 	/* let's add a device with the same PID to the table */
-	device_i = table_get_device(deps->usbi3c_dev->target_device_table, 100);
+	device_i = table_remove_device(deps->usbi3c_dev->target_device_table, 100);
 	device_i->target_address = 0;
 	device_i->pid_hi = 0x11223344;
 	device_i->pid_lo = 0x5566;
+	table_insert_device(deps->usbi3c_dev->target_device_table, device_i);
+	callback_called = FALSE;
 
 	ret = usbi3c_add_device_to_table(deps->usbi3c_dev, device);
 	assert_int_equal(ret, -1);
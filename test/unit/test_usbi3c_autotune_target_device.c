@@ -0,0 +1,218 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+/* the mock I3C controller supports SDR and HDR-DDR at 2, 4, 6 and 8 MHz */
+#define CANDIDATES 8
+#define PROBE_SIZE 4
+#define DATA_MISMATCH 0xFF
+
+const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+const int TIMEOUT = 60;
+
+static unsigned char expected_data[PROBE_SIZE] = { 0xDE, 0xAD, 0xBE, 0xEF };
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	struct list *buffers;
+	int buffer_available;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_i3c_mode(deps->usbi3c_dev, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	list_free_list_and_data(&deps->buffers, free);
+	free(deps);
+
+	return 0;
+}
+
+/* mocks one round of a read probe at a mode and rate, and its response with the error status provided */
+static void helper_mock_probe_round(struct test_deps *deps, int request_id, int transfer_mode, int transfer_rate, int error_status)
+{
+	struct usbi3c_response response = { 0 };
+	unsigned char data[PROBE_SIZE];
+	struct list *list = NULL;
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	buffer_size = helper_create_command_buffer(request_id, &buffer, ADDRESS, USBI3C_READ, USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK,
+						   PROBE_SIZE, NULL, transfer_mode, transfer_rate, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->buffer_available = buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+
+	memcpy(data, expected_data, PROBE_SIZE);
+	response.attempted = USBI3C_COMMAND_ATTEMPTED;
+	response.error_status = error_status;
+	response.has_data = USBI3C_RESPONSE_HAS_DATA;
+	response.data = data;
+	response.data_length = PROBE_SIZE;
+	if (error_status == DATA_MISMATCH) {
+		/* the data is corrupted but the I3C function did not notice */
+		response.error_status = USBI3C_SUCCEEDED;
+		data[0] = ~data[0];
+	}
+	list = list_append(list, &response);
+
+	buffer = NULL;
+	buffer_size = helper_create_multiple_response_buffer(&buffer, list, request_id);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+	list_free_list(&list);
+}
+
+static void assert_target_device_i3c_mode(struct test_deps *deps, int own_mode, uint8_t transfer_mode, uint8_t transfer_rate)
+{
+	uint8_t mode = 0xFF;
+	uint8_t rate = 0xFF;
+	uint8_t tm_specific_info = 0xFF;
+
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS, &mode, &rate, &tm_specific_info), own_mode);
+	assert_int_equal(mode, transfer_mode);
+	assert_int_equal(rate, transfer_rate);
+}
+
+/* Negative test to verify the function handles missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_autotune_probe probe = { .read_size = PROBE_SIZE, .rounds = 1 };
+	struct usbi3c_autotune_probe empty = { .rounds = 1 };
+	struct usbi3c_autotune_probe no_rounds = { .read_size = PROBE_SIZE };
+	struct usbi3c_autotune_probe no_write_data = { .write_size = PROBE_SIZE, .rounds = 1 };
+
+	assert_int_equal(usbi3c_autotune_target_device(NULL, ADDRESS, &probe, NULL, 0, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, NULL, NULL, 0, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &empty, NULL, 0, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &no_rounds, NULL, 0, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &no_write_data, NULL, 0, TIMEOUT), RETURN_FAILURE);
+	/* unknown target device */
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, 0x7E, &probe, NULL, 0, TIMEOUT), RETURN_FAILURE);
+}
+
+/* Negative test to verify the probe is only sent by the active controller */
+static void test_negative_not_active_controller(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_autotune_probe probe = { .read_size = PROBE_SIZE, .rounds = 1 };
+
+	deps->usbi3c_dev->device_info->device_state.active_i3c_controller = FALSE;
+
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &probe, NULL, 0, TIMEOUT), RETURN_FAILURE);
+}
+
+/* Negative test to verify the mode of the target device is not changed if it fails at every mode and rate */
+static void test_negative_no_reliable_mode(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_autotune_probe probe = { .read_size = PROBE_SIZE, .expected_data = expected_data, .rounds = 1 };
+	struct usbi3c_autotune_result results[CANDIDATES];
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	for (int i = 0; i < CANDIDATES; i++) {
+		helper_mock_probe_round(deps, request_id + i, i / 4, i % 4, USBI3C_FAILED_NACK);
+	}
+
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &probe, results, CANDIDATES, TIMEOUT), RETURN_FAILURE);
+	for (int i = 0; i < CANDIDATES; i++) {
+		assert_int_equal(results[i].commands, 1);
+		assert_int_equal(results[i].other_errors, 1);
+		assert_true(results[i].throughput == 0);
+	}
+	assert_target_device_i3c_mode(deps, 0, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+}
+
+/* Test to verify the fastest mode and rate without errors is selected and used by the commands sent afterwards */
+static void test_autotune_target_device(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_autotune_probe probe = { .read_size = PROBE_SIZE, .expected_data = expected_data, .rounds = 1 };
+	struct usbi3c_autotune_result results[CANDIDATES];
+	struct usbi3c_command *command = NULL;
+	unsigned char data[] = "data";
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+	const int error_status[CANDIDATES] = {
+		/* SDR at 2, 4, 6 and 8 MHz */
+		USBI3C_SUCCEEDED,
+		USBI3C_SUCCEEDED,
+		USBI3C_SUCCEEDED,
+		USBI3C_FAILED_FRAME_ERROR,
+		/* HDR-DDR at 2, 4, 6 and 8 MHz */
+		USBI3C_SUCCEEDED,
+		USBI3C_SUCCEEDED,
+		DATA_MISMATCH,
+		USBI3C_FAILED_CRC_ERROR,
+	};
+
+	for (int i = 0; i < CANDIDATES; i++) {
+		helper_mock_probe_round(deps, request_id + i, i / 4, i % 4, error_status[i]);
+	}
+
+	assert_int_equal(usbi3c_autotune_target_device(deps->usbi3c_dev, ADDRESS, &probe, results, CANDIDATES, TIMEOUT), CANDIDATES);
+	for (int i = 0; i < CANDIDATES; i++) {
+		assert_int_equal(results[i].transfer_mode, i / 4);
+		assert_int_equal(results[i].transfer_rate, i % 4);
+		assert_int_equal(results[i].commands, 1);
+	}
+	assert_int_equal(results[3].frame_errors, 1);
+	assert_int_equal(results[6].other_errors, 1);
+	assert_int_equal(results[7].crc_errors, 1);
+	assert_int_equal(results[2].crc_errors + results[2].parity_errors + results[2].frame_errors + results[2].other_errors, 0);
+
+	/* HDR-DDR at 4 MHz is faster than SDR at 6 MHz */
+	assert_target_device_i3c_mode(deps, 1, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	command = (struct usbi3c_command *)deps->usbi3c_dev->command_queue->data;
+	assert_int_equal(command->command_descriptor->transfer_mode, USBI3C_I3C_HDR_DDR_MODE);
+	assert_int_equal(command->command_descriptor->transfer_rate, USBI3C_I3C_RATE_4_MHZ);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+
+	/* the mode selected is not replaced by the one derived from the capabilities */
+	usbi3c_derive_target_device_i3c_modes(deps->usbi3c_dev);
+	assert_target_device_i3c_mode(deps, 1, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_autotune_target_device() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_not_active_controller, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_no_reliable_mode, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_autotune_target_device, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
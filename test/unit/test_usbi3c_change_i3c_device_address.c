@@ -232,7 +232,6 @@ static void test_usbi3c_change_dynamic_address(void **state)
 {
 	struct test_deps *deps = (struct test_deps *)*state;
 	struct target_device *device = NULL;
-	struct address_change_request *request = NULL;
 	unsigned char *address_change_buffer = NULL;
 	unsigned char *notification_buffer = NULL;
 	unsigned char *change_result_buffer = NULL;
@@ -244,20 +243,8 @@ static void test_usbi3c_change_dynamic_address(void **state)
 	address_change_buffer = mock_change_dynamic_address(OLD_ADDRESS, NEW_ADDRESS, RETURN_SUCCESS);
 
 	/* let's add some dummy requests to the address change request tracker */
-	request = (struct address_change_request *)malloc_or_die(sizeof(struct address_change_request));
-	request->request_id = (OLD_ADDRESS << 8) + NEW_ADDRESS - 10;
-	request->on_address_change_cb = NULL;
-	request->user_data = NULL;
-	pthread_mutex_lock(deps->usbi3c_dev->target_device_table->mutex);
-	deps->usbi3c_dev->target_device_table->address_change_tracker = list_append(deps->usbi3c_dev->target_device_table->address_change_tracker, request);
-	pthread_mutex_unlock(deps->usbi3c_dev->target_device_table->mutex);
-	request = (struct address_change_request *)malloc_or_die(sizeof(struct address_change_request));
-	request->request_id = (OLD_ADDRESS << 8) + NEW_ADDRESS + 10;
-	request->on_address_change_cb = NULL;
-	request->user_data = NULL;
-	pthread_mutex_lock(deps->usbi3c_dev->target_device_table->mutex);
-	deps->usbi3c_dev->target_device_table->address_change_tracker = list_append(deps->usbi3c_dev->target_device_table->address_change_tracker, request);
-	pthread_mutex_unlock(deps->usbi3c_dev->target_device_table->mutex);
+	table_track_address_change(deps->usbi3c_dev->target_device_table, OLD_ADDRESS, NEW_ADDRESS - 10, NULL, NULL);
+	table_track_address_change(deps->usbi3c_dev->target_device_table, OLD_ADDRESS, NEW_ADDRESS + 10, NULL, NULL);
 
 	ret = usbi3c_change_i3c_device_address(deps->usbi3c_dev, OLD_ADDRESS, NEW_ADDRESS, address_change_succeeded_cb, &callback_executed);
 	assert_int_equal(ret, 0);
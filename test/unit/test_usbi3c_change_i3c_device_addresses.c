@@ -0,0 +1,272 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define DEVICES_IN_BUS 3
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t ADDRESS_3 = INITIAL_TARGET_ADDRESS_POOL + 2;
+const uint8_t FREE_ADDRESS = INITIAL_TARGET_ADDRESS_POOL + 10;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+};
+
+/* the results received by the address change callback */
+struct address_change_results {
+	int count;
+	struct usbi3c_address_change changes[DEVICES_IN_BUS];
+	enum usbi3c_address_change_status status[DEVICES_IN_BUS];
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)malloc(sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+static void address_change_cb(uint8_t old_address, uint8_t new_address, enum usbi3c_address_change_status request_status, void *data)
+{
+	struct address_change_results *results = (struct address_change_results *)data;
+
+	assert_in_range(results->count, 0, DEVICES_IN_BUS - 1);
+	results->changes[results->count].current_address = old_address;
+	results->changes[results->count].new_address = new_address;
+	results->status[results->count] = request_status;
+	results->count++;
+}
+
+/* mocks the CHANGE_DYNAMIC_ADDRESS request expected for the address changes provided */
+static unsigned char *helper_mock_change_dynamic_addresses(struct usbi3c_device *usbi3c_dev, struct usbi3c_address_change *changes, int count, int return_code)
+{
+	struct control_transfer_mock out;
+	struct target_device *device = NULL;
+	unsigned char *buffer = NULL;
+	int buffer_size = sizeof(struct target_device_address_change_header) + (sizeof(struct target_device_address_change_entry) * count);
+
+	buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(buffer)->address_change_command_type = ADDRESS_CHANGE_COMMAND_TYPE;
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_HEADER(buffer)->numentries = count;
+	for (int i = 0; i < count; i++) {
+		device = table_get_device(usbi3c_dev->target_device_table, changes[i].current_address);
+		assert_non_null(device);
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(buffer, i)->current_address = changes[i].current_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(buffer, i)->new_address = changes[i].new_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(buffer, i)->pid_lo = device->pid_lo;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_ENTRY_N(buffer, i)->pid_hi = device->pid_hi;
+	}
+
+	out.bmRequestType = 0b00100001;
+	out.bRequest = CHANGE_DYNAMIC_ADDRESS;
+	out.wValue = 0;
+	out.wIndex = 0;
+	out.wLength = buffer_size;
+	out.data = buffer;
+	out.timeout = test_timeout;
+
+	mock_libusb_control_transfer(NULL, &out, return_code);
+
+	return buffer;
+}
+
+/* simulates the I3C function reporting the result of the address changes provided */
+static void helper_trigger_address_change_results(struct usbi3c_address_change *changes, uint8_t *status, int count)
+{
+	unsigned char *notification_buffer = NULL;
+	unsigned char *result_buffer = NULL;
+	int failed = FALSE;
+	int buffer_size = 0;
+
+	buffer_size = sizeof(struct target_device_address_change_result_header) + (sizeof(struct target_device_address_change_result_entry) * count);
+	result_buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_HEADER(result_buffer)->size = buffer_size;
+	GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_HEADER(result_buffer)->numentries = count;
+	for (int i = 0; i < count; i++) {
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(result_buffer, i)->current_address = changes[i].current_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(result_buffer, i)->new_address = changes[i].new_address;
+		GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_ENTRY_N(result_buffer, i)->status = status[i];
+		failed |= status[i];
+	}
+
+	/* the I3C function notifies the host when the address changes were processed */
+	buffer_size = helper_create_notification_buffer(&notification_buffer, NOTIFICATION_ADDRESS_CHANGE_STATUS, failed ? SOME_ADDRESS_CHANGE_FAILED : ALL_ADDRESS_CHANGE_SUCCEEDED);
+	helper_trigger_notification(notification_buffer, buffer_size);
+
+	/* the notification handler submits a GET_ADDRESS_CHANGE_RESULT request asynchronously */
+	mock_libusb_submit_transfer(LIBUSB_SUCCESS);
+	helper_trigger_control_transfer(result_buffer, GET_TARGET_DEVICE_ADDRESS_CHANGE_RESULT_HEADER(result_buffer)->size);
+
+	free(notification_buffer);
+	free(result_buffer);
+}
+
+/* Negative test to verify the function handles missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_address_change changes[1] = { { ADDRESS_1, FREE_ADDRESS } };
+
+	assert_int_equal(usbi3c_change_i3c_device_addresses(NULL, changes, 1, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, NULL, 1, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, changes, 0, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, changes, UINT8_MAX + 1, NULL, NULL), RETURN_FAILURE);
+}
+
+/* Negative test to verify that no request is sent if any entry of the batch conflicts with the table */
+static void test_negative_conflicting_entries(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_address_change unknown_device[2] = { { ADDRESS_1, FREE_ADDRESS }, { FREE_ADDRESS + 1, FREE_ADDRESS + 2 } };
+	struct usbi3c_address_change same_device[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_1, FREE_ADDRESS + 1 } };
+	struct usbi3c_address_change same_new_address[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_2, FREE_ADDRESS } };
+	struct usbi3c_address_change address_taken[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_2, ADDRESS_3 } };
+	struct usbi3c_address_change swap[2] = { { ADDRESS_1, ADDRESS_2 }, { ADDRESS_2, ADDRESS_1 } };
+	struct usbi3c_address_change invalid_address[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_2, USBI3C_BROADCAST_ADDRESS } };
+	struct usbi3c_address_change same_address[1] = { { ADDRESS_1, ADDRESS_1 } };
+
+	/* no control transfer is mocked, sending one would fail the test */
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, unknown_device, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, same_device, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, same_new_address, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, address_taken, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, swap, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, invalid_address, 2, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, same_address, 1, NULL, NULL), RETURN_FAILURE);
+
+	/* nothing was left in the tracker */
+	for (int i = 0; i < ADDRESS_LEN; i++) {
+		assert_null(deps->usbi3c_dev->target_device_table->address_change_tracker[i]);
+	}
+}
+
+/* Negative test to verify the tracked requests are dropped if the request fails */
+static void test_negative_libusb_failure(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_address_change changes[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_2, FREE_ADDRESS + 1 } };
+	unsigned char *buffer = NULL;
+
+	buffer = helper_mock_change_dynamic_addresses(deps->usbi3c_dev, changes, 2, RETURN_FAILURE);
+
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, changes, 2, NULL, NULL), RETURN_FAILURE);
+	for (int i = 0; i < ADDRESS_LEN; i++) {
+		assert_null(deps->usbi3c_dev->target_device_table->address_change_tracker[i]);
+	}
+
+	free(buffer);
+}
+
+/* Test to verify the addresses of a bus can be shifted with a single request, a device
+ * can take the address released by a device changed earlier in the same request */
+static void test_usbi3c_change_i3c_device_addresses_shift(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_address_change changes[DEVICES_IN_BUS] = {
+		{ ADDRESS_3, FREE_ADDRESS },
+		{ ADDRESS_2, ADDRESS_3 },
+		{ ADDRESS_1, ADDRESS_2 },
+	};
+	uint8_t status[DEVICES_IN_BUS] = { USBI3C_SUCCEEDED, USBI3C_SUCCEEDED, USBI3C_SUCCEEDED };
+	struct address_change_results results = { 0 };
+	struct target_device *devices[DEVICES_IN_BUS] = { NULL };
+	unsigned char *buffer = NULL;
+
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		devices[i] = table_get_device(deps->usbi3c_dev->target_device_table, changes[i].current_address);
+	}
+
+	buffer = helper_mock_change_dynamic_addresses(deps->usbi3c_dev, changes, DEVICES_IN_BUS, RETURN_SUCCESS);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, changes, DEVICES_IN_BUS, address_change_cb, &results), 0);
+
+	helper_trigger_address_change_results(changes, status, DEVICES_IN_BUS);
+
+	/* the callback is run once per entry, in order */
+	assert_int_equal(results.count, DEVICES_IN_BUS);
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		assert_int_equal(results.changes[i].current_address, changes[i].current_address);
+		assert_int_equal(results.changes[i].new_address, changes[i].new_address);
+		assert_int_equal(results.status[i], USBI3C_ADDRESS_CHANGE_SUCCEEDED);
+		assert_ptr_equal(table_get_device(deps->usbi3c_dev->target_device_table, changes[i].new_address), devices[i]);
+	}
+	assert_null(table_get_device(deps->usbi3c_dev->target_device_table, ADDRESS_1));
+
+	free(buffer);
+}
+
+/* Test to verify that each entry of the request gets its own result */
+static void test_usbi3c_change_i3c_device_addresses_partial_failure(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_address_change changes[2] = { { ADDRESS_1, FREE_ADDRESS }, { ADDRESS_2, FREE_ADDRESS + 1 } };
+	uint8_t status[2] = { USBI3C_SUCCEEDED, 1 };
+	struct address_change_results results = { 0 };
+	unsigned char *buffer = NULL;
+
+	buffer = helper_mock_change_dynamic_addresses(deps->usbi3c_dev, changes, 2, RETURN_SUCCESS);
+	assert_int_equal(usbi3c_change_i3c_device_addresses(deps->usbi3c_dev, changes, 2, address_change_cb, &results), 0);
+
+	helper_trigger_address_change_results(changes, status, 2);
+
+	assert_int_equal(results.count, 2);
+	assert_int_equal(results.status[0], USBI3C_ADDRESS_CHANGE_SUCCEEDED);
+	assert_int_equal(results.status[1], USBI3C_ADDRESS_CHANGE_FAILED);
+
+	/* only the address change that succeeded is reflected in the table */
+	assert_null(table_get_device(deps->usbi3c_dev->target_device_table, ADDRESS_1));
+	assert_non_null(table_get_device(deps->usbi3c_dev->target_device_table, FREE_ADDRESS));
+	assert_non_null(table_get_device(deps->usbi3c_dev->target_device_table, ADDRESS_2));
+	assert_null(table_get_device(deps->usbi3c_dev->target_device_table, FREE_ADDRESS + 1));
+
+	/* every tracked request was completed */
+	for (int i = 0; i < ADDRESS_LEN; i++) {
+		assert_null(deps->usbi3c_dev->target_device_table->address_change_tracker[i]);
+	}
+
+	free(buffer);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_change_i3c_device_addresses() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_conflicting_entries, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_libusb_failure, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_change_i3c_device_addresses_shift, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_change_i3c_device_addresses_partial_failure, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
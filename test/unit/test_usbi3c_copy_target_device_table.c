@@ -0,0 +1,210 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define DEVICES_IN_BUS 3
+#define BENCHMARK_ROUNDS 20000
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t NEW_ADDRESS = 0x40;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+};
+
+struct visit_data {
+	int visited;
+	int stop_after;
+	uint8_t addresses[DEVICES_IN_BUS];
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)malloc(sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+static int visit_device(const struct usbi3c_target_device *device, void *user_data)
+{
+	struct visit_data *data = (struct visit_data *)user_data;
+
+	data->addresses[data->visited++] = device->dynamic_address;
+
+	return data->visited == data->stop_after;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device devices[DEVICES_IN_BUS];
+	uint8_t addresses[DEVICES_IN_BUS];
+	uint64_t generation = 0;
+
+	assert_int_equal(usbi3c_get_target_device_table_generation(NULL, &generation), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_table_generation(deps->usbi3c_dev, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_copy_target_device_table(NULL, devices, DEVICES_IN_BUS, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, NULL, DEVICES_IN_BUS, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_copy_address_list(NULL, addresses, DEVICES_IN_BUS, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_copy_address_list(deps->usbi3c_dev, NULL, DEVICES_IN_BUS, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_visit_target_devices(NULL, visit_device, NULL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_visit_target_devices(deps->usbi3c_dev, NULL, NULL, NULL), RETURN_FAILURE);
+}
+
+/* Test to verify the copy of the table matches the one allocated by usbi3c_get_target_device_table() */
+static void test_usbi3c_copy_target_device_table(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device devices[DEVICES_IN_BUS + 1];
+	struct usbi3c_target_device **allocated = NULL;
+	uint8_t addresses[DEVICES_IN_BUS];
+	uint8_t *address_list = NULL;
+
+	/* the padding of the structures is compared as well */
+	memset(devices, 0, sizeof(devices));
+
+	/* a buffer of size 0 just gets the number of devices */
+	assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, NULL, 0, NULL), DEVICES_IN_BUS);
+
+	assert_int_equal(usbi3c_get_target_device_table(deps->usbi3c_dev, &allocated), DEVICES_IN_BUS);
+	assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, devices, DEVICES_IN_BUS + 1, NULL), DEVICES_IN_BUS);
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		assert_memory_equal(&devices[i], allocated[i], sizeof(struct usbi3c_target_device));
+	}
+	usbi3c_free_target_device_table(&allocated);
+
+	assert_int_equal(usbi3c_get_address_list(deps->usbi3c_dev, &address_list), DEVICES_IN_BUS);
+	/* only as many addresses as fit in the buffer are copied */
+	memset(addresses, 0, sizeof(addresses));
+	assert_int_equal(usbi3c_copy_address_list(deps->usbi3c_dev, addresses, 2, NULL), DEVICES_IN_BUS);
+	assert_memory_equal(addresses, address_list, 2);
+	assert_int_equal(addresses[2], 0);
+	free(address_list);
+}
+
+/* Test to verify the generation only changes when the table changes */
+static void test_target_device_table_generation(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device devices[DEVICES_IN_BUS];
+	uint64_t generation = 0;
+	uint64_t copied_generation = 0;
+	uint64_t new_generation = 0;
+
+	assert_int_equal(usbi3c_get_target_device_table_generation(deps->usbi3c_dev, &generation), 0);
+	assert_int_not_equal(generation, 0);
+	assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, devices, DEVICES_IN_BUS, &copied_generation), DEVICES_IN_BUS);
+	assert_int_equal(copied_generation, generation);
+	assert_int_equal(usbi3c_get_target_device_table_generation(deps->usbi3c_dev, &new_generation), 0);
+	assert_int_equal(new_generation, generation);
+
+	assert_int_equal(table_change_device_address(deps->usbi3c_dev->target_device_table, ADDRESS_1, NEW_ADDRESS), 0);
+	assert_int_equal(usbi3c_get_target_device_table_generation(deps->usbi3c_dev, &new_generation), 0);
+	assert_int_not_equal(new_generation, generation);
+	assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, devices, DEVICES_IN_BUS, &copied_generation), DEVICES_IN_BUS);
+	assert_int_equal(copied_generation, new_generation);
+	assert_int_equal(devices[0].dynamic_address, NEW_ADDRESS);
+}
+
+/* Test to verify the visitor is executed for every device and can stop the iteration */
+static void test_usbi3c_visit_target_devices(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct visit_data data = { 0 };
+
+	assert_int_equal(usbi3c_visit_target_devices(deps->usbi3c_dev, visit_device, &data, NULL), DEVICES_IN_BUS);
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		assert_int_equal(data.addresses[i], INITIAL_TARGET_ADDRESS_POOL + i);
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.stop_after = 2;
+	assert_int_equal(usbi3c_visit_target_devices(deps->usbi3c_dev, visit_device, &data, NULL), 2);
+	assert_int_equal(data.visited, 2);
+}
+
+/* micro-benchmark of a poll of the table using the allocating and the non allocating functions */
+static void test_target_device_table_poll_benchmark(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device devices[DEVICES_IN_BUS];
+	struct usbi3c_target_device **allocated = NULL;
+	struct timespec start, end;
+	uint64_t generation = 0;
+	double allocating_ns, copy_ns, generation_ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		assert_int_equal(usbi3c_get_target_device_table(deps->usbi3c_dev, &allocated), DEVICES_IN_BUS);
+		usbi3c_free_target_device_table(&allocated);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	allocating_ns = elapsed_ns(&start, &end) / BENCHMARK_ROUNDS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		assert_int_equal(usbi3c_copy_target_device_table(deps->usbi3c_dev, devices, DEVICES_IN_BUS, &generation), DEVICES_IN_BUS);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	copy_ns = elapsed_ns(&start, &end) / BENCHMARK_ROUNDS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		assert_int_equal(usbi3c_get_target_device_table_generation(deps->usbi3c_dev, &generation), 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	generation_ns = elapsed_ns(&start, &end) / BENCHMARK_ROUNDS;
+
+	print_message("table poll cost with %d devices: allocated copy %.1f ns, caller buffer %.1f ns, generation check %.1f ns\n",
+		      DEVICES_IN_BUS, allocating_ns, copy_ns, generation_ns);
+}
+
+int main(void)
+{
+	/* Unit tests for the non allocating target device table functions */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_copy_target_device_table, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_generation, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_visit_target_devices, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_table_poll_benchmark, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
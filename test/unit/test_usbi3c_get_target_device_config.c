@@ -49,7 +49,6 @@ static void test_usbi3c_get_target_device_config(void **state)
 {
 	struct usbi3c_device usbi3c_dev = { 0 };
 	struct target_device_table target_device_table = { 0 };
-	struct list *table = NULL;
 	struct target_device device = { 0 };
 	uint8_t config;
 	int ret = -1;
@@ -59,18 +58,19 @@ static void test_usbi3c_get_target_device_config(void **state)
 	device.device_data.ibi_timestamp = 1;
 	device.device_data.controller_role_request = 0;
 	device.device_data.target_interrupt_request = 1;
-	table = list_append(table, &device);
-	target_device_table.target_devices = table;
 	usbi3c_dev.target_device_table = &target_device_table;
 	target_device_table.mutex = malloc_or_die(sizeof(pthread_mutex_t));
 	pthread_mutex_init(target_device_table.mutex, NULL);
+	table_insert_device(&target_device_table, &device);
 
 	ret = usbi3c_get_target_device_config(&usbi3c_dev, ADDRESS, &config);
 	assert_int_equal(ret, 0);
 	assert_int_equal(config, 0b0101);
 
 	free(target_device_table.mutex);
-	list_free_list(&table);
+	free(target_device_table.snapshot);
+	list_free_list_and_data(&target_device_table.retired_snapshots, free);
+	list_free_list(&target_device_table.target_devices);
 }
 
 int main(void)
@@ -49,7 +49,6 @@ static void test_usbi3c_get_target_device_max_ibi_payload(void **state)
 {
 	struct usbi3c_device usbi3c_dev = { 0 };
 	struct target_device_table target_device_table = { 0 };
-	struct list *table = NULL;
 	struct target_device device = { 0 };
 	uint32_t max_payload;
 	int ret = -1;
@@ -57,18 +56,19 @@ static void test_usbi3c_get_target_device_max_ibi_payload(void **state)
 
 	device.target_address = ADDRESS;
 	device.device_data.max_ibi_payload_size = 2000;
-	table = list_append(table, &device);
-	target_device_table.target_devices = table;
 	usbi3c_dev.target_device_table = &target_device_table;
 	target_device_table.mutex = malloc_or_die(sizeof(pthread_mutex_t));
 	pthread_mutex_init(target_device_table.mutex, NULL);
+	table_insert_device(&target_device_table, &device);
 
 	ret = usbi3c_get_target_device_max_ibi_payload(&usbi3c_dev, ADDRESS, &max_payload);
 	assert_int_equal(ret, 0);
 	assert_int_equal(max_payload, 2000);
 
 	free(target_device_table.mutex);
-	list_free_list(&table);
+	free(target_device_table.snapshot);
+	list_free_list_and_data(&target_device_table.retired_snapshots, free);
+	list_free_list(&target_device_table.target_devices);
 }
 
 int main(void)
@@ -55,6 +55,7 @@ static void test_usbi3c_get_devices_in_table(void **state)
 {
 	struct usbi3c_device usbi3c_dev = { 0 };
 	struct target_device_table table = { 0 };
+	pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
 	struct target_device device_1 = { 0 };
 	struct target_device device_2 = { 0 };
 	struct usbi3c_target_device **target_devices = NULL;
@@ -76,6 +77,9 @@ static void test_usbi3c_get_devices_in_table(void **state)
 	device_2.device_data.target_type = USBI3C_I2C_DEVICE;
 	device_2.device_capability.static_address = 20;
 	table.target_devices = list_append(table.target_devices, &device_2);
+	table.mutex = &table_mutex;
+	/* the devices are read from the published snapshot of the table */
+	table_publish_snapshot(&table);
 	usbi3c_dev.target_device_table = &table;
 
 	ret = usbi3c_get_target_device_table(&usbi3c_dev, &target_devices);
@@ -104,6 +108,7 @@ static void test_usbi3c_get_devices_in_table(void **state)
 
 	usbi3c_free_target_device_table(&target_devices);
 	list_free_list(&table.target_devices);
+	free(table.snapshot);
 }
 
 int main(void)
@@ -56,7 +56,7 @@ static void test_usbi3c_initialize_target_device_capable_of_secondary_controller
 	/* when initializing a target device we send a bulk request transfer to it,
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -78,7 +78,7 @@ static void test_usbi3c_initialize_target_device_capable_of_secondary_controller
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the usb functions that get called during a target device initialization */
 	cap_buffer = mock_get_i3c_capability(NULL,
@@ -125,7 +125,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 	/* when initializing a target device we send a bulk request transfer to it,
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -146,7 +146,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the usb functions that get called during a target device initialization */
 	cap_buffer = mock_get_i3c_capability(NULL,
@@ -169,7 +169,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 	free(request_buffer);
 	free(response_buffer);
 
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   USBI3C_DEVICE_STATIC_ADDRESS,
 							   USBI3C_WRITE,
@@ -182,7 +182,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	mock_get_buffer_available(NULL, &buffer_available, RETURN_SUCCESS);
 	mock_usb_output_bulk_transfer(request_buffer, request_buffer_size, RETURN_SUCCESS);
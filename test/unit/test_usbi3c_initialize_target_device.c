@@ -81,7 +81,7 @@ static void test_negative_libusb_failure(void **state)
 	/* when initializing a target device we send a bulk request transfer to it,
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -130,7 +130,7 @@ static void test_negative_hot_join_failure(void **state)
 	/* when initializing a target device we send a bulk request transfer to it,
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -152,7 +152,7 @@ static void test_negative_hot_join_failure(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the usb functions that get called during a target device initialization */
 	cap_buffer = mock_get_i3c_capability(NULL,
@@ -193,7 +193,7 @@ static void test_usbi3c_initialize_target_device(void **state)
 	/* when initializing a target device we send a bulk request transfer to it,
 	 * let's create the type of buffer we expect so we can compare it against
 	 * the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   HOT_JOIN_ADDRESS,
 							   USBI3C_WRITE,
@@ -215,7 +215,7 @@ static void test_usbi3c_initialize_target_device(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the usb functions that get called during a target device initialization */
 	cap_buffer = mock_get_i3c_capability(NULL,
@@ -0,0 +1,275 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+
+#define COMMANDS 4
+#define DATA_SIZE 4
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t ADDRESS_3 = INITIAL_TARGET_ADDRESS_POOL + 2;
+const int TIMEOUT = 60;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	struct list *buffers;
+	int buffer_available;
+	int order[COMMANDS];
+	int responses;
+};
+
+/* a command of a test batch */
+struct test_command {
+	uint8_t address;
+	uint8_t direction;
+	uint8_t transfer_mode;
+	uint8_t transfer_rate;
+	int index;
+	struct test_deps *deps;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_i3c_mode(deps->usbi3c_dev, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	list_free_list_and_data(&deps->buffers, free);
+	free(deps);
+
+	return 0;
+}
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct test_command *command = (struct test_command *)user_data;
+
+	command->deps->order[command->deps->responses++] = command->index;
+
+	return 0;
+}
+
+/* enqueues the commands of a batch, each one with the mode of its target device */
+static void helper_enqueue_batch(struct test_deps *deps, struct test_command *commands, on_response_fn on_response_cb)
+{
+	unsigned char data[DATA_SIZE] = { 0 };
+
+	for (int i = 0; i < COMMANDS; i++) {
+		struct test_command *command = &commands[i];
+
+		command->index = i;
+		command->deps = deps;
+		assert_int_equal(usbi3c_set_target_device_i3c_mode(deps->usbi3c_dev, command->address, command->transfer_mode, command->transfer_rate, 0), 0);
+		assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, command->address, command->direction, USBI3C_TERMINATE_ON_ANY_ERROR,
+							DATA_SIZE, command->direction == USBI3C_WRITE ? data : NULL, on_response_cb, on_response_cb ? command : NULL),
+				 0);
+	}
+}
+
+/* mocks the bulk request with the commands of a batch in the order they are expected to be sent,
+ * and returns the response to them with the index of each command as data of the reads */
+static int helper_mock_batch(struct test_deps *deps, struct test_command *commands, const int *send_order, int request_id, unsigned char **response_buffer)
+{
+	struct usbi3c_response responses[COMMANDS] = { 0 };
+	unsigned char data[COMMANDS][DATA_SIZE] = { 0 };
+	unsigned char write_data[DATA_SIZE] = { 0 };
+	unsigned char *buffer = NULL;
+	struct list *list = NULL;
+	int buffer_size = 0;
+	int response_buffer_size = 0;
+
+	for (int i = 0; i < COMMANDS; i++) {
+		struct test_command *command = &commands[send_order[i]];
+		unsigned char *command_data = command->direction == USBI3C_WRITE ? write_data : NULL;
+
+		if (i == 0) {
+			buffer_size = helper_create_command_buffer(request_id, &buffer, command->address, command->direction, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE,
+								   command_data, command->transfer_mode, command->transfer_rate, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+		} else {
+			buffer_size = helper_add_to_command_buffer_with_mode(request_id + i, &buffer, buffer_size, command->address, command->direction, USBI3C_TERMINATE_ON_ANY_ERROR,
+									     DATA_SIZE, command_data, command->transfer_mode, command->transfer_rate);
+		}
+
+		responses[i].attempted = USBI3C_COMMAND_ATTEMPTED;
+		responses[i].error_status = USBI3C_SUCCEEDED;
+		if (command->direction == USBI3C_READ) {
+			data[i][0] = send_order[i];
+			responses[i].has_data = USBI3C_RESPONSE_HAS_DATA;
+			responses[i].data = data[i];
+			responses[i].data_length = DATA_SIZE;
+		}
+		list = list_append(list, &responses[i]);
+	}
+	deps->buffer_available = 2 * buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+
+	response_buffer_size = helper_create_multiple_response_buffer(response_buffer, list, request_id);
+	list_free_list(&list);
+
+	return response_buffer_size;
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_reorder_stats stats;
+
+	assert_int_equal(usbi3c_mark_commands_order_independent(NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_reorder_stats(NULL, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_reorder_stats(deps->usbi3c_dev, NULL), RETURN_FAILURE);
+	/* there are no commands to mark */
+	assert_int_equal(usbi3c_mark_commands_order_independent(deps->usbi3c_dev), RETURN_FAILURE);
+}
+
+/* Test to verify the commands are grouped by mode and the responses are returned in the order the commands were queued */
+static void test_send_commands_order_independent(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_1, USBI3C_WRITE, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_2, USBI3C_READ, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+		{ ADDRESS_1, USBI3C_READ, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_3, USBI3C_WRITE, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+	};
+	const int send_order[COMMANDS] = { 0, 2, 1, 3 };
+	struct usbi3c_reorder_stats stats;
+	struct usbi3c_response *response = NULL;
+	unsigned char *response_buffer = NULL;
+	struct list *responses = NULL;
+	struct list *node = NULL;
+	int response_buffer_size = 0;
+	int i = 0;
+
+	helper_enqueue_batch(deps, commands, NULL);
+	response_buffer_size = helper_mock_batch(deps, commands, send_order, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+
+	assert_int_equal(usbi3c_mark_commands_order_independent(deps->usbi3c_dev), 0);
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, TIMEOUT);
+	assert_int_equal(list_len(responses), COMMANDS);
+
+	/* the data read by each command identifies it */
+	for (node = responses, i = 0; node; node = node->next, i++) {
+		response = (struct usbi3c_response *)node->data;
+		if (commands[i].direction == USBI3C_READ) {
+			assert_int_equal(response->data_length, DATA_SIZE);
+			assert_int_equal(response->data[0], i);
+		} else {
+			assert_int_equal(response->data_length, 0);
+		}
+	}
+
+	/* SDR, HDR-DDR, SDR, HDR-DDR became SDR, SDR, HDR-DDR, HDR-DDR */
+	assert_int_equal(usbi3c_get_reorder_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.batches, 1);
+	assert_int_equal(stats.mode_switches, 1);
+	assert_int_equal(stats.mode_switches_saved, 2);
+
+	usbi3c_free_responses(&responses);
+	free(response_buffer);
+}
+
+/* Test to verify the commands to the same target device keep their order */
+static void test_submit_commands_order_independent(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_2, USBI3C_WRITE, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+		{ ADDRESS_1, USBI3C_WRITE, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_2, USBI3C_READ, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_3, USBI3C_READ, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+	};
+	/* the read from the second device cannot be moved ahead of its write */
+	const int send_order[COMMANDS] = { 0, 3, 1, 2 };
+	struct usbi3c_reorder_stats stats;
+	unsigned char *response_buffer = NULL;
+	int response_buffer_size = 0;
+
+	helper_enqueue_batch(deps, commands, on_response_cb);
+	response_buffer_size = helper_mock_batch(deps, commands, send_order, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+
+	assert_int_equal(usbi3c_mark_commands_order_independent(deps->usbi3c_dev), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	helper_trigger_response(response_buffer, response_buffer_size);
+
+	/* the callbacks run in the order the commands were executed */
+	assert_int_equal(deps->responses, COMMANDS);
+	assert_memory_equal(deps->order, send_order, sizeof(send_order));
+
+	assert_int_equal(usbi3c_get_reorder_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.batches, 1);
+	assert_int_equal(stats.mode_switches, 1);
+	assert_int_equal(stats.mode_switches_saved, 1);
+
+	free(response_buffer);
+}
+
+/* Test to verify the commands are sent in the order they were queued when the batch is not marked */
+static void test_send_commands_in_order(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_1, USBI3C_WRITE, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_2, USBI3C_WRITE, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+		{ ADDRESS_1, USBI3C_READ, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ },
+		{ ADDRESS_3, USBI3C_READ, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ },
+	};
+	const int send_order[COMMANDS] = { 0, 1, 2, 3 };
+	struct usbi3c_reorder_stats stats;
+	unsigned char *response_buffer = NULL;
+	int response_buffer_size = 0;
+
+	helper_enqueue_batch(deps, commands, on_response_cb);
+	response_buffer_size = helper_mock_batch(deps, commands, send_order, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	helper_trigger_response(response_buffer, response_buffer_size);
+	assert_memory_equal(deps->order, send_order, sizeof(send_order));
+
+	assert_int_equal(usbi3c_get_reorder_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.batches, 0);
+
+	free(response_buffer);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_mark_commands_order_independent() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_send_commands_order_independent, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_submit_commands_order_independent, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_send_commands_in_order, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,333 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define MAX_COMMANDS 4
+#define READ_SIZE 4
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t NEW_ADDRESS = 0x60;
+const int TIMEOUT = 60;
+
+const struct usbi3c_register_range VOLATILE_RANGES[] = { { 0x10, 0x1F } };
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	struct list *buffers;
+	int buffer_available;
+	uint8_t address; ///< the address the mocked requests are sent to
+};
+
+/* a command expected in a request, reads get the value as data */
+struct test_command {
+	uint8_t direction;
+	unsigned char data[4];
+	int data_size;
+	uint32_t error_status;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+	struct usbi3c_regmap_config config = {
+		.register_address_size = 1,
+		.value_size = 2,
+		.big_endian = TRUE,
+		.max_register = 0x7F,
+		.volatile_ranges = VOLATILE_RANGES,
+		.volatile_ranges_count = 1,
+	};
+
+	deps->address = ADDRESS_1;
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_i3c_mode(deps->usbi3c_dev, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, 0);
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_1, &config), 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	list_free_list_and_data(&deps->buffers, free);
+	free(deps);
+
+	return 0;
+}
+
+/* mocks a request with the commands expected and the response to it */
+static void helper_mock_request(struct test_deps *deps, struct test_command *commands, int count)
+{
+	struct usbi3c_response responses[MAX_COMMANDS] = { 0 };
+	unsigned char *buffer = NULL;
+	unsigned char *response_buffer = NULL;
+	struct list *list = NULL;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+	int buffer_size = 0;
+	int response_buffer_size = 0;
+	int failed = FALSE;
+
+	for (int i = 0; i < count; i++) {
+		unsigned char *data = commands[i].direction == USBI3C_WRITE ? commands[i].data : NULL;
+		int data_size = commands[i].direction == USBI3C_WRITE ? commands[i].data_size : READ_SIZE;
+
+		if (i == 0) {
+			buffer_size = helper_create_command_buffer(request_id, &buffer, deps->address, commands[i].direction, USBI3C_TERMINATE_ON_ANY_ERROR, data_size,
+								   data, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+		} else {
+			buffer_size = helper_add_to_command_buffer(request_id + i, &buffer, buffer_size, deps->address, commands[i].direction, USBI3C_TERMINATE_ON_ANY_ERROR,
+								   data_size, data);
+		}
+
+		/* the commands after a failed one are not attempted */
+		responses[i].attempted = failed ? USBI3C_COMMAND_NOT_ATTEMPTED : USBI3C_COMMAND_ATTEMPTED;
+		responses[i].error_status = commands[i].error_status;
+		failed = failed || commands[i].error_status != USBI3C_SUCCEEDED;
+		if (commands[i].direction == USBI3C_READ) {
+			responses[i].has_data = USBI3C_RESPONSE_HAS_DATA;
+			responses[i].data = commands[i].data;
+			responses[i].data_length = READ_SIZE;
+		}
+		list = list_append(list, &responses[i]);
+	}
+	deps->buffer_available = 2 * buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+
+	response_buffer_size = helper_create_multiple_response_buffer(&response_buffer, list, request_id);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, response_buffer);
+	list_free_list(&list);
+}
+
+/* mocks the read of a register with a 16-bit big endian value */
+static void helper_mock_register_read(struct test_deps *deps, uint8_t reg, uint16_t value)
+{
+	struct test_command commands[2] = {
+		{ USBI3C_WRITE, { reg }, 1, USBI3C_SUCCEEDED },
+		{ USBI3C_READ, { value >> 8, value & 0xFF }, READ_SIZE, USBI3C_SUCCEEDED },
+	};
+
+	helper_mock_request(deps, commands, 2);
+}
+
+/* Negative test to verify the functions handle invalid parameters gracefully */
+static void test_negative_invalid_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_register_range bad_range = { 0x20, 0x10 };
+	struct usbi3c_regmap_config config = { .register_address_size = 1, .value_size = 1, .max_register = 0xFF };
+	struct usbi3c_regmap_stats stats;
+	uint32_t value = 0;
+
+	assert_int_equal(usbi3c_regmap_init(NULL, ADDRESS_2, &config), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, NULL), RETURN_FAILURE);
+	/* the target device is not in the bus */
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, 0x50, &config), RETURN_FAILURE);
+
+	config.register_address_size = 0;
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, &config), RETURN_FAILURE);
+	config.register_address_size = 1;
+	config.value_size = 3;
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, &config), RETURN_FAILURE);
+	config.value_size = 1;
+	config.max_register = 0x100;
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, &config), RETURN_FAILURE);
+	config.max_register = 0xFF;
+	config.volatile_ranges = &bad_range;
+	config.volatile_ranges_count = 1;
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, &config), RETURN_FAILURE);
+
+	/* the target device has no register map */
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_2, 0, &value, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_2, 0, 0, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_sync(deps->usbi3c_dev, ADDRESS_2, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_exit(deps->usbi3c_dev, ADDRESS_2), RETURN_FAILURE);
+
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0, NULL, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x80, &value, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_get_stats(NULL, ADDRESS_1, &stats), RETURN_FAILURE);
+
+	/* the register map cannot send its commands while the queue has commands */
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS_2, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, READ_SIZE, NULL, NULL, NULL), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0, &value, TIMEOUT), RETURN_FAILURE);
+
+	assert_int_equal(usbi3c_regmap_exit(deps->usbi3c_dev, ADDRESS_1), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0, &value, TIMEOUT), RETURN_FAILURE);
+}
+
+/* Test to verify the register map of each target device can be removed */
+static void test_usbi3c_regmap_exit(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_regmap_config config = { .register_address_size = 1, .value_size = 1, .max_register = 0xFF };
+	struct usbi3c_regmap_stats stats;
+
+	assert_int_equal(usbi3c_regmap_init(deps->usbi3c_dev, ADDRESS_2, &config), 0);
+	assert_int_equal(usbi3c_regmap_exit(deps->usbi3c_dev, ADDRESS_2), 0);
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_2, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, &stats), 0);
+}
+
+/* Test to verify cacheable registers are read from the target device only once */
+static void test_usbi3c_regmap_read(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_regmap_stats stats;
+	uint32_t value = 0;
+
+	helper_mock_register_read(deps, 0x05, 0x1234);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x1234);
+	/* no request is mocked, it is served from the cache */
+	value = 0;
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x1234);
+
+	/* volatile registers are always read from the target device */
+	helper_mock_register_read(deps, 0x10, 0x0001);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x10, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x0001);
+	helper_mock_register_read(deps, 0x10, 0x0002);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x10, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x0002);
+
+	/* the cache can be dropped */
+	assert_int_equal(usbi3c_regmap_invalidate(deps->usbi3c_dev, ADDRESS_1), 0);
+	helper_mock_register_read(deps, 0x05, 0x5678);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x5678);
+
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, &stats), 0);
+	assert_int_equal(stats.cache_hits, 1);
+	assert_int_equal(stats.bus_reads, 4);
+}
+
+/* Test to verify writes go through the cache */
+static void test_usbi3c_regmap_write(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command write[1] = { { USBI3C_WRITE, { 0x05, 0xBE, 0xEF }, 3, USBI3C_SUCCEEDED } };
+	struct test_command failed_write[1] = { { USBI3C_WRITE, { 0x06, 0x00, 0x01 }, 3, USBI3C_FAILED_CRC_ERROR } };
+	struct usbi3c_regmap_stats stats;
+	uint32_t value = 0;
+
+	helper_mock_request(deps, write, 1);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_1, 0x05, 0xBEEF, TIMEOUT), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0xBEEF);
+
+	/* the value of a register is unknown after a failed write */
+	helper_mock_request(deps, failed_write, 1);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_1, 0x06, 0x0001, TIMEOUT), RETURN_FAILURE);
+	helper_mock_register_read(deps, 0x06, 0x0000);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x06, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x0000);
+
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, &stats), 0);
+	assert_int_equal(stats.cache_hits, 1);
+	assert_int_equal(stats.bus_reads, 1);
+	assert_int_equal(stats.bus_writes, 2);
+}
+
+/* Test to verify deferred writes are only sent for the dirty registers, in a single request */
+static void test_usbi3c_regmap_sync(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command sync[2] = {
+		{ USBI3C_WRITE, { 0x01, 0x22, 0x22 }, 3, USBI3C_SUCCEEDED },
+		{ USBI3C_WRITE, { 0x02, 0x33, 0x33 }, 3, USBI3C_FAILED_CRC_ERROR },
+	};
+	struct test_command retry[1] = { { USBI3C_WRITE, { 0x02, 0x33, 0x33 }, 3, USBI3C_SUCCEEDED } };
+	struct usbi3c_regmap_stats stats;
+	uint32_t value = 0;
+
+	assert_int_equal(usbi3c_regmap_defer_writes(deps->usbi3c_dev, ADDRESS_1, TRUE), 0);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_1, 0x02, 0x1111, TIMEOUT), 0);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_1, 0x01, 0x2222, TIMEOUT), 0);
+	assert_int_equal(usbi3c_regmap_write(deps->usbi3c_dev, ADDRESS_1, 0x02, 0x3333, TIMEOUT), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x02, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x3333);
+
+	/* the register that failed remains dirty */
+	helper_mock_request(deps, sync, 2);
+	assert_int_equal(usbi3c_regmap_sync(deps->usbi3c_dev, ADDRESS_1, TIMEOUT), RETURN_FAILURE);
+	helper_mock_request(deps, retry, 1);
+	assert_int_equal(usbi3c_regmap_sync(deps->usbi3c_dev, ADDRESS_1, TIMEOUT), 1);
+	/* there is nothing left to sync */
+	assert_int_equal(usbi3c_regmap_sync(deps->usbi3c_dev, ADDRESS_1, TIMEOUT), 0);
+
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, &stats), 0);
+	assert_int_equal(stats.deferred_writes, 3);
+	assert_int_equal(stats.registers_synced, 2);
+	assert_int_equal(stats.bus_writes, 3);
+}
+
+/* Test to verify the register map stays with its target device when the address of the target device changes */
+static void test_usbi3c_regmap_address_change(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device_table *table = deps->usbi3c_dev->target_device_table;
+	struct usbi3c_regmap_stats stats;
+	uint32_t value = 0;
+
+	helper_mock_register_read(deps, 0x05, 0x1234);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), 0);
+
+	/* the cache is used with the new address of the target device */
+	assert_int_equal(table_change_device_address(table, ADDRESS_1, NEW_ADDRESS), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, NEW_ADDRESS, 0x05, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x1234);
+	deps->address = NEW_ADDRESS;
+	helper_mock_register_read(deps, 0x10, 0x5678);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, NEW_ADDRESS, 0x10, &value, TIMEOUT), 0);
+	assert_int_equal(value, 0x5678);
+
+	/* a different target device that takes the previous address does not get the cache */
+	assert_int_equal(table_change_device_address(table, ADDRESS_2, ADDRESS_1), 0);
+	assert_int_equal(usbi3c_regmap_read(deps->usbi3c_dev, ADDRESS_1, 0x05, &value, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, ADDRESS_1, &stats), RETURN_FAILURE);
+
+	assert_int_equal(usbi3c_regmap_get_stats(deps->usbi3c_dev, NEW_ADDRESS, &stats), 0);
+	assert_int_equal(stats.cache_hits, 1);
+	assert_int_equal(stats.bus_reads, 2);
+	assert_int_equal(usbi3c_regmap_exit(deps->usbi3c_dev, NEW_ADDRESS), 0);
+}
+
+int main(void)
+{
+	/* Unit tests for the register map functions */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_invalid_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_regmap_read, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_regmap_write, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_regmap_sync, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_regmap_exit, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_regmap_address_change, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -108,7 +108,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 	/* the hot-join request is sent as a sync bulk request transfer,
 	 * let's create the type of buffer we expect so we can compare it
 	 * against the one generated by the library */
-	request_buffer_size = helper_create_command_buffer(bulk_request_id,
+	request_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev),
 							   &request_buffer,
 							   USBI3C_DEVICE_STATIC_ADDRESS,
 							   USBI3C_WRITE,
@@ -130,7 +130,7 @@ static void test_usbi3c_request_i3c_controller_role(void **state)
 	response.data = NULL;
 	response_buffer_size = helper_create_response_buffer(&response_buffer,
 							     &response,
-							     bulk_request_id);
+							     helper_next_request_id(deps->usbi3c_dev));
 
 	/* mock the USB related functions */
 	mock_get_buffer_available(NULL, &buffer_available, RETURN_SUCCESS);
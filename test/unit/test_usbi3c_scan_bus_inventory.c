@@ -0,0 +1,276 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define DEVICES_IN_BUS 3
+#define CCCS_PER_DEVICE 6
+#define NO_NACK -1
+
+const int TIMEOUT = 60;
+
+/* the order in which the CCCs are sent to every device */
+static const uint8_t CCCS[CCCS_PER_DEVICE] = { 0x8D, 0x8E, 0x8F, 0x94, 0x8C, 0x8B };
+static const int READ_SIZES[CCCS_PER_DEVICE] = { 8, 4, 4, 8, 4, 4 };
+
+/* request and response space used by the CCCs of one device in the I3C function */
+#define DEVICE_BUFFER_SIZE (CCCS_PER_DEVICE * (5 * DWORD_SIZE + 3 * DWORD_SIZE) + 32)
+#define BATCH_OVERHEAD (2 * DWORD_SIZE)
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	struct list *buffers;
+	int buffer_available[8];
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	list_free_list_and_data(&deps->buffers, free);
+	free(deps);
+
+	return 0;
+}
+
+/* mocks the bulk request with the CCCs of count devices starting from the first one */
+static void helper_mock_batch(struct test_deps *deps, int request_id, int first, int count, int *buffer_available)
+{
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	for (int i = first; i < first + count; i++) {
+		for (int j = 0; j < CCCS_PER_DEVICE; j++) {
+			if (buffer == NULL) {
+				buffer_size = helper_create_ccc_buffer(request_id, CCCS[j], &buffer, INITIAL_TARGET_ADDRESS_POOL + i, USBI3C_READ,
+								       USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK, READ_SIZES[j], NULL,
+								       USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+			} else {
+				buffer_size = helper_add_ccc_to_command_buffer(request_id, CCCS[j], &buffer, buffer_size, INITIAL_TARGET_ADDRESS_POOL + i, USBI3C_READ,
+									       USBI3C_DO_NOT_TERMINATE_ON_ERROR_INCLUDING_NACK, READ_SIZES[j], NULL);
+			}
+			request_id++;
+		}
+	}
+
+	mock_get_buffer_available(NULL, buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+}
+
+/* mocks the bulk response to the CCCs of count devices starting from the first one,
+ * the device nack_device NACKs its CCC nack_ccc */
+static void helper_mock_batch_response(struct test_deps *deps, int request_id, int first, int count, int nack_device, int nack_ccc)
+{
+	struct usbi3c_response responses[DEVICES_IN_BUS * CCCS_PER_DEVICE];
+	unsigned char data[DEVICES_IN_BUS][CCCS_PER_DEVICE][5];
+	struct list *list = NULL;
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+	int n = 0;
+
+	for (int i = first; i < first + count; i++) {
+		/* GETPID */
+		memcpy(data[i][0], (unsigned char[]){ 0x00, 0x00, 0x00, 0x00, 0xFF }, 5);
+		/* GETBCR, GETDCR */
+		data[i][1][0] = 0x10 + i;
+		data[i][2][0] = 0x20 + i;
+		/* GETMXDS with a max read turnaround of 10000 us */
+		memcpy(data[i][3], (unsigned char[]){ 0x01, 0x02, 0x10, 0x27, 0x00 }, 5);
+		/* GETMRL of 256 bytes, GETMWL of 128 bytes + device index */
+		memcpy(data[i][4], (unsigned char[]){ 0x01, 0x00 }, 2);
+		memcpy(data[i][5], (unsigned char[]){ 0x00, 0x80 + i }, 2);
+
+		for (int j = 0; j < CCCS_PER_DEVICE; j++) {
+			struct usbi3c_response *response = &responses[n++];
+
+			response->attempted = USBI3C_COMMAND_ATTEMPTED;
+			response->error_status = USBI3C_SUCCEEDED;
+			response->has_data = USBI3C_RESPONSE_HAS_DATA;
+			response->data = data[i][j];
+			response->data_length = (j == 1 || j == 2) ? 1 : (j == 4 || j == 5) ? 2 : 5;
+			if (j == 0) {
+				/* the PID is 6 bytes long, its last byte is the PID_LO of the device */
+				response->data = (unsigned char *)calloc(1, 6);
+				memcpy(response->data, data[i][0], 5);
+				response->data[5] = i;
+				response->data_length = 6;
+			}
+			if (i == nack_device && j == nack_ccc) {
+				response->error_status = USBI3C_FAILED_NACK;
+				response->has_data = USBI3C_RESPONSE_HAS_NO_DATA;
+				response->data_length = 0;
+			}
+			list = list_append(list, response);
+		}
+	}
+
+	buffer_size = helper_create_multiple_response_buffer(&buffer, list, request_id);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+
+	for (int i = 0; i < n; i += CCCS_PER_DEVICE) {
+		free(responses[i].data);
+	}
+	list_free_list(&list);
+}
+
+static void assert_device_inventory(struct test_deps *deps, int device, uint8_t valid)
+{
+	struct usbi3c_target_inventory inventory;
+	uint8_t address = INITIAL_TARGET_ADDRESS_POOL + device;
+
+	assert_int_equal(usbi3c_get_target_device_inventory(deps->usbi3c_dev, address, &inventory), 0);
+	assert_int_equal(inventory.valid, valid);
+	assert_int_equal(usbi3c_get_target_BCR(deps->usbi3c_dev, address), 0x10 + device);
+	assert_int_equal(usbi3c_get_target_DCR(deps->usbi3c_dev, address), 0x20 + device);
+	assert_int_equal(inventory.max_read_length, 256);
+	assert_int_equal(inventory.max_write_length, 0x80 + device);
+	if (valid & USBI3C_INVENTORY_MXDS) {
+		assert_int_equal(inventory.max_write_speed, 0x01);
+		assert_int_equal(inventory.max_read_speed, 0x02);
+		assert_int_equal(inventory.max_read_turnaround_us, 10000);
+	} else {
+		assert_int_equal(inventory.max_read_turnaround_us, 0);
+	}
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_inventory inventory;
+
+	assert_int_equal(usbi3c_scan_bus_inventory(NULL, TIMEOUT), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_inventory(NULL, INITIAL_TARGET_ADDRESS_POOL, &inventory), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_inventory(deps->usbi3c_dev, INITIAL_TARGET_ADDRESS_POOL, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_inventory(deps->usbi3c_dev, 0x7E, &inventory), RETURN_FAILURE);
+}
+
+/* Negative test to verify the scan is only done by the active controller */
+static void test_negative_not_active_controller(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	deps->usbi3c_dev->device_info->device_state.active_i3c_controller = FALSE;
+
+	assert_int_equal(usbi3c_scan_bus_inventory(deps->usbi3c_dev, TIMEOUT), RETURN_FAILURE);
+}
+
+/* Test to verify the CCCs of all devices are sent in a single request when they fit */
+static void test_scan_bus_inventory_single_batch(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_inventory inventory;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	deps->buffer_available[0] = 2 * (BATCH_OVERHEAD + DEVICES_IN_BUS * DEVICE_BUFFER_SIZE);
+	mock_get_buffer_available(NULL, &deps->buffer_available[0], RETURN_SUCCESS);
+	helper_mock_batch(deps, request_id, 0, DEVICES_IN_BUS, &deps->buffer_available[0]);
+	/* the second device does not support GETMXDS */
+	helper_mock_batch_response(deps, request_id, 0, DEVICES_IN_BUS, 1, 3);
+
+	assert_int_equal(usbi3c_get_target_device_inventory(deps->usbi3c_dev, INITIAL_TARGET_ADDRESS_POOL, &inventory), 0);
+	assert_int_equal(inventory.valid, 0);
+
+	assert_int_equal(usbi3c_scan_bus_inventory(deps->usbi3c_dev, TIMEOUT), DEVICES_IN_BUS);
+
+	assert_device_inventory(deps, 0, 0x3F);
+	assert_device_inventory(deps, 1, 0x3F & ~USBI3C_INVENTORY_MXDS);
+	assert_device_inventory(deps, 2, 0x3F);
+
+	/* all the responses were consumed */
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+}
+
+/* Test to verify the CCCs are split in several pipelined requests when they don't fit in the buffer */
+static void test_scan_bus_inventory_pipelined_batches(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	/* only one device fits in half of the buffer, so every request has one device
+	 * and all of them are sent before waiting for any response */
+	deps->buffer_available[0] = 2 * (BATCH_OVERHEAD + DEVICE_BUFFER_SIZE) + DEVICE_BUFFER_SIZE;
+	mock_get_buffer_available(NULL, &deps->buffer_available[0], RETURN_SUCCESS);
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		helper_mock_batch(deps, request_id + i * CCCS_PER_DEVICE, i, 1, &deps->buffer_available[0]);
+	}
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		helper_mock_batch_response(deps, request_id + i * CCCS_PER_DEVICE, i, 1, NO_NACK, NO_NACK);
+	}
+
+	assert_int_equal(usbi3c_scan_bus_inventory(deps->usbi3c_dev, TIMEOUT), DEVICES_IN_BUS);
+
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		assert_device_inventory(deps, i, 0x3F);
+	}
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+}
+
+/* Test to verify a request that does not fit in the buffer is retried once the requests in flight complete */
+static void test_scan_bus_inventory_buffer_full(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	deps->buffer_available[0] = 2 * (BATCH_OVERHEAD + DEVICE_BUFFER_SIZE);
+	deps->buffer_available[1] = DEVICE_BUFFER_SIZE;
+	mock_get_buffer_available(NULL, &deps->buffer_available[0], RETURN_SUCCESS);
+	helper_mock_batch(deps, request_id, 0, 1, &deps->buffer_available[0]);
+	/* there is no room for the second request until the first one completes */
+	mock_get_buffer_available(NULL, &deps->buffer_available[1], RETURN_SUCCESS);
+	helper_mock_batch_response(deps, request_id, 0, 1, NO_NACK, NO_NACK);
+	helper_mock_batch(deps, request_id + CCCS_PER_DEVICE, 1, 1, &deps->buffer_available[0]);
+	helper_mock_batch(deps, request_id + 2 * CCCS_PER_DEVICE, 2, 1, &deps->buffer_available[0]);
+	helper_mock_batch_response(deps, request_id + CCCS_PER_DEVICE, 1, 1, NO_NACK, NO_NACK);
+	helper_mock_batch_response(deps, request_id + 2 * CCCS_PER_DEVICE, 2, 1, 2, 0);
+
+	assert_int_equal(usbi3c_scan_bus_inventory(deps->usbi3c_dev, TIMEOUT), DEVICES_IN_BUS);
+
+	assert_device_inventory(deps, 0, 0x3F);
+	assert_device_inventory(deps, 1, 0x3F);
+	assert_device_inventory(deps, 2, 0x3F & ~USBI3C_INVENTORY_PID);
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_scan_bus_inventory() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_not_active_controller, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_scan_bus_inventory_single_batch, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_scan_bus_inventory_pipelined_batches, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_scan_bus_inventory_buffer_full, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
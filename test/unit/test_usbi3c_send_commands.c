@@ -15,6 +15,7 @@
 
 #include "helpers.h"
 #include "mocks.h"
+#include "request_id_i.h"
 
 int fake_handle = 1;
 
@@ -151,7 +152,7 @@ static void test_negative_not_enough_buffer_available(void **state)
 	deps->usbi3c_dev->command_queue = list_append(deps->usbi3c_dev->command_queue, command);
 
 	/* get a representation of how the command would look in memory, along with the size it would require */
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 0, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 0, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is smaller than the required buffer by 2 bytes */
 	buffer_available = expected_command_buffer_size - 2;
@@ -197,7 +198,7 @@ static void test_send_single_write_command(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = expected_command_buffer_size + 100;
@@ -218,7 +219,7 @@ static void test_send_single_write_command(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = expected_response_data;
 	expected_response.data_length = sizeof(expected_response_data);
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -305,7 +306,7 @@ static void test_send_single_read_command(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = expected_command_buffer_size + 100;
@@ -326,7 +327,7 @@ static void test_send_single_read_command(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = expected_response_data;
 	expected_response.data_length = BYTES_TO_READ;
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -412,7 +413,7 @@ static void test_send_ccc(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_ccc_buffer(bulk_request_id,
+	expected_command_buffer_size = helper_create_ccc_buffer(helper_next_request_id(deps->usbi3c_dev),
 								CCC_ENEC_DIRECT,
 								&expected_command_buffer,
 								DEVICE_ADDRESS,
@@ -443,7 +444,7 @@ static void test_send_ccc(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = NULL;
 	expected_response.data_length = 0;
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -531,7 +532,7 @@ static void test_send_ccc_with_defining_byte(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_ccc_with_defining_byte_buffer(bulk_request_id,
+	expected_command_buffer_size = helper_create_ccc_with_defining_byte_buffer(helper_next_request_id(deps->usbi3c_dev),
 										   CCC_RSTACT_BROADCAST,
 										   RESET_PERIPHERAL,
 										   &expected_command_buffer,
@@ -563,7 +564,7 @@ static void test_send_ccc_with_defining_byte(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = NULL;
 	expected_response.data_length = 0;
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -651,7 +652,7 @@ static void test_send_ccc_with_defining_byte_with_value_zero(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_ccc_with_defining_byte_buffer(bulk_request_id,
+	expected_command_buffer_size = helper_create_ccc_with_defining_byte_buffer(helper_next_request_id(deps->usbi3c_dev),
 										   CCC_ENEC_BROADCAST,
 										   0x00, // the ENEC broadcast CCC doesn't accept a defining byte, but for testing purposes let's ignore that
 										   &expected_command_buffer,
@@ -683,7 +684,7 @@ static void test_send_ccc_with_defining_byte_with_value_zero(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = NULL;
 	expected_response.data_length = 0;
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -771,7 +772,7 @@ static void test_send_command_at_different_transfer_mode(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_6_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_6_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = expected_command_buffer_size + 100;
@@ -792,7 +793,7 @@ static void test_send_command_at_different_transfer_mode(void **state)
 	expected_response.error_status = USBI3C_SUCCEEDED;
 	expected_response.data = expected_response_data;
 	expected_response.data_length = sizeof(expected_response_data);
-	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, bulk_request_id);
+	expected_response_buffer_size = helper_create_response_buffer(&expected_response_buffer, &expected_response, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -881,9 +882,9 @@ static void test_send_multiple_commands(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data1), data1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
-	expected_command_buffer_size = helper_add_to_command_buffer(bulk_request_id + 1, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL);
-	expected_command_buffer_size = helper_add_to_command_buffer(bulk_request_id + 2, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data2), data2);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data1), data1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_add_to_command_buffer(helper_next_request_id(deps->usbi3c_dev) + 1, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL);
+	expected_command_buffer_size = helper_add_to_command_buffer(helper_next_request_id(deps->usbi3c_dev) + 2, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data2), data2);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = expected_command_buffer_size + 100;
@@ -920,7 +921,7 @@ static void test_send_multiple_commands(void **state)
 	r3.data_length = 0;
 	expected_responses = list_append(expected_responses, &r3);
 
-	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, bulk_request_id);
+	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -1049,9 +1050,9 @@ static void test_send_multiple_dependent_commands(void **state)
 	/* Mocks for sending a command */
 	/*******************************/
 
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data1), data1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_DEPENDENT_ON_PREVIOUS);
-	expected_command_buffer_size = helper_add_to_command_buffer(bulk_request_id + 1, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL);
-	expected_command_buffer_size = helper_add_to_command_buffer(bulk_request_id + 2, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data2), data2);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data1), data1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_add_to_command_buffer(helper_next_request_id(deps->usbi3c_dev) + 1, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, BYTES_TO_READ, NULL);
+	expected_command_buffer_size = helper_add_to_command_buffer(helper_next_request_id(deps->usbi3c_dev) + 2, &expected_command_buffer, expected_command_buffer_size, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data2), data2);
 
 	/* let's say the buffer available is larger than the required buffer by 100 bytes */
 	buffer_available = expected_command_buffer_size + 100;
@@ -1088,7 +1089,7 @@ static void test_send_multiple_dependent_commands(void **state)
 	r3.data_length = 0;
 	expected_responses = list_append(expected_responses, &r3);
 
-	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, bulk_request_id);
+	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -1175,7 +1176,7 @@ static void test_send_target_reset_pattern(void **state)
 	unsigned char *expected_response_buffer = NULL;
 	int expected_response_buffer_size = 0;
 	int buffer_available = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 
 	/* variables required by the user */
 	struct usbi3c_command *command = NULL;
@@ -1233,7 +1234,7 @@ static void test_send_target_reset_pattern(void **state)
 	r2.data_length = 0;
 	expected_responses = list_append(expected_responses, &r2);
 
-	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, bulk_request_id);
+	expected_response_buffer_size = helper_create_multiple_response_buffer(&expected_response_buffer, expected_responses, helper_next_request_id(deps->usbi3c_dev));
 
 	/* add a mock response notification */
 	fake_transfer_add_data(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, expected_response_buffer, expected_response_buffer_size);
@@ -1317,6 +1318,57 @@ static void test_send_target_reset_pattern(void **state)
 	free(expected_command_buffer);
 }
 
+/* This test verifies that the requests whose responses timed out stop being tracked,
+ * so their IDs don't keep the allocator from issuing new ones */
+static void test_send_command_timeout(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct bulk_requests *regular_requests = deps->usbi3c_dev->request_tracker->regular_requests;
+	struct usbi3c_submit_window_stats stats;
+	unsigned char *expected_command_buffer = NULL;
+	int expected_command_buffer_size = 0;
+	int buffer_available = 0;
+	struct usbi3c_command *command = NULL;
+	unsigned char data[] = "Arbitrary test data";
+	uint16_t *request_ids = NULL;
+
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	buffer_available = expected_command_buffer_size + 100;
+	mock_get_buffer_available(&fake_handle, &buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(expected_command_buffer, expected_command_buffer_size, RETURN_SUCCESS);
+
+	/* the response never arrives */
+	mock_libusb_wait_for_events_not_trigger(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, RETURN_SUCCESS);
+
+	command = (struct usbi3c_command *)calloc(1, sizeof(struct usbi3c_command));
+	command->command_descriptor = (struct command_descriptor *)calloc(1, sizeof(struct command_descriptor));
+	command->command_descriptor->command_type = REGULAR_COMMAND;
+	command->command_descriptor->target_address = DEVICE_ADDRESS;
+	command->command_descriptor->command_direction = USBI3C_WRITE;
+	command->command_descriptor->error_handling = USBI3C_TERMINATE_ON_ANY_ERROR;
+	command->command_descriptor->data_length = sizeof(data);
+	command->data = (unsigned char *)calloc(1, sizeof(data));
+	memcpy(command->data, data, sizeof(data));
+	deps->usbi3c_dev->command_queue = list_append(deps->usbi3c_dev->command_queue, command);
+
+	assert_null(usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, 1));
+
+	assert_null(regular_requests->requests);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.commands_in_flight, 0);
+	assert_int_equal(stats.bytes_in_flight, 0);
+
+	/* IDs can be issued past half the range from the request that timed out */
+	request_ids = (uint16_t *)calloc(REQUEST_ID_HALF_RANGE, sizeof(uint16_t));
+	assert_int_equal(request_id_alloc(regular_requests->request_ids, request_ids, REQUEST_ID_HALF_RANGE), 0);
+	for (int i = 0; i < REQUEST_ID_HALF_RANGE; i++) {
+		request_id_free(regular_requests->request_ids, request_ids[i]);
+	}
+
+	free(request_ids);
+	free(expected_command_buffer);
+}
+
 int main(void)
 {
 
@@ -1337,6 +1389,7 @@ int main(void)
 		cmocka_unit_test(test_send_multiple_commands),
 		cmocka_unit_test(test_send_multiple_dependent_commands),
 		cmocka_unit_test(test_send_target_reset_pattern),
+		cmocka_unit_test(test_send_command_timeout),
 	};
 
 	return cmocka_run_group_tests(tests, group_setup, group_teardown);
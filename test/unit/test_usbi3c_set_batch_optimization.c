@@ -0,0 +1,389 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+
+#define COMMANDS 4
+#define MAX_SENT 4
+#define DATA_SIZE 4
+#define REGISTER_ADDRESS_SIZE 1
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const int TIMEOUT = 60;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	struct list *buffers;
+	int buffer_available;
+	int calls[COMMANDS];
+	uint32_t status[COMMANDS];
+	unsigned char read[COMMANDS];
+};
+
+/* a command of a test batch, writes start with the register they write to */
+struct test_command {
+	uint8_t address;
+	uint8_t direction;
+	uint8_t reg;
+	int index;
+	struct test_deps *deps;
+};
+
+/* a command expected in the bulk request, and its response */
+struct test_sent {
+	uint8_t address;
+	uint8_t direction;
+	uint8_t reg;
+	int data_size;
+	uint32_t error_status;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_i3c_mode(deps->usbi3c_dev, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, 0);
+	assert_int_equal(usbi3c_set_batch_optimization(deps->usbi3c_dev, USBI3C_COALESCE_WRITES | USBI3C_DEDUPLICATE_READS, REGISTER_ADDRESS_SIZE), 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	list_free_list_and_data(&deps->buffers, free);
+	free(deps);
+
+	return 0;
+}
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct test_command *command = (struct test_command *)user_data;
+	struct test_deps *deps = command->deps;
+
+	deps->calls[command->index]++;
+	deps->status[command->index] = response->error_status;
+	if (response->data_length > 0) {
+		deps->read[command->index] = response->data[0];
+	}
+
+	return 0;
+}
+
+/* fills the data of a write, the first byte is the register and the rest of them are
+ * the register numbers, so coalesced writes carry consecutive values */
+static void helper_write_data(unsigned char *data, uint8_t reg, int size)
+{
+	data[0] = reg;
+	for (int i = 1; i < size; i++) {
+		data[i] = reg + i - 1;
+	}
+}
+
+/* enqueues the commands of a batch */
+static void helper_enqueue_batch(struct test_deps *deps, struct test_command *commands, on_response_fn on_response_cb)
+{
+	unsigned char data[DATA_SIZE] = { 0 };
+
+	for (int i = 0; i < COMMANDS; i++) {
+		struct test_command *command = &commands[i];
+
+		command->index = i;
+		command->deps = deps;
+		helper_write_data(data, command->reg, DATA_SIZE);
+		assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, command->address, command->direction, USBI3C_TERMINATE_ON_ANY_ERROR,
+							DATA_SIZE, command->direction == USBI3C_WRITE ? data : NULL, on_response_cb, on_response_cb ? command : NULL),
+				 0);
+	}
+}
+
+/* mocks the bulk request with the commands expected to be sent, and returns the response
+ * to them with the index of each command sent as data of the reads */
+static int helper_mock_batch(struct test_deps *deps, struct test_sent *sent, int count, int request_id, unsigned char **response_buffer)
+{
+	struct usbi3c_response responses[MAX_SENT] = { 0 };
+	unsigned char data[MAX_SENT][DATA_SIZE] = { 0 };
+	unsigned char write_data[MAX_SENT * DATA_SIZE] = { 0 };
+	unsigned char *buffer = NULL;
+	struct list *list = NULL;
+	int buffer_size = 0;
+	int response_buffer_size = 0;
+
+	for (int i = 0; i < count; i++) {
+		unsigned char *command_data = sent[i].direction == USBI3C_WRITE ? write_data : NULL;
+
+		helper_write_data(write_data, sent[i].reg, sent[i].data_size);
+		if (i == 0) {
+			buffer_size = helper_create_command_buffer(request_id, &buffer, sent[i].address, sent[i].direction, USBI3C_TERMINATE_ON_ANY_ERROR, sent[i].data_size,
+								   command_data, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+		} else {
+			buffer_size = helper_add_to_command_buffer(request_id + i, &buffer, buffer_size, sent[i].address, sent[i].direction, USBI3C_TERMINATE_ON_ANY_ERROR,
+								   sent[i].data_size, command_data);
+		}
+
+		responses[i].attempted = USBI3C_COMMAND_ATTEMPTED;
+		responses[i].error_status = sent[i].error_status;
+		if (sent[i].direction == USBI3C_READ) {
+			data[i][0] = 0xA0 + i;
+			responses[i].has_data = USBI3C_RESPONSE_HAS_DATA;
+			responses[i].data = data[i];
+			responses[i].data_length = DATA_SIZE;
+		}
+		list = list_append(list, &responses[i]);
+	}
+	deps->buffer_available = 2 * buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers = list_append(deps->buffers, buffer);
+
+	response_buffer_size = helper_create_multiple_response_buffer(response_buffer, list, request_id);
+	list_free_list(&list);
+
+	return response_buffer_size;
+}
+
+/* Negative test to verify the functions handle invalid parameters gracefully */
+static void test_negative_invalid_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_batch_optimization_stats stats;
+
+	assert_int_equal(usbi3c_set_batch_optimization(NULL, USBI3C_COALESCE_WRITES, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_batch_optimization(deps->usbi3c_dev, 0x4, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_batch_optimization(deps->usbi3c_dev, USBI3C_COALESCE_WRITES, 5), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_batch_optimization_stats(NULL, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_batch_optimization_stats(deps->usbi3c_dev, NULL), RETURN_FAILURE);
+}
+
+/* Test to verify adjacent writes are coalesced, identical reads are sent once, and
+ * every command queued gets its response */
+static void test_send_commands_optimized(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_1, USBI3C_WRITE, 0x10 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x13 },
+		{ ADDRESS_2, USBI3C_READ },
+		{ ADDRESS_2, USBI3C_READ },
+	};
+	/* the second write continues at the register where the first one ended */
+	struct test_sent sent[] = {
+		{ ADDRESS_1, USBI3C_WRITE, 0x10, 2 * DATA_SIZE - REGISTER_ADDRESS_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_2, USBI3C_READ, 0, DATA_SIZE, USBI3C_SUCCEEDED },
+	};
+	struct usbi3c_batch_optimization_stats stats;
+	struct usbi3c_response *response = NULL;
+	unsigned char *response_buffer = NULL;
+	struct list *responses = NULL;
+	struct list *node = NULL;
+	int response_buffer_size = 0;
+	int i = 0;
+
+	helper_enqueue_batch(deps, commands, NULL);
+	response_buffer_size = helper_mock_batch(deps, sent, 2, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, TIMEOUT);
+	assert_int_equal(list_len(responses), COMMANDS);
+
+	for (node = responses, i = 0; node; node = node->next, i++) {
+		response = (struct usbi3c_response *)node->data;
+		assert_int_equal(response->error_status, USBI3C_SUCCEEDED);
+		if (commands[i].direction == USBI3C_READ) {
+			/* both reads get the data of the single read sent */
+			assert_int_equal(response->data_length, DATA_SIZE);
+			assert_int_equal(response->data[0], 0xA1);
+		} else {
+			assert_int_equal(response->data_length, 0);
+		}
+	}
+
+	assert_int_equal(usbi3c_get_batch_optimization_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.batches, 1);
+	assert_int_equal(stats.writes_coalesced, 1);
+	assert_int_equal(stats.reads_deduplicated, 1);
+	assert_int_equal(stats.commands_eliminated, 2);
+
+	usbi3c_free_responses(&responses);
+	free(response_buffer);
+}
+
+/* Test to verify the callback of every command merged is called, and that a failed
+ * coalesced write is reported to all the writes coalesced into it */
+static void test_submit_commands_optimized(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_2, USBI3C_READ },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x23 },
+		{ ADDRESS_2, USBI3C_READ },
+	};
+	struct test_sent sent[] = {
+		{ ADDRESS_2, USBI3C_READ, 0, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20, 2 * DATA_SIZE - REGISTER_ADDRESS_SIZE, USBI3C_FAILED_CRC_ERROR },
+	};
+	unsigned char *response_buffer = NULL;
+	int response_buffer_size = 0;
+
+	helper_enqueue_batch(deps, commands, on_response_cb);
+	response_buffer_size = helper_mock_batch(deps, sent, 2, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	helper_trigger_response(response_buffer, response_buffer_size);
+
+	for (int i = 0; i < COMMANDS; i++) {
+		assert_int_equal(deps->calls[i], 1);
+	}
+	assert_int_equal(deps->read[0], 0xA0);
+	assert_int_equal(deps->read[3], 0xA0);
+	assert_int_equal(deps->status[0], USBI3C_SUCCEEDED);
+	assert_int_equal(deps->status[1], USBI3C_FAILED_CRC_ERROR);
+	assert_int_equal(deps->status[2], USBI3C_FAILED_CRC_ERROR);
+
+	free(response_buffer);
+}
+
+/* Test to verify the callbacks of the commands merged are freed along with the requests
+ * that are dropped before their response arrives */
+static void test_submit_commands_optimized_dropped(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_2, USBI3C_READ },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x23 },
+		{ ADDRESS_2, USBI3C_READ },
+	};
+	struct test_sent sent[] = {
+		{ ADDRESS_2, USBI3C_READ, 0, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20, 2 * DATA_SIZE - REGISTER_ADDRESS_SIZE, USBI3C_SUCCEEDED },
+	};
+	unsigned char *response_buffer = NULL;
+
+	helper_enqueue_batch(deps, commands, on_response_cb);
+	helper_mock_batch(deps, sent, 2, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->request_tracker->regular_requests->requests), 2);
+
+	/* the response never arrives, the requests are dropped when the device is released */
+	for (int i = 0; i < COMMANDS; i++) {
+		assert_int_equal(deps->calls[i], 0);
+	}
+
+	free(response_buffer);
+}
+
+/* Test to verify writes that do not continue each other and reads separated by other
+ * commands to their target device are sent as queued */
+static void test_send_commands_not_mergeable(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_1, USBI3C_READ },
+		{ ADDRESS_1, USBI3C_WRITE, 0x10 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20 },
+		{ ADDRESS_1, USBI3C_READ },
+	};
+	struct test_sent sent[] = {
+		{ ADDRESS_1, USBI3C_READ, 0, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x10, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x20, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_READ, 0, DATA_SIZE, USBI3C_SUCCEEDED },
+	};
+	struct usbi3c_batch_optimization_stats stats;
+	unsigned char *response_buffer = NULL;
+	struct list *responses = NULL;
+	int response_buffer_size = 0;
+
+	helper_enqueue_batch(deps, commands, NULL);
+	response_buffer_size = helper_mock_batch(deps, sent, COMMANDS, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, TIMEOUT);
+	assert_int_equal(list_len(responses), COMMANDS);
+	assert_int_equal(((struct usbi3c_response *)list_tail(responses)->data)->data[0], 0xA3);
+
+	assert_int_equal(usbi3c_get_batch_optimization_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.batches, 0);
+	assert_int_equal(stats.commands_eliminated, 0);
+
+	usbi3c_free_responses(&responses);
+	free(response_buffer);
+}
+
+/* Test to verify adjacent writes are sent as queued when no register address size is
+ * set, since nothing tells whether they are contiguous */
+static void test_send_commands_no_register_address(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct test_command commands[COMMANDS] = {
+		{ ADDRESS_1, USBI3C_WRITE, 0x10 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x13 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x16 },
+		{ ADDRESS_1, USBI3C_WRITE, 0x19 },
+	};
+	struct test_sent sent[] = {
+		{ ADDRESS_1, USBI3C_WRITE, 0x10, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x13, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x16, DATA_SIZE, USBI3C_SUCCEEDED },
+		{ ADDRESS_1, USBI3C_WRITE, 0x19, DATA_SIZE, USBI3C_SUCCEEDED },
+	};
+	struct usbi3c_batch_optimization_stats stats;
+	unsigned char *response_buffer = NULL;
+	struct list *responses = NULL;
+	int response_buffer_size = 0;
+
+	assert_int_equal(usbi3c_set_batch_optimization(deps->usbi3c_dev, USBI3C_COALESCE_WRITES, 0), 0);
+
+	helper_enqueue_batch(deps, commands, NULL);
+	response_buffer_size = helper_mock_batch(deps, sent, COMMANDS, helper_next_request_id(deps->usbi3c_dev), &response_buffer);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, TIMEOUT);
+	assert_int_equal(list_len(responses), COMMANDS);
+
+	assert_int_equal(usbi3c_get_batch_optimization_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.writes_coalesced, 0);
+	assert_int_equal(stats.commands_eliminated, 0);
+
+	usbi3c_free_responses(&responses);
+	free(response_buffer);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_set_batch_optimization() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_invalid_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_send_commands_optimized, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_submit_commands_optimized, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_submit_commands_optimized_dropped, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_send_commands_not_mergeable, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_send_commands_no_register_address, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,279 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+#include "request_id_i.h"
+
+#define DATA_SIZE 8
+#define LONG_TIMEOUT_MS 60000
+#define SHORT_TIMEOUT_MS 20
+
+const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	int buffer_available;
+	atomic_int callbacks_called;
+	int attempted[2];
+	unsigned char *buffers[8];
+	int buffer_count;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	for (int i = 0; i < deps->buffer_count; i++) {
+		free(deps->buffers[i]);
+	}
+	free(deps);
+
+	return 0;
+}
+
+/* the callback may run in the expiry thread, so the checks are left to the test */
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+	int called = deps->callbacks_called;
+
+	if (called < 2) {
+		deps->attempted[called] = response->attempted;
+	}
+	deps->callbacks_called++;
+
+	return 0;
+}
+
+static int helper_enqueue_write(struct test_deps *deps, on_response_fn on_response)
+{
+	return usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh", on_response, on_response ? deps : NULL);
+}
+
+/* mocks a bulk request with as many writes as requested, starting at the request ID */
+static void helper_mock_writes(struct test_deps *deps, int request_id, int count)
+{
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	buffer_size = helper_create_command_buffer(request_id, &buffer, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh",
+						   USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	for (int i = 1; i < count; i++) {
+		buffer_size = helper_add_to_command_buffer(request_id + i, &buffer, buffer_size, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh");
+	}
+	deps->buffer_available = buffer_size + 100 * count;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* answers the write with the request ID */
+static void helper_answer_write(struct test_deps *deps, int request_id)
+{
+	struct usbi3c_response response = { 0 };
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	response.attempted = USBI3C_COMMAND_ATTEMPTED;
+	response.error_status = USBI3C_SUCCEEDED;
+	response.has_data = USBI3C_RESPONSE_HAS_NO_DATA;
+	buffer_size = helper_create_response_buffer(&buffer, &response, request_id);
+	helper_trigger_response(buffer, buffer_size);
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_request_expiry_stats stats;
+
+	assert_int_equal(usbi3c_set_response_timeout(NULL, LONG_TIMEOUT_MS), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_request_expiry_stats(NULL, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_request_expiry_stats(deps->usbi3c_dev, NULL), RETURN_FAILURE);
+	assert_int_equal(bulk_transfer_expire_requests(NULL, 0), RETURN_FAILURE);
+}
+
+/* Test to verify a request that is not answered in time is completed as timed out, and releases its resources */
+static void test_usbi3c_set_response_timeout_expire(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_request_expiry_stats stats;
+	struct usbi3c_submit_window_stats window_stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, LONG_TIMEOUT_MS), 0);
+
+	helper_mock_writes(deps, request_id, 2);
+	assert_int_equal(helper_enqueue_write(deps, on_response_cb), 0);
+	assert_int_equal(helper_enqueue_write(deps, on_response_cb), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+
+	/* nothing expires before the deadline */
+	assert_int_equal(bulk_transfer_expire_requests(deps->usbi3c_dev->request_tracker, monotonic_time_us() + (LONG_TIMEOUT_MS / 2) * 1000ULL), 0);
+	assert_int_equal(deps->callbacks_called, 0);
+
+	assert_int_equal(bulk_transfer_expire_requests(deps->usbi3c_dev->request_tracker, monotonic_time_us() + (LONG_TIMEOUT_MS + 1000) * 1000ULL), 2);
+	assert_int_equal(deps->callbacks_called, 2);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_TIMED_OUT);
+	assert_int_equal(deps->attempted[1], USBI3C_COMMAND_TIMED_OUT);
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &window_stats), 0);
+	assert_int_equal(window_stats.requests_in_flight, 0);
+	assert_int_equal(window_stats.bytes_in_flight, 0);
+	assert_int_equal(window_stats.commands_in_flight, 0);
+
+	assert_int_equal(usbi3c_get_request_expiry_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.expired_requests, 1);
+	assert_int_equal(stats.expired_commands, 2);
+	assert_int_equal(stats.timeout_ms, LONG_TIMEOUT_MS);
+
+	/* a response that arrives after the request expired is discarded */
+	helper_answer_write(deps, request_id);
+	assert_int_equal(deps->callbacks_called, 2);
+}
+
+/* Test to verify requests that were answered, or sent without a timeout, never expire */
+static void test_usbi3c_set_response_timeout_no_expiry(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_request_expiry_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	/* sent before a timeout is set */
+	helper_mock_writes(deps, request_id, 1);
+	assert_int_equal(helper_enqueue_write(deps, on_response_cb), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+
+	/* answered in time */
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, LONG_TIMEOUT_MS), 0);
+	helper_mock_writes(deps, request_id + 1, 1);
+	assert_int_equal(helper_enqueue_write(deps, on_response_cb), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	helper_answer_write(deps, request_id + 1);
+	assert_int_equal(deps->callbacks_called, 1);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_ATTEMPTED);
+
+	assert_int_equal(bulk_transfer_expire_requests(deps->usbi3c_dev->request_tracker, monotonic_time_us() + (LONG_TIMEOUT_MS + 1000) * 1000ULL), 0);
+	assert_int_equal(deps->callbacks_called, 1);
+	assert_non_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+
+	assert_int_equal(usbi3c_get_request_expiry_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.expired_requests, 0);
+	assert_int_equal(stats.expired_commands, 0);
+
+	helper_answer_write(deps, request_id);
+	assert_int_equal(deps->callbacks_called, 2);
+}
+
+/* Test to verify the requests are expired by the library once their deadline passes */
+static void test_usbi3c_set_response_timeout_expiry_thread(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_request_expiry_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, SHORT_TIMEOUT_MS), 0);
+	helper_mock_writes(deps, request_id, 1);
+	assert_int_equal(helper_enqueue_write(deps, on_response_cb), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+
+	for (int i = 0; i < 200 && deps->callbacks_called == 0; i++) {
+		usleep(10000);
+	}
+	assert_int_equal(deps->callbacks_called, 1);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_TIMED_OUT);
+
+	assert_int_equal(usbi3c_get_request_expiry_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.expired_requests, 1);
+	assert_int_equal(stats.expired_commands, 1);
+}
+
+/* Test to verify a blocking send gets a timed out response instead of waiting forever */
+static void test_usbi3c_set_response_timeout_blocking_send(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_response *response = NULL;
+	struct list *responses = NULL;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, SHORT_TIMEOUT_MS), 0);
+	helper_mock_writes(deps, request_id, 1);
+	mock_libusb_wait_for_events_not_trigger(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, RETURN_SUCCESS);
+	assert_int_equal(helper_enqueue_write(deps, NULL), 0);
+
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, 0);
+	assert_int_equal(list_len(responses), 1);
+	response = (struct usbi3c_response *)responses->data;
+	assert_int_equal(response->attempted, USBI3C_COMMAND_TIMED_OUT);
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+
+	usbi3c_free_responses(&responses);
+}
+
+/* Test to verify a request whose blocking send gave up before it expired is no longer tracked */
+static void test_usbi3c_set_response_timeout_waiter_gone(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct bulk_requests *regular_requests = deps->usbi3c_dev->request_tracker->regular_requests;
+	struct usbi3c_request_expiry_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, LONG_TIMEOUT_MS), 0);
+	helper_mock_writes(deps, request_id, 1);
+	mock_libusb_wait_for_events_not_trigger(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, RETURN_SUCCESS);
+	assert_int_equal(helper_enqueue_write(deps, NULL), 0);
+
+	assert_null(usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, 1));
+	assert_null(regular_requests->requests);
+	assert_int_equal(timer_wheel_count(regular_requests->expiry), 0);
+	assert_int_equal(request_id_in_use(regular_requests->request_ids), 0);
+
+	assert_int_equal(bulk_transfer_expire_requests(deps->usbi3c_dev->request_tracker, monotonic_time_us() + (LONG_TIMEOUT_MS + 1000) * 1000ULL), 0);
+	assert_int_equal(usbi3c_get_request_expiry_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.expired_commands, 0);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_set_response_timeout() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_response_timeout_expire, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_response_timeout_no_expiry, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_response_timeout_expiry_thread, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_response_timeout_blocking_send, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_response_timeout_waiter_gone, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
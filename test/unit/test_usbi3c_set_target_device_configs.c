@@ -0,0 +1,179 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define DEVICES_IN_BUS 3
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t ADDRESS_3 = INITIAL_TARGET_ADDRESS_POOL + 2;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)malloc(sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+/* mocks the SET_TARGET_DEVICE_CONFIG request expected for the configurations provided */
+static unsigned char *helper_mock_set_target_device_configs(struct usbi3c_target_device_config *configs, int count, int return_code)
+{
+	struct control_transfer_mock out;
+	unsigned char *buffer = NULL;
+	int buffer_size = sizeof(struct target_device_config_header) + (sizeof(struct target_device_config_entry) * count);
+
+	buffer = calloc(1, buffer_size);
+	GET_TARGET_DEVICE_CONFIG_HEADER(buffer)->config_change_command_type = CHANGE_CONFIG_COMMAND_TYPE;
+	GET_TARGET_DEVICE_CONFIG_HEADER(buffer)->numentries = count;
+	for (int i = 0; i < count; i++) {
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(buffer, i)->address = configs[i].address;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(buffer, i)->target_interrupt_request = configs[i].config & 0b001;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(buffer, i)->controller_role_request = (configs[i].config & 0b010) >> 1;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(buffer, i)->ibi_timestamp = (configs[i].config & 0b100) >> 2;
+		GET_TARGET_DEVICE_CONFIG_ENTRY_N(buffer, i)->max_ibi_payload_size = configs[i].max_ibi_payload_size;
+	}
+
+	out.bmRequestType = 0b00100001;
+	out.bRequest = SET_TARGET_DEVICE_CONFIG;
+	out.wValue = 0;
+	out.wIndex = 0;
+	out.wLength = buffer_size;
+	out.data = buffer;
+	out.timeout = test_timeout;
+
+	mock_libusb_control_transfer(NULL, &out, return_code);
+
+	return buffer;
+}
+
+/* Negative test to verify the function handles missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device_config configs[1] = { { .address = ADDRESS_1 } };
+
+	assert_int_equal(usbi3c_set_target_device_configs(NULL, configs, 1), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, NULL, 1), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, configs, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, configs, UINT8_MAX + 1), RETURN_FAILURE);
+}
+
+/* Negative test to verify the function handles a device that is not the active controller gracefully */
+static void test_negative_not_active_controller(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device_config configs[1] = { { .address = ADDRESS_1 } };
+
+	/* force the device to show as non-active controller */
+	deps->usbi3c_dev->device_info->device_state.active_i3c_controller = FALSE;
+
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, configs, 1), RETURN_FAILURE);
+}
+
+/* Negative test to verify that no request is sent if any entry of the batch is invalid */
+static void test_negative_invalid_entries(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device_config unknown[2] = { { .address = ADDRESS_1 }, { .address = 0x7E } };
+	struct usbi3c_target_device_config duplicated[2] = { { .address = ADDRESS_1 }, { .address = ADDRESS_1 } };
+
+	/* no control transfer is mocked, sending one would fail the test */
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, unknown, 2), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, duplicated, 2), RETURN_FAILURE);
+}
+
+/* Negative test to verify the table is not updated if the request fails */
+static void test_negative_libusb_failure(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device_config configs[2] = {
+		{ .address = ADDRESS_1, .config = 0b111, .max_ibi_payload_size = 16 },
+		{ .address = ADDRESS_2, .config = 0b111, .max_ibi_payload_size = 32 },
+	};
+	unsigned char *buffer = NULL;
+	uint32_t max_payload = 0;
+
+	buffer = helper_mock_set_target_device_configs(configs, 2, RETURN_FAILURE);
+
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, configs, 2), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_max_ibi_payload(deps->usbi3c_dev, ADDRESS_1, &max_payload), 0);
+	assert_int_not_equal(max_payload, 16);
+
+	free(buffer);
+}
+
+/* Test to verify that several target devices can be configured with a single request */
+static void test_usbi3c_set_target_device_configs(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_target_device_config configs[DEVICES_IN_BUS] = {
+		{ .address = ADDRESS_3, .config = 0b001, .max_ibi_payload_size = 8 },
+		{ .address = ADDRESS_1, .config = 0b110, .max_ibi_payload_size = 16 },
+		{ .address = ADDRESS_2, .config = 0b100, .max_ibi_payload_size = 1024 },
+	};
+	unsigned char *buffer = NULL;
+	uint32_t max_payload = 0;
+	uint8_t config = 0;
+
+	buffer = helper_mock_set_target_device_configs(configs, DEVICES_IN_BUS, RETURN_SUCCESS);
+
+	assert_int_equal(usbi3c_set_target_device_configs(deps->usbi3c_dev, configs, DEVICES_IN_BUS), 0);
+
+	/* verify that the configuration was updated in every device */
+	for (int i = 0; i < DEVICES_IN_BUS; i++) {
+		assert_int_equal(usbi3c_get_target_device_config(deps->usbi3c_dev, configs[i].address, &config), 0);
+		assert_int_equal(config, configs[i].config);
+		assert_int_equal(usbi3c_get_target_device_max_ibi_payload(deps->usbi3c_dev, configs[i].address, &max_payload), 0);
+		assert_int_equal(max_payload, configs[i].max_ibi_payload_size);
+	}
+
+	free(buffer);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_set_target_device_configs() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_not_active_controller, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_invalid_entries, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_libusb_failure, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_set_target_device_configs, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
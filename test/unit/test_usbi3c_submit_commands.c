@@ -190,7 +190,7 @@ static void test_negative_submit_failed(void **state)
 	deps->usbi3c_dev->command_queue = list_append(deps->usbi3c_dev->command_queue, command);
 
 	/* get a representation of how the command would look in memory, along with the size it would require */
-	expected_command_buffer_size = helper_create_command_buffer(bulk_request_id, &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, USBI3C_RESPONSE_HAS_NO_DATA, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	expected_command_buffer_size = helper_create_command_buffer(helper_next_request_id(deps->usbi3c_dev), &expected_command_buffer, DEVICE_ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, USBI3C_RESPONSE_HAS_NO_DATA, NULL, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
 
 	buffer_available = expected_command_buffer_size + 100;
 	/* Mocks for getting the buffer available */
@@ -221,7 +221,7 @@ static void test_negative_callback_fails(void **state)
 	struct regular_request *regular_request = NULL;
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int callback_called = 0;
 	int ret;
 
@@ -338,7 +338,7 @@ static void test_submitting_single_command(void **state)
 	unsigned char data[] = "Some test data with a length of 35";
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int callback_called = 0;
 	int ret;
 
@@ -439,7 +439,7 @@ static void test_submitting_command_at_different_transfer_mode(void **state)
 	unsigned char data[] = "Some test data with a length of 35";
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int callback_called = 0;
 	int ret;
 
@@ -542,7 +542,7 @@ static void test_submit_commands(void **state)
 	unsigned char data2[] = "Some data";
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int callback_called = 0;
 	int ret = -1;
 	const int BYTES_TO_READ = 36; // has to be a multiple of 4 (32-bit aligned)
@@ -706,7 +706,7 @@ static void test_submit_dependent_commands(void **state)
 	unsigned char data2[] = "Some data";
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int callback_called = 0;
 	int ret = -1;
 	const int BYTES_TO_READ = 36; // has to be a multiple of 4 (32-bit aligned)
@@ -820,7 +820,7 @@ static void test_submit_target_reset_pattern(void **state)
 	/* variables required for the mocks */
 	unsigned char *expected_command_buffer = NULL;
 	int expected_command_buffer_size = 0;
-	int request_id = bulk_request_id;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
 	int buffer_available = 0;
 	struct usbi3c_response r1, r2;
 	struct list *expected_responses = NULL;
@@ -0,0 +1,315 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+
+#define CHUNK_SIZE 8
+#define MAX_REQUESTS 4
+
+const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+
+struct test_deps;
+
+/* identifies the command a callback was called for */
+struct command_tag {
+	struct test_deps *deps;
+	int id;
+};
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	int buffer_available;
+	struct command_tag tags[MAX_REQUESTS];
+	int order[MAX_REQUESTS];
+	uint8_t attempted[MAX_REQUESTS];
+	int callbacks_called;
+	int resubmitted;
+	unsigned char *buffers[2 * MAX_REQUESTS];
+	int buffer_count;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	for (int i = 0; i < MAX_REQUESTS; i++) {
+		deps->tags[i].deps = deps;
+		deps->tags[i].id = i;
+	}
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	if (deps->usbi3c_dev) {
+		helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	}
+	for (int i = 0; i < deps->buffer_count; i++) {
+		free(deps->buffers[i]);
+	}
+	free(deps);
+
+	return 0;
+}
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct command_tag *tag = (struct command_tag *)user_data;
+	struct test_deps *deps = tag->deps;
+
+	deps->order[deps->callbacks_called] = tag->id;
+	deps->attempted[deps->callbacks_called] = response->attempted;
+	deps->callbacks_called++;
+
+	return 0;
+}
+
+/* mocks the bulk request of a single write with 8 bytes of data, the transfer fails with the return code */
+static void helper_mock_write_with_result(struct test_deps *deps, int request_id, uint8_t dependent_on_previous, int return_code)
+{
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	buffer_size = helper_create_command_buffer(request_id, &buffer, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, CHUNK_SIZE, (unsigned char *)"abcdefgh",
+						   USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, dependent_on_previous);
+	deps->buffer_available = buffer_size + 100;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(buffer, buffer_size, return_code);
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* mocks the bulk request of a single write with 8 bytes of data */
+static void helper_mock_write(struct test_deps *deps, int request_id, uint8_t dependent_on_previous)
+{
+	helper_mock_write_with_result(deps, request_id, dependent_on_previous, RETURN_SUCCESS);
+}
+
+/* answers the write with the request ID */
+static void helper_answer_write(struct test_deps *deps, int request_id)
+{
+	struct usbi3c_response response = { 0 };
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	response.attempted = USBI3C_COMMAND_ATTEMPTED;
+	response.error_status = USBI3C_SUCCEEDED;
+	response.has_data = USBI3C_RESPONSE_HAS_NO_DATA;
+	buffer_size = helper_create_response_buffer(&buffer, &response, request_id);
+	helper_trigger_response(buffer, buffer_size);
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* waits for the submission thread to send the bulk request with the request ID */
+static void helper_wait_for_request(struct test_deps *deps, int request_id)
+{
+	struct bulk_requests *regular_requests = deps->usbi3c_dev->request_tracker->regular_requests;
+	struct list *node = NULL;
+
+	for (int i = 0; i < 1000 && node == NULL; i++) {
+		pthread_mutex_lock(regular_requests->mutex);
+		node = list_search_node(regular_requests->requests, &request_id, compare_request_id);
+		pthread_mutex_unlock(regular_requests->mutex);
+		if (node == NULL) {
+			usleep(1000);
+		}
+	}
+	assert_non_null(node);
+}
+
+static int helper_enqueue_write(struct test_deps *deps, int tag)
+{
+	return usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, CHUNK_SIZE, (unsigned char *)"abcdefgh", on_response_cb, &deps->tags[tag]);
+}
+
+/* submits the command with tag 1 once the command it is called for is reported as not attempted */
+static int on_response_resubmit_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct command_tag *tag = (struct command_tag *)user_data;
+	struct test_deps *deps = tag->deps;
+
+	on_response_cb(response, user_data);
+	if (response->attempted == USBI3C_COMMAND_NOT_ATTEMPTED) {
+		helper_enqueue_write(deps, 1);
+		deps->resubmitted = usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0);
+	}
+
+	return 0;
+}
+
+/* Negative test to verify the functions handle missing and invalid parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submission_stats stats;
+
+	assert_int_equal(usbi3c_submit_commands_in_class(NULL, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), RETURN_FAILURE);
+	// the command queue is empty
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), RETURN_FAILURE);
+	// the commands are discarded if the submission is not valid
+	assert_int_equal(helper_enqueue_write(deps, 0), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_SUBMISSION_CLASSES, 0), RETURN_FAILURE);
+	assert_null(deps->usbi3c_dev->command_queue);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, CHUNK_SIZE, (unsigned char *)"abcdefgh", NULL, NULL), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), RETURN_FAILURE);
+	assert_null(deps->usbi3c_dev->command_queue);
+
+	assert_int_equal(usbi3c_set_bulk_chunk_size(NULL, CHUNK_SIZE), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submission_stats(NULL, USBI3C_NORMAL_SUBMISSION, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submission_stats(deps->usbi3c_dev, USBI3C_NORMAL_SUBMISSION, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submission_stats(deps->usbi3c_dev, USBI3C_SUBMISSION_CLASSES, &stats), RETURN_FAILURE);
+
+	// nothing was submitted yet
+	assert_int_equal(usbi3c_get_submission_stats(deps->usbi3c_dev, USBI3C_NORMAL_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 0);
+}
+
+/* Test to verify a realtime command is sent in between the chunks of a bulk submission */
+static void test_usbi3c_submit_commands_in_class(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submission_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_bulk_chunk_size(deps->usbi3c_dev, CHUNK_SIZE), 0);
+
+	/* the bulk submission is split in two requests, and only the first one depends on the previous request */
+	helper_mock_write(deps, request_id, USBI3C_DEPENDENT_ON_PREVIOUS);
+	helper_mock_write(deps, request_id + 1, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	helper_mock_write(deps, request_id + 2, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+
+	assert_int_equal(helper_enqueue_write(deps, 0), 0);
+	assert_int_equal(helper_enqueue_write(deps, 1), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_DEPENDENT_ON_PREVIOUS, USBI3C_BULK_SUBMISSION, 0), 0);
+	assert_null(deps->usbi3c_dev->command_queue);
+	helper_wait_for_request(deps, request_id);
+
+	/* the realtime command waits for the first chunk only */
+	assert_int_equal(helper_enqueue_write(deps, 2), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_REALTIME_SUBMISSION, 0), 0);
+	helper_answer_write(deps, request_id);
+	helper_wait_for_request(deps, request_id + 1);
+	helper_answer_write(deps, request_id + 1);
+	helper_wait_for_request(deps, request_id + 2);
+	helper_answer_write(deps, request_id + 2);
+
+	assert_int_equal(deps->callbacks_called, 3);
+	assert_int_equal(deps->order[0], 0);
+	assert_int_equal(deps->order[1], 2);
+	assert_int_equal(deps->order[2], 1);
+
+	assert_int_equal(usbi3c_get_submission_stats(deps->usbi3c_dev, USBI3C_BULK_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 1);
+	assert_int_equal(stats.requests, 2);
+	assert_int_equal(stats.pending, 0);
+	assert_int_equal(usbi3c_get_submission_stats(deps->usbi3c_dev, USBI3C_REALTIME_SUBMISSION, &stats), 0);
+	assert_int_equal(stats.submitted, 1);
+	assert_int_equal(stats.requests, 1);
+}
+
+/* Test to verify the next bulk request is sent once the request whose response was lost expires */
+static void test_usbi3c_submit_commands_in_class_lost_response(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_response_timeout(deps->usbi3c_dev, 60000), 0);
+	helper_mock_write(deps, request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	helper_mock_write(deps, request_id + 1, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+
+	assert_int_equal(helper_enqueue_write(deps, 0), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), 0);
+	helper_wait_for_request(deps, request_id);
+	assert_int_equal(helper_enqueue_write(deps, 1), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), 0);
+
+	/* the response is never received, the queue waits until the request expires */
+	assert_int_equal(bulk_transfer_expire_requests(deps->usbi3c_dev->request_tracker, monotonic_time_us() + 120000000), 1);
+	helper_wait_for_request(deps, request_id + 1);
+	helper_answer_write(deps, request_id + 1);
+
+	assert_int_equal(deps->callbacks_called, 2);
+	assert_int_equal(deps->order[0], 0);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_TIMED_OUT);
+	assert_int_equal(deps->order[1], 1);
+	assert_int_equal(deps->attempted[1], USBI3C_COMMAND_ATTEMPTED);
+}
+
+/* Test to verify the commands of a batch that failed to be sent can submit more commands from their callback */
+static void test_usbi3c_submit_commands_in_class_resubmit_from_callback(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	helper_mock_write_with_result(deps, request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, RETURN_FAILURE);
+	helper_mock_write(deps, request_id + 1, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, CHUNK_SIZE, (unsigned char *)"abcdefgh", on_response_resubmit_cb, &deps->tags[0]), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), 0);
+	helper_wait_for_request(deps, request_id + 1);
+	helper_answer_write(deps, request_id + 1);
+
+	assert_int_equal(deps->resubmitted, 0);
+	assert_int_equal(deps->callbacks_called, 2);
+	assert_int_equal(deps->order[0], 0);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_NOT_ATTEMPTED);
+	assert_int_equal(deps->order[1], 1);
+	assert_int_equal(deps->attempted[1], USBI3C_COMMAND_ATTEMPTED);
+}
+
+/* Test to verify the commands not sent when the device is deinitialized are reported as not attempted */
+static void test_usbi3c_submit_commands_in_class_not_sent(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	helper_mock_write(deps, request_id, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+
+	assert_int_equal(helper_enqueue_write(deps, 0), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), 0);
+	helper_wait_for_request(deps, request_id);
+
+	/* the first request was not answered so the second one is never sent */
+	assert_int_equal(helper_enqueue_write(deps, 1), 0);
+	assert_int_equal(usbi3c_submit_commands_in_class(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, USBI3C_NORMAL_SUBMISSION, 0), 0);
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+
+	assert_int_equal(deps->callbacks_called, 1);
+	assert_int_equal(deps->order[0], 1);
+	assert_int_equal(deps->attempted[0], USBI3C_COMMAND_NOT_ATTEMPTED);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_submit_commands_in_class() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_submit_commands_in_class, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_submit_commands_in_class_lost_response, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_submit_commands_in_class_resubmit_from_callback, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_submit_commands_in_class_not_sent, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
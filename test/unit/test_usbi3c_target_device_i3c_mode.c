@@ -0,0 +1,180 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t ADDRESS_3 = INITIAL_TARGET_ADDRESS_POOL + 2;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)malloc(sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_i3c_mode(deps->usbi3c_dev, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+static void assert_target_device_i3c_mode(struct test_deps *deps, uint8_t address, int own_mode, uint8_t transfer_mode, uint8_t transfer_rate)
+{
+	uint8_t mode = 0xFF;
+	uint8_t rate = 0xFF;
+	uint8_t tm_specific_info = 0xFF;
+
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, address, &mode, &rate, &tm_specific_info), own_mode);
+	assert_int_equal(mode, transfer_mode);
+	assert_int_equal(rate, transfer_rate);
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint8_t mode, rate, tm_specific_info;
+
+	assert_int_equal(usbi3c_set_target_device_i3c_mode(NULL, ADDRESS_1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_4_MHZ, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_clear_target_device_i3c_mode(NULL, ADDRESS_1), RETURN_FAILURE);
+	assert_int_equal(usbi3c_derive_target_device_i3c_modes(NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(NULL, ADDRESS_1, &mode, &rate, &tm_specific_info), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1, NULL, &rate, &tm_specific_info), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1, &mode, NULL, &tm_specific_info), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1, &mode, &rate, NULL), RETURN_FAILURE);
+	/* unknown target device */
+	assert_int_equal(usbi3c_set_target_device_i3c_mode(deps->usbi3c_dev, 0x7E, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_4_MHZ, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_clear_target_device_i3c_mode(deps->usbi3c_dev, 0x7E), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_device_i3c_mode(deps->usbi3c_dev, 0x7E, &mode, &rate, &tm_specific_info), RETURN_FAILURE);
+}
+
+/* Negative test to verify an I3C target device cannot be given the I2C mode */
+static void test_negative_mode_not_supported_by_target(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_int_equal(usbi3c_set_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1, USBI3C_I2C_MODE, USBI3C_I2C_RATE_400_KHZ, 0), RETURN_FAILURE);
+	assert_target_device_i3c_mode(deps, ADDRESS_1, 0, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+}
+
+/* Test to verify the mode of a target device is used instead of the device one until it is cleared */
+static void test_target_device_i3c_mode(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_command *command = NULL;
+	unsigned char data[] = "data";
+
+	assert_int_equal(usbi3c_set_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ, 0), 0);
+	assert_target_device_i3c_mode(deps, ADDRESS_1, 1, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_4_MHZ);
+	assert_target_device_i3c_mode(deps, ADDRESS_2, 0, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+
+	/* commands for different target devices in the same request get their own mode */
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS_1, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS_2, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	command = (struct usbi3c_command *)deps->usbi3c_dev->command_queue->data;
+	assert_int_equal(command->command_descriptor->transfer_mode, USBI3C_I3C_HDR_DDR_MODE);
+	assert_int_equal(command->command_descriptor->transfer_rate, USBI3C_I3C_RATE_4_MHZ);
+	command = (struct usbi3c_command *)deps->usbi3c_dev->command_queue->next->data;
+	assert_int_equal(command->command_descriptor->transfer_mode, USBI3C_I3C_SDR_MODE);
+	assert_int_equal(command->command_descriptor->transfer_rate, USBI3C_I3C_RATE_2_MHZ);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+
+	/* once cleared, the target device goes back to the device mode */
+	assert_int_equal(usbi3c_clear_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_1), 0);
+	assert_target_device_i3c_mode(deps, ADDRESS_1, 0, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS_1, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	command = (struct usbi3c_command *)deps->usbi3c_dev->command_queue->data;
+	assert_int_equal(command->command_descriptor->transfer_mode, USBI3C_I3C_SDR_MODE);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+}
+
+/* Test to verify the modes derived from the capabilities of the I3C controller and the target devices */
+static void test_derive_target_device_i3c_modes(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device_table *table = deps->usbi3c_dev->target_device_table;
+	struct target_device_discovery discovery = { 0 };
+	struct target_device *device = NULL;
+
+	/* the I3C controller supports SDR and HDR-DDR up to 8 MHz, and I2C up to 400 KHz */
+	assert_int_equal(deps->usbi3c_dev->device_info->capabilities.i3c_data_transfer_modes, 0b11);
+	assert_int_equal(deps->usbi3c_dev->device_info->capabilities.i3c_data_transfer_rates, 0b1111);
+	deps->usbi3c_dev->device_info->capabilities.i2c_data_transfer_rates = 0b011;
+
+	/* the first device is a Fast-mode Plus I2C device */
+	device = table_get_device(table, ADDRESS_1);
+	device->device_data.target_type = USBI3C_I2C_DEVICE;
+	device->device_data.device_characteristic_register = 0;
+
+	/* the max read speed of the second device is limited to 4 MHz */
+	discovery.address = ADDRESS_2;
+	discovery.inventory.valid = USBI3C_INVENTORY_MXDS;
+	discovery.inventory.max_write_speed = 0b001;
+	discovery.inventory.max_read_speed = 0b011;
+	assert_int_equal(table_set_device_inventory(table, &discovery, 1), 1);
+
+	/* the third device is HDR capable, its speed is limited but the limit is unknown */
+	device = table_get_device(table, ADDRESS_3);
+	device->device_data.bus_characteristic_register = BCR_HDR_CAPABLE | BCR_MAX_DATA_SPEED_LIMITATION;
+	assert_int_equal(usbi3c_set_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_3, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_6_MHZ, 0), 0);
+
+	/* the mode set by the user is kept */
+	assert_int_equal(usbi3c_derive_target_device_i3c_modes(deps->usbi3c_dev), 2);
+	assert_target_device_i3c_mode(deps, ADDRESS_1, 1, USBI3C_I2C_MODE, USBI3C_I2C_RATE_400_KHZ);
+	assert_target_device_i3c_mode(deps, ADDRESS_2, 1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_4_MHZ);
+	assert_target_device_i3c_mode(deps, ADDRESS_3, 1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_6_MHZ);
+
+	assert_int_equal(usbi3c_clear_target_device_i3c_mode(deps->usbi3c_dev, ADDRESS_3), 0);
+	assert_int_equal(usbi3c_derive_target_device_i3c_modes(deps->usbi3c_dev), 3);
+	assert_target_device_i3c_mode(deps, ADDRESS_3, 1, USBI3C_I3C_HDR_DDR_MODE, USBI3C_I3C_RATE_2_MHZ);
+
+	/* a device with no known limits gets the fastest rate of the I3C controller */
+	discovery.inventory.max_write_speed = 0;
+	discovery.inventory.max_read_speed = 0;
+	assert_int_equal(table_set_device_inventory(table, &discovery, 1), 1);
+	assert_int_equal(usbi3c_derive_target_device_i3c_modes(deps->usbi3c_dev), 3);
+	assert_target_device_i3c_mode(deps, ADDRESS_2, 1, USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_8_MHZ);
+}
+
+int main(void)
+{
+	/* Unit tests for the transfer modes of specific target devices */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_mode_not_supported_by_target, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_device_i3c_mode, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_derive_target_device_i3c_modes, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,230 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+const uint8_t ADDRESS_1 = INITIAL_TARGET_ADDRESS_POOL;
+const uint8_t ADDRESS_2 = INITIAL_TARGET_ADDRESS_POOL + 1;
+const uint8_t NEW_ADDRESS = 0x40;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)malloc(sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint32_t handle = 0;
+	uint8_t address = 0;
+
+	assert_int_equal(usbi3c_get_target_handle(NULL, ADDRESS_1, &handle), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_release_target_handle(NULL, handle), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_handle_address(NULL, handle, &address), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_enqueue_command_to_target(NULL, handle, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 0, NULL, NULL, NULL), RETURN_FAILURE);
+
+	/* there is no device at the address */
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, NEW_ADDRESS, &handle), RETURN_FAILURE);
+	/* a handle that was never obtained */
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, 0, &address), RETURN_FAILURE);
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, 0), RETURN_FAILURE);
+}
+
+/* Test to verify that a handle keeps referring to its target device after an address change */
+static void test_target_handle_follows_address_change(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	uint32_t handle_1 = 0;
+	uint32_t handle_2 = 0;
+	uint32_t same_handle = 0;
+	uint8_t address = 0;
+
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, &handle_1), 0);
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_2, &handle_2), 0);
+	assert_int_not_equal(handle_1, 0);
+	assert_int_not_equal(handle_1, handle_2);
+
+	/* a target device has a single handle */
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, &same_handle), 0);
+	assert_int_equal(same_handle, handle_1);
+
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle_1, &address), 0);
+	assert_int_equal(address, ADDRESS_1);
+
+	assert_int_equal(table_change_device_address(deps->usbi3c_dev->target_device_table, ADDRESS_1, NEW_ADDRESS), 0);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle_1, &address), 0);
+	assert_int_equal(address, NEW_ADDRESS);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle_2, &address), 0);
+	assert_int_equal(address, ADDRESS_2);
+}
+
+/* Test to verify that a handle is reported as stale once released, and a target
+ * device leaving the bus makes its handle unresolvable until it comes back */
+static void test_target_handle_generation(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct target_device *device = NULL;
+	uint32_t handle = 0;
+	uint32_t same_handle = 0;
+	uint32_t new_handle = 0;
+	uint8_t address = 0;
+
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, &handle), 0);
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, &same_handle), 0);
+
+	/* the device leaves the bus and comes back with a different address */
+	device = table_remove_device(deps->usbi3c_dev->target_device_table, ADDRESS_1);
+	assert_non_null(device);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, &address), RETURN_FAILURE);
+	device->target_address = NEW_ADDRESS;
+	assert_int_equal(table_insert_device(deps->usbi3c_dev->target_device_table, device), 0);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, &address), 0);
+	assert_int_equal(address, NEW_ADDRESS);
+
+	/* the handle was obtained twice, so it is valid until released twice */
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, handle), 0);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, &address), 0);
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, handle), 0);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, &address), RETURN_FAILURE);
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, handle), RETURN_FAILURE);
+
+	/* the slot is reused with a new generation, the old handle remains stale */
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, NEW_ADDRESS, &new_handle), 0);
+	assert_int_not_equal(new_handle, handle);
+	assert_int_equal(new_handle & 0xFFFF, handle & 0xFFFF);
+	assert_int_equal(usbi3c_get_target_handle_address(deps->usbi3c_dev, handle, &address), RETURN_FAILURE);
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, new_handle), 0);
+}
+
+/* Test to verify that a command queued for a handle is sent to the address the
+ * target device has when the command is transmitted */
+static void test_enqueue_command_to_target(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_command *command = NULL;
+	unsigned char data[] = { 0xAA, 0xBB, 0xCC, 0xDD };
+	int buffer_available = 0;
+	uint32_t handle = 0;
+
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS_1, &handle), 0);
+	assert_int_equal(usbi3c_enqueue_command_to_target(deps->usbi3c_dev, handle, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	command = (struct usbi3c_command *)deps->usbi3c_dev->command_queue->data;
+	assert_int_equal(command->command_descriptor->target_address, ADDRESS_1);
+
+	/* the address changes while the command is queued, the command follows the device,
+	 * the transfer itself is made to fail once the address is resolved */
+	assert_int_equal(table_change_device_address(deps->usbi3c_dev->target_device_table, ADDRESS_1, NEW_ADDRESS), 0);
+	mock_get_buffer_available(NULL, &buffer_available, RETURN_FAILURE);
+	assert_null(bulk_transfer_send_commands(deps->usbi3c_dev, deps->usbi3c_dev->command_queue, USBI3C_NOT_DEPENDENT_ON_PREVIOUS));
+	assert_int_equal(command->command_descriptor->target_address, NEW_ADDRESS);
+
+	/* a command for a stale handle is not sent */
+	assert_int_equal(usbi3c_release_target_handle(deps->usbi3c_dev, handle), 0);
+	assert_null(bulk_transfer_send_commands(deps->usbi3c_dev, deps->usbi3c_dev->command_queue, USBI3C_NOT_DEPENDENT_ON_PREVIOUS));
+	assert_int_equal(usbi3c_enqueue_command_to_target(deps->usbi3c_dev, handle, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), RETURN_FAILURE);
+}
+
+/* simulates the arrival of the IBI response of a target device */
+static void helper_receive_ibi(struct test_deps *deps, uint8_t address)
+{
+	uint8_t buffer[3 * DWORD_SIZE] = { 0 };
+	struct bulk_ibi_response_header *header = (struct bulk_ibi_response_header *)buffer;
+	struct bulk_ibi_response_footer *footer = (struct bulk_ibi_response_footer *)(buffer + 2 * DWORD_SIZE);
+
+	header->tag = INTERRUPT_BULK_RESPONSE;
+	footer->target_address = address;
+	footer->last_byte = 1;
+	assert_int_equal(ibi_handle_response(deps->usbi3c_dev->ibi, buffer, sizeof(buffer)), 0);
+}
+
+/* Test to verify that the IBI storm protection state stays with the target device when
+ * its address changes, and that the target device is only reported as disabled once the
+ * request to disable its IBIs completes */
+static void test_target_handle_ibi_storm(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_ibi_storm_counters counters;
+	struct target_device *device = NULL;
+
+	assert_int_equal(usbi3c_set_ibi_rate_limit(deps->usbi3c_dev, ADDRESS_1, 1, 1), 0);
+	usbi3c_set_ibi_storm_threshold(deps->usbi3c_dev, 1);
+	assert_int_equal(table_change_device_address(deps->usbi3c_dev->target_device_table, ADDRESS_1, NEW_ADDRESS), 0);
+	assert_int_equal(table_set_device_config(deps->usbi3c_dev->target_device_table, NEW_ADDRESS, TARGET_INTERRUPT_REQUEST_MASK), 0);
+
+	/* the rate limit set for the old address applies to the target device at its new address */
+	helper_receive_ibi(deps, NEW_ADDRESS);
+	helper_receive_ibi(deps, NEW_ADDRESS);
+	mock_usb_output_control_transfer_async(RETURN_SUCCESS);
+	helper_receive_ibi(deps, NEW_ADDRESS);
+	assert_int_equal(usbi3c_get_ibi_storm_counters(deps->usbi3c_dev, NEW_ADDRESS, &counters), 0);
+	assert_int_equal(counters.rate_limited, 2);
+
+	/* the request to disable the IBIs of the target device is still in flight */
+	assert_false(counters.ibi_disabled);
+	device = table_get_device(deps->usbi3c_dev->target_device_table, NEW_ADDRESS);
+	assert_int_equal(device->device_data.target_interrupt_request, 1);
+
+	mock_usb_wait_for_next_event(USBI3C_CONTROL_TRANSFER_ENDPOINT_INDEX, NULL, 0, RETURN_SUCCESS);
+	usb_wait_for_next_event(deps->usbi3c_dev->usb_dev);
+	assert_int_equal(usbi3c_get_ibi_storm_counters(deps->usbi3c_dev, NEW_ADDRESS, &counters), 0);
+	assert_true(counters.ibi_disabled);
+	assert_int_equal(device->device_data.target_interrupt_request, 0);
+
+	/* a target device taking the old address does not inherit the state */
+	assert_int_equal(table_change_device_address(deps->usbi3c_dev->target_device_table, ADDRESS_2, ADDRESS_1), 0);
+	assert_int_equal(usbi3c_get_ibi_storm_counters(deps->usbi3c_dev, ADDRESS_1, &counters), 0);
+	assert_int_equal(counters.rate_limited, 0);
+	assert_false(counters.ibi_disabled);
+}
+
+int main(void)
+{
+	/* Unit tests for the target handle functions */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_handle_follows_address_change, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_handle_generation, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_enqueue_command_to_target, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_target_handle_ibi_storm, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,259 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "helpers.h"
+#include "mocks.h"
+
+const int TIMEOUT = 60;
+const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+
+/* max lengths of the target device, the max read length is not 32-bit aligned */
+const uint16_t MAX_READ_LENGTH = 6;
+const uint16_t MAX_WRITE_LENGTH = 8;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	int buffer_available;
+	int callback_called;
+	struct usbi3c_response response;
+	unsigned char data[16];
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+	usbi3c_set_transfer_chunking(deps->usbi3c_dev, TRUE);
+	assert_int_equal(usbi3c_set_target_device_max_lengths(deps->usbi3c_dev, ADDRESS, MAX_READ_LENGTH, MAX_WRITE_LENGTH), 0);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	free(deps);
+
+	return 0;
+}
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+
+	deps->callback_called++;
+	deps->response = *response;
+	memcpy(deps->data, response->data, response->data_length);
+
+	return 0;
+}
+
+static struct usbi3c_response *helper_response(struct usbi3c_response *response, uint8_t error_status, unsigned char *data, uint32_t data_length)
+{
+	response->attempted = USBI3C_COMMAND_ATTEMPTED;
+	response->error_status = error_status;
+	response->has_data = data ? USBI3C_RESPONSE_HAS_DATA : USBI3C_RESPONSE_HAS_NO_DATA;
+	response->data = data;
+	response->data_length = data_length;
+
+	return response;
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	usbi3c_set_transfer_chunking(NULL, TRUE);
+	assert_int_equal(usbi3c_set_target_device_max_lengths(NULL, ADDRESS, MAX_READ_LENGTH, MAX_WRITE_LENGTH), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_target_device_max_lengths(deps->usbi3c_dev, 0x7E, MAX_READ_LENGTH, MAX_WRITE_LENGTH), RETURN_FAILURE);
+}
+
+/* Negative test to verify a read cannot be split if the max read length of the target is less than 4 bytes */
+static void test_negative_max_read_length_too_small(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	assert_int_equal(usbi3c_set_target_device_max_lengths(deps->usbi3c_dev, ADDRESS, 2, MAX_WRITE_LENGTH), 0);
+
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 8, NULL, NULL, NULL), RETURN_FAILURE);
+	assert_null(deps->usbi3c_dev->command_queue);
+}
+
+/* Test to verify the commands are only split when transfer chunking is enabled, and when they exceed the max length */
+static void test_transfer_chunking_enqueue(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	unsigned char data[20] = "Some long test data";
+	struct usbi3c_command *command = NULL;
+	struct list *node = NULL;
+	uint32_t handle = 0;
+
+	/* a write that fits is not split */
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, MAX_WRITE_LENGTH, data, NULL, NULL), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->command_queue), 1);
+	assert_null(((struct usbi3c_command *)deps->usbi3c_dev->command_queue->data)->chunked);
+
+	/* target devices without known limits are not split */
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS + 1, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->command_queue), 2);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+
+	/* every chunk follows the target handle */
+	assert_int_equal(usbi3c_get_target_handle(deps->usbi3c_dev, ADDRESS, &handle), 0);
+	assert_int_equal(usbi3c_enqueue_command_to_target(deps->usbi3c_dev, handle, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->command_queue), 3);
+	for (node = deps->usbi3c_dev->command_queue; node; node = node->next) {
+		command = (struct usbi3c_command *)node->data;
+		assert_int_equal(command->target_handle, handle);
+		assert_non_null(command->chunked);
+		assert_ptr_equal(command->chunked, ((struct usbi3c_command *)deps->usbi3c_dev->command_queue->data)->chunked);
+	}
+	command = (struct usbi3c_command *)list_tail(deps->usbi3c_dev->command_queue)->data;
+	assert_int_equal(command->command_descriptor->data_length, sizeof(data) - 2 * MAX_WRITE_LENGTH);
+	assert_memory_equal(command->data, data + 2 * MAX_WRITE_LENGTH, sizeof(data) - 2 * MAX_WRITE_LENGTH);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+
+	/* the transfers are queued as they are when chunking is disabled */
+	usbi3c_set_transfer_chunking(deps->usbi3c_dev, FALSE);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->command_queue), 1);
+	bulk_transfer_free_commands(&deps->usbi3c_dev->command_queue);
+}
+
+/* Test to verify the responses to the chunks are reassembled into one response per transfer when sending commands */
+static void test_transfer_chunking_send_commands(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	unsigned char data[20] = "Some long test data";
+	struct usbi3c_response chunk_responses[5];
+	struct usbi3c_response *response = NULL;
+	struct list *chunk_list = NULL;
+	struct list *responses = NULL;
+	unsigned char *command_buffer = NULL;
+	unsigned char *response_buffer = NULL;
+	int command_buffer_size = 0;
+	int response_buffer_size = 0;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	/* the write is split in chunks of 8, 8 and 4 bytes, the read in chunks of 4 bytes */
+	command_buffer_size = helper_create_command_buffer(request_id, &command_buffer, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 8, data,
+							   USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 1, &command_buffer, command_buffer_size, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 8, data + 8);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 2, &command_buffer, command_buffer_size, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, 4, data + 16);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 3, &command_buffer, command_buffer_size, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 4, NULL);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 4, &command_buffer, command_buffer_size, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 4, NULL);
+	deps->buffer_available = command_buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(command_buffer, command_buffer_size, RETURN_SUCCESS);
+
+	/* the second chunk of the write is NACKed */
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[0], USBI3C_SUCCEEDED, NULL, 0));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[1], USBI3C_FAILED_NACK, NULL, 0));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[2], USBI3C_SUCCEEDED, NULL, 0));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[3], USBI3C_SUCCEEDED, (unsigned char *)"abcd", 4));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[4], USBI3C_SUCCEEDED, (unsigned char *)"efgh", 4));
+	response_buffer_size = helper_create_multiple_response_buffer(&response_buffer, chunk_list, request_id);
+	mock_usb_wait_for_next_event(USBI3C_BULK_TRANSFER_ENDPOINT_INDEX, response_buffer, response_buffer_size, RETURN_SUCCESS);
+
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, sizeof(data), data, NULL, NULL), 0);
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 8, NULL, NULL, NULL), 0);
+	assert_int_equal(list_len(deps->usbi3c_dev->command_queue), 5);
+
+	responses = usbi3c_send_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS, TIMEOUT);
+	assert_int_equal(list_len(responses), 2);
+
+	/* the failed chunk determines the status of the write */
+	response = (struct usbi3c_response *)responses->data;
+	assert_int_equal(response->attempted, USBI3C_COMMAND_ATTEMPTED);
+	assert_int_equal(response->error_status, USBI3C_FAILED_NACK);
+	assert_int_equal(response->data_length, 0);
+
+	response = (struct usbi3c_response *)responses->next->data;
+	assert_int_equal(response->error_status, USBI3C_SUCCEEDED);
+	assert_int_equal(response->has_data, USBI3C_RESPONSE_HAS_DATA);
+	assert_int_equal(response->data_length, 8);
+	assert_memory_equal(response->data, "abcdefgh", 8);
+
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+
+	usbi3c_free_responses(&responses);
+	list_free_list(&chunk_list);
+	free(command_buffer);
+	free(response_buffer);
+}
+
+/* Test to verify the callback of a chunked transfer is run once, with the reassembled response, when submitting commands */
+static void test_transfer_chunking_submit_commands(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_response chunk_responses[3];
+	struct list *chunk_list = NULL;
+	unsigned char *command_buffer = NULL;
+	unsigned char *response_buffer = NULL;
+	int command_buffer_size = 0;
+	int response_buffer_size = 0;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	command_buffer_size = helper_create_command_buffer(request_id, &command_buffer, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 4, NULL,
+							   USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 1, &command_buffer, command_buffer_size, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 4, NULL);
+	command_buffer_size = helper_add_to_command_buffer(request_id + 2, &command_buffer, command_buffer_size, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 4, NULL);
+	deps->buffer_available = command_buffer_size + 200;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	mock_usb_output_bulk_transfer(command_buffer, command_buffer_size, RETURN_SUCCESS);
+
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_READ, USBI3C_TERMINATE_ON_ANY_ERROR, 12, NULL, on_response_cb, deps), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[0], USBI3C_SUCCEEDED, (unsigned char *)"abcd", 4));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[1], USBI3C_SUCCEEDED, (unsigned char *)"efgh", 4));
+	chunk_list = list_append(chunk_list, helper_response(&chunk_responses[2], USBI3C_SUCCEEDED, (unsigned char *)"ijkl", 4));
+	response_buffer_size = helper_create_multiple_response_buffer(&response_buffer, chunk_list, request_id);
+	helper_trigger_response(response_buffer, response_buffer_size);
+
+	assert_int_equal(deps->callback_called, 1);
+	assert_int_equal(deps->response.attempted, USBI3C_COMMAND_ATTEMPTED);
+	assert_int_equal(deps->response.error_status, USBI3C_SUCCEEDED);
+	assert_int_equal(deps->response.data_length, 12);
+	assert_memory_equal(deps->data, "abcdefghijkl", 12);
+
+	/* all the chunks were untracked */
+	assert_null(deps->usbi3c_dev->request_tracker->regular_requests->requests);
+
+	list_free_list(&chunk_list);
+	free(command_buffer);
+	free(response_buffer);
+}
+
+int main(void)
+{
+	/* Unit tests for splitting transfers that exceed the max lengths of their target device */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_negative_max_read_length_too_small, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_transfer_chunking_enqueue, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_transfer_chunking_send_commands, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_transfer_chunking_submit_commands, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
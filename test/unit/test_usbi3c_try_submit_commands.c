@@ -0,0 +1,300 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+
+#define DATA_SIZE 8
+
+const uint8_t ADDRESS = INITIAL_TARGET_ADDRESS_POOL;
+
+struct test_deps {
+	struct usbi3c_device *usbi3c_dev;
+	int buffer_available;
+	int callbacks_called;
+	int writable_called;
+	int resubmitted;
+	unsigned char *buffers[8];
+	int buffer_count;
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)calloc(1, sizeof(struct test_deps));
+
+	deps->usbi3c_dev = helper_usbi3c_init(NULL);
+	helper_initialize_controller(deps->usbi3c_dev, NULL, NULL);
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+
+	helper_usbi3c_deinit(&deps->usbi3c_dev, NULL);
+	for (int i = 0; i < deps->buffer_count; i++) {
+		free(deps->buffers[i]);
+	}
+	free(deps);
+
+	return 0;
+}
+
+static int on_response_cb(struct usbi3c_response *response, void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+
+	deps->callbacks_called++;
+
+	return 0;
+}
+
+static void on_writable_cb(void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+
+	deps->writable_called++;
+}
+
+static void on_writable_resubmit_cb(void *user_data)
+{
+	struct test_deps *deps = (struct test_deps *)user_data;
+
+	deps->writable_called++;
+	deps->resubmitted = usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+}
+
+static int helper_enqueue_write(struct test_deps *deps)
+{
+	return usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh", on_response_cb, deps);
+}
+
+/* mocks the bulk request of a single write, the I3C function has buffer_available bytes available
+ * for it, if they are not enough the request is not expected to be sent */
+static void helper_mock_write(struct test_deps *deps, int request_id, int buffer_available)
+{
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	buffer_size = helper_create_command_buffer(request_id, &buffer, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh",
+						   USBI3C_I3C_SDR_MODE, USBI3C_I3C_RATE_2_MHZ, USBI3C_NOT_DEPENDENT_ON_PREVIOUS);
+	deps->buffer_available = buffer_available ? buffer_available : buffer_size + 100;
+	mock_get_buffer_available(NULL, &deps->buffer_available, RETURN_SUCCESS);
+	if (buffer_available == 0) {
+		mock_usb_output_bulk_transfer(buffer, buffer_size, RETURN_SUCCESS);
+	}
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* answers the write with the request ID */
+static void helper_answer_write(struct test_deps *deps, int request_id)
+{
+	struct usbi3c_response response = { 0 };
+	unsigned char *buffer = NULL;
+	int buffer_size = 0;
+
+	response.attempted = USBI3C_COMMAND_ATTEMPTED;
+	response.error_status = USBI3C_SUCCEEDED;
+	response.has_data = USBI3C_RESPONSE_HAS_NO_DATA;
+	buffer_size = helper_create_response_buffer(&buffer, &response, request_id);
+	helper_trigger_response(buffer, buffer_size);
+	deps->buffers[deps->buffer_count++] = buffer;
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+
+	assert_int_equal(usbi3c_try_submit_commands(NULL, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), RETURN_FAILURE);
+	// the command queue is empty
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), RETURN_FAILURE);
+	// the commands are discarded if they are missing their callback
+	assert_int_equal(usbi3c_enqueue_command(deps->usbi3c_dev, ADDRESS, USBI3C_WRITE, USBI3C_TERMINATE_ON_ANY_ERROR, DATA_SIZE, (unsigned char *)"abcdefgh", NULL, NULL), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), RETURN_FAILURE);
+	assert_null(deps->usbi3c_dev->command_queue);
+
+	assert_int_equal(usbi3c_set_submit_window(NULL, 1, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_on_submit_writable(NULL, on_writable_cb, deps), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submit_writable_fd(NULL), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submit_window_stats(NULL, &stats), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, NULL), RETURN_FAILURE);
+}
+
+/* Test to verify the commands wait while the window of requests in flight is full, and the producer is notified once it is not */
+static void test_usbi3c_try_submit_commands_window_full(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+	uint64_t events = 0;
+	int fd = -1;
+
+	assert_int_equal(usbi3c_set_submit_window(deps->usbi3c_dev, 1, 0), 0);
+	assert_int_equal(usbi3c_on_submit_writable(deps->usbi3c_dev, on_writable_cb, deps), 0);
+	fd = usbi3c_get_submit_writable_fd(deps->usbi3c_dev);
+	assert_true(fd >= 0);
+	assert_int_equal(usbi3c_get_submit_writable_fd(deps->usbi3c_dev), fd);
+
+	helper_mock_write(deps, request_id, 0);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	assert_null(deps->usbi3c_dev->command_queue);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.requests_in_flight, 1);
+	assert_true(stats.bytes_in_flight > DATA_SIZE);
+
+	/* the window is full, nothing is sent to the I3C function and the commands stay in the queue */
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), USBI3C_WOULD_BLOCK);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), USBI3C_WOULD_BLOCK);
+	assert_non_null(deps->usbi3c_dev->command_queue);
+	assert_int_equal(deps->writable_called, 0);
+	assert_int_equal(read(fd, &events, sizeof(events)), -1);
+
+	/* the producer is notified once when the request is answered */
+	helper_answer_write(deps, request_id);
+	assert_int_equal(deps->callbacks_called, 1);
+	assert_int_equal(deps->writable_called, 1);
+	assert_int_equal(read(fd, &events, sizeof(events)), sizeof(events));
+	assert_int_equal(events, 1);
+
+	helper_mock_write(deps, request_id + 1, 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	assert_null(deps->usbi3c_dev->command_queue);
+	helper_answer_write(deps, request_id + 1);
+	assert_int_equal(deps->callbacks_called, 2);
+	assert_int_equal(deps->writable_called, 1);
+
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.would_block, 2);
+	assert_int_equal(stats.notifications, 1);
+	assert_int_equal(stats.requests_in_flight, 0);
+	assert_int_equal(stats.bytes_in_flight, 0);
+}
+
+/* Test to verify the commands refused can be submitted again from the writable callback */
+static void test_usbi3c_try_submit_commands_resubmit_when_writable(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_submit_window(deps->usbi3c_dev, 1, 0), 0);
+	assert_int_equal(usbi3c_on_submit_writable(deps->usbi3c_dev, on_writable_resubmit_cb, deps), 0);
+
+	helper_mock_write(deps, request_id, 0);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), USBI3C_WOULD_BLOCK);
+
+	/* the callback runs once the response is handled and the request tracker is unlocked */
+	helper_mock_write(deps, request_id + 1, 0);
+	helper_answer_write(deps, request_id);
+	assert_int_equal(deps->writable_called, 1);
+	assert_int_equal(deps->resubmitted, 0);
+	assert_null(deps->usbi3c_dev->command_queue);
+
+	helper_answer_write(deps, request_id + 1);
+	assert_int_equal(deps->callbacks_called, 2);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.requests_in_flight, 0);
+}
+
+/* Test to verify the commands wait while the I3C function has no buffer for them, unless nothing is in flight */
+static void test_usbi3c_try_submit_commands_no_buffer(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	/* the requests sent with a blocking submission are in flight too */
+	helper_mock_write(deps, request_id, 0);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+
+	helper_mock_write(deps, request_id + 1, 4);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), USBI3C_WOULD_BLOCK);
+	assert_non_null(deps->usbi3c_dev->command_queue);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.requests_in_flight, 1);
+
+	/* with nothing in flight the buffer of the I3C function is just too small for the commands */
+	helper_answer_write(deps, request_id);
+	helper_mock_write(deps, request_id + 1, 4);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), RETURN_FAILURE);
+	assert_null(deps->usbi3c_dev->command_queue);
+
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.would_block, 1);
+	assert_int_equal(stats.requests_in_flight, 0);
+	assert_int_equal(stats.bytes_in_flight, 0);
+}
+
+/* Test to verify the commands wait while the max number of commands is awaiting a response */
+static void test_usbi3c_try_submit_commands_max_commands(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_submit_window_stats stats;
+	int request_id = helper_next_request_id(deps->usbi3c_dev);
+
+	assert_int_equal(usbi3c_set_max_commands_in_flight(NULL, 1), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_max_commands_in_flight(deps->usbi3c_dev, 0), RETURN_FAILURE);
+	assert_int_equal(usbi3c_set_max_commands_in_flight(deps->usbi3c_dev, 1), 0);
+
+	helper_mock_write(deps, request_id, 0);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.commands_in_flight, 1);
+
+	/* there is buffer for the commands but no request ID */
+	helper_mock_write(deps, request_id + 1, 1000);
+	assert_int_equal(helper_enqueue_write(deps), 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), USBI3C_WOULD_BLOCK);
+	assert_non_null(deps->usbi3c_dev->command_queue);
+
+	/* the ID is issued again once its request is answered */
+	helper_answer_write(deps, request_id);
+	helper_mock_write(deps, request_id + 1, 0);
+	assert_int_equal(usbi3c_try_submit_commands(deps->usbi3c_dev, USBI3C_NOT_DEPENDENT_ON_PREVIOUS), 0);
+	helper_answer_write(deps, request_id + 1);
+	assert_int_equal(deps->callbacks_called, 2);
+
+	assert_int_equal(usbi3c_get_submit_window_stats(deps->usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.commands_in_flight, 0);
+}
+
+int main(void)
+{
+	/* Unit tests for the usbi3c_try_submit_commands() function */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_try_submit_commands_window_full, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_try_submit_commands_resubmit_when_writable, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_try_submit_commands_no_buffer, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_try_submit_commands_max_commands, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
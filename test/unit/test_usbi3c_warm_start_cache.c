@@ -0,0 +1,229 @@
+/***************************************************************************
+  USBI3C  -  Library to talk to I3C devices via USB.
+  -------------------
+  copyright            : (C) 2022 Intel Corporation
+  SPDX-License-Identifier: LGPL-2.1-only
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License           *
+ *   version 2.1 as published by the Free Software Foundation.             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "mocks.h"
+#include "target_device_table_i.h"
+
+#define DEVICES_IN_BUS 3
+
+struct test_deps {
+	char directory[32];
+};
+
+static int test_setup(void **state)
+{
+	struct test_deps *deps = calloc(1, sizeof(struct test_deps));
+
+	strcpy(deps->directory, "/tmp/usbi3c-cache-XXXXXX");
+	assert_non_null(mkdtemp(deps->directory));
+
+	*state = deps;
+
+	return 0;
+}
+
+static int test_teardown(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	char path[PATH_MAX];
+	struct dirent *entry = NULL;
+	DIR *dir = NULL;
+
+	dir = opendir(deps->directory);
+	while (dir && (entry = readdir(dir))) {
+		if (entry->d_name[0] != '.') {
+			snprintf(path, sizeof(path), "%s/%s", deps->directory, entry->d_name);
+			unlink(path);
+		}
+	}
+	if (dir) {
+		closedir(dir);
+	}
+	rmdir(deps->directory);
+	free(deps);
+
+	return 0;
+}
+
+static int count_cache_files(const char *directory)
+{
+	struct dirent *entry = NULL;
+	DIR *dir = NULL;
+	int count = 0;
+
+	dir = opendir(directory);
+	while (dir && (entry = readdir(dir))) {
+		if (entry->d_name[0] != '.') {
+			count++;
+		}
+	}
+	if (dir) {
+		closedir(dir);
+	}
+
+	return count;
+}
+
+/* mocks the initialization of an I3C controller whose target device table reports the
+ * provided configuration after the bus initialization, the requests used to configure
+ * the target devices are only expected if configure is TRUE */
+static void helper_initialize_controller_cached(struct usbi3c_device *usbi3c_dev, int target_config, int configure)
+{
+	struct notification_format notification = {
+		.type = NOTIFICATION_I3C_BUS_INITIALIZATION_STATUS,
+		.code = SUCCESSFUL_I3C_BUS_INITIALIZATION
+	};
+	unsigned char *cap_buffer = NULL;
+	unsigned char *table_buffer = NULL;
+	unsigned char *config_buffer = NULL;
+	unsigned char *updated_table_buffer = NULL;
+
+	cap_buffer = mock_get_i3c_capability(NULL,
+					     DEVICE_CONTAINS_CAPABILITY_DATA,
+					     USBI3C_PRIMARY_CONTROLLER_ROLE,
+					     STATIC_DATA,
+					     DEFAULT_CONTROLLER_CAPABILITY,
+					     DEVICES_IN_BUS,
+					     RETURN_SUCCESS);
+	mock_usb_bulk_transfer_response_buffer_init(RETURN_SUCCESS);
+	mock_usb_input_bulk_transfer_polling(RETURN_SUCCESS);
+	mock_usb_interrupt_init(RETURN_SUCCESS);
+	mock_initialize_i3c_bus(NULL, I3C_CONTROLLER_DECIDED_ADDRESS_ASSIGNMENT, RETURN_SUCCESS);
+	mock_usb_wait_for_next_event(USBI3C_INTERRUPT_ENDPOINT_INDEX,
+				     (unsigned char *)&notification,
+				     sizeof(struct notification_format),
+				     RETURN_SUCCESS);
+	table_buffer = mock_get_target_device_table(NULL, DEVICES_IN_BUS, target_config, DEFAULT_TARGET_CAPABILITY, RETURN_SUCCESS);
+	if (configure) {
+		config_buffer = mock_set_target_device_configs_from_device_capability(NULL,
+										      INITIAL_TARGET_ADDRESS_POOL,
+										      DEVICES_IN_BUS,
+										      DEFAULT_CONTROLLER_CAPABILITY,
+										      DEFAULT_MAX_IBI_PAYLOAD_SIZE,
+										      RETURN_SUCCESS);
+		updated_table_buffer = mock_get_target_device_table(NULL, DEVICES_IN_BUS, DEFAULT_TARGET_CONFIGURATION, DEFAULT_TARGET_CAPABILITY, RETURN_SUCCESS);
+	}
+
+	assert_int_equal(usbi3c_initialize_device(usbi3c_dev), RETURN_SUCCESS);
+
+	free(cap_buffer);
+	free(table_buffer);
+	free(config_buffer);
+	free(updated_table_buffer);
+}
+
+/* Negative test to verify the functions handle missing parameters gracefully */
+static void test_negative_missing_parameters(void **state)
+{
+	struct usbi3c_startup_stats stats;
+	struct usbi3c_device *usbi3c_dev = NULL;
+
+	assert_int_equal(usbi3c_set_warm_start_cache(NULL, "/tmp"), RETURN_FAILURE);
+	assert_int_equal(usbi3c_get_startup_stats(NULL, &stats), RETURN_FAILURE);
+
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_get_startup_stats(usbi3c_dev, NULL), RETURN_FAILURE);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+}
+
+/* Test to verify that a second initialization of the same I3C function with the same
+ * bus skips the configuration of the target devices */
+static void test_usbi3c_warm_start(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_startup_stats cold = { 0 };
+	struct usbi3c_startup_stats warm = { 0 };
+	struct usbi3c_device *usbi3c_dev = NULL;
+	uint8_t *address_list = NULL;
+
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	helper_initialize_controller_cached(usbi3c_dev, DEFAULT_TARGET_CONFIGURATION, TRUE);
+	assert_int_equal(usbi3c_get_startup_stats(usbi3c_dev, &cold), 0);
+	assert_int_equal(cold.warm_start, FALSE);
+	assert_int_equal(count_cache_files(deps->directory), 1);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+
+	/* no configuration request is mocked, sending one would fail the test */
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	helper_initialize_controller_cached(usbi3c_dev, DEFAULT_TARGET_CONFIGURATION, FALSE);
+	assert_int_equal(usbi3c_get_startup_stats(usbi3c_dev, &warm), 0);
+	assert_int_equal(warm.warm_start, TRUE);
+	assert_int_equal(usbi3c_device_is_active_controller(usbi3c_dev), TRUE);
+	assert_int_equal(usbi3c_get_address_list(usbi3c_dev, &address_list), DEVICES_IN_BUS);
+	free(address_list);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+}
+
+/* Test to verify that a target device table different from the cached one falls back
+ * to the regular initialization */
+static void test_usbi3c_warm_start_table_mismatch(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_startup_stats stats = { 0 };
+	struct usbi3c_device *usbi3c_dev = NULL;
+
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	helper_initialize_controller_cached(usbi3c_dev, DEFAULT_TARGET_CONFIGURATION, TRUE);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+
+	/* the target devices lost their configuration, e.g. the bus was power cycled */
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	helper_initialize_controller_cached(usbi3c_dev, 0b011, TRUE);
+	assert_int_equal(usbi3c_get_startup_stats(usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.warm_start, FALSE);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+}
+
+/* Test to verify that the cache is not used once it is disabled */
+static void test_usbi3c_warm_start_disabled(void **state)
+{
+	struct test_deps *deps = (struct test_deps *)*state;
+	struct usbi3c_startup_stats stats = { 0 };
+	struct usbi3c_device *usbi3c_dev = NULL;
+
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	helper_initialize_controller_cached(usbi3c_dev, DEFAULT_TARGET_CONFIGURATION, TRUE);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+
+	usbi3c_dev = helper_usbi3c_init(NULL);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, deps->directory), 0);
+	assert_int_equal(usbi3c_set_warm_start_cache(usbi3c_dev, NULL), 0);
+	helper_initialize_controller_cached(usbi3c_dev, DEFAULT_TARGET_CONFIGURATION, TRUE);
+	assert_int_equal(usbi3c_get_startup_stats(usbi3c_dev, &stats), 0);
+	assert_int_equal(stats.warm_start, FALSE);
+	helper_usbi3c_deinit(&usbi3c_dev, NULL);
+}
+
+int main(void)
+{
+	/* Unit tests for the warm-start cache used by usbi3c_initialize_device() */
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_negative_missing_parameters, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_warm_start, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_warm_start_table_mismatch, test_setup, test_teardown),
+		cmocka_unit_test_setup_teardown(test_usbi3c_warm_start_disabled, test_setup, test_teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}